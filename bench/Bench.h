@@ -0,0 +1,70 @@
+#pragma once
+// Minimal benchmark harness for sameness_bench. Each bench/*.cpp registers
+// its cases with SAMENESS_BENCH; `sameness_bench [filter]` runs every case
+// whose name contains the filter.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+using Fn = void (*)();
+
+struct Case {
+    const char* name;
+    Fn fn;
+};
+
+inline std::vector<Case>& registry() {
+    static std::vector<Case> cases;
+    return cases;
+}
+
+struct Registrar {
+    Registrar(const char* name, Fn fn) { registry().push_back({name, fn}); }
+};
+
+// Keeps the compiler from discarding a computed value.
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T* sink;
+    sink = &value;
+#endif
+}
+
+// Runs `fn` repeatedly for at least `minSeconds` and returns nanoseconds per call.
+template <typename F>
+double nsPerCall(F&& fn, double minSeconds = 0.3) {
+    using clock = std::chrono::steady_clock;
+    fn();   // warm up
+    size_t iters = 1;
+    for (;;) {
+        auto start = clock::now();
+        for (size_t i = 0; i < iters; ++i) {
+            fn();
+        }
+        std::chrono::duration<double> elapsed = clock::now() - start;
+        if (elapsed.count() >= minSeconds) {
+            return elapsed.count() * 1e9 / iters;
+        }
+        iters *= 2;
+    }
+}
+
+inline void report(const std::string& label, double value, const char* unit) {
+    std::printf("  %-48s %12.2f %s\n", label.c_str(), value, unit);
+}
+
+} // namespace bench
+
+#define SAMENESS_BENCH(name) \
+    static void name(); \
+    static bench::Registrar name##_registrar(#name, name); \
+    static void name()
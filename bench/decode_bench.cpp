@@ -0,0 +1,52 @@
+// Header decoding: batch decoder vs the byte-at-a-time reference.
+
+#include "Bench.h"
+#include "EventPacket.h"
+#include "PacketDecoder.h"
+#include <vector>
+
+namespace {
+    // A read's worth of mixed input packets, as the server sees them.
+    std::vector<uint8_t> makeStream(size_t packets) {
+        std::vector<uint8_t> stream;
+        for (size_t i = 0; i < packets; ++i) {
+            EventPacket pkt;
+            pkt.type = (i % 4 == 0) ? SamenessEventType::KeyPress : SamenessEventType::MouseMove;
+            pkt.timestamp = 1700000000000000ull + i * 125;
+            pkt.payloadSize = pkt.type == SamenessEventType::KeyPress ? 4 : 8;
+            pkt.payload.assign(pkt.payloadSize, static_cast<uint8_t>(i));
+            auto bytes = pkt.toBytes();
+            stream.insert(stream.end(), bytes.begin(), bytes.end());
+        }
+        return stream;
+    }
+}
+
+SAMENESS_BENCH(decode_headers) {
+    for (size_t packets : {1, 16, 64, 256}) {
+        std::vector<uint8_t> stream = makeStream(packets);
+        std::vector<PacketRecord> records(packets);
+
+        double batch = bench::nsPerCall([&]() {
+            DecodeResult r = decodePackets(stream.data(), stream.size(), records.data(), records.size());
+            bench::doNotOptimize(r);
+        });
+        double scalar = bench::nsPerCall([&]() {
+            DecodeResult r = decodePacketsScalar(stream.data(), stream.size(), records.data(), records.size());
+            bench::doNotOptimize(r);
+        });
+        double perPacket = bench::nsPerCall([&]() {
+            size_t off = 0, consumed = 0;
+            EventPacket pkt;
+            while (EventPacket::tryParse(stream.data() + off, stream.size() - off, pkt, consumed)) {
+                off += consumed;
+            }
+            bench::doNotOptimize(off);
+        });
+
+        std::string n = std::to_string(packets) + " packets";
+        bench::report("batch decode, " + n, batch / packets, "ns/packet");
+        bench::report("scalar decode, " + n, scalar / packets, "ns/packet");
+        bench::report("tryParse into EventPacket, " + n, perPacket / packets, "ns/packet");
+    }
+}
@@ -0,0 +1,61 @@
+// Per-event cost of the key rule engine in the capture path.
+
+#include "Bench.h"
+#include "KeyRules.h"
+#include <sstream>
+#include <uiohook.h>
+#include <vector>
+
+namespace {
+    struct KeyEvent {
+        uint32_t code;
+        bool pressed;
+    };
+
+    // Typing with the odd chord: modifiers, plain keys and remapped keys.
+    std::vector<KeyEvent> makeTrace() {
+        const uint32_t keys[] = { VC_A, VC_S, VC_D, VC_CAPS_LOCK, VC_H, VC_SPACE, VC_ENTER, VC_META_L };
+        std::vector<KeyEvent> trace;
+        for (size_t i = 0; i < 1024; ++i) {
+            bool chord = i % 16 == 0;
+            if (chord) {
+                trace.push_back({VC_CONTROL_L, true});
+            }
+            uint32_t k = keys[i % (sizeof(keys) / sizeof(keys[0]))];
+            trace.push_back({k, true});
+            trace.push_back({k, false});
+            if (chord) {
+                trace.push_back({VC_CONTROL_L, false});
+            }
+        }
+        return trace;
+    }
+}
+
+SAMENESS_BENCH(key_rules) {
+    std::vector<KeyEvent> trace = makeTrace();
+
+    for (int configured = 0; configured < 2; ++configured) {
+        KeyRules rules;
+        if (configured) {
+            std::istringstream in(
+                "hotkey ctrl+alt+h host\n"
+                "hotkey scroll_lock lock\n"
+                "hotkey meta+l lock\n"
+                "remap caps_lock ctrl\n"
+                "remap meta_l alt\n");
+            rules.load(in);
+        }
+        double ns = bench::nsPerCall([&]() {
+            uint32_t sum = 0;
+            for (const KeyEvent& ev : trace) {
+                uint32_t code = ev.code;
+                KeyAction action = rules.onKey(code, ev.pressed);
+                sum += code + static_cast<uint32_t>(action);
+            }
+            bench::doNotOptimize(sum);
+        });
+        bench::report(configured ? "onKey, 3 hotkeys + 2 remaps" : "onKey, no rules",
+                      ns / trace.size(), "ns/event");
+    }
+}
@@ -0,0 +1,25 @@
+// sameness_bench — runs the registered benchmark cases.
+//
+//   sameness_bench [filter]
+
+#include "Bench.h"
+#include <cstring>
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+    const char* filter = argc > 1 ? argv[1] : "";
+    int ran = 0;
+    for (const bench::Case& c : bench::registry()) {
+        if (std::strstr(c.name, filter) == nullptr) {
+            continue;
+        }
+        std::cout << c.name << std::endl;
+        c.fn();
+        ++ran;
+    }
+    if (ran == 0) {
+        std::cerr << "No benchmark matches '" << filter << "'" << std::endl;
+        return 1;
+    }
+    return 0;
+}
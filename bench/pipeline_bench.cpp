@@ -0,0 +1,62 @@
+// Per-event cost of the whole client→server path (encode, frame, queue,
+// write, read, decode, dispatch) over MemoryTransport, so no socket or TLS
+// time hides a regression.
+
+#include "Bench.h"
+#include "Session.h"
+#include "Transport.h"
+#include <atomic>
+#include <thread>
+
+namespace {
+    struct IoThread {
+        boost::asio::io_context io;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{io.get_executor()};
+        std::thread thread{[this]() { io.run(); }};
+
+        ~IoThread() {
+            io.stop();
+            thread.join();
+        }
+    };
+
+    // Sends a batch of key presses and waits for the last to be dispatched.
+    double nsPerEvent(boost::asio::io_context& clientIo, boost::asio::io_context& serverIo, uint16_t version) {
+        constexpr uint32_t kBatch = 256;
+        MemoryTransport::Pair ends = MemoryTransport::connect(clientIo, serverIo);
+        auto client = std::make_shared<Session>(std::move(ends.first), version);
+        auto server = std::make_shared<Session>(std::move(ends.second), version);
+        std::atomic<uint32_t> received{0};
+        server->start([&](const EventPacket&) { received.fetch_add(1, std::memory_order_release); },
+                      [](const boost::system::error_code&) {});
+        client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+
+        uint32_t sent = 0;
+        double ns = bench::nsPerCall([&]() {
+            for (uint32_t i = 0; i < kBatch; ++i) {
+                client->send(makeKeyPacket(SamenessEventType::KeyPress, sent, sent));
+                ++sent;
+            }
+            while (received.load(std::memory_order_acquire) != sent) {
+                std::this_thread::yield();
+            }
+        });
+        client->close();
+        server->close();
+        return ns / kBatch;
+    }
+}
+
+SAMENESS_BENCH(pipeline_memory) {
+    for (uint16_t version : {kProtocolV1, kProtocolV2}) {
+        std::string v = "v" + std::to_string(version);
+        {
+            IoThread clientIo, serverIo;
+            bench::report(v + " key press, client and server threads", nsPerEvent(clientIo.io, serverIo.io, version), "ns/event");
+        }
+        {
+            IoThread io;
+            bench::report(v + " key press, one io thread", nsPerEvent(io.io, io.io, version), "ns/event");
+        }
+    }
+}
@@ -0,0 +1,104 @@
+// An 8 kHz mouse for one second, paced in real time, through a client and
+// server Session over MemoryTransport: process CPU time and bytes written,
+// with every sample sent and with motion resampled to display rates (see
+// MotionResampler.h). CPU includes the loop generating the samples, which
+// costs the same in every run.
+
+#include "Bench.h"
+#include "MotionResampler.h"
+#include "Session.h"
+#include "Stats.h"
+#include "Transport.h"
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <thread>
+
+namespace {
+    constexpr uint64_t kSpacingUs = 125;
+    constexpr uint64_t kDurationUs = 1000000;
+
+    uint64_t steadyMicroseconds() {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // rateHz 0 sends every sample
+    void run(uint32_t rateHz) {
+        boost::asio::io_context clientIo, serverIo;
+        auto clientWork = boost::asio::make_work_guard(clientIo);
+        auto serverWork = boost::asio::make_work_guard(serverIo);
+        MemoryTransport::Pair ends = MemoryTransport::connect(clientIo, serverIo);
+        auto client = std::make_shared<Session>(std::move(ends.first), kProtocolV2);
+        auto server = std::make_shared<Session>(std::move(ends.second), kProtocolV2);
+        // The session may collapse motion itself while writes are held, so
+        // the run ends when the last position arrives, not after a count
+        std::atomic<uint64_t> received{0};
+        std::atomic<int32_t> lastX{-1};
+        server->start([&](const EventPacket& pkt) {
+                          int32_t x, y;
+                          if (readMouseMove(pkt, x, y)) {
+                              received.fetch_add(1, std::memory_order_relaxed);
+                              lastX.store(x, std::memory_order_release);
+                          }
+                      },
+                      [](const boost::system::error_code&) {});
+        client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+        std::thread clientThread([&]() { clientIo.run(); });
+        std::thread serverThread([&]() { serverIo.run(); });
+
+        std::unique_ptr<MotionResampler> resampler;
+        if (rateHz > 0) {
+            resampler = std::make_unique<MotionResampler>(rateHz);
+        }
+        stats::Snapshot before = stats::snapshot(stats::block());
+        std::clock_t cpuStart = std::clock();
+        uint64_t start = steadyMicroseconds();
+        uint64_t sent = 0;
+        int32_t sentX = -1;
+        for (uint64_t t = 0; t < kDurationUs; t += kSpacingUs) {
+            std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(start + t)));
+            uint64_t now = steadyMicroseconds();
+            EventPacket move = makeMouseMovePacket(now, static_cast<int32_t>(t / kSpacingUs), 500);
+            EventPacket out;
+            if (!resampler) {
+                out = move;
+            } else if (resampler->push(move, now, out) != MotionResampler::Outcome::Send
+                       && !resampler->popDue(now, out)) {
+                continue;
+            }
+            int32_t y;
+            readMouseMove(out, sentX, y);
+            client->send(out);
+            ++sent;
+        }
+        while (lastX.load(std::memory_order_acquire) != sentX) {
+            std::this_thread::yield();
+        }
+        double cpuMs = (std::clock() - cpuStart) * 1000.0 / CLOCKS_PER_SEC;
+        stats::Snapshot after = stats::snapshot(stats::block());
+
+        client->close();
+        server->close();
+        clientWork.reset();
+        serverWork.reset();
+        clientIo.stop();
+        serverIo.stop();
+        clientThread.join();
+        serverThread.join();
+
+        std::string label = rateHz ? "resampled to " + std::to_string(rateHz) + " Hz" : "every sample";
+        double seconds = kDurationUs / 1e6;
+        bench::report(label + ", moves sent", sent / seconds, "/s");
+        bench::report(label + ", moves delivered", received / seconds, "/s");
+        bench::report(label + ", CPU", cpuMs / seconds / 10.0, "% of a core");
+        bench::report(label + ", bytes written", (after.bytesSent - before.bytesSent) / seconds / 1024.0, "KB/s");
+        bench::report(label + ", TLS records", (after.recordsSent - before.recordsSent) / seconds, "/s");
+    }
+}
+
+SAMENESS_BENCH(resample_8khz) {
+    for (uint32_t rateHz : {0u, 240u, 144u, 60u}) {
+        run(rateHz);
+    }
+}
@@ -0,0 +1,73 @@
+// Loopback round trip of one input-sized message under each socket profile
+// (see SocketTuning.h): the client writes 27 bytes, an echo server on its own
+// io thread sends them back. On loopback this mostly shows what QUICKACK and
+// spinning cost or save in the kernel path; DSCP only matters on a real switch.
+
+#include "Bench.h"
+#include "SocketTuning.h"
+#include "Transport.h"
+#include <thread>
+
+namespace {
+    using boost::asio::ip::tcp;
+
+    struct Echo : Transport::Handler, std::enable_shared_from_this<Echo> {
+        Transport& transport;
+        uint8_t buf[256];
+
+        explicit Echo(Transport& t) : transport(t) {}
+
+        void start() { transport.asyncRead(boost::asio::buffer(buf), shared_from_this()); }
+        void onRead(const boost::system::error_code& ec, size_t len) override {
+            if (!ec) {
+                transport.asyncWrite(boost::asio::buffer(buf, len), shared_from_this());
+            }
+        }
+        void onWrite(const boost::system::error_code& ec, size_t) override {
+            if (!ec) {
+                start();
+            }
+        }
+    };
+
+    double roundTripNs(const SocketProfile& profile) {
+        boost::asio::io_context serverIo;
+        auto work = boost::asio::make_work_guard(serverIo);
+        tcp::acceptor acceptor(serverIo, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        boost::asio::io_context clientIo;
+        tcp::socket client(clientIo);
+        tcp::socket accepted(serverIo);
+        client.connect(acceptor.local_endpoint());
+        acceptor.accept(accepted);
+        applySocketProfile(client, profile);
+        applySocketProfile(accepted, profile);
+
+        TcpTransport server(std::move(accepted));
+        server.setQuickAck(profile.quickAck);
+        auto echo = std::make_shared<Echo>(server);
+        boost::asio::post(serverIo, [echo]() { echo->start(); });
+        std::thread serverThread([&]() { runIoContext(serverIo, profile); });
+
+        uint8_t message[27] = {};
+        uint8_t reply[27];
+        double ns = bench::nsPerCall([&]() {
+            boost::asio::write(client, boost::asio::buffer(message));
+            boost::asio::read(client, boost::asio::buffer(reply));
+            if (profile.quickAck) {
+                rearmQuickAck(client);
+            }
+        });
+
+        boost::asio::post(serverIo, [&server]() { server.close(); });
+        work.reset();
+        serverIo.stop();
+        serverThread.join();
+        return ns;
+    }
+}
+
+SAMENESS_BENCH(socket_profiles) {
+    for (const std::string& name : SocketProfile::names()) {
+        bench::report("loopback round trip, profile " + name, roundTripNs(SocketProfile::named(name)) / 1000.0, "us");
+    }
+}
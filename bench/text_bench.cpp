@@ -0,0 +1,100 @@
+// Typing a 10 KB string: as TextInput packets vs a KeyPress and KeyRelease
+// per character (with Shift around capitals and symbols), the way a typing
+// tool drives the client today. Client to server over MemoryTransport, bytes
+// on the wire, and on Linux the uinput records the server writes.
+
+#include "Bench.h"
+#include "Channels.h"
+#include "Session.h"
+#include "TextInput.h"
+#include "Transport.h"
+#include <uiohook.h>
+#ifdef __linux__
+#include "UinputDevice.h"
+#endif
+
+namespace {
+    constexpr size_t kTextBytes = 10 * 1024;
+
+    std::string sampleText() {
+        static const char kWords[] = "The quick brown fox jumps over the lazy dog; Pack my box with 5 dozen liquor jugs! ";
+        std::string text;
+        while (text.size() < kTextBytes) {
+            text += kWords[text.size() % (sizeof(kWords) - 1)];
+        }
+        return text;
+    }
+
+    std::vector<EventPacket> keyPackets(const std::string& text) {
+        std::vector<EventPacket> packets;
+        for (char c : text) {
+            uint16_t keycode = 0;
+            bool shift = false;
+            if (!asciiKey(c, keycode, shift)) {
+                continue;
+            }
+            if (shift) {
+                packets.push_back(makeKeyPacket(SamenessEventType::KeyPress, 1, VC_SHIFT_L));
+            }
+            packets.push_back(makeKeyPacket(SamenessEventType::KeyPress, 1, keycode));
+            packets.push_back(makeKeyPacket(SamenessEventType::KeyRelease, 1, keycode));
+            if (shift) {
+                packets.push_back(makeKeyPacket(SamenessEventType::KeyRelease, 1, VC_SHIFT_L));
+            }
+        }
+        return packets;
+    }
+
+    // Sends everything and runs both sessions until the client has written it
+    // all. Packets go out in slices, as a tool typing from its own thread
+    // would, so per-character keys stay under Session::kMaxInputBacklog.
+    void deliver(const std::vector<EventPacket>& packets) {
+        boost::asio::io_context io;
+        MemoryTransport::Pair ends = MemoryTransport::connect(io, io);
+        auto client = std::make_shared<Session>(std::move(ends.first), kProtocolV2);
+        auto server = std::make_shared<Session>(std::move(ends.second), kProtocolV2);
+        size_t received = 0;
+        server->start([&received](const EventPacket&) { ++received; }, [](const boost::system::error_code&) {});
+        client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+        for (size_t i = 0; i < packets.size(); ++i) {
+            client->send(packets[i]);
+            if (i % 256 == 255) {
+                while (io.poll() > 0) {
+                }
+            }
+        }
+        client->closeWhenSent();
+        io.run();
+        bench::doNotOptimize(received);
+    }
+
+    void run(const std::string& label, const std::vector<EventPacket>& packets) {
+        size_t wireBytes = 0;
+        for (const EventPacket& pkt : packets) {
+            wireBytes += makeFrame(Channel::Input, pkt, kProtocolV2)->size();
+        }
+        double ns = bench::nsPerCall([&]() { deliver(packets); });
+        bench::report(label + ", packets", static_cast<double>(packets.size()), "");
+        bench::report(label + ", bytes on the wire", wireBytes / 1024.0, "KB");
+        bench::report(label + ", send to receive", ns / 1e6, "ms");
+        bench::report(label + ", throughput", kTextBytes / (ns / 1e9) / (1024.0 * 1024.0), "MB/s of text");
+#ifdef __linux__
+        std::vector<input_event> records;
+        double encodeNs = bench::nsPerCall([&]() {
+            records.clear();
+            for (const EventPacket& pkt : packets) {
+                UinputDevice::encode(pkt, records);
+            }
+            bench::doNotOptimize(records.data());
+        });
+        bench::report(label + ", uinput records", static_cast<double>(records.size()), "");
+        bench::report(label + ", uinput encode", encodeNs / 1e3, "us");
+#endif
+    }
+}
+
+SAMENESS_BENCH(text_10kb) {
+    std::string text = sampleText();
+    run("key per character", keyPackets(text));
+    run("TextInput", makeTextPackets(1, text));
+}
@@ -0,0 +1,22 @@
+// Cost of a trace point at every stage an event passes: a load and a branch
+// while tracing is off, a timestamp and a ring write while it is on.
+
+#include "Bench.h"
+#include "Trace.h"
+
+SAMENESS_BENCH(trace_span) {
+    EventPacket pkt = makeKeyPacket(SamenessEventType::KeyPress, 1000, 30);
+    uint64_t begin = 0;
+    auto point = [&]() {
+        uint64_t at = trace::enabled() ? trace::nowUs() : begin;
+        trace::span(trace::Stage::Decode, trace::eventId(pkt), begin, at);
+        ++pkt.timestamp;
+    };
+
+    trace::disable();
+    bench::report("trace point, tracing off", bench::nsPerCall(point), "ns/call");
+    trace::enable();
+    bench::report("trace point, tracing on", bench::nsPerCall(point), "ns/call");
+    trace::disable();
+    trace::clear();
+}
@@ -0,0 +1,104 @@
+// Parse cost of a read's worth of input: protocol v1 (big-endian header,
+// variable payload) vs v2 (fixed little-endian structs).
+
+#include "Bench.h"
+#include "ByteOrder.h"
+#include "EventPacket.h"
+#include "PacketDecoder.h"
+#include "WireV2.h"
+#include <vector>
+
+namespace {
+    EventPacket inputPacket(size_t i) {
+        uint64_t ts = 1700000000000000ull + i * 125;
+        if (i % 4 == 0) {
+            return makeKeyPacket(SamenessEventType::KeyPress, ts, static_cast<uint32_t>(i));
+        }
+        return makeMouseMovePacket(ts, static_cast<int32_t>(i), -static_cast<int32_t>(i));
+    }
+
+    std::vector<uint8_t> makeV1(size_t packets) {
+        std::vector<uint8_t> stream;
+        for (size_t i = 0; i < packets; ++i) {
+            auto bytes = inputPacket(i).toBytes();
+            stream.insert(stream.end(), bytes.begin(), bytes.end());
+        }
+        return stream;
+    }
+
+    std::vector<uint8_t> makeV2(size_t packets) {
+        std::vector<uint8_t> stream;
+        for (size_t i = 0; i < packets; ++i) {
+            wire::encode(inputPacket(i), stream);
+        }
+        return stream;
+    }
+}
+
+SAMENESS_BENCH(wire_parse) {
+    for (size_t packets : {1, 16, 64, 256}) {
+        std::vector<uint8_t> v1 = makeV1(packets);
+        std::vector<uint8_t> v2 = makeV2(packets);
+        std::vector<PacketRecord> records(packets);
+
+        // v1 as the server reads it: batch header decode, then pull fields out of the payload.
+        double v1Batch = bench::nsPerCall([&]() {
+            DecodeResult r = decodePackets(v1.data(), v1.size(), records.data(), records.size());
+            int64_t sum = 0;
+            for (size_t i = 0; i < r.count; ++i) {
+                const uint8_t* p = v1.data() + records[i].payloadOffset;
+                if (records[i].type == SamenessEventType::KeyPress) {
+                    sum += byteorder::loadLe<uint32_t>(p);
+                } else {
+                    sum += byteorder::loadLe<int32_t>(p) + byteorder::loadLe<int32_t>(p + 4);
+                }
+            }
+            bench::doNotOptimize(sum);
+        });
+
+        // v2 struct overlay: bounds check plus a memcpy per message.
+        double v2Load = bench::nsPerCall([&]() {
+            size_t off = 0;
+            int64_t sum = 0;
+            while (off + sizeof(wire::MsgHeader) <= v2.size()) {
+                const uint8_t* p = v2.data() + off;
+                if (p[0] == static_cast<uint8_t>(SamenessEventType::KeyPress)) {
+                    wire::KeyMsg m;
+                    if (!wire::load(p, v2.size() - off, m)) break;
+                    sum += m.keycode;
+                    off += sizeof(m);
+                } else {
+                    wire::MouseMoveMsg m;
+                    if (!wire::load(p, v2.size() - off, m)) break;
+                    sum += m.x + m.y;
+                    off += sizeof(m);
+                }
+            }
+            bench::doNotOptimize(sum);
+        });
+
+        // Both versions decoded into the canonical EventPacket the session hands out.
+        double v1Packet = bench::nsPerCall([&]() {
+            size_t off = 0, consumed = 0;
+            EventPacket pkt;
+            while (EventPacket::tryParse(v1.data() + off, v1.size() - off, pkt, consumed)) {
+                off += consumed;
+            }
+            bench::doNotOptimize(off);
+        });
+        double v2Packet = bench::nsPerCall([&]() {
+            size_t off = 0, consumed = 0;
+            EventPacket pkt;
+            while (wire::decode(v2.data() + off, v2.size() - off, pkt, consumed) == wire::DecodeStatus::Ok) {
+                off += consumed;
+            }
+            bench::doNotOptimize(off);
+        });
+
+        std::string n = std::to_string(packets) + " packets";
+        bench::report("v1 batch decode + payload read, " + n, v1Batch / packets, "ns/packet");
+        bench::report("v2 struct load, " + n, v2Load / packets, "ns/packet");
+        bench::report("v1 into EventPacket, " + n, v1Packet / packets, "ns/packet");
+        bench::report("v2 into EventPacket, " + n, v2Packet / packets, "ns/packet");
+    }
+}
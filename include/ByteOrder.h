@@ -0,0 +1,112 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// Unaligned big/little-endian loads and stores for wire formats.
+// Each compiles to a plain load/store plus at most one byte swap.
+// Also the bit scan the lock-free bitsets use, for the same compilers.
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <stdlib.h>
+#define SAMENESS_BSWAP16(x) _byteswap_ushort(x)
+#define SAMENESS_BSWAP32(x) _byteswap_ulong(x)
+#define SAMENESS_BSWAP64(x) _byteswap_uint64(x)
+#else
+#define SAMENESS_BSWAP16(x) __builtin_bswap16(x)
+#define SAMENESS_BSWAP32(x) __builtin_bswap32(x)
+#define SAMENESS_BSWAP64(x) __builtin_bswap64(x)
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define SAMENESS_BIG_ENDIAN_HOST 1
+#endif
+
+namespace byteorder {
+
+inline uint16_t toLe(uint16_t v) {
+#if defined(SAMENESS_BIG_ENDIAN_HOST)
+    return SAMENESS_BSWAP16(v);
+#else
+    return v;
+#endif
+}
+
+inline uint32_t toLe(uint32_t v) {
+#if defined(SAMENESS_BIG_ENDIAN_HOST)
+    return SAMENESS_BSWAP32(v);
+#else
+    return v;
+#endif
+}
+
+inline uint64_t toLe(uint64_t v) {
+#if defined(SAMENESS_BIG_ENDIAN_HOST)
+    return SAMENESS_BSWAP64(v);
+#else
+    return v;
+#endif
+}
+
+inline int32_t toLe(int32_t v) {
+    return static_cast<int32_t>(toLe(static_cast<uint32_t>(v)));
+}
+
+// Little-endian is its own inverse
+template <typename T>
+inline T fromLe(T v) {
+    return toLe(v);
+}
+
+inline uint64_t loadBe64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+#if defined(SAMENESS_BIG_ENDIAN_HOST)
+    return v;
+#else
+    return SAMENESS_BSWAP64(v);
+#endif
+}
+
+inline uint32_t loadBe32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+#if defined(SAMENESS_BIG_ENDIAN_HOST)
+    return v;
+#else
+    return SAMENESS_BSWAP32(v);
+#endif
+}
+
+inline void storeBe64(uint8_t* p, uint64_t v) {
+#if !defined(SAMENESS_BIG_ENDIAN_HOST)
+    v = SAMENESS_BSWAP64(v);
+#endif
+    std::memcpy(p, &v, sizeof(v));
+}
+
+template <typename T>
+inline T loadLe(const uint8_t* p) {
+    T v;
+    std::memcpy(&v, p, sizeof(v));
+    return fromLe(v);
+}
+
+template <typename T>
+inline void storeLe(uint8_t* p, T v) {
+    v = toLe(v);
+    std::memcpy(p, &v, sizeof(v));
+}
+
+// Index of the lowest set bit; `v` must not be 0.
+inline unsigned lowestBit(uint64_t v) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(v));
+#endif
+}
+
+} // namespace byteorder
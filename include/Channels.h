@@ -0,0 +1,116 @@
+#pragma once
+#include "EventPacket.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Multiplexing of several packet streams over one connection.
+//
+// From protocol v2 on, every byte on the wire belongs to a frame:
+//   channel (1 byte) | length (2 bytes, big-endian) | length bytes of payload
+// Each channel carries its own stream of packets in the negotiated protocol
+// version (see Protocol.h), cut into frames of at most the channel's
+// quantum. Channels are strictly prioritized by id: input frames always
+// preempt bulk frames, and because a bulk frame is small a keystroke waits
+// behind at most one of them.
+//
+// v1 is the original stream of EventPackets, back to back, with no frames.
+// The scheduler still picks which channel writes next, but only ever writes
+// whole packets, and the decoder reports each packet on channelFor(type).
+enum class Channel : uint8_t {
+    Input       = 0,    // key, button, motion and text events
+    Control     = 1,    // small protocol messages (clipboard offers/requests, switch-back, ...)
+    Clipboard   = 2,    // clipboard content
+    Bulk        = 3,    // file transfer, diagnostics
+};
+
+constexpr size_t kChannelCount = 4;
+constexpr size_t kFrameHeaderSize = 1 + 2;
+constexpr size_t kMaxFramePayload = 0xFFFF;
+
+// Default quantum (maximum frame payload) per channel.
+constexpr size_t kInputQuantum = kMaxFramePayload;
+constexpr size_t kControlQuantum = 4 * 1024;
+constexpr size_t kBulkQuantum = 1024;
+
+// Which channel a packet type travels on.
+Channel channelFor(SamenessEventType type);
+
+// One packet already encoded and wrapped in its channel frame. Immutable, so a
+// single encoding can be queued on any number of connections (see SessionGroup).
+using SharedFrame = std::shared_ptr<const std::vector<uint8_t>>;
+
+// Encodes `pkt` for `version` as a single frame (v2) or bare packet (v1); the
+// encoding must fit in one frame.
+SharedFrame makeFrame(Channel channel, const EventPacket& pkt, uint16_t version);
+
+// Write side: per-channel queues drained by strict priority.
+class ChannelScheduler {
+public:
+    // Produces the next packet for an otherwise idle channel (e.g. clipboard chunks).
+    using Source = std::function<bool(EventPacket&)>;
+
+    // Queued bytes are allocated from `memory`.
+    explicit ChannelScheduler(uint16_t version, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+    void setQuantum(Channel channel, size_t maxFramePayload);
+    void setSource(Channel channel, Source source);
+
+    // Appends an encoded packet to the channel's stream.
+    void enqueue(Channel channel, const std::vector<uint8_t>& bytes);
+
+    // Builds the next write into `out`: everything pending on the input channel
+    // followed by at most one frame from the highest-priority other channel.
+    // Returns false if nothing is pending.
+    bool nextWrite(std::pmr::vector<uint8_t>& out);
+
+    // Bytes queued on a channel and not yet framed.
+    size_t pending(Channel channel) const;
+
+private:
+    struct Queue {
+        explicit Queue(std::pmr::memory_resource* memory) : bytes(memory) {}
+
+        std::pmr::vector<uint8_t> bytes;
+        size_t head = 0;
+        size_t quantum = kBulkQuantum;
+        Source source;
+
+        size_t size() const { return bytes.size() - head; }
+    };
+
+    // Moves one frame of up to the quantum from `q` into `out`.
+    void emitFrame(size_t index, std::pmr::vector<uint8_t>& out);
+    bool refill(Queue& q);
+
+    uint16_t version_;
+    std::array<Queue, kChannelCount> queues_;
+    EventPacket sourcePacket_;          // reused by refill()
+    std::vector<uint8_t> encoded_;      // reused by refill()
+};
+
+// Read side: reassembles frames and per-channel packet streams.
+class FrameDecoder {
+public:
+    using Handler = std::function<void(Channel, const EventPacket&)>;
+
+    // Partial frames and packets are buffered in `memory`.
+    explicit FrameDecoder(uint16_t version, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+    // Consumes raw bytes and calls `handler` for every complete packet.
+    // Returns false on a malformed frame; the connection should then be dropped.
+    // Whole frames and packets are decoded in place; only partial ones are copied.
+    bool feed(const uint8_t* data, size_t len, const Handler& handler);
+
+private:
+    bool feedChannel(size_t channel, const uint8_t* data, size_t len, const Handler& handler);
+
+    uint16_t version_;
+    std::pmr::vector<uint8_t> pending_;     // partial frame
+    std::array<std::pmr::vector<uint8_t>, kChannelCount> streams_;  // partial packet per channel
+    EventPacket scratch_;               // every packet is decoded into this one
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include "EventPacket.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Lazy clipboard sharing between two peers.
+//
+// A local clipboard change is announced with a ClipboardOffer carrying only the
+// SHA-256 digest and size of the content. The peer fetches the bytes with a
+// ClipboardRequest when something is actually pasted, and the content is then
+// streamed back as bounded ClipboardChunk packets so it can be interleaved with
+// input events instead of blocking them.
+//
+// Whichever side changed its clipboard last holds the current one. Offers are
+// only held back when nothing changed: the clipboard still holds what we
+// offered, or holds what we just fetched from the peer (which the peer has).
+// Content that comes back, e.g. A, then B, then A again, is offered again.
+// PasteboardBridge (Pasteboard.h) connects this to the system clipboard.
+class ClipboardSync {
+public:
+    using Digest = std::array<uint8_t, 32>;
+
+    // Upper bound on the content bytes carried by a single ClipboardChunk.
+    static constexpr size_t kChunkSize = 16 * 1024;
+    // Number of digests of content fetched from the peer that are remembered,
+    // so it is not offered back when it turns up on our clipboard.
+    static constexpr size_t kRecentDigests = 8;
+    // Largest clipboard shared either way; larger offers are not made, and
+    // are ignored when the peer makes them.
+    static constexpr uint64_t kMaxContentSize = 64 * 1024 * 1024;
+
+    // Called when the peer announces new clipboard content.
+    using OfferHandler = std::function<void(const Digest&, uint64_t size)>;
+    // Called once requested remote content has fully arrived and matched its digest.
+    using ContentHandler = std::function<void(const std::vector<uint8_t>&)>;
+
+    void setOfferHandler(OfferHandler handler);
+    void setContentHandler(ContentHandler handler);
+
+    // Local clipboard content. Fills `offer` and returns true, or returns false
+    // if it is what we last offered, the peer's current content that we just
+    // received, or larger than kMaxContentSize. Unless it is too large,
+    // requests are served from it from now on.
+    bool offerLocal(std::vector<uint8_t> content, EventPacket& offer);
+
+    // Local paste of the last remote offer. Returns false if nothing is on offer.
+    bool requestRemote(EventPacket& request);
+
+    // Routes an incoming clipboard packet. Returns false for non-clipboard packets.
+    bool handlePacket(const EventPacket& pkt);
+
+    // Forgets the peer, e.g. when the clipboard moves to another one: no
+    // transfer is in progress, and the local content is offered at the next
+    // offerLocal() even if unchanged.
+    void reset();
+
+    // Produces the next chunk of an outgoing transfer, if one is in progress.
+    bool nextChunk(EventPacket& chunk);
+    bool hasPendingChunks() const;
+
+    static Digest digestOf(const uint8_t* data, size_t len);
+
+private:
+    // Tiny most-recently-used list of digests; linear scan is cheaper than hashing at this size.
+    class RecentDigests {
+    public:
+        // Returns true if `d` was already present. Either way `d` becomes most recent.
+        bool touch(const Digest& d);
+        bool contains(const Digest& d) const;
+
+    private:
+        std::array<Digest, kRecentDigests> entries_{};
+        size_t count_ = 0;
+    };
+
+    void handleOffer(const EventPacket& pkt);
+    void handleRequest(const EventPacket& pkt);
+    void handleChunk(const EventPacket& pkt);
+
+    mutable std::mutex mutex_;
+    RecentDigests recent_;
+    OfferHandler onOffer_;
+    ContentHandler onContent_;
+
+    // Outgoing side
+    Digest localDigest_{};
+    std::shared_ptr<const std::vector<uint8_t>> localContent_;
+    bool localCurrent_ = false;     // our offer is newer than any of the peer's
+    bool sending_ = false;
+    size_t sendOffset_ = 0;
+
+    // Incoming side
+    Digest remoteDigest_{};
+    uint64_t remoteSize_ = 0;
+    bool remoteOffered_ = false;
+    bool receiving_ = false;
+    std::vector<uint8_t> incoming_;
+};
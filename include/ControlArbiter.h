@@ -0,0 +1,115 @@
+#pragma once
+#include "EventPacket.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Decides which of several controllers connected to one server drives its
+// input, so two hosts pointed at the same machine do not interleave their
+// key and pointer streams.
+//
+//   LastActive: the controller that sent input last keeps control; another
+//               one takes over once it has been idle for `idle`.
+//   Lock:       the first controller to send input keeps control until it
+//               leaves.
+//
+// Input from a controller without control is refused. Each controller's
+// held keys and buttons are tracked, and when it loses control (or leaves)
+// the release handler is given a release for each, so nothing it pressed
+// stays down under the new controller.
+//
+// Control is one 64-bit word, the owner and a stamp of its last input,
+// taken and refreshed with compare_exchange; held keys are atomic bitsets,
+// one per controller, drained with exchange. admit() takes no locks, and
+// only allocates for the releases of a takeover. It is safe to call from
+// several threads, but releases come out on whichever thread takes control,
+// so injection stays in order only when one thread admits and injects (the
+// server's io thread does).
+class ControlArbiter {
+public:
+    enum class Policy : uint8_t {
+        LastActive,
+        Lock,
+    };
+
+    struct Config {
+        Policy policy = Policy::LastActive;
+        std::chrono::milliseconds idle{500};    // LastActive only
+    };
+
+    static constexpr size_t kMaxControllers = 8;
+    static constexpr size_t kNone = kMaxControllers;
+    // Keycodes above this are passed on but not tracked (uiohook's fit)
+    static constexpr uint32_t kMaxKeycode = 0xFFFF;
+
+    // Gets one KeyRelease or MouseButtonRelease at a time.
+    using ReleaseHandler = std::function<void(const EventPacket& release)>;
+
+    ControlArbiter();
+    explicit ControlArbiter(const Config& config);
+    ~ControlArbiter();
+
+    ControlArbiter(const ControlArbiter&) = delete;
+    ControlArbiter& operator=(const ControlArbiter&) = delete;
+
+    // Call before any controller joins.
+    void setReleaseHandler(ReleaseHandler handler) { onRelease_ = std::move(handler); }
+
+    // Takes a controller slot; kNone when all are taken.
+    size_t join();
+    // Gives control up if `id` has it, releasing what it holds, and frees
+    // the slot.
+    void leave(size_t id, uint64_t nowUs);
+
+    // True if `pkt` from controller `id` should be injected. Packets that
+    // are not input always are. Taking control over from another controller
+    // hands its releases to the release handler before this returns.
+    bool admit(size_t id, const EventPacket& pkt, uint64_t nowUs);
+
+    // The controller in control, or kNone.
+    size_t owner() const;
+    uint64_t takeovers() const { return takeovers_.load(std::memory_order_relaxed); }
+
+    // "last-active" or "lock"; throws std::invalid_argument for others.
+    static Policy parsePolicy(const std::string& name);
+    static const char* policyName(Policy policy);
+
+private:
+    static constexpr size_t kKeyWords = (kMaxKeycode + 1) / 64;
+    static constexpr uint64_t kStampMask = (1ull << 48) - 1;
+    // The owner refreshes its stamp at most this often; the idle timeout is
+    // only as exact as this
+    static constexpr uint64_t kRefreshUs = 1000;
+
+    struct Controller {
+        std::atomic<bool> joined{false};
+        std::atomic<uint32_t> buttons{0};
+        std::atomic<uint64_t> keys[kKeyWords];
+    };
+
+    static uint64_t pack(size_t id, uint64_t nowUs) {
+        return (static_cast<uint64_t>(id + 1) << 48) | (nowUs & kStampMask);
+    }
+    static size_t ownerOf(uint64_t word) {
+        return word >> 48 == 0 ? kNone : static_cast<size_t>(word >> 48) - 1;
+    }
+
+    // Makes `id` the owner, or refreshes its stamp; false if it may not.
+    bool claim(size_t id, uint64_t nowUs);
+    // Notes a press for `id` and checks it still has control; false if the
+    // press must not be injected.
+    template <typename Word>
+    bool hold(size_t id, std::atomic<Word>& word, Word bit);
+    void releaseAll(size_t id, uint64_t nowUs);
+
+    Config config_;
+    ReleaseHandler onRelease_;
+    std::unique_ptr<Controller[]> controllers_;
+    alignas(64) std::atomic<uint64_t> control_{0};
+    std::atomic<uint64_t> position_{0};     // last admitted pointer x, y; for button releases
+    std::atomic<uint64_t> takeovers_{0};
+};
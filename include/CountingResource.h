@@ -0,0 +1,27 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+// A memory_resource that forwards to another one and keeps count, so a
+// session can report what it costs. Allocation happens on the owner's
+// thread; the counters are relaxed atomics so anyone may read them.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+    uint64_t allocations() const { return allocations_.load(std::memory_order_relaxed); }
+    size_t bytesInUse() const { return bytesInUse_.load(std::memory_order_relaxed); }
+    size_t peakBytes() const { return peakBytes_.load(std::memory_order_relaxed); }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    std::pmr::memory_resource* upstream_;
+    std::atomic<uint64_t> allocations_{0};
+    std::atomic<size_t> bytesInUse_{0};
+    std::atomic<size_t> peakBytes_{0};
+};
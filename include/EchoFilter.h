@@ -0,0 +1,74 @@
+#pragma once
+#include "EventPacket.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Recognizes input this machine injected when capture sees it again.
+//
+// The OS hands injected events to every hook just like real ones. In peer
+// mode each machine both captures and injects, so without a filter an event
+// injected here would be captured, forwarded and injected on the other
+// machine, captured there, and so on for ever.
+//
+// The injecting side notes a signature of every event it injects (type plus
+// key or button; pointer motion matches any injected move, since injectors
+// rescale positions) with the time, in a ring. The capturing side looks each
+// event up among the signatures noted in the last window and drops it on a
+// match, taking that signature so it only swallows one event.
+//
+// The ring is a fixed array of 64-bit words, each a signature and a
+// millisecond stamp, claimed with fetch_add and taken with compare_exchange:
+// no locks on either side. It works in-process or in shared memory
+// (attachShared: POSIX shm, or a named file mapping on Windows), so a server
+// that injects and a client that captures on the same machine share one.
+// Times are steady-clock microseconds, which is CLOCK_MONOTONIC (or the
+// performance counter on Windows) and so agrees across processes.
+class EchoFilter {
+public:
+    static constexpr size_t kSlots = 4096;
+    static constexpr uint32_t kDefaultWindowMs = 500;
+
+    struct Ring {
+        uint32_t magic;
+        uint32_t version;
+        alignas(64) std::atomic<uint64_t> next;
+        alignas(64) std::atomic<uint64_t> slots[kSlots];
+    };
+
+    explicit EchoFilter(uint32_t windowMs = kDefaultWindowMs);
+    ~EchoFilter();
+
+    EchoFilter(const EchoFilter&) = delete;
+    EchoFilter& operator=(const EchoFilter&) = delete;
+
+    // Switches to the ring in shared memory `name`, creating it if this is
+    // the first process there (on Windows, a mapping named `name` without
+    // its leading '/' in the session's Local namespace). Signatures noted so
+    // far are left behind.
+    // False (and the in-process ring stays) if it cannot be mapped.
+    bool attachShared(const std::string& name = "/sameness-echo");
+
+    // Injecting side: call before handing `pkt` to the system. TextInput is
+    // noted as the key strokes that type it only where the injector types
+    // it with keys (uiohook, uinput); macOS and Windows post characters.
+    void note(const EventPacket& pkt, uint64_t nowUs);
+
+    // Capturing side: true if `captured` matches an injection noted within
+    // the window, which is then used up.
+    bool takeEcho(const EventPacket& captured, uint64_t nowUs);
+
+private:
+    void noteSignature(uint64_t signature, uint64_t nowUs);
+
+    uint32_t windowMs_;
+    std::unique_ptr<Ring> local_;
+    Ring* ring_;
+    bool shared_ = false;
+};
+
+// The process's filter. Every injection through Injectors.h and the uinput
+// backend is noted in it.
+EchoFilter& echoFilter();
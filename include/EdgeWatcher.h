@@ -0,0 +1,47 @@
+#pragma once
+#include "EventPacket.h"
+#include <cstdint>
+
+// Server side of handing control back to the client's machine.
+//
+// The client puts this screen to the right of its own, so the pointer goes
+// back through the left edge. The client can only guess when that happens
+// from its own cursor, which has nothing to do with where the pointer is on
+// this screen; the server knows, because it injects every position. The
+// watcher follows those positions, clamped to the screen as the system
+// clamps the cursor, and fires when the pointer reaches the `zone` leftmost
+// columns. The server then sends a SwitchBack on the same connection, and the
+// client takes control back with its cursor at the mirrored point of its
+// right edge (see ScreenEdgeSwitcher::returnFromPeer).
+//
+// The pointer arrives through that same edge, so the watcher only arms once
+// the pointer has been more than kRearmPixels clear of the zone: arriving
+// does not send it straight back, and neither does jitter at the edge.
+class EdgeWatcher {
+public:
+    static constexpr int kRearmPixels = 16;
+
+    // Throws std::invalid_argument unless the screen is wider than the zone
+    // plus kRearmPixels.
+    EdgeWatcher(int width, int height, int zone = 2);
+
+    // Call with every position injected. True when it has just reached the edge.
+    bool onMove(int32_t x, int32_t y);
+
+    // The SwitchBack for the last position. `timestamp` should be the
+    // client's capture time of the move that reached the edge, so the client
+    // can tell how long the switch took.
+    EventPacket switchBack(uint64_t timestamp) const;
+
+    int x() const { return x_; }
+    int y() const { return y_; }
+    bool armed() const { return armed_; }
+
+private:
+    int width_;
+    int height_;
+    int zone_;
+    int x_ = 0;
+    int y_ = 0;
+    bool armed_ = false;
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <uiohook.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Linux keyboard and mouse capture straight from the kernel's evdev devices
+// (/dev/input/event*), without libuiohook's X11 hook and its trip through
+// Xlib for every event.
+//
+// All devices sit in one epoll set. Each wakeup read()s whole arrays of
+// input_event from every ready device and hands everything that arrived to
+// the handler as one batch, stamped with the kernel's CLOCK_MONOTONIC time
+// (the steady clock's timebase) instead of the time it was dispatched.
+//
+// Events come out as uiohook_events so the rest of the capture path is
+// shared: keycodes are translated to VC_* codes, and relative mouse motion is
+// accumulated per SYN_REPORT into a position inside the given bounds. That
+// position skips the desktop's pointer acceleration, so it only roughly
+// follows the visible cursor while the devices are not grabbed. Devices with
+// absolute axes only (touchpads, tablets) are not picked up by openAll().
+//
+// setGrab(true) takes every device exclusively (EVIOCGRAB): input reaches
+// this process and nothing else, which suppresses it locally at the source
+// while a peer has control.
+//
+// Not thread-safe, except warp() and stop().
+class EvdevCapture {
+public:
+    struct Captured {
+        uiohook_event event;
+        uint64_t timestampUs;   // kernel timestamp, CLOCK_MONOTONIC
+    };
+    using BatchHandler = std::function<void(const Captured* events, size_t count)>;
+
+    // Pointer positions stay within [0, width) x [0, height).
+    EvdevCapture(int width, int height);
+    ~EvdevCapture();
+
+    EvdevCapture(const EvdevCapture&) = delete;
+    EvdevCapture& operator=(const EvdevCapture&) = delete;
+
+    // Opens every device under `dir` that has keys or relative axes and
+    // returns how many. Devices this user may not read are skipped, and so is
+    // the uinput device the server injects through.
+    size_t openAll(const std::string& dir = "/dev/input");
+
+    // Opens one device. Throws std::runtime_error.
+    void open(const std::string& path);
+
+    // Takes ownership of a descriptor that yields input_event records, such
+    // as a pipe standing in for a device. Grabbing does not apply to it.
+    void adopt(int fd, const std::string& name);
+
+    size_t deviceCount() const { return devices_.size(); }
+
+    // Returns false if a device could not be grabbed or released.
+    bool setGrab(bool grab);
+    bool grabbed() const { return grabbed_; }
+
+    void setPosition(int x, int y);
+    // setPosition() from another thread, applied before the next batch is read.
+    void warp(int x, int y);
+    int x() const { return x_; }
+    int y() const { return y_; }
+
+    // Waits up to timeoutMs (-1: forever) and delivers whatever arrived as
+    // one batch. Returns false once stop() has been called.
+    bool poll(int timeoutMs, const BatchHandler& handler);
+
+    // Polls until stop().
+    void run(const BatchHandler& handler);
+
+    // Thread-safe.
+    void stop();
+
+private:
+    struct Device;
+
+    void add(int fd, const std::string& name, bool grabbable);
+    void remove(Device* device);
+    // False if the device is gone
+    bool readDevice(Device& device);
+
+    int width_;
+    int height_;
+    int x_ = 0;
+    int y_ = 0;
+    int epoll_ = -1;
+    int wake_ = -1;
+    bool grabbed_ = false;
+    std::atomic<uint64_t> warp_{0};     // pending flag | x << 32 | y, 0 if none
+    std::vector<std::unique_ptr<Device>> devices_;
+    std::vector<Captured> batch_;
+};
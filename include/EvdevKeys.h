@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdint>
+
+// Translation between Linux input event codes (KEY_*, BTN_*) and the codes
+// that travel in packets: uiohook's VC_* keys and MOUSE_BUTTON* buttons.
+// Shared by evdev capture and uinput injection, so a key captured from a
+// device comes back out of a virtual one unchanged. Linux only.
+
+// VC_UNDEFINED for a key with no VC_* code.
+uint16_t evdevToVirtualKey(uint16_t code);
+
+// 0 (KEY_RESERVED) for a VC_* code with no Linux key.
+uint16_t virtualKeyToEvdev(uint16_t keycode);
+
+// MOUSE_NOBUTTON for anything but the five buttons uiohook knows.
+uint16_t evdevToButton(uint16_t code);
+
+// 0 for an unknown button.
+uint16_t buttonToEvdev(uint16_t button);
@@ -1,4 +1,5 @@
 #pragma once 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -8,22 +9,58 @@ enum class SamenessEventType : uint8_t {
     MouseMove           =3,
     MouseButtonPress    =4,
     MouseButtonRelease  =5,
+    // Clipboard sync (see ClipboardSync.h)
+    ClipboardOffer      =6,
+    ClipboardRequest    =7,
+    ClipboardChunk      =8,
+    // Liveness probe sent on idle connections; no payload (see Session::setHeartbeat)
+    Heartbeat           =9,
+    // UTF-8 text typed as a unit (see TextInput.h)
+    TextInput           =10,
+    // Server to client: its pointer reached the edge facing the client (see EdgeWatcher.h)
+    SwitchBack          =11,
 }; 
 
 struct EventPacket {
+    // type + timestamp + payloadSize
+    static constexpr size_t kHeaderSize = 1 + 8 + 4;
+
     SamenessEventType type;
     uint64_t timestamp;
     uint32_t payloadSize;
     std::vector<uint8_t> payload;
 
     std::vector<uint8_t> toBytes() const;
+    // Same encoding as toBytes(), appended to `buffer`.
+    void appendTo(std::vector<uint8_t>& buffer) const;
     static EventPacket fromBytes(const std::vector<uint8_t>& buffer);
+
+    // Parses one packet from the front of a byte stream.
+    // Returns false (and leaves `out` untouched) if fewer than a whole packet is available.
+    static bool tryParse(const uint8_t* data, size_t len, EventPacket& out, size_t& consumed);
 };
 
+// Canonical payload layouts, shared by the client, the injectors and both
+// wire versions. Integers are little-endian.
+//   KeyPress/KeyRelease:                  uint32 keycode
+//   MouseMove:                            int32 x, int32 y
+//   MouseButtonPress/MouseButtonRelease:  uint8 button, int32 x, int32 y
+//   TextInput:                            UTF-8 bytes, 1 to kMaxTextBytes (see TextInput.h)
+//   SwitchBack:                           int32 x, int32 y, int32 width, int32 height
+EventPacket makeKeyPacket(SamenessEventType type, uint64_t timestamp, uint32_t keycode);
+EventPacket makeMouseMovePacket(uint64_t timestamp, int32_t x, int32_t y);
+EventPacket makeMouseButtonPacket(SamenessEventType type, uint64_t timestamp, uint8_t button, int32_t x, int32_t y);
+EventPacket makeSwitchBackPacket(uint64_t timestamp, int32_t x, int32_t y, int32_t width, int32_t height);
+
+// Read the layouts above; false if the payload is too short.
+bool readKey(const EventPacket& pkt, uint32_t& keycode);
+bool readMouseMove(const EventPacket& pkt, int32_t& x, int32_t& y);
+bool readMouseButton(const EventPacket& pkt, uint8_t& button, int32_t& x, int32_t& y);
+bool readSwitchBack(const EventPacket& pkt, int32_t& x, int32_t& y, int32_t& width, int32_t& height);
+
 void injectKeyPress(const EventPacket&);
 void injectKeyRelease(const EventPacket&);
 void injectMouseMove(const EventPacket&);
 void injectMouseButtonPress(const EventPacket&);
 void injectMouseButtonRelease(const EventPacket&);
 
-
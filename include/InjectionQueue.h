@@ -0,0 +1,101 @@
+#pragma once
+#include "EventPacket.h"
+#include "SpscRing.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Hands input from the network thread to a dedicated injection thread, so a
+// slow platform injector (CGEventPost, SendInput) never holds up reading the
+// socket, and a slow read never holds up injection.
+//
+// Packets travel as fixed-size records through an SpscRing. The injection
+// thread takes everything queued, up to kMaxBatch records, and passes it to
+// the batch handler in one call; with nothing queued it sleeps, and the
+// network thread only pays for a wake-up while it does.
+//
+// When the ring is full the network thread keeps further records in a
+// backlog of its own, in order, and moves them over as the injection thread
+// makes room. In the backlog consecutive MouseMoves collapse into the newest
+// one; keys, buttons and text are never dropped or reordered.
+//
+// TextInput does not fit a fixed-size record, so its record points to a
+// heap copy of the string, owned by the queue until the text is injected.
+//
+// Queue depth, time spent queued and collapsed moves go to the stats block
+// (see Stats.h).
+class InjectionQueue {
+public:
+    struct Record {
+        SamenessEventType type;
+        uint8_t button;
+        uint32_t keycode;
+        int32_t x;
+        int32_t y;
+        uint64_t timestamp;     // the packet's capture time
+        uint64_t queuedUs;      // steady clock
+        std::string* text;      // TextInput only
+    };
+    using BatchHandler = std::function<void(const EventPacket* packets, size_t count)>;
+
+    static constexpr size_t kMaxBatch = 64;
+
+    // `capacity` records fit in the ring (rounded up to a power of two).
+    explicit InjectionQueue(size_t capacity = 1024);
+    // Stops the thread if it is still running.
+    ~InjectionQueue();
+
+    InjectionQueue(const InjectionQueue&) = delete;
+    InjectionQueue& operator=(const InjectionQueue&) = delete;
+
+    // Starts the injection thread; `onStart`, if set, runs on it first and
+    // `handler` for every batch.
+    void start(BatchHandler handler, std::function<void()> onStart = nullptr);
+
+    // Injects everything still queued, then joins the thread. Call from the
+    // network thread.
+    void stop();
+
+    // Network thread only. Queues an input packet; returns false for packets
+    // that are not key, button, motion or text input.
+    bool push(const EventPacket& pkt);
+
+    // Network thread only. Moves what it can of the backlog into the ring.
+    void retry();
+
+    // Called on the injection thread once it has made room while a backlog
+    // is waiting. It should get retry() run on the network thread soon, e.g.
+    // by posting it to that thread's io_context. Call before start().
+    void setSpaceHandler(std::function<void()> onSpace) { onSpace_ = std::move(onSpace); }
+
+    // Records in the ring plus the backlog. Network thread only.
+    size_t depth() const { return ring_.size() + backlog_.size(); }
+
+    // A text record owns its string until toPacket() has consumed it.
+    static bool toRecord(const EventPacket& pkt, Record& out);
+    static EventPacket toPacket(Record& record);
+
+private:
+    void run();
+    // Wakes the injection thread if it is asleep.
+    void wake();
+
+    SpscRing<Record> ring_;
+    std::deque<Record> backlog_;            // network thread only
+    std::atomic<bool> backlogWaiting_{false};
+    std::function<void()> onSpace_;
+
+    BatchHandler handler_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wakeUp_;
+    std::atomic<bool> parked_{false};
+    std::atomic<bool> stopping_{false};
+};
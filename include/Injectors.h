@@ -1,8 +1,24 @@
 #pragma once
 #include "EventPacket.h"
+#include <cstddef>
+#include <cstdint>
 
 void injectKeyPress(const EventPacket&);
 void injectKeyRelease(const EventPacket&);
 void injectMouseMove(const EventPacket&);
 void injectMouseButtonPress(const EventPacket&);
-void injectMouseButtonRelease(const EventPacket&); 
\ No newline at end of file
+void injectMouseButtonRelease(const EventPacket&); 
+
+// Types a TextInput packet (see TextInput.h): Unicode keyboard events on
+// macOS and Windows, US-layout key strokes for ASCII elsewhere.
+void injectText(const EventPacket&);
+
+// Injects `count` packets in order; Windows hands them to the system in one
+// SendInput call. Packets that are not input are skipped.
+void injectBatch(const EventPacket* packets, size_t count);
+
+// Refresh rate of the main display in Hz, 0 if the platform does not say.
+uint16_t displayRefreshHz();
+
+// Size of the main display in pixels; false if the platform does not say.
+bool displaySize(int& width, int& height);
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <vector>
+
+// A minimal io_uring: one submission and one completion queue mapped from the
+// kernel, driven with the raw syscalls (no liburing). Needs Linux 5.11; 6.0
+// for multishot receive.
+//
+// Work is prepared with getSqe() and handed to the kernel by the next
+// submitAndWait(), which is also where this thread sleeps: one io_uring_enter
+// both submits everything prepared since the last one and waits for
+// completions. Not thread-safe; the ring belongs to the thread that created it.
+class IoUring {
+public:
+    // Throws std::runtime_error if io_uring is unavailable.
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Whether this kernel lets us create a ring at all.
+    static bool available();
+
+    // The next submission entry, cleared. Throws std::runtime_error if the
+    // queue is full: size the ring for everything one iteration prepares.
+    io_uring_sqe* getSqe();
+
+    // Submits what was prepared and waits for at least `waitFor` completions
+    // or `timeoutUs` (-1: no limit), in one io_uring_enter. Returns false if
+    // the wait was cut short by a signal or the timeout.
+    bool submitAndWait(unsigned waitFor, int64_t timeoutUs = -1);
+
+    // Calls fn(const io_uring_cqe&) for every completion ready, then
+    // releases them to the kernel. Returns how many there were.
+    template <typename Fn>
+    size_t drain(Fn&& fn);
+
+    // io_uring_enter calls so far.
+    uint64_t enterCalls() const { return enterCalls_; }
+
+    // Equal buffers the kernel picks from for receives that set
+    // IOSQE_BUFFER_SELECT with this group, so no buffer is tied up by a
+    // receive until data actually arrives. A completion names the buffer it
+    // filled; hand it back with recycle() once its bytes have been used.
+    // Buffers are given to the kernel by entries that ride along with the
+    // next submitAndWait() and post no completion of their own.
+    class BufferGroup {
+    public:
+        BufferGroup(IoUring& ring, uint16_t group, unsigned count, size_t size);
+
+        BufferGroup(const BufferGroup&) = delete;
+        BufferGroup& operator=(const BufferGroup&) = delete;
+
+        uint16_t group() const { return group_; }
+        const uint8_t* data(uint16_t id) const { return storage_.data() + id * size_; }
+        void recycle(uint16_t id);
+
+    private:
+        void provide(uint16_t first, unsigned count);
+
+        IoUring& ring_;
+        uint16_t group_;
+        size_t size_;
+        std::vector<uint8_t> storage_;
+    };
+
+private:
+    int fd_ = -1;
+    void* sqRing_ = nullptr;
+    void* cqRing_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqRingSize_ = 0;
+    size_t cqRingSize_ = 0;
+    size_t sqesSize_ = 0;
+
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned* sqArray_ = nullptr;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    unsigned sqLocalTail_ = 0;     // entries handed out by getSqe()
+    unsigned toSubmit_ = 0;
+    uint64_t enterCalls_ = 0;
+};
+
+template <typename Fn>
+size_t IoUring::drain(Fn&& fn) {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    for (; head != tail; ++head, ++n) {
+        fn(static_cast<const io_uring_cqe&>(cqes_[head & cqMask_]));
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return n;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "EventPacket.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+// Adaptive playout buffer for pointer motion.
+//
+// MouseMove packets are scheduled by their capture timestamp instead of their
+// arrival time: a move captured at t plays at t + base + delay, where base is
+// the smallest recent transit time (arrival minus capture, which also absorbs
+// the offset between the two machines' clocks) and delay follows the observed
+// jitter. Bursty delivery then comes out with the spacing it was captured at,
+// at the cost of a few milliseconds of added latency on jittery links and
+// almost none on clean ones.
+//
+// All times are microseconds on the local steady clock. Not thread-safe; the
+// server drives it from its io thread.
+class JitterBuffer {
+public:
+    struct Config {
+        uint64_t minDelayUs = 0;
+        uint64_t maxDelayUs = 40000;    // motion is never held longer than this
+        double jitterMultiple = 2.0;    // target delay = multiple * jitter estimate
+        uint64_t windowUs = 2000000;    // base transit is the minimum over 1-2 windows
+        size_t maxPending = 256;        // oldest moves are dropped beyond this
+    };
+
+    JitterBuffer();
+    explicit JitterBuffer(const Config& config);
+
+    // Queues a MouseMove that arrived at `nowUs`. Returns false if an older
+    // pending move had to be dropped to make room.
+    bool push(const EventPacket& move, uint64_t nowUs);
+
+    // Playout time of the oldest pending move; false when empty.
+    bool nextDue(uint64_t& dueUs) const;
+
+    // Pops the oldest move if it is due at `nowUs`; `heldUs` is how long it was buffered.
+    bool popDue(uint64_t nowUs, EventPacket& out, uint64_t& heldUs);
+
+    // Drops every pending move but the newest and returns that one, so a key or
+    // button event can be injected at once without reordering it before motion.
+    // Returns false when nothing was pending; `dropped` counts the discarded moves.
+    bool flush(uint64_t nowUs, EventPacket& latest, uint64_t& heldUs, size_t& dropped);
+
+    size_t pending() const { return queue_.size(); }
+    uint64_t jitterUs() const { return static_cast<uint64_t>(jitterUs_); }
+    uint64_t targetDelayUs() const { return targetDelayUs_; }
+
+private:
+    struct Pending {
+        EventPacket pkt;
+        uint64_t arrivalUs;
+        uint64_t dueUs;
+    };
+
+    void observe(int64_t transitUs, uint64_t nowUs);
+
+    Config config_;
+    std::deque<Pending> queue_;
+
+    // Windowed minimum transit: the current window and the one before it.
+    bool haveTransit_ = false;
+    int64_t windowMin_ = 0;
+    int64_t prevWindowMin_ = 0;
+    uint64_t windowStartUs_ = 0;
+
+    double jitterUs_ = 0;           // smoothed transit above the base
+    uint64_t targetDelayUs_ = 0;
+    uint64_t lastDueUs_ = 0;
+};
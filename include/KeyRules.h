@@ -0,0 +1,97 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Hotkeys and key remaps, compiled for the capture path.
+//
+// Rules are loaded from a small text config (see load()) and compiled into a
+// two-level keycode table: the high byte of a uiohook keycode selects a
+// 256-entry page and the low byte an entry, so a lookup is two loads. Pages
+// are only allocated for key ranges that have rules; all others share one
+// empty page. Modifier state is an 8-bit mask with uiohook's MASK_* layout,
+// and hotkeys match on that mask with left and right folded together.
+// onKey() is constant time and never allocates.
+enum class KeyAction : uint8_t {
+    Forward = 0,    // send `keycode` (possibly remapped) on as usual
+    Swallow,        // drop the event (release of a key that fired a hotkey)
+    SwitchToHost,   // hand control back to this machine
+    ToggleLock,     // keep the cursor on the current screen
+};
+
+class KeyRules {
+public:
+    // Modifier bits in uiohook's MASK_* layout, left side; right side is << 4.
+    static constexpr uint8_t kShift = 1 << 0;
+    static constexpr uint8_t kCtrl  = 1 << 1;
+    static constexpr uint8_t kMeta  = 1 << 2;
+    static constexpr uint8_t kAlt   = 1 << 3;
+
+    KeyRules();
+
+    // Parses rules, one per line; `#` starts a comment.
+    //   hotkey <chord> <action>    chord: modifiers and one key joined by '+',
+    //                              e.g. ctrl+alt+h; action: host | lock
+    //   remap <from> <to>          applies to keys forwarded to the peer
+    // Keys are uiohook names without the VC_ prefix (a, f12, caps_lock,
+    // control_r, ...) or numeric keycodes. Replaces any previous rules.
+    // Throws std::runtime_error naming the offending line.
+    void load(std::istream& in);
+    void loadFile(const std::string& path);
+
+    void addHotkey(uint8_t modifiers, uint32_t keycode, KeyAction action);
+    void addRemap(uint32_t from, uint32_t to);
+    void clear();
+
+    // Runs one key event through the rules. Modifier state is tracked for
+    // every event, forwarded or not. On Forward, `keycode` holds the key to send.
+    KeyAction onKey(uint32_t& keycode, bool pressed);
+
+    // Held modifier keys (8-bit MASK_* layout), e.g. to release them on the
+    // peer when control leaves it.
+    uint8_t heldModifiers() const { return held_; }
+    static uint32_t modifierKeycode(int bit);
+
+    // The keycode forwarded for `keycode` after remaps.
+    uint32_t remapOf(uint32_t keycode) const {
+        if (keycode == 0 || keycode > 0xFFFF) {
+            return keycode;
+        }
+        uint16_t to = lookup(keycode).remap;
+        return to != 0 ? to : keycode;
+    }
+
+    size_t hotkeyCount() const { return hotkeyCount_; }
+    size_t remapCount() const { return remapCount_; }
+
+private:
+    struct Entry {
+        uint16_t remap;     // keycode to forward instead, 0 for none
+        uint8_t modifier;   // MASK_* bit if this key is a modifier
+        uint8_t hotkeys;    // 1-based index into hotkeys_, 0 if none
+    };
+    struct Page {
+        std::array<Entry, 256> entries;
+    };
+    // Actions for one key, indexed by folded modifier mask.
+    struct Hotkeys {
+        std::array<KeyAction, 16> byModifiers{};
+    };
+
+    Entry& entryFor(uint32_t keycode);     // allocates the page if needed
+    const Entry& lookup(uint32_t keycode) const {
+        return pages_[pageOf_[(keycode >> 8) & 0xFF]].entries[keycode & 0xFF];
+    }
+
+    std::array<uint8_t, 256> pageOf_{};    // page index per keycode high byte; 0 is the empty page
+    std::vector<Page> pages_;
+    std::vector<Hotkeys> hotkeys_;
+    size_t hotkeyCount_ = 0;
+    size_t remapCount_ = 0;
+
+    uint8_t held_ = 0;
+    uint32_t swallowRelease_ = 0;           // key whose press fired a hotkey
+};
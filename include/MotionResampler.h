@@ -0,0 +1,54 @@
+#pragma once
+#include "EventPacket.h"
+#include <cstdint>
+
+// Thins pointer motion to a target rate on the client.
+//
+// A 4-8 kHz gaming mouse reports far more positions than the server's
+// display can show, and each would otherwise be its own packet. The
+// resampler lets at most one MouseMove out per period: a move arriving after
+// a quiet period goes out at once, later ones wait until the period is up
+// and are replaced by each newer move in the meantime. Positions are
+// absolute, so the move that goes out carries all the distance travelled
+// since the last one; only the intermediate points are dropped.
+//
+// A key or button event must not overtake motion captured before it, so
+// flush() hands over the waiting move to be sent first.
+//
+// All times are microseconds on the steady clock. Not thread-safe.
+class MotionResampler {
+public:
+    enum class Outcome {
+        Send,   // `out` goes now
+        Hold,   // the move waits until nextDueUs(); arm a timer for it
+        Merge,  // it replaced the move already waiting
+    };
+
+    explicit MotionResampler(uint32_t rateHz);
+
+    void setRate(uint32_t rateHz);
+    uint32_t rateHz() const { return rateHz_; }
+
+    Outcome push(const EventPacket& move, uint64_t nowUs, EventPacket& out);
+
+    // The waiting move, if it is due at `nowUs`.
+    bool popDue(uint64_t nowUs, EventPacket& out);
+
+    // The waiting move regardless of its due time.
+    bool flush(uint64_t nowUs, EventPacket& out);
+
+    bool holding() const { return holding_; }
+    uint64_t nextDueUs() const { return lastSentUs_ + periodUs_; }
+
+    // Moves replaced before they went out.
+    uint64_t merged() const { return merged_; }
+
+private:
+    uint32_t rateHz_ = 0;
+    uint64_t periodUs_ = 0;
+    bool sentAny_ = false;
+    uint64_t lastSentUs_ = 0;
+    bool holding_ = false;
+    EventPacket held_;
+    uint64_t merged_ = 0;
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include "EventPacket.h"
+#include <cstddef>
+#include <cstdint>
+
+// Batch decoder for a contiguous stream of EventPackets.
+//
+// Validates and decodes every complete header in a buffer in one pass and
+// emits compact records pointing back into the buffer, so the caller can
+// reject a malformed stream before touching any payload. Header integers are
+// big-endian; they are loaded with a single byte shuffle per header where
+// SSSE3 is available and with byte-swap loads otherwise.
+struct PacketRecord {
+    SamenessEventType type;
+    uint32_t payloadOffset;     // from the start of the decoded buffer
+    uint32_t payloadSize;
+    uint64_t timestamp;
+};
+
+struct DecodeResult {
+    size_t count = 0;           // records written
+    size_t consumed = 0;        // bytes covered by those records
+    bool malformed = false;     // an invalid header was found at `consumed`
+};
+
+// Decodes up to `maxRecords` complete packets from the front of `data`.
+// A trailing partial packet is left for the next call. Decoding stops at the
+// first header with an unknown type or a payload size outside the bounds for
+// that type.
+DecodeResult decodePackets(const uint8_t* data, size_t len, PacketRecord* out, size_t maxRecords);
+
+// Header decoded one byte at a time; kept as the reference the batch path is
+// tested and benchmarked against.
+DecodeResult decodePacketsScalar(const uint8_t* data, size_t len, PacketRecord* out, size_t maxRecords);
+
+// Accepted payload size range for a packet type; false for unknown types.
+bool payloadBounds(SamenessEventType type, uint32_t& minSize, uint32_t& maxSize);
@@ -0,0 +1,72 @@
+#pragma once
+#include "ClipboardSync.h"
+#include "EventPacket.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The system clipboard, as text.
+//
+//   macOS:   pbpaste / pbcopy
+//   Linux:   wl-paste / wl-copy under Wayland, xclip otherwise
+//   Windows: CF_UNICODETEXT, converted to and from UTF-8
+//
+// Both calls block (the tools are separate processes), so they belong on a
+// thread of their own, not the io thread.
+namespace pasteboard {
+
+// The clipboard's content; false if it cannot be read, holds no text or is
+// larger than `maxSize`.
+bool read(std::vector<uint8_t>& content, size_t maxSize);
+bool write(const std::vector<uint8_t>& content);
+
+}
+
+// Shares the system clipboard with the peer through a ClipboardSync.
+//
+// Its thread checks the clipboard every `interval` and hands the offer for
+// a change to `send`. An offer from the peer is fetched at once, since
+// nothing here sees a paste coming, and the content is put on the clipboard
+// by the same thread. The next check then finds content the peer already
+// has, which ClipboardSync does not offer back.
+class PasteboardBridge {
+public:
+    using Sender = std::function<void(EventPacket pkt)>;
+    using Reader = std::function<bool(std::vector<uint8_t>& content)>;
+    using Writer = std::function<bool(const std::vector<uint8_t>& content)>;
+
+    // Takes over `sync`'s offer and content handlers. `send` is called from
+    // this thread and from the io thread (for requests). The reader and
+    // writer default to the system clipboard.
+    PasteboardBridge(ClipboardSync& sync, std::chrono::milliseconds interval, Sender send,
+                     Reader read = nullptr, Writer write = nullptr);
+    ~PasteboardBridge();
+
+    PasteboardBridge(const PasteboardBridge&) = delete;
+    PasteboardBridge& operator=(const PasteboardBridge&) = delete;
+
+    void start();
+    // Joins the thread; content still waiting to be written is dropped.
+    void stop();
+
+private:
+    void run();
+
+    ClipboardSync& sync_;
+    std::chrono::milliseconds interval_;
+    Sender send_;
+    Reader read_;
+    Writer write_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    bool haveContent_ = false;
+    std::vector<uint8_t> content_;      // from the peer, for the clipboard
+    std::thread thread_;
+};
@@ -0,0 +1,145 @@
+#pragma once
+#include "Session.h"
+#include "SessionGroup.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Keeps a session open to every server the client drives, ahead of time, so
+// that crossing onto their screen only changes where input goes (the
+// SessionGroup) and never waits for a resolve, a TCP connect, a TLS
+// handshake or the version negotiation.
+//
+// Connections are made on the pool's own threads, one per address, never on
+// the capture or io threads, so a server that is slow to answer holds up no
+// other. An attempt still running after connectTimeout, or when stop() is
+// called, is cancelled (see Attempt). An idle session is kept alive by
+// heartbeats (Session::setHeartbeat). When one drops it leaves the group at
+// once, and the pool connects again in the background, waiting twice as long
+// after each failed attempt, up to retryMax.
+//
+// The sessions' close handlers call back into the pool, so it must outlive
+// every session it connected (join their io thread first).
+class PeerPool {
+public:
+    // One connection attempt, handed to the connector. The connector puts a
+    // Watch around each blocking call; cancelling the attempt calls the
+    // Watch's cancel function from another thread, which should make that
+    // call fail, e.g. by shutting its socket down.
+    class Attempt {
+    public:
+        class Watch {
+        public:
+            // Throws std::runtime_error if the attempt is already cancelled.
+            Watch(Attempt& attempt, std::function<void()> cancel);
+            ~Watch();
+
+            Watch(const Watch&) = delete;
+            Watch& operator=(const Watch&) = delete;
+
+        private:
+            Attempt& attempt_;
+        };
+
+        // Starts the deadline over for a second try at the same address (an
+        // older protocol, say); false once the pool is stopping.
+        bool restart();
+
+    private:
+        friend class PeerPool;
+        Attempt(PeerPool& pool, size_t index) : pool_(pool), index_(index) {}
+
+        PeerPool& pool_;
+        size_t index_;
+    };
+
+    // Resolves, connects, handshakes and starts a session to `address`,
+    // arranging for `onClose` to run when it ends. Throws on failure. Runs on
+    // the address's pool thread; `index` is its position in the list.
+    using Connector = std::function<std::shared_ptr<Session>(size_t index, const std::string& address,
+                                                              Attempt& attempt, Session::CloseHandler onClose)>;
+    // A connected session dropped and has left the group. Runs on its io thread.
+    using DownHandler = std::function<void(size_t index)>;
+
+    struct Config {
+        std::chrono::milliseconds retryMin{100};
+        std::chrono::milliseconds retryMax{5000};
+        std::chrono::milliseconds connectTimeout{2000};
+    };
+
+    PeerPool(SessionGroup& group, std::vector<std::string> addresses, Connector connector);
+    PeerPool(SessionGroup& group, std::vector<std::string> addresses, Connector connector, const Config& config);
+    ~PeerPool();
+
+    PeerPool(const PeerPool&) = delete;
+    PeerPool& operator=(const PeerPool&) = delete;
+
+    // Call before start().
+    void setDownHandler(DownHandler handler) { onDown_ = std::move(handler); }
+
+    // Starts connecting every address.
+    void start();
+
+    // Stops connecting, cancelling attempts under way. Sessions already up
+    // stay in the group for the caller to close.
+    void stop();
+
+    // Waits until every address is connected or `timeout` has passed, and
+    // returns how many are.
+    size_t waitConnected(std::chrono::milliseconds timeout);
+
+    struct Link {
+        std::string address;
+        bool up;
+        uint64_t connects;
+        uint64_t failures;
+        uint64_t connectUs;     // how long the latest successful connect took
+    };
+    std::vector<Link> links() const;
+
+private:
+    struct State {
+        std::string address;
+        std::shared_ptr<Session> session;
+        uint64_t generation = 0;    // tells a stale session's close apart
+        bool up = false;
+        bool closed = false;        // the current attempt's session has ended
+        std::chrono::steady_clock::time_point due;
+        std::chrono::milliseconds backoff{};
+        uint64_t connects = 0;
+        uint64_t failures = 0;
+        uint64_t connectUs = 0;
+        // Of the attempt under way; max when there is none
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+        bool cancelled = false;
+        std::function<void()> cancel;   // the Watch in scope
+    };
+
+    void run(size_t index);
+    // Cancels attempts past their deadline
+    void watch();
+    void connect(size_t index);
+    void dropped(size_t index, uint64_t generation);
+    // Under mutex_
+    void retryLater(State& state);
+    void cancel(State& state);
+
+    SessionGroup& group_;
+    Connector connector_;
+    Config config_;
+    DownHandler onDown_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<State> states_;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+    std::thread watchdog_;
+};
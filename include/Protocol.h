@@ -0,0 +1,86 @@
+#pragma once
+#include "EventPacket.h"
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+// Wire protocol versions and the handshake that picks one.
+//
+//   v1: EventPacket encoding (big-endian header, variable payload), back to
+//       back with no channel frames: the original stream of toBytes().
+//   v2: fixed-size little-endian message structs, see WireV2.h, inside the
+//       channel frames of Channels.h.
+//
+// Right after the TLS handshake a v2-capable client sends a Hello with the
+// highest version it speaks and the server answers with the version it
+// picked. Peers that predate the Hello start sending packets immediately; a
+// server recognizes them because a Hello's first byte is never a valid event
+// type.
+//
+// The server's Hello also reports its display refresh rate, which the client
+// resamples pointer motion to (see MotionResampler.h). Older servers leave
+// the field zero: unknown.
+constexpr uint16_t kProtocolV1 = 1;
+constexpr uint16_t kProtocolV2 = 2;
+constexpr uint16_t kProtocolVersion = kProtocolV2;     // newest version we speak
+
+constexpr uint8_t kHelloMagic[4] = {'S', 'M', 'N', 'S'};
+
+struct Hello {
+    uint8_t magic[4];       // kHelloMagic
+    uint16_t version;       // little-endian
+    uint16_t refreshHz;     // little-endian; server only, 0 if unknown
+};
+static_assert(sizeof(Hello) == 8, "Hello is 8 bytes on the wire");
+
+class ProtocolError : public std::runtime_error {
+public:
+    explicit ProtocolError(const std::string& message)
+        : std::runtime_error(message) {}
+};
+
+using TlsStream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+
+// Client side of the handshake. Returns the agreed version; with
+// maxVersion == kProtocolV1 nothing is sent (legacy mode). Throws
+// ProtocolError if the server rejects or drops the Hello; a server that
+// predates it does, so the caller can retry with kProtocolV1. The refresh rate
+// the server reported goes to `peerRefreshHz` (0 in legacy mode).
+uint16_t negotiateClient(TlsStream& stream, uint16_t maxVersion = kProtocolVersion,
+                         uint16_t* peerRefreshHz = nullptr);
+
+// Server side. Bytes read from a legacy peer that belong to its packet stream
+// are returned in `leftover`. Throws ProtocolError if the first byte starts
+// neither a Hello nor a packet.
+uint16_t negotiateServer(TlsStream& stream, std::vector<uint8_t>& leftover,
+                         uint16_t maxVersion = kProtocolVersion, uint16_t refreshHz = 0);
+
+// The same over a plain TCP connection (TcpTransport).
+uint16_t negotiateClient(boost::asio::ip::tcp::socket& socket, uint16_t maxVersion = kProtocolVersion,
+                         uint16_t* peerRefreshHz = nullptr);
+uint16_t negotiateServer(boost::asio::ip::tcp::socket& socket, std::vector<uint8_t>& leftover,
+                         uint16_t maxVersion = kProtocolVersion, uint16_t refreshHz = 0);
+
+// Server side without blocking, for a server already serving other clients:
+// runs on the stream's executor and calls `handler` there, with the version
+// and legacy bytes negotiateServer would return. A peer that is not speaking
+// the protocol fails with boost::asio::error::invalid_argument. Has no
+// timeout of its own; close the stream to give up on a peer.
+using NegotiateHandler = std::function<void(const boost::system::error_code& ec, uint16_t version,
+                                            std::vector<uint8_t> leftover)>;
+void asyncNegotiateServer(TlsStream& stream, uint16_t maxVersion, uint16_t refreshHz, NegotiateHandler handler);
+
+// Appends the encoding of `pkt` for the given version.
+void encodePacket(const EventPacket& pkt, uint16_t version, std::vector<uint8_t>& out);
+
+// Decodes every complete packet at the front of a channel stream.
+// Sets `consumed`; returns false on malformed input.
+bool decodeStream(uint16_t version, const uint8_t* data, size_t len, size_t& consumed,
+                  const std::function<void(const EventPacket&)>& handler);
+// Same, decoding into `scratch` so its payload buffer is reused across calls.
+bool decodeStream(uint16_t version, const uint8_t* data, size_t len, size_t& consumed,
+                  const std::function<void(const EventPacket&)>& handler, EventPacket& scratch);
@@ -0,0 +1,89 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of equal-size buffers carved from one allocation. Acquire and
+// release only happen when a connection opens or closes.
+class BufferPool {
+public:
+    BufferPool(size_t count, size_t size);
+
+    // nullptr when every buffer is in use.
+    uint8_t* acquire();
+    void release(uint8_t* buffer);
+
+    size_t bufferSize() const { return size_; }
+    size_t available() const;
+
+private:
+    size_t size_;
+    std::vector<uint8_t> slab_;
+    mutable std::mutex mutex_;
+    std::vector<uint8_t*> free_;
+};
+
+// Forwards sessions from clients to servers they cannot reach directly
+// (sameness_relay).
+//
+// Each accepted client is paired with a new connection to the route's
+// downstream server. TLS ends at the relay on both sides; in between, whole
+// channel frames (see Channels.h), or whole packets on a v1 connection, are
+// copied from one stream to the other as they arrive, without decoding the
+// packets inside, and the version Hello is passed through untouched, so
+// client and server negotiate with each other.
+// A pair holds two pool buffers for its lifetime and does no other
+// allocation while forwarding.
+//
+// Pairs are spread over `threads` io_contexts with one thread each, so every
+// pair is single-threaded like a Session.
+class Relay {
+public:
+    using tcp = boost::asio::ip::tcp;
+
+    struct Config {
+        size_t threads = 2;
+        size_t maxPairs = 64;       // further clients are turned away
+    };
+
+    Relay(boost::asio::ssl::context& acceptContext, boost::asio::ssl::context& connectContext);
+    Relay(boost::asio::ssl::context& acceptContext, boost::asio::ssl::context& connectContext,
+          const Config& config);
+    ~Relay();
+
+    // Accepts on `listen` and forwards each client to `downstream`. Returns the
+    // bound port (useful with port 0). Call before start().
+    uint16_t addRoute(const tcp::endpoint& listen, const tcp::endpoint& downstream);
+
+    void start();
+    // Drops every pair and joins the threads.
+    void stop();
+
+    size_t activePairs() const { return activePairs_; }
+
+private:
+    class Pair;
+    struct Route {
+        tcp::acceptor acceptor;
+        tcp::endpoint downstream;
+    };
+
+    void accept(Route& route);
+
+    boost::asio::ssl::context& acceptContext_;
+    boost::asio::ssl::context& connectContext_;
+    Config config_;
+    BufferPool pool_;
+    std::vector<std::unique_ptr<boost::asio::io_context>> ios_;
+    std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work_;
+    std::vector<std::unique_ptr<Route>> routes_;
+    std::vector<std::thread> threads_;
+    size_t nextIo_ = 0;                 // only touched on the accepting thread
+    std::atomic<size_t> activePairs_{0};
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 
 // Control state: events are either handled locally on the Host,
 // or forwarded to the peer Client.
@@ -10,7 +11,7 @@ enum class ControlState {
 class ScreenEdgeSwitcher {
 public:
     // hostWidth: width in pixels of the host's screen (e.g. 1920)
-    // hostHeight: height in pixels of the host's screen (not used here, but for future extension)
+    // hostHeight: height in pixels of the host's screen (used by returnFromPeer)
     ScreenEdgeSwitcher(int hostWidth, int hostHeight);
 
     // Call on every mouse-move event.
@@ -20,11 +21,27 @@ public:
     // Helper: are we currently forwarding to client?
     bool isClientControlled() const;
 
+    // Hands control back to the host, e.g. when the peer is lost.
+    // Safe to call from any thread.
+    void forceHost();
+
+    // The peer saw its pointer leave through the edge facing this screen
+    // (peerY of peerHeight rows; see EdgeWatcher.h). Hands control to the
+    // host and sets x, y to the mirrored point on the host's right edge, just
+    // outside the switch zone. False, and nothing changes, while locked or
+    // already on the host. Safe to call from any thread.
+    bool returnFromPeer(int peerY, int peerHeight, int& x, int& y);
+
+    // While locked, update() keeps the current state regardless of position.
+    void setLocked(bool locked);
+    bool isLocked() const;
+
     void setEdgeThreshold(int threshold);
 
 private:
     int hostWidth_;
     int hostHeight_;
     int edgeThreshold_;
-    ControlState state_ = ControlState::HOST;
+    std::atomic<ControlState> state_{ControlState::HOST};
+    std::atomic<bool> locked_{false};
 };
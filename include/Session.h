@@ -0,0 +1,167 @@
+#pragma once
+#include "Channels.h"
+#include "CountingResource.h"
+#include "EventPacket.h"
+#include "Protocol.h"
+#include "Transport.h"
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// One established connection carrying EventPackets in both directions.
+//
+// All socket work runs on the transport's io_context, which must be run by a
+// single thread; send() and kickBulk() may be called from any thread.
+// Packets are multiplexed onto prioritized channels (see Channels.h): every
+// write carries all pending input plus at most one small frame of lower
+// priority data, so a large transfer delays input by at most one frame.
+//
+// Input is queued as shared, pre-encoded frames. While a write is in flight,
+// consecutive queued MouseMoves collapse into the newest one, so a slow peer
+// costs memory proportional to its key and button backlog only; past
+// kMaxInputBacklog frames the session gives up on the peer.
+//
+// Buffers and queues come from a pool owned by the session and only touched
+// on its io thread, so sessions on different threads never share allocator
+// state, and memoryStats() shows what each one costs. Decoding and queueing
+// reuse that memory: once warm, a session allocates nothing per packet
+// except the frames handed to sendFrame().
+class Session : public std::enable_shared_from_this<Session>, private Transport::Handler {
+public:
+    using Stream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+    using PacketHandler = std::function<void(const EventPacket&)>;
+    using CloseHandler = std::function<void(const boost::system::error_code&)>;
+    // Fills the next packet for a bulk channel; returns false when there is nothing to send.
+    using BulkSource = ChannelScheduler::Source;
+
+    // `version` is the negotiated protocol version; `leftover` holds stream
+    // bytes already read during negotiation (see negotiateServer).
+    explicit Session(std::unique_ptr<Transport> transport, uint16_t version = kProtocolVersion,
+                     std::vector<uint8_t> leftover = {});
+    // Over TLS, as the client and server run.
+    explicit Session(std::unique_ptr<Stream> stream, uint16_t version = kProtocolVersion,
+                     std::vector<uint8_t> leftover = {});
+
+    // Call before start().
+    void setBulkSource(Channel channel, BulkSource source);
+
+    // Dead-peer detection. A heartbeat goes out whenever nothing else has been
+    // written for `interval` (default deadline / 4), and the session fails with
+    // error::timed_out once nothing has been received for `deadline`, so a
+    // silent peer is noticed within deadline + interval. Heartbeats are part of
+    // protocol v2; v1 sessions ignore this. Call before start().
+    void setHeartbeat(std::chrono::milliseconds deadline,
+                      std::chrono::milliseconds interval = std::chrono::milliseconds(0));
+
+    // Congestion control. While more than `maxUnsentBytes` from earlier writes
+    // are still waiting in the transport (see Transport::unsentBytes), a write
+    // of nothing but a MouseMove is held, and the session looks again every
+    // `recheck`. The held move keeps collapsing into the newest one, so on a
+    // slow link motion is sent at the rate the link drains, a position at a
+    // time, instead of queueing in kernel buffers. Keys, buttons and the other
+    // channels are never held; their write carries the held move along, in
+    // order. 0 (the default) never holds. Call before start().
+    void setSendBacklogLimit(size_t maxUnsentBytes,
+                             std::chrono::microseconds recheck = std::chrono::microseconds(1000));
+
+    // Begins the read loop. Handlers run on the io thread.
+    void start(PacketHandler onPacket, CloseHandler onClose);
+
+    // Input frames queued beyond this mean the peer has stopped reading.
+    static constexpr size_t kMaxInputBacklog = 4096;
+
+    // Queues a packet on the channel for its type. Thread-safe.
+    void send(EventPacket pkt);
+
+    // Queues an input frame built with makeFrame(Channel::Input, pkt, version()).
+    // The frame is shared, not copied. `traceId` is trace::eventId(pkt), or 0
+    // when not tracing. Thread-safe.
+    void sendFrame(SamenessEventType type, SharedFrame frame, uint64_t traceId = 0);
+
+    uint16_t version() const { return version_; }
+
+    struct MemoryStats {
+        uint64_t allocations;   // blocks the session's pool took from the heap
+        size_t bytesInUse;
+        size_t peakBytes;
+    };
+    // Safe to call from any thread.
+    MemoryStats memoryStats() const;
+
+    // Wakes the writer after a bulk source gained data. Thread-safe.
+    void kickBulk();
+
+    // Shuts the connection down. Thread-safe.
+    void close();
+
+    // Shuts the connection down once everything queued before the call has
+    // been written. Thread-safe.
+    void closeWhenSent();
+
+    Transport& transport() { return *transport_; }
+
+private:
+    void doRead();
+    void onRead(const boost::system::error_code& ec, size_t len) override;
+    void onWrite(const boost::system::error_code& ec, size_t len) override;
+    // This session as the receiver of its transport's completions.
+    std::shared_ptr<Transport::Handler> completions();
+    // Feeds received bytes to the decoder; false if the connection was dropped.
+    bool consume(const uint8_t* data, size_t len);
+    void enqueueInput(SamenessEventType type, SharedFrame frame, uint64_t traceId);
+    void pump();
+    void armHeartbeat();
+    // True (and a recheck is armed) if the transport is too far behind for motion.
+    bool holdForBacklog();
+    void fail(const boost::system::error_code& ec);
+
+    // Declared first so it outlives everything allocated from it
+    CountingResource heap_;
+    std::pmr::unsynchronized_pool_resource pool_;
+
+    std::unique_ptr<Transport> transport_;
+    uint16_t version_;
+    std::vector<uint8_t> leftover_;
+    PacketHandler onPacket_;
+    CloseHandler onClose_;
+
+    std::pmr::vector<uint8_t> readBuf_;
+    FrameDecoder decoder_;
+
+    struct QueuedFrame {
+        SamenessEventType type;
+        SharedFrame frame;
+        uint64_t traceId;
+        uint64_t queuedUs;      // only set while tracing
+    };
+    std::pmr::deque<QueuedFrame> inputQueue_;
+    size_t inputQueuedBytes_ = 0;
+
+    ChannelScheduler scheduler_;
+    std::vector<uint8_t> encoded_;         // scratch for packets sent on the lower priority channels
+    std::pmr::vector<uint8_t> lowerBuf_;   // next frame from the lower priority channels
+    std::pmr::vector<uint8_t> writeBuf_;   // input frames and lowerBuf_ packed into one write
+    SharedFrame inFlight_;                 // a lone input frame written without packing
+    bool writing_ = false;
+    std::pmr::vector<uint64_t> writeTraceIds_;   // traced events in the write in flight
+    uint64_t writeStartUs_ = 0;
+    bool closed_ = false;
+    bool closeWhenSent_ = false;
+
+    size_t backlogLimit_ = 0;
+    std::chrono::microseconds backlogRecheck_{};
+    boost::asio::steady_timer backlogTimer_;
+    bool backlogHeld_ = false;
+
+    boost::asio::steady_timer heartbeatTimer_;
+    std::chrono::steady_clock::duration deadline_{};
+    std::chrono::steady_clock::duration heartbeatInterval_{};
+    std::chrono::steady_clock::time_point lastRead_;
+    std::chrono::steady_clock::time_point lastWrite_;
+};
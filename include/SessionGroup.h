@@ -0,0 +1,35 @@
+#pragma once
+#include "EventPacket.h"
+#include "Session.h"
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// The set of peers a client drives at once (broadcast mode).
+//
+// An input event is encoded once per protocol version in use, and the same
+// immutable frame is queued on every session. Each session has its own writer
+// and backlog (see Session), so a slow peer falls behind on its own instead of
+// stalling the others.
+class SessionGroup {
+public:
+    void add(std::shared_ptr<Session> session);
+    void remove(const Session* session);
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+
+    // The first session still connected, or nullptr.
+    std::shared_ptr<Session> primary() const;
+
+    // Sends to every session. Thread-safe.
+    void send(const EventPacket& pkt);
+
+    void closeAll();
+    // Session::closeWhenSent on every session.
+    void closeAllWhenSent();
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<Session>> sessions_;
+};
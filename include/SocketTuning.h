@@ -0,0 +1,47 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <string>
+#include <vector>
+
+// Socket options for the client's and server's connection, chosen by name
+// (--socket-profile):
+//
+//   default      TCP_NODELAY only
+//   interactive  also TCP_QUICKACK after every read, so the peer's small
+//                writes are acknowledged at once instead of waiting on the
+//                delayed-ACK timer; DSCP EF (expedited forwarding) so switches
+//                queue our packets ahead of bulk traffic; and small socket
+//                buffers, so a congested link backs up into the session's
+//                queue (see Session::setSendBacklogLimit) rather than the kernel
+//   spin         interactive plus SO_BUSY_POLL, and the server's io thread
+//                polls in a loop instead of sleeping in epoll. Costs a core.
+//
+// TCP_QUICKACK and SO_BUSY_POLL are Linux only and ignored elsewhere.
+struct SocketProfile {
+    std::string name = "default";
+    bool noDelay = true;
+    bool quickAck = false;      // re-armed after every read by the transport
+    int busyPollUs = 0;         // SO_BUSY_POLL; 0 leaves it off
+    bool spinRead = false;      // run the io thread with poll() in a loop
+    int dscp = -1;              // -1 leaves the traffic class alone
+    int sendBuffer = 0;         // SO_SNDBUF in bytes; 0 keeps the kernel's
+    int receiveBuffer = 0;      // SO_RCVBUF
+
+    static constexpr int kDscpExpedited = 46;
+
+    // Throws std::invalid_argument for an unknown name.
+    static SocketProfile named(const std::string& name);
+    static std::vector<std::string> names();
+};
+
+// Applies `profile` to a connected socket. An option the system refuses is
+// reported on stderr and skipped; the connection works without it.
+void applySocketProfile(boost::asio::ip::tcp::socket& socket, const SocketProfile& profile);
+
+// Asks for an immediate ACK of whatever arrives next. The kernel drops back to
+// delayed ACKs on its own, so this is repeated after every read.
+void rearmQuickAck(boost::asio::ip::tcp::socket& socket);
+
+// Runs `io` until it runs out of work, polling without ever blocking when
+// the profile asks for it.
+void runIoContext(boost::asio::io_context& io, const SocketProfile& profile);
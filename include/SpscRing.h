@@ -0,0 +1,86 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Bounded queue of trivially copyable values between exactly one producer
+// thread and one consumer thread. Neither side locks or blocks: push() and
+// pop() move as many items as fit or are available and return the count.
+// Each side keeps a cached copy of the other's index, so the shared cache
+// line is only touched when the cached view runs out.
+template <typename T>
+class SpscRing {
+    static_assert(std::is_trivially_copyable<T>::value, "SpscRing copies items with memcpy");
+
+public:
+    // Capacity is rounded up to a power of two.
+    explicit SpscRing(size_t capacity) {
+        size_t n = 1;
+        while (n < capacity) {
+            n <<= 1;
+        }
+        slots_.resize(n);
+        mask_ = n - 1;
+    }
+
+    size_t capacity() const { return slots_.size(); }
+
+    // Producer side.
+    size_t push(const T* items, size_t n) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (capacity() - (tail - producerHead_) < n) {
+            producerHead_ = head_.load(std::memory_order_acquire);
+        }
+        n = std::min(n, capacity() - (tail - producerHead_));
+        copyIn(tail, items, n);
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    bool push(const T& item) { return push(&item, 1) == 1; }
+
+    // Consumer side.
+    size_t pop(T* items, size_t n) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (consumerTail_ - head < n) {
+            consumerTail_ = tail_.load(std::memory_order_acquire);
+        }
+        n = std::min(n, consumerTail_ - head);
+        copyOut(head, items, n);
+        head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    bool pop(T& item) { return pop(&item, 1) == 1; }
+
+    // Either side; exact only when the other side is idle.
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+
+private:
+    // Indices grow without wrapping; the slot is index & mask_
+    void copyIn(size_t at, const T* items, size_t n) {
+        size_t first = std::min(n, capacity() - (at & mask_));
+        std::memcpy(&slots_[at & mask_], items, first * sizeof(T));
+        std::memcpy(&slots_[0], items + first, (n - first) * sizeof(T));
+    }
+
+    void copyOut(size_t at, T* items, size_t n) {
+        size_t first = std::min(n, capacity() - (at & mask_));
+        std::memcpy(items, &slots_[at & mask_], first * sizeof(T));
+        std::memcpy(items + first, &slots_[0], (n - first) * sizeof(T));
+    }
+
+    std::vector<T> slots_;
+    size_t mask_ = 0;
+
+    alignas(64) std::atomic<size_t> head_{0};   // next slot to pop, written by the consumer
+    size_t consumerTail_ = 0;
+    alignas(64) std::atomic<size_t> tail_{0};   // next slot to fill, written by the producer
+    size_t producerHead_ = 0;
+};
@@ -0,0 +1,145 @@
+#pragma once
+#include "EventPacket.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Live counters for a running client or server.
+//
+// The block has a fixed layout and lives in POSIX shared memory
+// (/sameness-<role>) so that sameness_stat can attach to it from outside the
+// process. Each writer thread owns a cache-line aligned slot that only it
+// updates, so the hot path is a relaxed load and store: no locks, no
+// syscalls. A thread gives its slot back when it exits, and the next thread
+// to start takes it over, counts and all. Threads beyond the slot count share
+// the last slot through relaxed fetch_add. Readers sum all slots.
+namespace stats {
+
+constexpr uint32_t kMagic = 0x534D5354;    // "SMST"
+constexpr uint32_t kVersion = 7;
+constexpr size_t kSlots = 16;
+constexpr size_t kEventTypes = 16;         // indexed by SamenessEventType value
+
+// Point-in-time values rather than counters.
+enum class Gauge : uint8_t {
+    SendInput = 0,      // bytes queued per send channel, see Channels.h
+    SendControl,
+    SendClipboard,
+    SendBulk,
+    MoveJitterUs,       // pointer motion jitter estimate, see JitterBuffer.h
+    PlayoutDelayUs,     // current jitter buffer target delay
+    InjectQueueDepth,   // records waiting for the injection thread, see InjectionQueue.h
+    Count
+};
+
+struct alignas(64) Slot {
+    std::atomic<uint64_t> events[kEventTypes];
+    std::atomic<uint64_t> bytesSent;
+    std::atomic<uint64_t> recordsSent;      // TLS records written
+    std::atomic<uint64_t> bytesReceived;
+    std::atomic<uint64_t> injectCalls;
+    std::atomic<uint64_t> injectNanos;      // total time spent in inject* calls
+    std::atomic<uint64_t> drops;
+    std::atomic<uint64_t> coalescedMoves;
+    std::atomic<uint64_t> playoutMoves;     // moves played out by the jitter buffer
+    std::atomic<uint64_t> playoutNanos;     // total time those moves were held
+    std::atomic<uint64_t> heldWrites;       // motion writes put off for a congested link, see Session::setSendBacklogLimit
+    std::atomic<uint64_t> injectQueued;     // records taken off the injection queue
+    std::atomic<uint64_t> injectWaitNanos;  // total time those records were queued
+    std::atomic<uint64_t> echoes;           // captured events dropped as our own injections, see EchoFilter.h
+    std::atomic<uint64_t> refused;          // input from a controller without control, see ControlArbiter.h
+};
+
+struct Block {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t pid;
+    std::atomic<uint32_t> slotsInUse;       // a bit per owned slot; the last slot is shared
+    alignas(64) std::atomic<int64_t> gauges[static_cast<size_t>(Gauge::Count)];
+    Slot slots[kSlots];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "stats counters must be lock-free");
+
+// Plain sum of all slots, as seen by a reader.
+struct Snapshot {
+    uint64_t events[kEventTypes];
+    uint64_t bytesSent;
+    uint64_t recordsSent;
+    uint64_t bytesReceived;
+    uint64_t injectCalls;
+    uint64_t injectNanos;
+    uint64_t drops;
+    uint64_t coalescedMoves;
+    uint64_t playoutMoves;
+    uint64_t playoutNanos;
+    uint64_t heldWrites;
+    uint64_t injectQueued;
+    uint64_t injectWaitNanos;
+    uint64_t echoes;
+    uint64_t refused;
+    int64_t gauges[static_cast<size_t>(Gauge::Count)];
+};
+
+// Creates and maps /sameness-<role>. Until this succeeds (or if it fails, or on
+// platforms without POSIX shared memory) counters go to a process-local block.
+bool open(const char* role);
+void close();
+
+// Maps an existing block read-only. Returns nullptr if it does not exist.
+const Block* attach(const char* role);
+void detach(const Block* block);
+
+Snapshot snapshot(const Block& block);
+
+namespace detail {
+    extern std::atomic<Block*> current;
+
+    struct ThreadSlot {
+        Block* owner = nullptr;
+        Slot* slot = nullptr;
+        bool shared = false;
+
+        ~ThreadSlot();
+        void release();
+    };
+    extern thread_local ThreadSlot tls;
+    void claim();
+
+    // Slot of the calling thread in the current block.
+    inline ThreadSlot& local() {
+        if (tls.owner != current.load(std::memory_order_relaxed)) {
+            claim();
+        }
+        return tls;
+    }
+
+    inline void bump(std::atomic<uint64_t>& c, uint64_t n, bool shared) {
+        if (shared) {
+            c.fetch_add(n, std::memory_order_relaxed);
+        } else {
+            c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    }
+}
+
+inline Block& block() {
+    return *detail::current.load(std::memory_order_relaxed);
+}
+
+// Adds to a counter in the calling thread's slot.
+inline void add(std::atomic<uint64_t> Slot::*counter, uint64_t n = 1) {
+    detail::ThreadSlot& t = detail::local();
+    detail::bump(t.slot->*counter, n, t.shared);
+}
+
+inline void countEvent(SamenessEventType type) {
+    detail::ThreadSlot& t = detail::local();
+    detail::bump(t.slot->events[static_cast<size_t>(type) % kEventTypes], 1, t.shared);
+}
+
+inline void setGauge(Gauge g, int64_t value) {
+    block().gauges[static_cast<size_t>(g)].store(value, std::memory_order_relaxed);
+}
+
+} // namespace stats
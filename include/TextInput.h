@@ -0,0 +1,35 @@
+#pragma once
+#include "EventPacket.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Text typed as a unit (SamenessEventType::TextInput).
+//
+// Tools that type into a remote machine (password managers, snippet
+// expanders, paste-as-keystrokes) would otherwise send a KeyPress and a
+// KeyRelease per character, each injected on its own. A TextInput packet
+// carries the string as UTF-8 instead, and the injectors hand it to the
+// system in one go: Unicode keyboard events on macOS and Windows, one
+// uinput write on Linux (see Injectors.h, UinputDevice.h).
+
+// Upper bound on the UTF-8 bytes in one TextInput packet; longer text is
+// split across packets.
+constexpr size_t kMaxTextBytes = 4096;
+
+// `text` as TextInput packets of at most kMaxTextBytes each, never splitting
+// a UTF-8 sequence. Empty text gives no packets.
+std::vector<EventPacket> makeTextPackets(uint64_t timestamp, const std::string& text);
+
+// The UTF-8 carried by a TextInput packet; false for any other packet.
+bool readText(const EventPacket& pkt, std::string& text);
+
+// UTF-16 code units for `text`, as SendInput and CGEventKeyboardSetUnicodeString
+// take them. Malformed sequences become U+FFFD.
+std::u16string utf8ToUtf16(const std::string& text);
+
+// The key that types ASCII `c` on a US layout, as a VC_* code, and whether
+// Shift must be held; false for characters with no such key. Used where the
+// platform can only inject keys (uiohook, uinput).
+bool asciiKey(char c, uint16_t& keycode, bool& shift);
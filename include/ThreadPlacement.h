@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Which CPUs one of our threads may run on and how it competes for them, set
+// per thread role from the command line:
+//
+//   --pin <role>=<cpus>          e.g. hook=2, inject=2,3 or io=4-7
+//   --priority <role>=<policy>   fifo:<1-99>, rr:<1-99> or nice:<-20..19>
+//
+// Roles: hook (the client's capture thread, uiohook or evdev), io (the
+// network thread on either side) and inject (the server's injection thread,
+// see InjectionQueue.h). Each thread applies its own placement as it starts.
+//
+// SCHED_FIFO and SCHED_RR need CAP_SYS_NICE or an RLIMIT_RTPRIO allowance, a
+// negative nice value CAP_SYS_NICE or RLIMIT_NICE. A refused real-time policy
+// falls back to the lowest nice value RLIMIT_NICE allows. Anything refused is
+// reported on stderr and the thread carries on without it. Linux only;
+// elsewhere placements are reported and ignored.
+struct ThreadPlacement {
+    enum class Policy { Inherit, Nice, Fifo, RoundRobin };
+
+    std::vector<int> cpus;          // empty: wherever the scheduler likes
+    Policy policy = Policy::Inherit;
+    int priority = 0;               // nice value for Nice, 1-99 for Fifo and RoundRobin
+
+    bool empty() const { return cpus.empty() && policy == Policy::Inherit; }
+    // e.g. "cpus 2,3, fifo 50"; "unplaced" when empty
+    std::string describe() const;
+};
+
+using ThreadPlacements = std::map<std::string, ThreadPlacement>;
+
+// Parse "<role>=<cpus>" (--pin) and "<role>=<policy>" (--priority) into
+// placements[role]. Throw std::invalid_argument for a malformed spec or a
+// role not in `roles`.
+void parsePin(const std::string& spec, const std::vector<std::string>& roles, ThreadPlacements& placements);
+void parsePriority(const std::string& spec, const std::vector<std::string>& roles, ThreadPlacements& placements);
+
+// Applies `placement` to the calling thread. Returns false if any part of it
+// was refused.
+bool applyThreadPlacement(const ThreadPlacement& placement, const std::string& role);
+
+// Applies the placement for `role`, if there is one.
+bool applyThreadPlacement(const ThreadPlacements& placements, const std::string& role);
+
+// Wakeup latency under load (--probe-wakeups): a thread asks to wake every
+// periodUs and records how late each wakeup comes, while hog threads spin on
+// the same CPUs at normal priority.
+struct WakeupProbe {
+    uint64_t durationMs = 2000;
+    uint64_t periodUs = 1000;
+    int hogs = 0;                   // spinning threads; 0: one more than there are CPUs to run on
+};
+
+// Lateness of each wakeup in microseconds, for a thread with `placement`.
+std::vector<uint64_t> probeWakeups(const ThreadPlacement& placement, const WakeupProbe& probe);
+
+// Probes an unplaced thread and then each placement, printing percentiles.
+void reportWakeups(const ThreadPlacements& placements, const WakeupProbe& probe);
@@ -0,0 +1,109 @@
+#pragma once
+#include "EventPacket.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Opt-in lifecycle tracing of input events (--trace on the client and server).
+//
+// Every input event is identified by its capture timestamp and type, which
+// both sides see, and each stage it passes through records a span: capture
+// to hook on the client, encoding, waiting in the send queue, the transport
+// write, then on the server the read, decoding and injection. The gap between
+// the client's write and the server's read is the kernels and the network.
+//
+// Spans go into a fixed-size ring per thread (the oldest are overwritten), and
+// writeJson() exports them in Chrome's trace-event format, one async track
+// per event, for chrome://tracing or ui.perfetto.dev. The server shifts its
+// times onto the client's clock, estimated from the smallest observed
+// (arrival - capture) difference, so the fastest event's network time shows
+// as zero. mergeJson() combines both sides' files into one timeline.
+//
+// When tracing is off, each call site costs one relaxed load and a branch.
+namespace trace {
+
+enum class Stage : uint8_t {
+    Hook = 0,       // captured until the client's hook saw it
+    Encode,
+    Queue,          // waiting in the session's send queue
+    Write,          // handed to the transport until the write completed
+    Read,           // read from the transport, behind earlier packets of the same read
+    Decode,
+    Inject,
+    Count
+};
+
+const char* stageName(Stage stage);
+
+struct Config {
+    size_t recordsPerThread = 1 << 16;
+    // Export on the peer's clock (see observePeerTime); the server sets this
+    bool alignToPeer = false;
+};
+
+namespace detail {
+    extern std::atomic<bool> enabled;
+    void record(Stage stage, uint64_t id, uint64_t beginUs, uint64_t endUs);
+    void observe(uint64_t remoteUs, uint64_t localUs);
+}
+
+inline bool enabled() {
+    return detail::enabled.load(std::memory_order_relaxed);
+}
+
+inline uint64_t nowUs() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// The ID both sides give an event. Two events of the same type captured in
+// the same microsecond share one.
+inline uint64_t eventId(const EventPacket& pkt) {
+    return (pkt.timestamp << 4) | (static_cast<uint8_t>(pkt.type) & 0xF);
+}
+
+// Records that event `id` spent [beginUs, endUs] in `stage`, on the local
+// steady clock. Thread-safe.
+inline void span(Stage stage, uint64_t id, uint64_t beginUs, uint64_t endUs) {
+    if (enabled()) {
+        detail::record(stage, id, beginUs, endUs);
+    }
+}
+
+// Feeds the clock offset estimate: a packet captured at remoteUs on the
+// peer's clock arrived at localUs.
+inline void observePeerTime(uint64_t remoteUs, uint64_t localUs) {
+    if (enabled()) {
+        detail::observe(remoteUs, localUs);
+    }
+}
+
+void enable(const Config& config = Config());
+void disable();
+
+// Drops everything recorded so far. Call while nothing is recording.
+void clear();
+
+struct Span {
+    Stage stage;
+    uint64_t id;
+    uint64_t beginUs;   // already shifted onto the peer's clock if aligned
+    uint64_t endUs;
+    uint32_t thread;    // in order of each thread's first span
+};
+
+// Everything still in the rings, oldest first per thread. Call once the traced
+// threads have stopped recording, e.g. after disable().
+std::vector<Span> collect();
+
+// Writes collect() as trace-event JSON, labelled with `process`. False if the
+// file cannot be written.
+bool writeJson(const std::string& path, const std::string& process);
+
+// Concatenates the events of files written by writeJson() into one.
+bool mergeJson(const std::vector<std::string>& inputs, const std::string& output);
+
+} // namespace trace
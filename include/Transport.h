@@ -0,0 +1,151 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <utility>
+
+// An Asio completion handler whose associated allocator is `memory`, so the
+// state Asio keeps for the operation is allocated there.
+template <typename Handler>
+struct PoolHandler {
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    Handler handler;
+    allocator_type allocator;
+
+    allocator_type get_allocator() const noexcept { return allocator; }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler(std::forward<Args>(args)...);
+    }
+};
+
+template <typename Handler>
+PoolHandler<std::decay_t<Handler>> fromPool(std::pmr::memory_resource* memory, Handler&& handler) {
+    return {std::forward<Handler>(handler), std::pmr::polymorphic_allocator<std::byte>(memory)};
+}
+
+// The byte stream a Session runs over.
+//
+// TlsTransport is what the client and server use; TcpTransport is the same
+// without encryption, for trusted links and for measuring what TLS costs;
+// MemoryTransport connects two sessions inside one process, so the whole
+// pipeline can be driven and timed without sockets.
+//
+// Operations follow Asio rules: one read and one write may be outstanding at
+// a time, completions never run inside the call that started them, and they
+// run on executor(). Completions go to a Handler the transport keeps a
+// reference to until it has been called, which also keeps its owner alive.
+class Transport {
+public:
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        virtual void onRead(const boost::system::error_code& ec, size_t len) = 0;
+        virtual void onWrite(const boost::system::error_code& ec, size_t len) = 0;
+    };
+    using Executor = boost::asio::any_io_executor;
+
+    virtual ~Transport() = default;
+
+    virtual Executor executor() = 0;
+
+    // Reads at least one byte into `buffer`.
+    virtual void asyncRead(boost::asio::mutable_buffer buffer, std::shared_ptr<Handler> handler) = 0;
+
+    // Writes all of `buffer`, which must stay valid until onWrite.
+    virtual void asyncWrite(boost::asio::const_buffer buffer, std::shared_ptr<Handler> handler) = 0;
+
+    // Aborts outstanding operations and disconnects. Call on the executor.
+    virtual void close() = 0;
+
+    // The TCP socket underneath, for socket options; nullptr if there is none.
+    virtual boost::asio::ip::tcp::socket* socket() { return nullptr; }
+
+    // Bytes from completed writes that are still waiting to go out: for a
+    // socket the part of the kernel's send queue not sent yet (SIOCOUTQNSD;
+    // bytes sent and awaiting their ACK do not count; 0 where that is not
+    // available). Call on the executor.
+    virtual size_t unsentBytes();
+
+    // Where per-operation state is allocated (default: the heap).
+    void setMemory(std::pmr::memory_resource* memory) { memory_ = memory; }
+
+    // Re-arms TCP_QUICKACK after every read (see SocketTuning.h). Sockets only.
+    void setQuickAck(bool on) { quickAck_ = on; }
+
+protected:
+    std::pmr::memory_resource* memory_ = std::pmr::get_default_resource();
+    bool quickAck_ = false;
+};
+
+class TlsTransport final : public Transport {
+public:
+    using Stream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+
+    // `stream` must have completed its handshake.
+    explicit TlsTransport(std::unique_ptr<Stream> stream);
+
+    Executor executor() override;
+    void asyncRead(boost::asio::mutable_buffer buffer, std::shared_ptr<Handler> handler) override;
+    void asyncWrite(boost::asio::const_buffer buffer, std::shared_ptr<Handler> handler) override;
+    void close() override;
+    boost::asio::ip::tcp::socket* socket() override { return &stream_->next_layer(); }
+
+    Stream& stream() { return *stream_; }
+
+private:
+    std::unique_ptr<Stream> stream_;
+};
+
+class TcpTransport final : public Transport {
+public:
+    explicit TcpTransport(boost::asio::ip::tcp::socket socket);
+
+    Executor executor() override;
+    void asyncRead(boost::asio::mutable_buffer buffer, std::shared_ptr<Handler> handler) override;
+    void asyncWrite(boost::asio::const_buffer buffer, std::shared_ptr<Handler> handler) override;
+    void close() override;
+    boost::asio::ip::tcp::socket* socket() override { return &socket_; }
+
+private:
+    boost::asio::ip::tcp::socket socket_;
+};
+
+// One end of an in-process connection. Each direction is an SpscRing of
+// bytes: the writing end's thread fills it and the reading end's thread
+// drains it, so the two ends may run on different threads without a lock.
+// An end with nothing to do parks, and the other end posts it a wake-up
+// when it adds bytes or frees space. Closing either end closes both
+// directions; the peer still reads what was already written, then eof.
+class MemoryTransport final : public Transport {
+public:
+    using Pair = std::pair<std::unique_ptr<MemoryTransport>, std::unique_ptr<MemoryTransport>>;
+
+    // Two connected ends whose completions run on `first` and `second`,
+    // which may be the same io_context. `capacity` bytes buffer each direction.
+    static Pair connect(boost::asio::io_context& first, boost::asio::io_context& second,
+                        size_t capacity = 64 * 1024);
+
+    ~MemoryTransport() override;
+
+    Executor executor() override;
+    void asyncRead(boost::asio::mutable_buffer buffer, std::shared_ptr<Handler> handler) override;
+    void asyncWrite(boost::asio::const_buffer buffer, std::shared_ptr<Handler> handler) override;
+    void close() override;
+    // What the peer has not read yet
+    size_t unsentBytes() override;
+
+private:
+    struct Pipe;
+    struct End;
+
+    explicit MemoryTransport(std::shared_ptr<End> end);
+
+    std::shared_ptr<End> end_;
+};
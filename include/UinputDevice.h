@@ -0,0 +1,41 @@
+#pragma once
+#include "EventPacket.h"
+#include <linux/input.h>
+#include <vector>
+
+// A virtual keyboard and absolute pointer created through /dev/uinput, the
+// kernel's way of injecting input below the display server. Packets become
+// input_event records; a batch of them goes to the kernel in one write().
+// Linux only, and needs write access to /dev/uinput.
+class UinputDevice {
+public:
+    // Device name the kernel reports, so capture can tell our injections apart
+    static constexpr const char* kName = "sameness";
+
+    // Pointer positions span [0, width) x [0, height). Throws std::runtime_error.
+    UinputDevice(int width, int height);
+    ~UinputDevice();
+
+    UinputDevice(const UinputDevice&) = delete;
+    UinputDevice& operator=(const UinputDevice&) = delete;
+
+    // Whether this process may create a device.
+    static bool available();
+
+    // Where records are written, for callers that batch their own writes.
+    int fd() const { return fd_; }
+
+    // Appends the records that replay `pkt`, ending with a SYN_REPORT.
+    // Returns false and appends nothing for packets that are not key,
+    // button, motion or text input, and for keys with no Linux code.
+    // uinput injects keys, not characters, so TextInput is typed as key
+    // presses on a US layout: ASCII only, anything else is skipped.
+    static bool encode(const EventPacket& pkt, std::vector<input_event>& out);
+
+    // Encodes and writes one packet. Throws std::runtime_error if the write fails.
+    void inject(const EventPacket& pkt);
+
+private:
+    int fd_ = -1;
+    std::vector<input_event> records_;      // reused by inject()
+};
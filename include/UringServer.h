@@ -0,0 +1,131 @@
+#pragma once
+#include "Channels.h"
+#include "EventPacket.h"
+#include "IoUring.h"
+#include "Protocol.h"
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <linux/input.h>
+#include <memory>
+#include <openssl/ssl.h>
+#include <vector>
+
+// The server's receive and inject path on io_uring instead of Asio (server
+// --backend uring). Linux only.
+//
+// It takes over a connection once TLS and the protocol version have been
+// negotiated: the socket and the OpenSSL session leave the Asio stream, and
+// TLS runs on memory BIOs from then on. One thread loops on a single ring:
+//
+//   - a multishot receive stays armed on the socket and fills buffers the
+//     kernel picks from a provided buffer group, so no buffer waits on an
+//     idle connection and no receive has to be re-submitted per read;
+//   - every completion's ciphertext is fed to the read BIO, and once the
+//     batch is drained SSL_read decrypts whatever whole records arrived;
+//   - input packets become uinput records (see UinputDevice), and the
+//     records of the whole batch go out as a single write on the same ring.
+//
+// That write is submitted by the io_uring_enter that also waits for the next
+// receives, so a burst of packets costs one syscall rather than a read, a
+// wakeup and a write per event.
+//
+// Heartbeats follow Session::setHeartbeat, and send() answers the client on
+// the same connection (a SwitchBack, say). Only the input channel is served:
+// clipboard and other lower priority traffic is read and dropped, and motion
+// is injected as it arrives (no jitter buffer).
+class UringServer {
+public:
+    using Stream = boost::asio::ssl::stream<boost::asio::ip::tcp::socket>;
+    using PacketHandler = std::function<void(const EventPacket&)>;
+
+    // `stream` must have completed the handshake and negotiateServer(), whose
+    // `version` and `leftover` are passed on; it is destroyed here.
+    // Throws std::runtime_error if io_uring is unavailable.
+    UringServer(std::unique_ptr<Stream> stream, uint16_t version, std::vector<uint8_t> leftover = {});
+    ~UringServer();
+
+    UringServer(const UringServer&) = delete;
+    UringServer& operator=(const UringServer&) = delete;
+
+    // Where injected records are written: a UinputDevice's fd, or anything
+    // else that takes input_event writes. -1 (the default) injects nothing.
+    void setInjectFd(int fd) { injectFd_ = fd; }
+
+    // As Session::setHeartbeat; ignored for v1 peers.
+    void setHeartbeat(std::chrono::milliseconds deadline,
+                      std::chrono::milliseconds interval = std::chrono::milliseconds(0));
+
+    // Serves the connection on this thread until the peer leaves, falls
+    // silent past the deadline, sends a malformed frame, or stop() is called
+    // (operation_aborted). `onPacket` sees every input packet as its records
+    // are queued for injection.
+    boost::system::error_code run(PacketHandler onPacket);
+
+    // Sends `pkt` to the client with the next batch. Only from `onPacket`,
+    // on the thread in run().
+    void send(const EventPacket& pkt);
+
+    // Makes run() return. Thread-safe.
+    void stop();
+
+    struct Counters {
+        uint64_t enterCalls = 0;    // io_uring_enter, i.e. syscalls while serving
+        uint64_t receives = 0;      // receive completions
+        uint64_t packets = 0;       // input packets injected
+        uint64_t injectWrites = 0;  // batched record writes
+    };
+    // Read after run() has returned.
+    const Counters& counters() const { return counters_; }
+
+private:
+    enum Op : uint64_t { Receive = 1, Send, Inject, Wake };
+
+    void armReceive();
+    void armWake();
+    // Decrypts and decodes whatever whole records have arrived.
+    bool decrypt(boost::system::error_code& ec);
+    void flushInjections();
+    void flushSends();
+    void queueHeartbeat();
+    // Encrypts one packet onto sendQueue_
+    void queuePacket(const EventPacket& pkt);
+    // Runs once every operation still in the kernel has completed.
+    void drainInFlight();
+
+    int fd_ = -1;
+    SSL* ssl_ = nullptr;
+    BIO* in_ = nullptr;     // ciphertext received, owned by ssl_
+    BIO* out_ = nullptr;    // ciphertext to send, owned by ssl_
+    uint16_t version_;
+    std::vector<uint8_t> leftover_;
+    int injectFd_ = -1;
+    int wake_ = -1;
+    uint64_t wakeValue_ = 0;
+
+    std::unique_ptr<IoUring> ring_;
+    std::unique_ptr<IoUring::BufferGroup> buffers_;
+    PacketHandler onPacket_;
+    FrameDecoder decoder_;
+    FrameDecoder::Handler onFrame_;     // feeds decoded input to pending_
+    std::vector<uint8_t> plain_;
+
+    std::vector<input_event> pending_;      // records waiting for the next write
+    std::vector<input_event> injecting_;    // records of the write in flight
+    std::vector<uint8_t> sendQueue_;
+    std::vector<uint8_t> sending_;          // bytes of the send in flight
+    size_t sent_ = 0;
+    bool receiveArmed_ = false;
+    bool wakeArmed_ = false;
+    bool sendInFlight_ = false;
+    bool injectInFlight_ = false;
+
+    std::chrono::steady_clock::duration deadline_{};
+    std::chrono::steady_clock::duration heartbeatInterval_{};
+    std::chrono::steady_clock::time_point lastRead_;
+    std::chrono::steady_clock::time_point lastWrite_;
+
+    Counters counters_;
+};
@@ -0,0 +1,26 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// A microsecond clock that only moves when told to. Simulations stamp events
+// and drive time-based stages (JitterBuffer, deadlines) from it instead of
+// the steady clock, so a run schedules everything identically however fast
+// the machine is. Any thread may read it; one thread advances it.
+class VirtualClock {
+public:
+    explicit VirtualClock(uint64_t startUs = 0) : nowUs_(startUs) {}
+
+    uint64_t nowUs() const { return nowUs_.load(std::memory_order_acquire); }
+
+    void advance(uint64_t us) { nowUs_.fetch_add(us, std::memory_order_acq_rel); }
+
+    // Moves forward to `us`; never backwards.
+    void advanceTo(uint64_t us) {
+        if (us > nowUs()) {
+            nowUs_.store(us, std::memory_order_release);
+        }
+    }
+
+private:
+    std::atomic<uint64_t> nowUs_;
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include "EventPacket.h"
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Protocol v2 message layouts.
+//
+// Every message is a fixed-size, naturally aligned little-endian struct that
+// starts with a MsgHeader. Message sizes are multiples of 8, so consecutive
+// messages in a channel stream stay 8-byte aligned. Decoding is a bounds check
+// plus a memcpy into the struct (byte swaps compile away on little-endian
+// hosts). Only ClipboardChunk and TextInput carry trailing bytes after their
+// structs.
+namespace wire {
+
+struct MsgHeader {
+    uint8_t type;           // SamenessEventType
+    uint8_t reserved[3];
+    uint32_t size;          // whole message including header and padding
+    uint64_t timestamp;     // capture time, microseconds
+};
+
+struct KeyMsg {
+    MsgHeader header;
+    uint32_t keycode;
+    uint32_t reserved;
+};
+
+struct MouseMoveMsg {
+    MsgHeader header;
+    int32_t x;
+    int32_t y;
+};
+
+struct MouseButtonMsg {
+    MsgHeader header;
+    int32_t x;
+    int32_t y;
+    uint8_t button;
+    uint8_t reserved[7];
+};
+
+struct ClipboardOfferMsg {
+    MsgHeader header;
+    uint8_t digest[32];
+    uint64_t size;
+};
+
+struct ClipboardRequestMsg {
+    MsgHeader header;
+    uint8_t digest[32];
+};
+
+// Followed by `length` content bytes, zero-padded to a multiple of 8.
+struct ClipboardChunkMsg {
+    MsgHeader header;
+    uint8_t digest[32];
+    uint64_t offset;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+struct HeartbeatMsg {
+    MsgHeader header;
+};
+
+// Followed by `length` UTF-8 bytes, zero-padded to a multiple of 8.
+struct TextInputMsg {
+    MsgHeader header;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+struct SwitchBackMsg {
+    MsgHeader header;
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+static_assert(sizeof(MsgHeader) == 16, "v2 layout");
+static_assert(sizeof(KeyMsg) == 24, "v2 layout");
+static_assert(sizeof(MouseMoveMsg) == 24, "v2 layout");
+static_assert(sizeof(MouseButtonMsg) == 32, "v2 layout");
+static_assert(sizeof(ClipboardOfferMsg) == 56, "v2 layout");
+static_assert(sizeof(ClipboardRequestMsg) == 48, "v2 layout");
+static_assert(sizeof(ClipboardChunkMsg) == 64, "v2 layout");
+static_assert(sizeof(HeartbeatMsg) == 16, "v2 layout");
+static_assert(sizeof(TextInputMsg) == 24, "v2 layout");
+static_assert(sizeof(SwitchBackMsg) == 32, "v2 layout");
+static_assert(std::is_trivially_copyable<ClipboardChunkMsg>::value, "v2 messages are loaded with memcpy");
+
+// Upper bound on any v2 message; larger sizes are rejected before the payload is read.
+constexpr size_t kMaxMessageSize = 64 * 1024;
+
+// Bounds-checked load of a message struct from the front of `data`.
+template <typename T>
+bool load(const uint8_t* data, size_t len, T& out);
+
+// Appends the v2 encoding of `pkt` to `out`.
+void encode(const EventPacket& pkt, std::vector<uint8_t>& out);
+
+enum class DecodeStatus { Ok, NeedMore, Malformed };
+
+// Decodes one message from the front of `data` into the canonical EventPacket form.
+DecodeStatus decode(const uint8_t* data, size_t len, EventPacket& out, size_t& consumed);
+
+} // namespace wire
@@ -0,0 +1,196 @@
+#include "Channels.h"
+#include "Protocol.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    // More than any v1 header or padded v2 message struct adds to a payload
+    constexpr size_t kMaxEncodingOverhead = 80;
+}
+
+Channel channelFor(SamenessEventType type) {
+    switch (type) {
+        case SamenessEventType::ClipboardOffer:
+        case SamenessEventType::ClipboardRequest:
+        case SamenessEventType::Heartbeat:
+        case SamenessEventType::SwitchBack:
+            return Channel::Control;
+        case SamenessEventType::ClipboardChunk:
+            return Channel::Clipboard;
+        default:
+            return Channel::Input;
+    }
+}
+
+SharedFrame makeFrame(Channel channel, const EventPacket& pkt, uint16_t version) {
+    auto frame = std::make_shared<std::vector<uint8_t>>();
+    // Room for the header of either version, so encoding never reallocates
+    frame->reserve(kFrameHeaderSize + kMaxEncodingOverhead + pkt.payload.size());
+    if (version < kProtocolV2) {
+        encodePacket(pkt, version, *frame);
+        return frame;
+    }
+    frame->resize(kFrameHeaderSize);
+    encodePacket(pkt, version, *frame);
+    size_t n = frame->size() - kFrameHeaderSize;
+    if (n > kMaxFramePayload) {
+        throw std::runtime_error("packet does not fit in one frame");
+    }
+    (*frame)[0] = static_cast<uint8_t>(channel);
+    (*frame)[1] = static_cast<uint8_t>((n >> 8) & 0xFF);
+    (*frame)[2] = static_cast<uint8_t>(n & 0xFF);
+    return frame;
+}
+
+// ---------------------------------------------------------------------------
+//  ChannelScheduler
+// ---------------------------------------------------------------------------
+
+static_assert(kChannelCount == 4, "one initializer per channel below");
+
+ChannelScheduler::ChannelScheduler(uint16_t version, std::pmr::memory_resource* memory)
+    : version_(version)
+    , queues_{{Queue(memory), Queue(memory), Queue(memory), Queue(memory)}} {
+    queues_[static_cast<size_t>(Channel::Input)].quantum = kInputQuantum;
+    queues_[static_cast<size_t>(Channel::Control)].quantum = kControlQuantum;
+    queues_[static_cast<size_t>(Channel::Clipboard)].quantum = kBulkQuantum;
+    queues_[static_cast<size_t>(Channel::Bulk)].quantum = kBulkQuantum;
+}
+
+void ChannelScheduler::setQuantum(Channel channel, size_t maxFramePayload) {
+    queues_[static_cast<size_t>(channel)].quantum = std::max<size_t>(1, std::min(maxFramePayload, kMaxFramePayload));
+}
+
+void ChannelScheduler::setSource(Channel channel, Source source) {
+    queues_[static_cast<size_t>(channel)].source = std::move(source);
+}
+
+void ChannelScheduler::enqueue(Channel channel, const std::vector<uint8_t>& bytes) {
+    Queue& q = queues_[static_cast<size_t>(channel)];
+    q.bytes.insert(q.bytes.end(), bytes.begin(), bytes.end());
+}
+
+size_t ChannelScheduler::pending(Channel channel) const {
+    return queues_[static_cast<size_t>(channel)].size();
+}
+
+bool ChannelScheduler::refill(Queue& q) {
+    if (q.size() > 0) {
+        return true;
+    }
+    if (!q.source || !q.source(sourcePacket_)) {
+        return false;
+    }
+    encoded_.clear();
+    encodePacket(sourcePacket_, version_, encoded_);
+    q.bytes.assign(encoded_.begin(), encoded_.end());
+    q.head = 0;
+    return true;
+}
+
+void ChannelScheduler::emitFrame(size_t index, std::pmr::vector<uint8_t>& out) {
+    Queue& q = queues_[index];
+    // v1 has no frames to resume a cut packet in: a queue holds whole
+    // packets, and goes out whole
+    size_t n = version_ < kProtocolV2 ? q.size() : std::min(q.size(), q.quantum);
+    if (version_ >= kProtocolV2) {
+        out.push_back(static_cast<uint8_t>(index));
+        out.push_back(static_cast<uint8_t>((n >> 8) & 0xFF));
+        out.push_back(static_cast<uint8_t>(n & 0xFF));
+    }
+    out.insert(out.end(), q.bytes.begin() + q.head, q.bytes.begin() + q.head + n);
+    q.head += n;
+    if (q.head == q.bytes.size()) {
+        q.bytes.clear();
+        q.head = 0;
+    }
+}
+
+bool ChannelScheduler::nextWrite(std::pmr::vector<uint8_t>& out) {
+    out.clear();
+    Queue& input = queues_[static_cast<size_t>(Channel::Input)];
+    while (input.size() > 0) {
+        emitFrame(static_cast<size_t>(Channel::Input), out);
+    }
+    for (size_t i = static_cast<size_t>(Channel::Input) + 1; i < kChannelCount; ++i) {
+        if (refill(queues_[i])) {
+            emitFrame(i, out);
+            break;
+        }
+    }
+    return !out.empty();
+}
+
+// ---------------------------------------------------------------------------
+//  FrameDecoder
+// ---------------------------------------------------------------------------
+
+FrameDecoder::FrameDecoder(uint16_t version, std::pmr::memory_resource* memory)
+    : version_(version)
+    , pending_(memory)
+    , streams_{{std::pmr::vector<uint8_t>(memory), std::pmr::vector<uint8_t>(memory),
+                std::pmr::vector<uint8_t>(memory), std::pmr::vector<uint8_t>(memory)}} {
+}
+
+bool FrameDecoder::feed(const uint8_t* data, size_t len, const Handler& handler) {
+    if (version_ < kProtocolV2) {
+        return feedChannel(0, data, len, handler);
+    }
+    // Only a frame left over from the last call makes us copy
+    bool buffered = !pending_.empty();
+    if (buffered) {
+        pending_.insert(pending_.end(), data, data + len);
+        data = pending_.data();
+        len = pending_.size();
+    }
+
+    size_t offset = 0;
+    while (len - offset >= kFrameHeaderSize) {
+        const uint8_t* frame = data + offset;
+        size_t channel = frame[0];
+        size_t n = (static_cast<size_t>(frame[1]) << 8) | frame[2];
+        if (channel >= kChannelCount) {
+            return false;
+        }
+        if (len - offset - kFrameHeaderSize < n) {
+            break;
+        }
+        offset += kFrameHeaderSize + n;
+        if (!feedChannel(channel, frame + kFrameHeaderSize, n, handler)) {
+            return false;
+        }
+    }
+    if (buffered) {
+        pending_.erase(pending_.begin(), pending_.begin() + offset);
+    } else {
+        pending_.assign(data + offset, data + len);
+    }
+    return true;
+}
+
+bool FrameDecoder::feedChannel(size_t channel, const uint8_t* data, size_t len, const Handler& handler) {
+    std::pmr::vector<uint8_t>& stream = streams_[channel];
+    bool buffered = !stream.empty();
+    if (buffered) {
+        stream.insert(stream.end(), data, data + len);
+        data = stream.data();
+        len = stream.size();
+    }
+
+    // Two captures at most, so the callback stays inside std::function
+    size_t consumed = 0;
+    bool ok = version_ < kProtocolV2
+        ? decodeStream(version_, data, len, consumed,
+              [&handler](const EventPacket& pkt) { handler(channelFor(pkt.type), pkt); }, scratch_)
+        : decodeStream(version_, data, len, consumed,
+              [&](const EventPacket& pkt) { handler(static_cast<Channel>(channel), pkt); }, scratch_);
+    if (!ok) {
+        return false;
+    }
+    if (buffered) {
+        stream.erase(stream.begin(), stream.begin() + consumed);
+    } else {
+        stream.assign(data + consumed, data + len);
+    }
+    return true;
+}
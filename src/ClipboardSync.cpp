@@ -0,0 +1,271 @@
+#include "ClipboardSync.h"
+#include <openssl/sha.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    uint64_t nowMicroseconds() {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Clipboard payloads use the same big-endian integers as the packet header.
+    void putU64(std::vector<uint8_t>& out, uint64_t v) {
+        for (int i = 7; i >= 0; --i) {
+            out.push_back(static_cast<uint8_t>((v >> (i*8)) & 0xFF));
+        }
+    }
+
+    uint64_t getU64(const uint8_t* p) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+
+    EventPacket makePacket(SamenessEventType type, std::vector<uint8_t> payload) {
+        EventPacket pkt;
+        pkt.type = type;
+        pkt.timestamp = nowMicroseconds();
+        pkt.payloadSize = static_cast<uint32_t>(payload.size());
+        pkt.payload = std::move(payload);
+        return pkt;
+    }
+}
+
+// ---------------------------------------------------------------------------
+//  RecentDigests
+// ---------------------------------------------------------------------------
+
+bool ClipboardSync::RecentDigests::touch(const Digest& d) {
+    auto end = entries_.begin() + count_;
+    auto it = std::find(entries_.begin(), end, d);
+    bool found = it != end;
+    if (!found) {
+        if (count_ < entries_.size()) {
+            ++count_;
+        }
+        it = entries_.begin() + count_ - 1;  // overwrite the oldest slot
+    }
+    std::rotate(entries_.begin(), it, it + 1);
+    entries_[0] = d;
+    return found;
+}
+
+bool ClipboardSync::RecentDigests::contains(const Digest& d) const {
+    auto end = entries_.begin() + count_;
+    return std::find(entries_.begin(), end, d) != end;
+}
+
+// ---------------------------------------------------------------------------
+//  ClipboardSync
+// ---------------------------------------------------------------------------
+
+ClipboardSync::Digest ClipboardSync::digestOf(const uint8_t* data, size_t len) {
+    Digest d;
+    SHA256(data, len, d.data());
+    return d;
+}
+
+void ClipboardSync::setOfferHandler(OfferHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    onOffer_ = std::move(handler);
+}
+
+void ClipboardSync::setContentHandler(ContentHandler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    onContent_ = std::move(handler);
+}
+
+bool ClipboardSync::offerLocal(std::vector<uint8_t> content, EventPacket& offer) {
+    uint64_t size = content.size();
+    if (size > kMaxContentSize) {
+        return false;
+    }
+    Digest d = digestOf(content.data(), content.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (localCurrent_ && localContent_ && d == localDigest_) {
+        return false;  // unchanged since we offered it
+    }
+    localDigest_ = d;
+    localContent_ = std::make_shared<const std::vector<uint8_t>>(std::move(content));
+    sending_ = false;  // a newer clipboard supersedes any transfer in progress
+    sendOffset_ = 0;
+    if (remoteOffered_ && d == remoteDigest_ && recent_.contains(d)) {
+        // The peer's current clipboard, fetched and now on ours: it has it
+        localCurrent_ = false;
+        return false;
+    }
+    // Ours is now the newer clipboard; the peer's last offer is stale
+    localCurrent_ = true;
+    remoteOffered_ = false;
+    receiving_ = false;
+    incoming_.clear();
+
+    std::vector<uint8_t> payload(d.begin(), d.end());
+    putU64(payload, size);
+    offer = makePacket(SamenessEventType::ClipboardOffer, std::move(payload));
+    return true;
+}
+
+bool ClipboardSync::requestRemote(EventPacket& request) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!remoteOffered_) {
+        return false;
+    }
+    receiving_ = true;
+    incoming_.clear();
+    // Whole, so a large transfer never reallocates on the io thread; the
+    // offer was only taken if it is within kMaxContentSize
+    incoming_.reserve(static_cast<size_t>(std::min(remoteSize_, kMaxContentSize)));
+    request = makePacket(SamenessEventType::ClipboardRequest,
+                         std::vector<uint8_t>(remoteDigest_.begin(), remoteDigest_.end()));
+    return true;
+}
+
+bool ClipboardSync::handlePacket(const EventPacket& pkt) {
+    switch (pkt.type) {
+        case SamenessEventType::ClipboardOffer:
+            handleOffer(pkt);
+            return true;
+        case SamenessEventType::ClipboardRequest:
+            handleRequest(pkt);
+            return true;
+        case SamenessEventType::ClipboardChunk:
+            handleChunk(pkt);
+            return true;
+        default:
+            return false;
+    }
+}
+
+void ClipboardSync::handleOffer(const EventPacket& pkt) {
+    if (pkt.payload.size() != sizeof(Digest) + sizeof(uint64_t)) {
+        std::cerr << "Invalid clipboard offer payload size" << std::endl;
+        return;
+    }
+    Digest d;
+    std::memcpy(d.data(), pkt.payload.data(), d.size());
+    uint64_t size = getU64(pkt.payload.data() + d.size());
+    if (size > kMaxContentSize) {
+        std::cerr << "Ignoring clipboard offer of " << size << " bytes (limit " << kMaxContentSize << ")" << std::endl;
+        return;
+    }
+
+    OfferHandler handler;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (localCurrent_ && localContent_ && d == localDigest_) {
+            // Our own offer coming back: the peer fetched it and offers it in turn.
+            return;
+        }
+        remoteDigest_ = d;
+        remoteSize_ = size;
+        remoteOffered_ = true;
+        receiving_ = false;
+        incoming_.clear();
+        localCurrent_ = false;
+        handler = onOffer_;
+    }
+    if (handler) {
+        handler(d, size);
+    }
+}
+
+void ClipboardSync::handleRequest(const EventPacket& pkt) {
+    if (pkt.payload.size() != sizeof(Digest)) {
+        std::cerr << "Invalid clipboard request payload size" << std::endl;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!localContent_ || std::memcmp(pkt.payload.data(), localDigest_.data(), localDigest_.size()) != 0) {
+        // Stale request for content that is no longer on our clipboard.
+        return;
+    }
+    sending_ = true;
+    sendOffset_ = 0;
+}
+
+void ClipboardSync::handleChunk(const EventPacket& pkt) {
+    if (pkt.payload.size() < sizeof(Digest) + sizeof(uint64_t)) {
+        std::cerr << "Invalid clipboard chunk payload size" << std::endl;
+        return;
+    }
+    const uint8_t* p = pkt.payload.data();
+    uint64_t offset = getU64(p + sizeof(Digest));
+    const uint8_t* bytes = p + sizeof(Digest) + sizeof(uint64_t);
+    size_t n = pkt.payload.size() - sizeof(Digest) - sizeof(uint64_t);
+
+    std::vector<uint8_t> complete;
+    ContentHandler handler;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!receiving_ || std::memcmp(p, remoteDigest_.data(), remoteDigest_.size()) != 0) {
+            return;
+        }
+        if (offset != incoming_.size() || offset + n > remoteSize_) {
+            std::cerr << "Clipboard chunk out of order, dropping transfer" << std::endl;
+            receiving_ = false;
+            incoming_.clear();
+            return;
+        }
+        incoming_.insert(incoming_.end(), bytes, bytes + n);
+        if (incoming_.size() < remoteSize_) {
+            return;
+        }
+        receiving_ = false;
+        if (digestOf(incoming_.data(), incoming_.size()) != remoteDigest_) {
+            std::cerr << "Clipboard content does not match its digest" << std::endl;
+            incoming_.clear();
+            return;
+        }
+        recent_.touch(remoteDigest_);
+        complete.swap(incoming_);
+        handler = onContent_;
+    }
+    if (handler) {
+        handler(complete);
+    }
+}
+
+void ClipboardSync::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    recent_ = RecentDigests();
+    localCurrent_ = false;
+    sending_ = false;
+    sendOffset_ = 0;
+    remoteOffered_ = false;
+    receiving_ = false;
+    incoming_.clear();
+}
+
+bool ClipboardSync::nextChunk(EventPacket& chunk) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!sending_) {
+        return false;
+    }
+    const std::vector<uint8_t>& content = *localContent_;
+    size_t n = std::min(kChunkSize, content.size() - sendOffset_);
+
+    std::vector<uint8_t> payload;
+    payload.reserve(sizeof(Digest) + sizeof(uint64_t) + n);
+    payload.insert(payload.end(), localDigest_.begin(), localDigest_.end());
+    putU64(payload, sendOffset_);
+    payload.insert(payload.end(), content.begin() + sendOffset_, content.begin() + sendOffset_ + n);
+    chunk = makePacket(SamenessEventType::ClipboardChunk, std::move(payload));
+
+    sendOffset_ += n;
+    if (sendOffset_ >= content.size()) {
+        sending_ = false;
+    }
+    return true;
+}
+
+bool ClipboardSync::hasPendingChunks() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sending_;
+}
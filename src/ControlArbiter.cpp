@@ -0,0 +1,181 @@
+#include "ControlArbiter.h"
+#include "ByteOrder.h"
+#include <stdexcept>
+
+ControlArbiter::ControlArbiter()
+    : ControlArbiter(Config{}) {}
+
+ControlArbiter::ControlArbiter(const Config& config)
+    : config_(config)
+    , controllers_(new Controller[kMaxControllers]) {
+    for (size_t i = 0; i < kMaxControllers; ++i) {
+        for (std::atomic<uint64_t>& word : controllers_[i].keys) {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+ControlArbiter::~ControlArbiter() = default;
+
+ControlArbiter::Policy ControlArbiter::parsePolicy(const std::string& name) {
+    if (name == "last-active") {
+        return Policy::LastActive;
+    }
+    if (name == "lock") {
+        return Policy::Lock;
+    }
+    throw std::invalid_argument("unknown arbitration policy: " + name);
+}
+
+const char* ControlArbiter::policyName(Policy policy) {
+    return policy == Policy::Lock ? "lock" : "last-active";
+}
+
+size_t ControlArbiter::join() {
+    for (size_t i = 0; i < kMaxControllers; ++i) {
+        bool free = false;
+        if (controllers_[i].joined.compare_exchange_strong(free, true)) {
+            return i;
+        }
+    }
+    return kNone;
+}
+
+void ControlArbiter::leave(size_t id, uint64_t nowUs) {
+    uint64_t word = control_.load();
+    while (ownerOf(word) == id && !control_.compare_exchange_weak(word, 0)) {
+    }
+    releaseAll(id, nowUs);
+    controllers_[id].joined.store(false);
+}
+
+size_t ControlArbiter::owner() const {
+    return ownerOf(control_.load(std::memory_order_relaxed));
+}
+
+bool ControlArbiter::admit(size_t id, const EventPacket& pkt, uint64_t nowUs) {
+    switch (pkt.type) {
+        case SamenessEventType::KeyPress:
+        case SamenessEventType::KeyRelease:
+        case SamenessEventType::MouseMove:
+        case SamenessEventType::MouseButtonPress:
+        case SamenessEventType::MouseButtonRelease:
+        case SamenessEventType::TextInput:
+            break;
+        default:
+            return true;
+    }
+    if (!claim(id, nowUs)) {
+        return false;
+    }
+    Controller& c = controllers_[id];
+    uint32_t keycode = 0;
+    uint8_t button = 0;
+    int32_t x = 0;
+    int32_t y = 0;
+    switch (pkt.type) {
+        case SamenessEventType::KeyPress:
+        case SamenessEventType::KeyRelease: {
+            if (!readKey(pkt, keycode) || keycode > kMaxKeycode) {
+                return true;
+            }
+            std::atomic<uint64_t>& word = c.keys[keycode / 64];
+            uint64_t bit = 1ull << (keycode % 64);
+            if (pkt.type == SamenessEventType::KeyRelease) {
+                word.fetch_and(~bit);
+                return true;
+            }
+            return hold(id, word, bit);
+        }
+        case SamenessEventType::MouseButtonPress:
+        case SamenessEventType::MouseButtonRelease: {
+            if (!readMouseButton(pkt, button, x, y)) {
+                return true;
+            }
+            position_.store((static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y),
+                            std::memory_order_relaxed);
+            if (button >= 32) {
+                return true;
+            }
+            uint32_t bit = 1u << button;
+            if (pkt.type == SamenessEventType::MouseButtonRelease) {
+                c.buttons.fetch_and(~bit);
+                return true;
+            }
+            return hold(id, c.buttons, bit);
+        }
+        case SamenessEventType::MouseMove:
+            if (readMouseMove(pkt, x, y)) {
+                position_.store((static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y),
+                                std::memory_order_relaxed);
+            }
+            return true;
+        default:
+            return true;
+    }
+}
+
+bool ControlArbiter::claim(size_t id, uint64_t nowUs) {
+    nowUs &= kStampMask;
+    uint64_t word = control_.load();
+    for (;;) {
+        size_t current = ownerOf(word);
+        uint64_t stamp = word & kStampMask;
+        uint64_t quietUs = nowUs > stamp ? nowUs - stamp : 0;
+        if (current == id) {
+            if (quietUs < kRefreshUs) {
+                return true;
+            }
+        } else if (current != kNone) {
+            uint64_t idleUs = static_cast<uint64_t>(config_.idle.count()) * 1000;
+            if (config_.policy == Policy::Lock || quietUs < idleUs) {
+                return false;
+            }
+        }
+        if (control_.compare_exchange_weak(word, pack(id, nowUs))) {
+            if (current != kNone && current != id) {
+                takeovers_.fetch_add(1, std::memory_order_relaxed);
+                releaseAll(current, nowUs);
+            }
+            return true;
+        }
+    }
+}
+
+template <typename Word>
+bool ControlArbiter::hold(size_t id, std::atomic<Word>& word, Word bit) {
+    word.fetch_or(bit);
+    if (ownerOf(control_.load()) == id) {
+        // Any takeover from here on drains the bit and releases the press
+        return true;
+    }
+    // Control moved on since claim(): take the press back, unless the new
+    // owner has already drained it, in which case its release is on the way
+    return (word.fetch_and(static_cast<Word>(~bit)) & bit) == 0;
+}
+
+void ControlArbiter::releaseAll(size_t id, uint64_t nowUs) {
+    Controller& c = controllers_[id];
+    uint64_t position = position_.load(std::memory_order_relaxed);
+    int32_t x = static_cast<int32_t>(position >> 32);
+    int32_t y = static_cast<int32_t>(position & 0xFFFFFFFF);
+    uint32_t buttons = c.buttons.exchange(0);
+    for (uint8_t button = 0; buttons != 0; ++button, buttons >>= 1) {
+        if ((buttons & 1) != 0 && onRelease_) {
+            onRelease_(makeMouseButtonPacket(SamenessEventType::MouseButtonRelease, nowUs, button, x, y));
+        }
+    }
+    for (size_t w = 0; w < kKeyWords; ++w) {
+        if (c.keys[w].load() == 0) {
+            continue;
+        }
+        uint64_t keys = c.keys[w].exchange(0);
+        while (keys != 0) {
+            uint32_t keycode = static_cast<uint32_t>(w * 64 + byteorder::lowestBit(keys));
+            keys &= keys - 1;
+            if (onRelease_) {
+                onRelease_(makeKeyPacket(SamenessEventType::KeyRelease, nowUs, keycode));
+            }
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#include "CountingResource.h"
+
+CountingResource::CountingResource(std::pmr::memory_resource* upstream)
+    : upstream_(upstream) {
+}
+
+void* CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    void* p = upstream_->allocate(bytes, alignment);
+    allocations_.store(allocations() + 1, std::memory_order_relaxed);
+    size_t inUse = bytesInUse() + bytes;
+    bytesInUse_.store(inUse, std::memory_order_relaxed);
+    if (inUse > peakBytes()) {
+        peakBytes_.store(inUse, std::memory_order_relaxed);
+    }
+    return p;
+}
+
+void CountingResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    upstream_->deallocate(p, bytes, alignment);
+    bytesInUse_.store(bytesInUse() - bytes, std::memory_order_relaxed);
+}
+
+bool CountingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
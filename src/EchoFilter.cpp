@@ -0,0 +1,222 @@
+#include "EchoFilter.h"
+#include "TextInput.h"
+#include <cstring>
+#include <iostream>
+#include <uiohook.h>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr uint32_t kMagic = 0x53454348;    // "SECH"
+    constexpr uint32_t kVersion = 1;
+
+    // Slot word: used, taken, 38-bit signature, 24-bit millisecond stamp.
+    // Zero is an unused slot, which is what fresh shared memory holds.
+    constexpr uint64_t kUsed = 1ull << 63;
+    constexpr uint64_t kTaken = 1ull << 62;
+    constexpr int kStampBits = 24;
+    constexpr uint64_t kStampMask = (1ull << kStampBits) - 1;
+    constexpr uint64_t kSignatureMask = (1ull << 38) - 1;
+
+    uint64_t signatureOf(SamenessEventType type, uint32_t code) {
+        return ((static_cast<uint64_t>(type) << 30) | (code & 0x3FFFFFFF)) & kSignatureMask;
+    }
+
+    // Key, button or motion signature of `pkt`; false for anything else
+    bool signatureOf(const EventPacket& pkt, uint64_t& signature) {
+        uint32_t keycode = 0;
+        uint8_t button = 0;
+        int32_t x = 0;
+        int32_t y = 0;
+        switch (pkt.type) {
+            case SamenessEventType::KeyPress:
+            case SamenessEventType::KeyRelease:
+                if (!readKey(pkt, keycode)) {
+                    return false;
+                }
+                signature = signatureOf(pkt.type, keycode);
+                return true;
+            case SamenessEventType::MouseMove:
+                signature = signatureOf(pkt.type, 0);
+                return true;
+            case SamenessEventType::MouseButtonPress:
+            case SamenessEventType::MouseButtonRelease:
+                if (!readMouseButton(pkt, button, x, y)) {
+                    return false;
+                }
+                signature = signatureOf(pkt.type, button);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+#if defined(__APPLE__) || defined(_WIN32)
+    // These injectors post text as characters, which capture does not see
+    // as key strokes
+    constexpr bool kTextAsKeys = false;
+#else
+    // The uiohook and uinput injectors type text as US-layout key strokes
+    constexpr bool kTextAsKeys = true;
+#endif
+
+    // Maps a Ring-sized block of shared memory `name`, zeroed if new;
+    // nullptr (after saying why) if it cannot
+    void* mapRing(const std::string& name) {
+#if defined(_WIN32)
+        // A named mapping backed by the paging file, in this session's
+        // namespace; the views keep it alive while either process runs
+        std::string local = "Local\\" + (name.rfind('/', 0) == 0 ? name.substr(1) : name);
+        HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+                                            static_cast<DWORD>(sizeof(EchoFilter::Ring)), local.c_str());
+        if (mapping == nullptr) {
+            std::cerr << "Echo filter: CreateFileMapping(" << local << ") failed: " << GetLastError() << std::endl;
+            return nullptr;
+        }
+        void* mem = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(EchoFilter::Ring));
+        DWORD error = GetLastError();
+        CloseHandle(mapping);
+        if (mem == nullptr) {
+            std::cerr << "Echo filter: MapViewOfFile failed: " << error << std::endl;
+        }
+        return mem;
+#else
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+        if (fd < 0) {
+            std::cerr << "Echo filter: shm_open(" << name << ") failed: " << std::strerror(errno) << std::endl;
+            return nullptr;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) != 0 ||
+            (static_cast<size_t>(st.st_size) < sizeof(EchoFilter::Ring) && ftruncate(fd, sizeof(EchoFilter::Ring)) != 0)) {
+            std::cerr << "Echo filter: cannot size " << name << ": " << std::strerror(errno) << std::endl;
+            ::close(fd);
+            return nullptr;
+        }
+        void* mem = mmap(nullptr, sizeof(EchoFilter::Ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mem == MAP_FAILED) {
+            std::cerr << "Echo filter: mmap failed: " << std::strerror(errno) << std::endl;
+            return nullptr;
+        }
+        return mem;
+#endif
+    }
+
+    void unmapRing(void* mem) {
+#if defined(_WIN32)
+        UnmapViewOfFile(mem);
+#else
+        munmap(mem, sizeof(EchoFilter::Ring));
+#endif
+    }
+}
+
+EchoFilter::EchoFilter(uint32_t windowMs)
+    : windowMs_(windowMs), local_(std::make_unique<Ring>()), ring_(local_.get()) {
+    ring_->magic = kMagic;
+    ring_->version = kVersion;
+    ring_->next.store(0, std::memory_order_relaxed);
+    for (auto& slot : ring_->slots) {
+        slot.store(0, std::memory_order_relaxed);
+    }
+}
+
+EchoFilter::~EchoFilter() {
+    if (shared_) {
+        unmapRing(ring_);
+    }
+}
+
+bool EchoFilter::attachShared(const std::string& name) {
+    void* mem = mapRing(name);
+    if (mem == nullptr) {
+        return false;
+    }
+    // Fresh pages are an empty ring; both processes writing the header is harmless
+    Ring* ring = static_cast<Ring*>(mem);
+    if (ring->magic == 0) {
+        ring->magic = kMagic;
+        ring->version = kVersion;
+    }
+    if (ring->magic != kMagic || ring->version != kVersion) {
+        std::cerr << "Echo filter: " << name << " has another layout; remove it and restart" << std::endl;
+        unmapRing(mem);
+        return false;
+    }
+    if (shared_) {
+        unmapRing(ring_);
+    }
+    ring_ = ring;
+    shared_ = true;
+    return true;
+}
+
+void EchoFilter::noteSignature(uint64_t signature, uint64_t nowUs) {
+    uint64_t word = kUsed | (signature << kStampBits) | ((nowUs / 1000) & kStampMask);
+    uint64_t index = ring_->next.fetch_add(1, std::memory_order_relaxed);
+    ring_->slots[index % kSlots].store(word, std::memory_order_release);
+}
+
+void EchoFilter::note(const EventPacket& pkt, uint64_t nowUs) {
+    uint64_t signature = 0;
+    if (signatureOf(pkt, signature)) {
+        noteSignature(signature, nowUs);
+        return;
+    }
+    if (!kTextAsKeys || pkt.type != SamenessEventType::TextInput) {
+        return;
+    }
+    for (uint8_t byte : pkt.payload) {
+        uint16_t keycode = 0;
+        bool shift = false;
+        if (!asciiKey(static_cast<char>(byte), keycode, shift)) {
+            continue;
+        }
+        if (shift) {
+            noteSignature(signatureOf(SamenessEventType::KeyPress, VC_SHIFT_L), nowUs);
+        }
+        noteSignature(signatureOf(SamenessEventType::KeyPress, keycode), nowUs);
+        noteSignature(signatureOf(SamenessEventType::KeyRelease, keycode), nowUs);
+        if (shift) {
+            noteSignature(signatureOf(SamenessEventType::KeyRelease, VC_SHIFT_L), nowUs);
+        }
+    }
+}
+
+bool EchoFilter::takeEcho(const EventPacket& captured, uint64_t nowUs) {
+    uint64_t signature = 0;
+    if (!signatureOf(captured, signature)) {
+        return false;
+    }
+    uint64_t nowMs = nowUs / 1000;
+    uint64_t next = ring_->next.load(std::memory_order_acquire);
+    // Newest first; slots are claimed in time order, so the scan ends at the
+    // first one older than the window
+    for (uint64_t i = 1; i <= kSlots && i <= next; ++i) {
+        std::atomic<uint64_t>& slot = ring_->slots[(next - i) % kSlots];
+        uint64_t word = slot.load(std::memory_order_acquire);
+        if (word == 0 || ((nowMs - word) & kStampMask) > windowMs_) {
+            return false;
+        }
+        if ((word & kTaken) || ((word >> kStampBits) & kSignatureMask) != signature) {
+            continue;
+        }
+        if (slot.compare_exchange_strong(word, word | kTaken, std::memory_order_acq_rel)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+EchoFilter& echoFilter() {
+    static EchoFilter filter;
+    return filter;
+}
@@ -0,0 +1,30 @@
+#include "EdgeWatcher.h"
+#include <algorithm>
+#include <stdexcept>
+
+EdgeWatcher::EdgeWatcher(int width, int height, int zone)
+    : width_(width)
+    , height_(height)
+    , zone_(zone) {
+    if (zone <= 0 || height <= 0 || width <= zone + kRearmPixels) {
+        throw std::invalid_argument("edge zone does not fit the screen");
+    }
+}
+
+bool EdgeWatcher::onMove(int32_t x, int32_t y) {
+    x_ = std::clamp<int32_t>(x, 0, width_ - 1);
+    y_ = std::clamp<int32_t>(y, 0, height_ - 1);
+    if (x_ >= zone_ + kRearmPixels) {
+        armed_ = true;
+        return false;
+    }
+    if (x_ < zone_ && armed_) {
+        armed_ = false;
+        return true;
+    }
+    return false;
+}
+
+EventPacket EdgeWatcher::switchBack(uint64_t timestamp) const {
+    return makeSwitchBackPacket(timestamp, x_, y_, width_, height_);
+}
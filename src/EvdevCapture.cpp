@@ -0,0 +1,294 @@
+#include "EvdevCapture.h"
+#include "EvdevKeys.h"
+#include "UinputDevice.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/input.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+    // input_event records taken per read() call
+    constexpr size_t kReadBatch = 64;
+
+    constexpr uint64_t kWarpPending = 1ull << 63;
+
+    bool hasBit(const unsigned long* bits, size_t bit) {
+        constexpr size_t kBitsPerLong = sizeof(unsigned long) * 8;
+        return (bits[bit / kBitsPerLong] >> (bit % kBitsPerLong)) & 1;
+    }
+
+    // Keyboards and mice: anything with a letter key, a mouse button or relative X.
+    bool isInputDevice(int fd) {
+        constexpr size_t kLongs = (KEY_MAX + 1 + sizeof(unsigned long) * 8 - 1) / (sizeof(unsigned long) * 8);
+        unsigned long keys[kLongs] = {};
+        unsigned long rel[kLongs] = {};
+        bool haveKeys = ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) >= 0;
+        bool haveRel = ioctl(fd, EVIOCGBIT(EV_REL, sizeof(rel)), rel) >= 0;
+        return (haveKeys && (hasBit(keys, KEY_A) || hasBit(keys, BTN_LEFT))) || (haveRel && hasBit(rel, REL_X));
+    }
+}
+
+struct EvdevCapture::Device {
+    int fd;
+    std::string name;
+    bool grabbable;
+    bool dropping = false;      // SYN_DROPPED seen: skip to the next SYN_REPORT
+    int32_t dx = 0;             // motion since the last SYN_REPORT
+    int32_t dy = 0;
+};
+
+EvdevCapture::EvdevCapture(int width, int height)
+    : width_(width)
+    , height_(height)
+    , x_(width / 2)
+    , y_(height / 2) {
+    epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epoll_ < 0 || wake_ < 0) {
+        throw std::runtime_error(std::string("evdev capture setup failed: ") + std::strerror(errno));
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;
+    epoll_ctl(epoll_, EPOLL_CTL_ADD, wake_, &ev);
+}
+
+EvdevCapture::~EvdevCapture() {
+    while (!devices_.empty()) {
+        remove(devices_.back().get());
+    }
+    ::close(wake_);
+    ::close(epoll_);
+}
+
+size_t EvdevCapture::openAll(const std::string& dir) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) {
+        return 0;
+    }
+    std::vector<std::string> paths;
+    while (dirent* entry = readdir(d)) {
+        if (std::strncmp(entry->d_name, "event", 5) == 0) {
+            paths.push_back(dir + "/" + entry->d_name);
+        }
+    }
+    closedir(d);
+    std::sort(paths.begin(), paths.end());
+
+    size_t opened = 0;
+    for (const std::string& path : paths) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        if (!isInputDevice(fd)) {
+            ::close(fd);
+            continue;
+        }
+        char name[256] = "unknown";
+        ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+        // Our own uinput device only carries what a peer sent here
+        if (std::strcmp(name, UinputDevice::kName) == 0) {
+            ::close(fd);
+            continue;
+        }
+        add(fd, path + " (" + name + ")", true);
+        ++opened;
+    }
+    return opened;
+}
+
+void EvdevCapture::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+    }
+    add(fd, path, true);
+}
+
+void EvdevCapture::adopt(int fd, const std::string& name) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    add(fd, name, false);
+}
+
+void EvdevCapture::add(int fd, const std::string& name, bool grabbable) {
+    if (grabbable) {
+        // Kernel timestamps on the steady clock's timebase instead of wall time
+        int clock = CLOCK_MONOTONIC;
+        ioctl(fd, EVIOCSCLOCKID, &clock);
+        if (grabbed_) {
+            ioctl(fd, EVIOCGRAB, 1);
+        }
+    }
+    devices_.push_back(std::make_unique<Device>(Device{fd, name, grabbable}));
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = devices_.back().get();
+    epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev);
+    std::cout << "Capturing input from " << name << std::endl;
+}
+
+void EvdevCapture::remove(Device* device) {
+    epoll_ctl(epoll_, EPOLL_CTL_DEL, device->fd, nullptr);
+    ::close(device->fd);
+    devices_.erase(std::find_if(devices_.begin(), devices_.end(),
+                                [device](const std::unique_ptr<Device>& d) { return d.get() == device; }));
+}
+
+bool EvdevCapture::setGrab(bool grab) {
+    bool ok = true;
+    for (const auto& device : devices_) {
+        if (device->grabbable && ioctl(device->fd, EVIOCGRAB, grab ? 1 : 0) < 0) {
+            std::cerr << "Cannot " << (grab ? "grab " : "release ") << device->name << ": " << std::strerror(errno) << std::endl;
+            ok = false;
+        }
+    }
+    grabbed_ = grab;
+    return ok;
+}
+
+void EvdevCapture::setPosition(int x, int y) {
+    x_ = std::clamp(x, 0, width_ - 1);
+    y_ = std::clamp(y, 0, height_ - 1);
+}
+
+void EvdevCapture::warp(int x, int y) {
+    // Both fit in 31 bits once clamped, which leaves the top bit for "pending"
+    uint64_t packed = static_cast<uint64_t>(std::clamp(x, 0, width_ - 1)) << 32 | static_cast<uint64_t>(std::clamp(y, 0, height_ - 1));
+    warp_.store(kWarpPending | packed, std::memory_order_release);
+}
+
+bool EvdevCapture::readDevice(Device& device) {
+    input_event events[kReadBatch];
+    for (;;) {
+        ssize_t n = ::read(device.fd, events, sizeof(events));
+        if (n < 0) {
+            return errno == EAGAIN || errno == EINTR;
+        }
+        if (n == 0) {
+            return false;
+        }
+        size_t count = static_cast<size_t>(n) / sizeof(input_event);
+        for (size_t i = 0; i < count; ++i) {
+            const input_event& in = events[i];
+            uint64_t us = static_cast<uint64_t>(in.input_event_sec) * 1000000 + in.input_event_usec;
+            Captured out{};
+            out.timestampUs = us;
+            out.event.time = us / 1000;
+
+            if (in.type == EV_SYN && in.code == SYN_DROPPED) {
+                // The kernel's buffer overflowed; the rest of this report is incomplete
+                device.dropping = true;
+                device.dx = device.dy = 0;
+                continue;
+            }
+            if (in.type == EV_SYN && in.code == SYN_REPORT) {
+                if (!device.dropping && (device.dx != 0 || device.dy != 0)) {
+                    setPosition(x_ + device.dx, y_ + device.dy);
+                    out.event.type = EVENT_MOUSE_MOVED;
+                    out.event.data.mouse.x = static_cast<int16_t>(x_);
+                    out.event.data.mouse.y = static_cast<int16_t>(y_);
+                    batch_.push_back(out);
+                }
+                device.dropping = false;
+                device.dx = device.dy = 0;
+                continue;
+            }
+            if (device.dropping) {
+                continue;
+            }
+            if (in.type == EV_REL) {
+                if (in.code == REL_X) {
+                    device.dx += in.value;
+                } else if (in.code == REL_Y) {
+                    device.dy += in.value;
+                } else if (in.code == REL_WHEEL || in.code == REL_HWHEEL) {
+                    out.event.type = EVENT_MOUSE_WHEEL;
+                    out.event.data.wheel.clicks = 1;
+                    out.event.data.wheel.x = static_cast<int16_t>(x_);
+                    out.event.data.wheel.y = static_cast<int16_t>(y_);
+                    out.event.data.wheel.type = WHEEL_UNIT_SCROLL;
+                    out.event.data.wheel.amount = 3;
+                    out.event.data.wheel.rotation = static_cast<int16_t>(-in.value);   // uiohook: positive is down
+                    out.event.data.wheel.direction = in.code == REL_WHEEL ? WHEEL_VERTICAL_DIRECTION : WHEEL_HORIZONTAL_DIRECTION;
+                    batch_.push_back(out);
+                }
+                continue;
+            }
+            // Autorepeat (value 2) is left to the machine that injects the key
+            if (in.type != EV_KEY || in.value > 1) {
+                continue;
+            }
+            bool pressed = in.value == 1;
+            if (uint16_t button = evdevToButton(in.code)) {
+                out.event.type = pressed ? EVENT_MOUSE_PRESSED : EVENT_MOUSE_RELEASED;
+                out.event.data.mouse.button = button;
+                out.event.data.mouse.clicks = 1;
+                out.event.data.mouse.x = static_cast<int16_t>(x_);
+                out.event.data.mouse.y = static_cast<int16_t>(y_);
+                batch_.push_back(out);
+            } else if (uint16_t key = evdevToVirtualKey(in.code)) {
+                out.event.type = pressed ? EVENT_KEY_PRESSED : EVENT_KEY_RELEASED;
+                out.event.data.keyboard.keycode = key;
+                out.event.data.keyboard.rawcode = in.code;
+                batch_.push_back(out);
+            }
+        }
+        if (count < kReadBatch) {
+            return true;
+        }
+    }
+}
+
+bool EvdevCapture::poll(int timeoutMs, const BatchHandler& handler) {
+    epoll_event ready[16];
+    int n = epoll_wait(epoll_, ready, 16, timeoutMs);
+    if (n < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        throw std::runtime_error(std::string("epoll_wait failed: ") + std::strerror(errno));
+    }
+    if (uint64_t warp = warp_.exchange(0, std::memory_order_acquire)) {
+        setPosition(static_cast<int>((warp & ~kWarpPending) >> 32), static_cast<int>(warp & 0xFFFFFFFF));
+    }
+    batch_.clear();
+    std::vector<Device*> gone;
+    for (int i = 0; i < n; ++i) {
+        Device* device = static_cast<Device*>(ready[i].data.ptr);
+        if (!device) {
+            return false;   // stop()
+        }
+        if (!readDevice(*device)) {
+            gone.push_back(device);
+        }
+    }
+    for (Device* device : gone) {
+        std::cout << "Input device removed: " << device->name << std::endl;
+        remove(device);
+    }
+    if (!batch_.empty()) {
+        handler(batch_.data(), batch_.size());
+    }
+    return true;
+}
+
+void EvdevCapture::run(const BatchHandler& handler) {
+    while (poll(-1, handler)) {
+    }
+}
+
+void EvdevCapture::stop() {
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wake_, &one, sizeof(one));
+    (void)ignored;
+}
@@ -0,0 +1,109 @@
+#include "EvdevKeys.h"
+#include <array>
+#include <linux/input.h>
+#include <memory>
+#include <uiohook.h>
+
+// Linux key codes are PC set 1 scancodes up to KEY_F12, as are most VC_* codes.
+uint16_t evdevToVirtualKey(uint16_t code) {
+    if (code >= KEY_ESC && code <= KEY_KPDOT) {
+        return code;
+    }
+    switch (code) {
+        case KEY_102ND:         return VC_LESSER_GREATER;
+        case KEY_F11:           return VC_F11;
+        case KEY_F12:           return VC_F12;
+        case KEY_RO:            return VC_UNDERSCORE;
+        case KEY_KATAKANA:      return VC_KATAKANA;
+        case KEY_HIRAGANA:      return VC_HIRAGANA;
+        case KEY_HENKAN:        return VC_KANJI;
+        case KEY_KPENTER:       return VC_KP_ENTER;
+        case KEY_RIGHTCTRL:     return VC_CONTROL_R;
+        case KEY_KPSLASH:       return VC_KP_DIVIDE;
+        case KEY_SYSRQ:         return VC_PRINTSCREEN;
+        case KEY_RIGHTALT:      return VC_ALT_R;
+        case KEY_HOME:          return VC_HOME;
+        case KEY_UP:            return VC_UP;
+        case KEY_PAGEUP:        return VC_PAGE_UP;
+        case KEY_LEFT:          return VC_LEFT;
+        case KEY_RIGHT:         return VC_RIGHT;
+        case KEY_END:           return VC_END;
+        case KEY_DOWN:          return VC_DOWN;
+        case KEY_PAGEDOWN:      return VC_PAGE_DOWN;
+        case KEY_INSERT:        return VC_INSERT;
+        case KEY_DELETE:        return VC_DELETE;
+        case KEY_MUTE:          return VC_VOLUME_MUTE;
+        case KEY_VOLUMEDOWN:    return VC_VOLUME_DOWN;
+        case KEY_VOLUMEUP:      return VC_VOLUME_UP;
+        case KEY_POWER:         return VC_POWER;
+        case KEY_KPEQUAL:       return VC_KP_EQUALS;
+        case KEY_PAUSE:         return VC_PAUSE;
+        case KEY_KPCOMMA:       return VC_KP_COMMA;
+        case KEY_YEN:           return VC_YEN;
+        case KEY_LEFTMETA:      return VC_META_L;
+        case KEY_RIGHTMETA:     return VC_META_R;
+        case KEY_COMPOSE:       return VC_CONTEXT_MENU;
+        case KEY_CALC:          return VC_APP_CALCULATOR;
+        case KEY_SLEEP:         return VC_SLEEP;
+        case KEY_WAKEUP:        return VC_WAKE;
+        case KEY_MAIL:          return VC_APP_MAIL;
+        case KEY_BOOKMARKS:     return VC_BROWSER_FAVORITES;
+        case KEY_BACK:          return VC_BROWSER_BACK;
+        case KEY_FORWARD:       return VC_BROWSER_FORWARD;
+        case KEY_EJECTCD:       return VC_MEDIA_EJECT;
+        case KEY_NEXTSONG:      return VC_MEDIA_NEXT;
+        case KEY_PLAYPAUSE:     return VC_MEDIA_PLAY;
+        case KEY_PREVIOUSSONG:  return VC_MEDIA_PREVIOUS;
+        case KEY_STOPCD:        return VC_MEDIA_STOP;
+        case KEY_HOMEPAGE:      return VC_BROWSER_HOME;
+        case KEY_REFRESH:       return VC_BROWSER_REFRESH;
+        case KEY_SEARCH:        return VC_BROWSER_SEARCH;
+        default:
+            break;
+    }
+    if (code >= KEY_F13 && code <= KEY_F15) {
+        return static_cast<uint16_t>(VC_F13 + (code - KEY_F13));
+    }
+    if (code >= KEY_F16 && code <= KEY_F24) {
+        return static_cast<uint16_t>(VC_F16 + (code - KEY_F16));
+    }
+    return VC_UNDEFINED;
+}
+
+// uiohook numbers buttons left, right, middle, then the side buttons
+uint16_t evdevToButton(uint16_t code) {
+    switch (code) {
+        case BTN_LEFT:   return MOUSE_BUTTON1;
+        case BTN_RIGHT:  return MOUSE_BUTTON2;
+        case BTN_MIDDLE: return MOUSE_BUTTON3;
+        case BTN_SIDE:   return MOUSE_BUTTON4;
+        case BTN_EXTRA:  return MOUSE_BUTTON5;
+        default:         return MOUSE_NOBUTTON;
+    }
+}
+
+uint16_t virtualKeyToEvdev(uint16_t keycode) {
+    // The inverse of evdevToVirtualKey, built once by walking every key code
+    static const auto table = []() {
+        auto t = std::make_unique<std::array<uint16_t, 0x10000>>();
+        t->fill(0);
+        for (uint16_t code = KEY_MAX; code > KEY_RESERVED; --code) {
+            if (uint16_t vc = evdevToVirtualKey(code)) {
+                (*t)[vc] = code;    // lowest Linux code wins where two share a VC_* code
+            }
+        }
+        return t;
+    }();
+    return (*table)[keycode];
+}
+
+uint16_t buttonToEvdev(uint16_t button) {
+    switch (button) {
+        case MOUSE_BUTTON1: return BTN_LEFT;
+        case MOUSE_BUTTON2: return BTN_RIGHT;
+        case MOUSE_BUTTON3: return BTN_MIDDLE;
+        case MOUSE_BUTTON4: return BTN_SIDE;
+        case MOUSE_BUTTON5: return BTN_EXTRA;
+        default:            return 0;
+    }
+}
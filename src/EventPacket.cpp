@@ -1,9 +1,19 @@
 #include "../include/EventPacket.h"
+#include "ByteOrder.h"
 #include <cstring>  // for memcpy
+#include <stdexcept>
+
+using byteorder::loadBe32;
+using byteorder::loadBe64;
 
 std::vector<uint8_t> EventPacket::toBytes() const {
     std::vector<uint8_t> buffer;
     buffer.reserve(1 + 8 + 4 + payloadSize);
+    appendTo(buffer);
+    return buffer;
+}
+
+void EventPacket::appendTo(std::vector<uint8_t>& buffer) const {
     // 1. type
     buffer.push_back(static_cast<uint8_t>(type));
     // 2. timestamp (big-endian)
@@ -16,26 +26,124 @@ std::vector<uint8_t> EventPacket::toBytes() const {
     }
     // 4. payload bytes
     buffer.insert(buffer.end(), payload.begin(), payload.end());
-    return buffer;
 }
 
 EventPacket EventPacket::fromBytes(const std::vector<uint8_t>& buffer) {
+    if (buffer.size() < kHeaderSize) {
+        throw std::runtime_error("Packet shorter than its header");
+    }
     EventPacket pkt;
-    size_t offset = 0;
+    const uint8_t* p = buffer.data();
     // 1. type
-    pkt.type = static_cast<SamenessEventType>(buffer[offset++]);
+    pkt.type = static_cast<SamenessEventType>(p[0]);
     // 2. timestamp
-    pkt.timestamp = 0;
-    for (int i = 0; i < 8; ++i) {
-        pkt.timestamp = (pkt.timestamp << 8) | buffer[offset++];
-    }
+    pkt.timestamp = loadBe64(p + 1);
     // 3. payloadSize
-    pkt.payloadSize = 0;
-    for (int i = 0; i < 4; ++i) {
-        pkt.payloadSize = (pkt.payloadSize << 8) | buffer[offset++];
-    }
+    pkt.payloadSize = loadBe32(p + 9);
     // 4. payload
-    pkt.payload.assign(buffer.begin() + offset,
-                       buffer.begin() + offset + pkt.payloadSize);
+    if (buffer.size() - kHeaderSize < pkt.payloadSize) {
+        throw std::runtime_error("Packet payload truncated");
+    }
+    pkt.payload.assign(p + kHeaderSize, p + kHeaderSize + pkt.payloadSize);
+    return pkt;
+}
+
+bool EventPacket::tryParse(const uint8_t* data, size_t len, EventPacket& out, size_t& consumed) {
+    if (len < kHeaderSize) {
+        return false;
+    }
+    uint32_t payloadSize = loadBe32(data + 9);
+    if (len - kHeaderSize < payloadSize) {
+        return false;
+    }
+    out.type = static_cast<SamenessEventType>(data[0]);
+    out.timestamp = loadBe64(data + 1);
+    out.payloadSize = payloadSize;
+    out.payload.assign(data + kHeaderSize, data + kHeaderSize + payloadSize);
+    consumed = kHeaderSize + payloadSize;
+    return true;
+}
+
+EventPacket makeKeyPacket(SamenessEventType type, uint64_t timestamp, uint32_t keycode) {
+    EventPacket pkt;
+    pkt.type = type;
+    pkt.timestamp = timestamp;
+    pkt.payloadSize = sizeof(uint32_t);
+    pkt.payload.resize(pkt.payloadSize);
+    byteorder::storeLe(pkt.payload.data(), keycode);
+    return pkt;
+}
+
+EventPacket makeMouseMovePacket(uint64_t timestamp, int32_t x, int32_t y) {
+    EventPacket pkt;
+    pkt.type = SamenessEventType::MouseMove;
+    pkt.timestamp = timestamp;
+    pkt.payloadSize = sizeof(int32_t) * 2;
+    pkt.payload.resize(pkt.payloadSize);
+    byteorder::storeLe(pkt.payload.data(), x);
+    byteorder::storeLe(pkt.payload.data() + 4, y);
     return pkt;
 }
+
+EventPacket makeMouseButtonPacket(SamenessEventType type, uint64_t timestamp, uint8_t button, int32_t x, int32_t y) {
+    EventPacket pkt;
+    pkt.type = type;
+    pkt.timestamp = timestamp;
+    pkt.payloadSize = sizeof(uint8_t) + sizeof(int32_t) * 2;
+    pkt.payload.resize(pkt.payloadSize);
+    pkt.payload[0] = button;
+    byteorder::storeLe(pkt.payload.data() + 1, x);
+    byteorder::storeLe(pkt.payload.data() + 5, y);
+    return pkt;
+}
+
+EventPacket makeSwitchBackPacket(uint64_t timestamp, int32_t x, int32_t y, int32_t width, int32_t height) {
+    EventPacket pkt;
+    pkt.type = SamenessEventType::SwitchBack;
+    pkt.timestamp = timestamp;
+    pkt.payloadSize = sizeof(int32_t) * 4;
+    pkt.payload.resize(pkt.payloadSize);
+    byteorder::storeLe(pkt.payload.data(), x);
+    byteorder::storeLe(pkt.payload.data() + 4, y);
+    byteorder::storeLe(pkt.payload.data() + 8, width);
+    byteorder::storeLe(pkt.payload.data() + 12, height);
+    return pkt;
+}
+
+bool readKey(const EventPacket& pkt, uint32_t& keycode) {
+    if (pkt.payload.size() < sizeof(uint32_t)) {
+        return false;
+    }
+    keycode = byteorder::loadLe<uint32_t>(pkt.payload.data());
+    return true;
+}
+
+bool readMouseMove(const EventPacket& pkt, int32_t& x, int32_t& y) {
+    if (pkt.payload.size() < sizeof(int32_t) * 2) {
+        return false;
+    }
+    x = byteorder::loadLe<int32_t>(pkt.payload.data());
+    y = byteorder::loadLe<int32_t>(pkt.payload.data() + 4);
+    return true;
+}
+
+bool readMouseButton(const EventPacket& pkt, uint8_t& button, int32_t& x, int32_t& y) {
+    if (pkt.payload.size() < sizeof(uint8_t) + sizeof(int32_t) * 2) {
+        return false;
+    }
+    button = pkt.payload[0];
+    x = byteorder::loadLe<int32_t>(pkt.payload.data() + 1);
+    y = byteorder::loadLe<int32_t>(pkt.payload.data() + 5);
+    return true;
+}
+
+bool readSwitchBack(const EventPacket& pkt, int32_t& x, int32_t& y, int32_t& width, int32_t& height) {
+    if (pkt.payload.size() < sizeof(int32_t) * 4) {
+        return false;
+    }
+    x = byteorder::loadLe<int32_t>(pkt.payload.data());
+    y = byteorder::loadLe<int32_t>(pkt.payload.data() + 4);
+    width = byteorder::loadLe<int32_t>(pkt.payload.data() + 8);
+    height = byteorder::loadLe<int32_t>(pkt.payload.data() + 12);
+    return true;
+}
@@ -0,0 +1,184 @@
+#include "InjectionQueue.h"
+#include "Stats.h"
+#include <chrono>
+
+namespace {
+    uint64_t steadyMicroseconds() {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+InjectionQueue::InjectionQueue(size_t capacity)
+    : ring_(capacity) {
+}
+
+InjectionQueue::~InjectionQueue() {
+    stop();
+    // Left over only if the thread never ran
+    Record record;
+    while (ring_.pop(record)) {
+        delete record.text;
+    }
+    for (const Record& r : backlog_) {
+        delete r.text;
+    }
+}
+
+bool InjectionQueue::toRecord(const EventPacket& pkt, Record& out) {
+    out = Record{};
+    out.type = pkt.type;
+    out.timestamp = pkt.timestamp;
+    switch (pkt.type) {
+        case SamenessEventType::KeyPress:
+        case SamenessEventType::KeyRelease:
+            return readKey(pkt, out.keycode);
+        case SamenessEventType::MouseMove:
+            return readMouseMove(pkt, out.x, out.y);
+        case SamenessEventType::MouseButtonPress:
+        case SamenessEventType::MouseButtonRelease:
+            return readMouseButton(pkt, out.button, out.x, out.y);
+        case SamenessEventType::TextInput:
+            out.text = new std::string(pkt.payload.begin(), pkt.payload.end());
+            return true;
+        default:
+            return false;
+    }
+}
+
+EventPacket InjectionQueue::toPacket(Record& record) {
+    switch (record.type) {
+        case SamenessEventType::TextInput: {
+            EventPacket pkt;
+            pkt.type = record.type;
+            pkt.timestamp = record.timestamp;
+            pkt.payload.assign(record.text->begin(), record.text->end());
+            pkt.payloadSize = static_cast<uint32_t>(pkt.payload.size());
+            delete record.text;
+            record.text = nullptr;
+            return pkt;
+        }
+        case SamenessEventType::MouseMove:
+            return makeMouseMovePacket(record.timestamp, record.x, record.y);
+        case SamenessEventType::MouseButtonPress:
+        case SamenessEventType::MouseButtonRelease:
+            return makeMouseButtonPacket(record.type, record.timestamp, record.button, record.x, record.y);
+        default:
+            return makeKeyPacket(record.type, record.timestamp, record.keycode);
+    }
+}
+
+void InjectionQueue::start(BatchHandler handler, std::function<void()> onStart) {
+    handler_ = std::move(handler);
+    stopping_ = false;
+    thread_ = std::thread([this, onStart = std::move(onStart)]() {
+        if (onStart) {
+            onStart();
+        }
+        run();
+    });
+}
+
+void InjectionQueue::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    while (!backlog_.empty()) {
+        retry();
+        std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeUp_.notify_one();
+    thread_.join();
+}
+
+bool InjectionQueue::push(const EventPacket& pkt) {
+    Record record;
+    if (!toRecord(pkt, record)) {
+        return false;
+    }
+    record.queuedUs = steadyMicroseconds();
+    if (backlog_.empty() && ring_.push(record)) {
+        wake();
+        stats::setGauge(stats::Gauge::InjectQueueDepth, static_cast<int64_t>(ring_.size()));
+        return true;
+    }
+    // Full, or older records are still waiting for room: keep the order
+    if (record.type == SamenessEventType::MouseMove && !backlog_.empty()
+        && backlog_.back().type == SamenessEventType::MouseMove) {
+        backlog_.back() = record;
+        stats::add(&stats::Slot::coalescedMoves);
+    } else {
+        backlog_.push_back(record);
+    }
+    retry();
+    return true;
+}
+
+void InjectionQueue::retry() {
+    for (;;) {
+        while (!backlog_.empty() && ring_.push(backlog_.front())) {
+            backlog_.pop_front();
+        }
+        wake();
+        stats::setGauge(stats::Gauge::InjectQueueDepth, static_cast<int64_t>(depth()));
+        if (backlog_.empty()) {
+            backlogWaiting_ = false;
+            return;
+        }
+        // Announce the backlog, then look again: either the injection thread
+        // sees the flag after its next pop, or we see the room it made
+        backlogWaiting_ = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring_.size() == ring_.capacity()) {
+            return;
+        }
+    }
+}
+
+void InjectionQueue::wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked_.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wakeUp_.notify_one();
+    }
+}
+
+void InjectionQueue::run() {
+    Record records[kMaxBatch];
+    std::vector<EventPacket> packets;
+    packets.reserve(kMaxBatch);
+    for (;;) {
+        size_t n = ring_.pop(records, kMaxBatch);
+        if (n == 0) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            parked_ = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wakeUp_.wait(lock, [this]() { return !ring_.empty() || stopping_; });
+            parked_ = false;
+            if (ring_.empty()) {
+                return;     // stopping, and everything has been injected
+            }
+            continue;
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (backlogWaiting_.load(std::memory_order_relaxed) && backlogWaiting_.exchange(false) && onSpace_) {
+            onSpace_();
+        }
+
+        uint64_t now = steadyMicroseconds();
+        uint64_t waitedUs = 0;
+        packets.clear();
+        for (size_t i = 0; i < n; ++i) {
+            waitedUs += now - records[i].queuedUs;
+            packets.push_back(toPacket(records[i]));
+        }
+        stats::add(&stats::Slot::injectQueued, n);
+        stats::add(&stats::Slot::injectWaitNanos, waitedUs * 1000);
+        stats::setGauge(stats::Gauge::InjectQueueDepth, static_cast<int64_t>(ring_.size()));
+        handler_(packets.data(), packets.size());
+    }
+}
@@ -1,24 +1,51 @@
 #include "../include/EventPacket.h"
-#include <cstring>  // for memcpy
-#include "EventState.h"
+#include "EchoFilter.h"
+#include "TextInput.h"
 #include <uiohook.h>
+#include <algorithm>
+#include <chrono>
 #include <stdexcept>
+#include <string>
 #include <memory>
 #include <type_traits>
-#include <CoreGraphics/CoreGraphics.h>
 #include <iostream>
+#include <vector>
+
+namespace {
+    uint64_t steadyMicroseconds() {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Batch injection for injectors that take one event per call
+    template <typename Injector>
+    void injectEach(const EventPacket* packets, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            const EventPacket& pkt = packets[i];
+            switch (pkt.type) {
+                case SamenessEventType::KeyPress: Injector::injectKeyPress(pkt); break;
+                case SamenessEventType::KeyRelease: Injector::injectKeyRelease(pkt); break;
+                case SamenessEventType::MouseMove: Injector::injectMouseMove(pkt); break;
+                case SamenessEventType::MouseButtonPress: Injector::injectMouseButtonPress(pkt); break;
+                case SamenessEventType::MouseButtonRelease: Injector::injectMouseButtonRelease(pkt); break;
+                case SamenessEventType::TextInput: Injector::injectText(pkt); break;
+                default: break;
+            }
+        }
+    }
+}
 
 #if defined(__APPLE__)
+#include <CoreGraphics/CoreGraphics.h>
+
 namespace {
     class MacOSEventInjector {
     public:
         static void injectKeyPress(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint32_t)) {
+            uint32_t code;
+            if (!readKey(pkt, code)) {
                 throw std::runtime_error("Invalid key press payload size");
             }
-            
-            uint32_t code;
-            std::memcpy(&code, pkt.payload.data(), sizeof(code));
             std::cout << "Injecting key press: " << code << std::endl;
             
             using CGEventPtr = std::unique_ptr<std::remove_pointer_t<CGEventRef>, decltype(&CFRelease)>;
@@ -35,12 +62,10 @@ namespace {
         }
 
         static void injectKeyRelease(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint32_t)) {
+            uint32_t code;
+            if (!readKey(pkt, code)) {
                 throw std::runtime_error("Invalid key release payload size");
             }
-            
-            uint32_t code;
-            std::memcpy(&code, pkt.payload.data(), sizeof(code));
             std::cout << "Injecting key release: " << code << std::endl;
             
             using CGEventPtr = std::unique_ptr<std::remove_pointer_t<CGEventRef>, decltype(&CFRelease)>;
@@ -57,12 +82,10 @@ namespace {
         }
 
         static void injectMouseMove(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(int32_t) * 2) {
+            int32_t coords[2];
+            if (!readMouseMove(pkt, coords[0], coords[1])) {
                 throw std::runtime_error("Invalid mouse move payload size");
             }
-            
-            int32_t coords[2];
-            std::memcpy(coords, pkt.payload.data(), sizeof(coords));
             std::cout << "Injecting mouse move to: (" << coords[0] << ", " << coords[1] << ")" << std::endl;
             
             // Get screen dimensions
@@ -89,17 +112,11 @@ namespace {
         }
 
         static void injectMouseButtonPress(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint8_t) + sizeof(int32_t) * 2) {
-                throw std::runtime_error("Invalid mouse button press payload size");
-            }
-            
-            size_t off = 0;
             uint8_t button;
-            std::memcpy(&button, pkt.payload.data() + off, sizeof(button));
-            off += sizeof(button);
-            
             int32_t coords[2];
-            std::memcpy(coords, pkt.payload.data() + off, sizeof(coords));
+            if (!readMouseButton(pkt, button, coords[0], coords[1])) {
+                throw std::runtime_error("Invalid mouse button press payload size");
+            }
             std::cout << "Injecting mouse button press: " << (int)button << " at (" << coords[0] << ", " << coords[1] << ")" << std::endl;
             
             // Get screen dimensions
@@ -126,17 +143,11 @@ namespace {
         }
 
         static void injectMouseButtonRelease(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint8_t) + sizeof(int32_t) * 2) {
-                throw std::runtime_error("Invalid mouse button release payload size");
-            }
-            
-            size_t off = 0;
             uint8_t button;
-            std::memcpy(&button, pkt.payload.data() + off, sizeof(button));
-            off += sizeof(button);
-            
             int32_t coords[2];
-            std::memcpy(coords, pkt.payload.data() + off, sizeof(coords));
+            if (!readMouseButton(pkt, button, coords[0], coords[1])) {
+                throw std::runtime_error("Invalid mouse button release payload size");
+            }
             std::cout << "Injecting mouse button release: " << (int)button << " at (" << coords[0] << ", " << coords[1] << ")" << std::endl;
             
             // Get screen dimensions
@@ -161,6 +172,40 @@ namespace {
             
             CGEventPost(kCGHIDEventTap, e.get());
         }
+
+        // A keyboard event carries at most 20 UTF-16 units of its own text,
+        // so the string goes out as a down/up pair per 20 units
+        static void injectText(const EventPacket& pkt) {
+            std::string text;
+            if (!readText(pkt, text)) {
+                throw std::runtime_error("Invalid text payload");
+            }
+            std::u16string units = utf8ToUtf16(text);
+            constexpr size_t kUnitsPerEvent = 20;
+
+            using CGEventPtr = std::unique_ptr<std::remove_pointer_t<CGEventRef>, decltype(&CFRelease)>;
+            size_t i = 0;
+            while (i < units.size()) {
+                size_t n = std::min(kUnitsPerEvent, units.size() - i);
+                // Keep a surrogate pair in one event
+                if (n > 1 && units[i + n - 1] >= 0xD800 && units[i + n - 1] <= 0xDBFF) {
+                    --n;
+                }
+                for (bool down : {true, false}) {
+                    CGEventPtr e(CGEventCreateKeyboardEvent(NULL, 0, down), CFRelease);
+                    if (!e) {
+                        throw std::runtime_error("Failed to create keyboard event");
+                    }
+                    CGEventKeyboardSetUnicodeString(e.get(), n, reinterpret_cast<const UniChar*>(units.data() + i));
+                    CGEventPost(kCGHIDEventTap, e.get());
+                }
+                i += n;
+            }
+        }
+
+        static void injectBatch(const EventPacket* packets, size_t count) {
+            injectEach<MacOSEventInjector>(packets, count);
+        }
     };
     
     using PlatformInjector = MacOSEventInjector;
@@ -170,16 +215,41 @@ namespace {
 #include <Windows.h>
 
 namespace {
+    // uiohook button number (1 = left, 2 = right, 3 = middle) to its SendInput DOWN flag
+    DWORD buttonDownFlag(uint8_t button) {
+        switch (button) {
+            case 2: return MOUSEEVENTF_RIGHTDOWN;
+            case 3: return MOUSEEVENTF_MIDDLEDOWN;
+            default: return MOUSEEVENTF_LEFTDOWN;
+        }
+    }
+
+    // KEYEVENTF_UNICODE down/up pairs, one per UTF-16 unit; Windows pairs
+    // up surrogates itself when they arrive back to back
+    void appendText(const EventPacket& pkt, std::vector<INPUT>& inputs) {
+        std::string text;
+        if (!readText(pkt, text)) {
+            throw std::runtime_error("Invalid text payload");
+        }
+        for (char16_t unit : utf8ToUtf16(text)) {
+            INPUT input = {};
+            input.type = INPUT_KEYBOARD;
+            input.ki.wScan = static_cast<WORD>(unit);
+            input.ki.dwFlags = KEYEVENTF_UNICODE;
+            inputs.push_back(input);
+            input.ki.dwFlags = KEYEVENTF_UNICODE | KEYEVENTF_KEYUP;
+            inputs.push_back(input);
+        }
+    }
+
     class WindowsEventInjector {
     public:
         static void injectKeyPress(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint32_t)) {
+            uint32_t code;
+            if (!readKey(pkt, code)) {
                 throw std::runtime_error("Invalid key press payload size");
             }
             
-            uint32_t code;
-            std::memcpy(&code, pkt.payload.data(), sizeof(code));
-            
             INPUT inputs[2] = {};
             inputs[0].type = INPUT_KEYBOARD;
             inputs[0].ki.wVk = static_cast<WORD>(code);
@@ -195,13 +265,11 @@ namespace {
         }
 
         static void injectMouseMove(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(int32_t) * 2) {
+            int32_t coords[2];
+            if (!readMouseMove(pkt, coords[0], coords[1])) {
                 throw std::runtime_error("Invalid mouse move payload size");
             }
             
-            int32_t coords[2];
-            std::memcpy(coords, pkt.payload.data(), sizeof(coords));
-            
             INPUT input = {};
             input.type = INPUT_MOUSE;
             input.mi.dwFlags = MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE;
@@ -216,13 +284,11 @@ namespace {
         }
 
         static void injectKeyRelease(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint32_t)) {
+            uint32_t code;
+            if (!readKey(pkt, code)) {
                 throw std::runtime_error("Invalid key release payload size");
             }
             
-            uint32_t code;
-            std::memcpy(&code, pkt.payload.data(), sizeof(code));
-            
             INPUT input = {};
             input.type = INPUT_KEYBOARD;
             input.ki.wVk = static_cast<WORD>(code);
@@ -234,16 +300,15 @@ namespace {
         }
 
         static void injectMouseButtonPress(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint32_t)) {
+            uint8_t button;
+            int32_t x, y;
+            if (!readMouseButton(pkt, button, x, y)) {
                 throw std::runtime_error("Invalid mouse button press payload size");
             }
             
-            uint32_t button;
-            std::memcpy(&button, pkt.payload.data(), sizeof(button));
-            
             INPUT input = {};
             input.type = INPUT_MOUSE;
-            input.mi.dwFlags = static_cast<DWORD>(button);  // MOUSEEVENTF_LEFTDOWN, MOUSEEVENTF_RIGHTDOWN, etc.
+            input.mi.dwFlags = buttonDownFlag(button);
             
             if (SendInput(1, &input, sizeof(input)) != 1) {
                 throw std::runtime_error("Failed to send mouse input");
@@ -251,21 +316,90 @@ namespace {
         }
 
         static void injectMouseButtonRelease(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint32_t)) {
+            uint8_t button;
+            int32_t x, y;
+            if (!readMouseButton(pkt, button, x, y)) {
                 throw std::runtime_error("Invalid mouse button release payload size");
             }
             
-            uint32_t button;
-            std::memcpy(&button, pkt.payload.data(), sizeof(button));
-            
             INPUT input = {};
             input.type = INPUT_MOUSE;
-            input.mi.dwFlags = static_cast<DWORD>(button) << 1;  // Convert DOWN to UP flags
+            input.mi.dwFlags = buttonDownFlag(button) << 1;  // Convert DOWN to UP flags
             
             if (SendInput(1, &input, sizeof(input)) != 1) {
                 throw std::runtime_error("Failed to send mouse input");
             }
         }
+
+        static void injectText(const EventPacket& pkt) {
+            injectBatch(&pkt, 1);
+        }
+
+        // One SendInput call for the whole batch, so its events reach the
+        // input queue back to back and cost a single transition to the kernel
+        static void injectBatch(const EventPacket* packets, size_t count) {
+            std::vector<INPUT> inputs;
+            inputs.reserve(count * 2);
+            double scaleX = 65535.0 / GetSystemMetrics(SM_CXSCREEN);
+            double scaleY = 65535.0 / GetSystemMetrics(SM_CYSCREEN);
+            for (size_t i = 0; i < count; ++i) {
+                const EventPacket& pkt = packets[i];
+                INPUT input = {};
+                uint32_t code;
+                uint8_t button;
+                int32_t x, y;
+                switch (pkt.type) {
+                    case SamenessEventType::KeyPress:
+                    case SamenessEventType::KeyRelease:
+                        if (!readKey(pkt, code)) {
+                            throw std::runtime_error("Invalid key payload size");
+                        }
+                        input.type = INPUT_KEYBOARD;
+                        input.ki.wVk = static_cast<WORD>(code);
+                        input.ki.dwFlags = KEYEVENTF_KEYUP;
+                        if (pkt.type == SamenessEventType::KeyPress) {
+                            // Same down-then-up pair as injectKeyPress
+                            INPUT down = input;
+                            down.ki.dwFlags = 0;
+                            inputs.push_back(down);
+                        }
+                        break;
+                    case SamenessEventType::MouseMove:
+                        if (!readMouseMove(pkt, x, y)) {
+                            throw std::runtime_error("Invalid mouse move payload size");
+                        }
+                        input.type = INPUT_MOUSE;
+                        input.mi.dwFlags = MOUSEEVENTF_MOVE | MOUSEEVENTF_ABSOLUTE;
+                        input.mi.dx = static_cast<LONG>(x * scaleX);
+                        input.mi.dy = static_cast<LONG>(y * scaleY);
+                        break;
+                    case SamenessEventType::MouseButtonPress:
+                    case SamenessEventType::MouseButtonRelease:
+                        if (!readMouseButton(pkt, button, x, y)) {
+                            throw std::runtime_error("Invalid mouse button payload size");
+                        }
+                        input.type = INPUT_MOUSE;
+                        input.mi.dwFlags = buttonDownFlag(button);
+                        if (pkt.type == SamenessEventType::MouseButtonRelease) {
+                            input.mi.dwFlags <<= 1;
+                        }
+                        break;
+                    case SamenessEventType::TextInput:
+                        appendText(pkt, inputs);
+                        continue;
+                    default:
+                        continue;
+                }
+                inputs.push_back(input);
+            }
+            if (inputs.empty()) {
+                return;
+            }
+            UINT sent = SendInput(static_cast<UINT>(inputs.size()), inputs.data(), sizeof(INPUT));
+            if (sent != inputs.size()) {
+                throw std::runtime_error("Failed to send batched input");
+            }
+        }
     };
     
     using PlatformInjector = WindowsEventInjector;
@@ -276,152 +410,173 @@ namespace {
     class UiohookEventInjector {
     public:
         static void injectKeyPress(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint16_t)) {
+            uint32_t code;
+            if (!readKey(pkt, code)) {
                 return;
             }
-            uint16_t keycode;
-            std::memcpy(&keycode, pkt.payload.data(), sizeof(keycode));
-            setInjectedEventFlag(true);
-            uiohook_event event = {
-                .type = EVENT_KEY_PRESSED,
-                .time = pkt.timestamp,
-                .mask = 0,
-                .data = {
-                    .keyboard = {
-                        .keycode = keycode,
-                        .rawcode = keycode,
-                        .keychar = 0
-                    }
-                }
-            };
-            hook_post_event(&event);
-            setInjectedEventFlag(false);
+            uint16_t keycode = static_cast<uint16_t>(code);
+            postKey(EVENT_KEY_PRESSED, keycode, pkt.timestamp);
         }
         static void injectKeyRelease(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint16_t)) {
+            uint32_t code;
+            if (!readKey(pkt, code)) {
                 return;
             }
-            uint16_t keycode;
-            std::memcpy(&keycode, pkt.payload.data(), sizeof(keycode));
-            setInjectedEventFlag(true);
-            uiohook_event event = {
-                .type = EVENT_KEY_RELEASED,
-                .time = pkt.timestamp,
-                .mask = 0,
-                .data = {
-                    .keyboard = {
-                        .keycode = keycode,
-                        .rawcode = keycode,
-                        .keychar = 0
-                    }
-                }
-            };
-            hook_post_event(&event);
-            setInjectedEventFlag(false);
+            uint16_t keycode = static_cast<uint16_t>(code);
+            postKey(EVENT_KEY_RELEASED, keycode, pkt.timestamp);
         }
         static void injectMouseMove(const EventPacket& pkt) {
-            if (pkt.payload.size() < 2 * sizeof(int32_t)) {
+            int32_t coords[2];
+            if (!readMouseMove(pkt, coords[0], coords[1])) {
                 return;
             }
-            int32_t coords[2];
-            std::memcpy(coords, pkt.payload.data(), sizeof(coords));
-            setInjectedEventFlag(true);
-            uiohook_event event = {
-                .type = EVENT_MOUSE_MOVED,
-                .time = pkt.timestamp,
-                .mask = 0,
-                .data = {
-                    .mouse = {
-                        .button = 0,
-                        .clicks = 0,
-                        .x = static_cast<int16_t>(coords[0]),
-                        .y = static_cast<int16_t>(coords[1])
-                    }
-                }
-            };
-            hook_post_event(&event);
-            setInjectedEventFlag(false);
+            postMouse(EVENT_MOUSE_MOVED, 0, 0, coords[0], coords[1], pkt.timestamp);
         }
         static void injectMouseButtonPress(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint16_t) + 2 * sizeof(int16_t)) {
+            uint8_t button;
+            int32_t x, y;
+            if (!readMouseButton(pkt, button, x, y)) {
                 return;
             }
-            uint16_t button;
-            int16_t x, y;
-            size_t offset = 0;
-            std::memcpy(&button, pkt.payload.data() + offset, sizeof(button));
-            offset += sizeof(button);
-            std::memcpy(&x, pkt.payload.data() + offset, sizeof(x));
-            offset += sizeof(x);
-            std::memcpy(&y, pkt.payload.data() + offset, sizeof(y));
-            setInjectedEventFlag(true);
-            uiohook_event event = {
-                .type = EVENT_MOUSE_PRESSED,
-                .time = pkt.timestamp,
-                .mask = 0,
-                .data = {
-                    .mouse = {
-                        .button = button,
-                        .clicks = 1,
-                        .x = x,
-                        .y = y
-                    }
-                }
-            };
-            hook_post_event(&event);
-            setInjectedEventFlag(false);
+            postMouse(EVENT_MOUSE_PRESSED, button, 1, x, y, pkt.timestamp);
         }
         static void injectMouseButtonRelease(const EventPacket& pkt) {
-            if (pkt.payload.size() < sizeof(uint16_t) + 2 * sizeof(int16_t)) {
+            uint8_t button;
+            int32_t x, y;
+            if (!readMouseButton(pkt, button, x, y)) {
                 return;
             }
-            uint16_t button;
-            int16_t x, y;
-            size_t offset = 0;
-            std::memcpy(&button, pkt.payload.data() + offset, sizeof(button));
-            offset += sizeof(button);
-            std::memcpy(&x, pkt.payload.data() + offset, sizeof(x));
-            offset += sizeof(x);
-            std::memcpy(&y, pkt.payload.data() + offset, sizeof(y));
-            setInjectedEventFlag(true);
-            uiohook_event event = {
-                .type = EVENT_MOUSE_RELEASED,
-                .time = pkt.timestamp,
-                .mask = 0,
-                .data = {
-                    .mouse = {
-                        .button = button,
-                        .clicks = 1,
-                        .x = x,
-                        .y = y
-                    }
+            postMouse(EVENT_MOUSE_RELEASED, button, 1, x, y, pkt.timestamp);
+        }
+
+        // uiohook posts keys, not characters: ASCII is typed on a US layout
+        // and anything else is skipped
+        static void injectText(const EventPacket& pkt) {
+            std::string text;
+            if (!readText(pkt, text)) {
+                return;
+            }
+            for (char c : text) {
+                uint16_t keycode = 0;
+                bool shift = false;
+                if (!asciiKey(c, keycode, shift)) {
+                    continue;
                 }
-            };
+                if (shift) {
+                    postKey(EVENT_KEY_PRESSED, VC_SHIFT_L, pkt.timestamp);
+                }
+                postKey(EVENT_KEY_PRESSED, keycode, pkt.timestamp);
+                postKey(EVENT_KEY_RELEASED, keycode, pkt.timestamp);
+                if (shift) {
+                    postKey(EVENT_KEY_RELEASED, VC_SHIFT_L, pkt.timestamp);
+                }
+            }
+        }
+
+        static void injectBatch(const EventPacket* packets, size_t count) {
+            injectEach<UiohookEventInjector>(packets, count);
+        }
+
+    private:
+        static void postKey(event_type type, uint16_t keycode, uint64_t timestamp) {
+            uiohook_event event{};
+            event.type = type;
+            event.time = timestamp;
+            event.data.keyboard.keycode = keycode;
+            event.data.keyboard.rawcode = keycode;
+            hook_post_event(&event);
+        }
+        static void postMouse(event_type type, uint16_t button, uint16_t clicks, int32_t x, int32_t y,
+                              uint64_t timestamp) {
+            uiohook_event event{};
+            event.type = type;
+            event.time = timestamp;
+            event.data.mouse.button = button;
+            event.data.mouse.clicks = clicks;
+            event.data.mouse.x = static_cast<int16_t>(x);
+            event.data.mouse.y = static_cast<int16_t>(y);
             hook_post_event(&event);
-            setInjectedEventFlag(false);
         }
     };
     using PlatformInjector = UiohookEventInjector;
 }
 #endif
 
-// Global injection functions that use the platform-specific injector
+// Global injection functions that use the platform-specific injector. Each
+// injection is noted first, so capture on this machine can tell it from real
+// input (see EchoFilter.h).
 void injectKeyPress(const EventPacket& pkt) {
+    echoFilter().note(pkt, steadyMicroseconds());
     PlatformInjector::injectKeyPress(pkt);
 }
 
 void injectKeyRelease(const EventPacket& pkt) {
+    echoFilter().note(pkt, steadyMicroseconds());
     PlatformInjector::injectKeyRelease(pkt);
 }
 
 void injectMouseMove(const EventPacket& pkt) {
+    echoFilter().note(pkt, steadyMicroseconds());
     PlatformInjector::injectMouseMove(pkt);
 }
 
 void injectMouseButtonPress(const EventPacket& pkt) {
+    echoFilter().note(pkt, steadyMicroseconds());
     PlatformInjector::injectMouseButtonPress(pkt);
 }
 
 void injectMouseButtonRelease(const EventPacket& pkt) {
+    echoFilter().note(pkt, steadyMicroseconds());
     PlatformInjector::injectMouseButtonRelease(pkt);
 }
+
+void injectText(const EventPacket& pkt) {
+    echoFilter().note(pkt, steadyMicroseconds());
+    PlatformInjector::injectText(pkt);
+}
+
+void injectBatch(const EventPacket* packets, size_t count) {
+    uint64_t now = steadyMicroseconds();
+    for (size_t i = 0; i < count; ++i) {
+        echoFilter().note(packets[i], now);
+    }
+    PlatformInjector::injectBatch(packets, count);
+}
+
+uint16_t displayRefreshHz() {
+#if defined(__APPLE__)
+    CGDisplayModeRef mode = CGDisplayCopyDisplayMode(CGMainDisplayID());
+    if (!mode) {
+        return 0;
+    }
+    double hz = CGDisplayModeGetRefreshRate(mode);
+    CGDisplayModeRelease(mode);
+    return static_cast<uint16_t>(hz + 0.5);
+#elif defined(_WIN32)
+    DEVMODE mode = {};
+    mode.dmSize = sizeof(mode);
+    if (!EnumDisplaySettings(nullptr, ENUM_CURRENT_SETTINGS, &mode) || mode.dmDisplayFrequency <= 1) {
+        return 0;   // 0 and 1 mean the hardware default
+    }
+    return static_cast<uint16_t>(mode.dmDisplayFrequency);
+#else
+    return 0;
+#endif
+}
+
+bool displaySize(int& width, int& height) {
+#if defined(__APPLE__)
+    CGDirectDisplayID display = CGMainDisplayID();
+    width = static_cast<int>(CGDisplayPixelsWide(display));
+    height = static_cast<int>(CGDisplayPixelsHigh(display));
+    return width > 0 && height > 0;
+#elif defined(_WIN32)
+    width = GetSystemMetrics(SM_CXSCREEN);
+    height = GetSystemMetrics(SM_CYSCREEN);
+    return width > 0 && height > 0;
+#else
+    (void)width;
+    (void)height;
+    return false;
+#endif
+}
@@ -0,0 +1,163 @@
+#include "IoUring.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    int setup(unsigned entries, io_uring_params& params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    }
+
+    int enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+    }
+
+    std::runtime_error failure(const char* what) {
+        return std::runtime_error(std::string(what) + ": " + std::strerror(errno));
+    }
+
+    void* map(int fd, size_t size, off_t offset) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    template <typename T>
+    T* at(void* base, uint32_t offset) {
+        return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+    }
+}
+
+IoUring::IoUring(unsigned entries) {
+    // Completions are only run when this thread enters the ring, so they
+    // never interrupt it; older kernels refuse the flags and get a plain ring
+    const unsigned attempts[] = {IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN, 0};
+    io_uring_params params{};
+    for (unsigned flags : attempts) {
+        params = io_uring_params{};
+        params.flags = flags;
+        fd_ = setup(entries, params);
+        if (fd_ >= 0 || errno != EINVAL) {
+            break;
+        }
+    }
+    if (fd_ < 0) {
+        throw failure("io_uring_setup failed");
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        ::close(fd_);
+        throw std::runtime_error("io_uring on this kernel is too old (needs 5.11 or later)");
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqRing_ = cqRing_ = map(fd_, sqRingSize_, IORING_OFF_SQ_RING);
+    sqes_ = sqRing_ ? static_cast<io_uring_sqe*>(map(fd_, sqesSize_, IORING_OFF_SQES)) : nullptr;
+    if (!sqes_) {
+        int err = errno;
+        if (sqRing_) {
+            munmap(sqRing_, sqRingSize_);
+        }
+        ::close(fd_);
+        errno = err;
+        throw failure("io_uring mmap failed");
+    }
+
+    sqHead_ = at<unsigned>(sqRing_, params.sq_off.head);
+    sqTail_ = at<unsigned>(sqRing_, params.sq_off.tail);
+    sqMask_ = *at<unsigned>(sqRing_, params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqArray_ = at<unsigned>(sqRing_, params.sq_off.array);
+    cqHead_ = at<unsigned>(cqRing_, params.cq_off.head);
+    cqTail_ = at<unsigned>(cqRing_, params.cq_off.tail);
+    cqMask_ = *at<unsigned>(cqRing_, params.cq_off.ring_mask);
+    cqes_ = at<io_uring_cqe>(cqRing_, params.cq_off.cqes);
+    sqLocalTail_ = *sqTail_;
+}
+
+IoUring::~IoUring() {
+    munmap(sqes_, sqesSize_);
+    munmap(sqRing_, sqRingSize_);
+    ::close(fd_);
+}
+
+bool IoUring::available() {
+    io_uring_params params{};
+    int fd = setup(2, params);
+    if (fd < 0) {
+        return false;
+    }
+    ::close(fd);
+    return true;
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqLocalTail_ - head >= sqEntries_) {
+        throw std::runtime_error("io_uring submission queue full");
+    }
+    unsigned index = sqLocalTail_ & sqMask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    ++sqLocalTail_;
+    ++toSubmit_;
+    return sqe;
+}
+
+bool IoUring::submitAndWait(unsigned waitFor, int64_t timeoutUs) {
+    __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+    __kernel_timespec ts{};
+    io_uring_getevents_arg arg{};
+    if (timeoutUs >= 0) {
+        ts.tv_sec = timeoutUs / 1000000;
+        ts.tv_nsec = (timeoutUs % 1000000) * 1000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    ++enterCalls_;
+    int submitted = enter(fd_, toSubmit_, waitFor, flags, &arg, sizeof(arg));
+    if (submitted >= 0) {
+        toSubmit_ -= static_cast<unsigned>(submitted);
+        return true;
+    }
+    if (errno == ETIME || errno == EINTR || errno == EBUSY) {
+        // Nothing was lost: unsubmitted entries go out with the next call
+        return false;
+    }
+    throw failure("io_uring_enter failed");
+}
+
+// ---------------------------------------------------------------------------
+//  BufferGroup
+// ---------------------------------------------------------------------------
+
+IoUring::BufferGroup::BufferGroup(IoUring& ring, uint16_t group, unsigned count, size_t size)
+    : ring_(ring)
+    , group_(group)
+    , size_(size)
+    , storage_(count * size) {
+    provide(0, count);
+}
+
+void IoUring::BufferGroup::recycle(uint16_t id) {
+    provide(id, 1);
+}
+
+void IoUring::BufferGroup::provide(uint16_t first, unsigned count) {
+    io_uring_sqe* sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(data(first));
+    sqe->len = static_cast<uint32_t>(size_);
+    sqe->off = first;
+    sqe->buf_group = group_;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#include "JitterBuffer.h"
+#include <algorithm>
+
+namespace {
+    // Smoothing for the jitter estimate, as in RFC 3550's interarrival jitter
+    constexpr double kJitterGain = 1.0 / 16;
+}
+
+JitterBuffer::JitterBuffer()
+    : JitterBuffer(Config{}) {
+}
+
+JitterBuffer::JitterBuffer(const Config& config)
+    : config_(config) {
+    targetDelayUs_ = config_.minDelayUs;
+}
+
+void JitterBuffer::observe(int64_t transitUs, uint64_t nowUs) {
+    if (!haveTransit_) {
+        haveTransit_ = true;
+        windowMin_ = prevWindowMin_ = transitUs;
+        windowStartUs_ = nowUs;
+    } else if (nowUs - windowStartUs_ >= config_.windowUs) {
+        // Rotate so that clock drift and route changes age out
+        prevWindowMin_ = windowMin_;
+        windowMin_ = transitUs;
+        windowStartUs_ = nowUs;
+    } else {
+        windowMin_ = std::min(windowMin_, transitUs);
+    }
+
+    int64_t base = std::min(windowMin_, prevWindowMin_);
+    jitterUs_ += (static_cast<double>(transitUs - base) - jitterUs_) * kJitterGain;
+
+    uint64_t target = static_cast<uint64_t>(jitterUs_ * config_.jitterMultiple);
+    targetDelayUs_ = std::min(std::max(target, config_.minDelayUs), config_.maxDelayUs);
+}
+
+bool JitterBuffer::push(const EventPacket& move, uint64_t nowUs) {
+    int64_t transit = static_cast<int64_t>(nowUs - move.timestamp);
+    observe(transit, nowUs);
+
+    // Earliest arrival this capture time could have had, plus the jitter allowance
+    int64_t base = std::min(windowMin_, prevWindowMin_);
+    uint64_t due = move.timestamp + static_cast<uint64_t>(base) + targetDelayUs_;
+    due = std::min(std::max(due, nowUs), nowUs + config_.maxDelayUs);
+    due = std::max(due, lastDueUs_);    // never reorder motion
+    lastDueUs_ = due;
+
+    bool room = queue_.size() < config_.maxPending;
+    if (!room) {
+        queue_.pop_front();
+    }
+    queue_.push_back({move, nowUs, due});
+    return room;
+}
+
+bool JitterBuffer::nextDue(uint64_t& dueUs) const {
+    if (queue_.empty()) {
+        return false;
+    }
+    dueUs = queue_.front().dueUs;
+    return true;
+}
+
+bool JitterBuffer::popDue(uint64_t nowUs, EventPacket& out, uint64_t& heldUs) {
+    if (queue_.empty() || queue_.front().dueUs > nowUs) {
+        return false;
+    }
+    Pending& p = queue_.front();
+    out = std::move(p.pkt);
+    heldUs = nowUs - p.arrivalUs;
+    queue_.pop_front();
+    return true;
+}
+
+bool JitterBuffer::flush(uint64_t nowUs, EventPacket& latest, uint64_t& heldUs, size_t& dropped) {
+    dropped = 0;
+    if (queue_.empty()) {
+        return false;
+    }
+    Pending& p = queue_.back();
+    latest = std::move(p.pkt);
+    heldUs = nowUs - p.arrivalUs;
+    dropped = queue_.size() - 1;
+    queue_.clear();
+    lastDueUs_ = nowUs;
+    return true;
+}
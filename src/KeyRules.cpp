@@ -0,0 +1,248 @@
+#include "KeyRules.h"
+#include <uiohook.h>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    struct KeyName {
+        const char* name;
+        uint16_t code;
+    };
+
+    // uiohook key names without the VC_ prefix, lowercased
+    const KeyName kKeyNames[] = {
+        {"escape", VC_ESCAPE}, {"f1", VC_F1}, {"f2", VC_F2}, {"f3", VC_F3}, {"f4", VC_F4},
+        {"f5", VC_F5}, {"f6", VC_F6}, {"f7", VC_F7}, {"f8", VC_F8}, {"f9", VC_F9}, {"f10", VC_F10},
+        {"f11", VC_F11}, {"f12", VC_F12}, {"f13", VC_F13}, {"f14", VC_F14}, {"f15", VC_F15},
+        {"f16", VC_F16}, {"f17", VC_F17}, {"f18", VC_F18}, {"f19", VC_F19}, {"f20", VC_F20},
+        {"f21", VC_F21}, {"f22", VC_F22}, {"f23", VC_F23}, {"f24", VC_F24},
+        {"backquote", VC_BACKQUOTE}, {"1", VC_1}, {"2", VC_2}, {"3", VC_3}, {"4", VC_4},
+        {"5", VC_5}, {"6", VC_6}, {"7", VC_7}, {"8", VC_8}, {"9", VC_9}, {"0", VC_0},
+        {"minus", VC_MINUS}, {"equals", VC_EQUALS}, {"backspace", VC_BACKSPACE}, {"tab", VC_TAB},
+        {"caps_lock", VC_CAPS_LOCK}, {"a", VC_A}, {"b", VC_B}, {"c", VC_C}, {"d", VC_D},
+        {"e", VC_E}, {"f", VC_F}, {"g", VC_G}, {"h", VC_H}, {"i", VC_I}, {"j", VC_J}, {"k", VC_K},
+        {"l", VC_L}, {"m", VC_M}, {"n", VC_N}, {"o", VC_O}, {"p", VC_P}, {"q", VC_Q}, {"r", VC_R},
+        {"s", VC_S}, {"t", VC_T}, {"u", VC_U}, {"v", VC_V}, {"w", VC_W}, {"x", VC_X}, {"y", VC_Y},
+        {"z", VC_Z}, {"open_bracket", VC_OPEN_BRACKET}, {"close_bracket", VC_CLOSE_BRACKET},
+        {"back_slash", VC_BACK_SLASH}, {"semicolon", VC_SEMICOLON}, {"quote", VC_QUOTE},
+        {"enter", VC_ENTER}, {"comma", VC_COMMA}, {"period", VC_PERIOD}, {"slash", VC_SLASH},
+        {"space", VC_SPACE}, {"printscreen", VC_PRINTSCREEN}, {"scroll_lock", VC_SCROLL_LOCK},
+        {"pause", VC_PAUSE}, {"lesser_greater", VC_LESSER_GREATER}, {"insert", VC_INSERT},
+        {"delete", VC_DELETE}, {"home", VC_HOME}, {"end", VC_END}, {"page_up", VC_PAGE_UP},
+        {"page_down", VC_PAGE_DOWN}, {"up", VC_UP}, {"left", VC_LEFT}, {"clear", VC_CLEAR},
+        {"right", VC_RIGHT}, {"down", VC_DOWN}, {"num_lock", VC_NUM_LOCK},
+        {"kp_divide", VC_KP_DIVIDE}, {"kp_multiply", VC_KP_MULTIPLY},
+        {"kp_subtract", VC_KP_SUBTRACT}, {"kp_equals", VC_KP_EQUALS}, {"kp_add", VC_KP_ADD},
+        {"kp_enter", VC_KP_ENTER}, {"kp_separator", VC_KP_SEPARATOR}, {"kp_1", VC_KP_1},
+        {"kp_2", VC_KP_2}, {"kp_3", VC_KP_3}, {"kp_4", VC_KP_4}, {"kp_5", VC_KP_5},
+        {"kp_6", VC_KP_6}, {"kp_7", VC_KP_7}, {"kp_8", VC_KP_8}, {"kp_9", VC_KP_9},
+        {"kp_0", VC_KP_0}, {"kp_end", VC_KP_END}, {"kp_down", VC_KP_DOWN},
+        {"kp_page_down", VC_KP_PAGE_DOWN}, {"kp_left", VC_KP_LEFT}, {"kp_clear", VC_KP_CLEAR},
+        {"kp_right", VC_KP_RIGHT}, {"kp_home", VC_KP_HOME}, {"kp_up", VC_KP_UP},
+        {"kp_page_up", VC_KP_PAGE_UP}, {"kp_insert", VC_KP_INSERT}, {"kp_delete", VC_KP_DELETE},
+        {"shift_l", VC_SHIFT_L}, {"shift_r", VC_SHIFT_R}, {"control_l", VC_CONTROL_L},
+        {"control_r", VC_CONTROL_R}, {"alt_l", VC_ALT_L}, {"alt_r", VC_ALT_R},
+        {"meta_l", VC_META_L}, {"meta_r", VC_META_R}, {"context_menu", VC_CONTEXT_MENU},
+        {"power", VC_POWER}, {"sleep", VC_SLEEP}, {"wake", VC_WAKE}, {"media_play", VC_MEDIA_PLAY},
+        {"media_stop", VC_MEDIA_STOP}, {"media_previous", VC_MEDIA_PREVIOUS},
+        {"media_next", VC_MEDIA_NEXT}, {"media_select", VC_MEDIA_SELECT},
+        {"media_eject", VC_MEDIA_EJECT}, {"volume_mute", VC_VOLUME_MUTE},
+        {"volume_up", VC_VOLUME_UP}, {"volume_down", VC_VOLUME_DOWN}, {"app_mail", VC_APP_MAIL},
+        {"app_calculator", VC_APP_CALCULATOR}, {"app_music", VC_APP_MUSIC},
+        {"app_pictures", VC_APP_PICTURES}, {"browser_search", VC_BROWSER_SEARCH},
+        {"browser_home", VC_BROWSER_HOME}, {"browser_back", VC_BROWSER_BACK},
+        {"browser_forward", VC_BROWSER_FORWARD}, {"browser_stop", VC_BROWSER_STOP},
+        {"browser_refresh", VC_BROWSER_REFRESH}, {"browser_favorites", VC_BROWSER_FAVORITES},
+        {"katakana", VC_KATAKANA}, {"underscore", VC_UNDERSCORE}, {"furigana", VC_FURIGANA},
+        {"kanji", VC_KANJI}, {"hiragana", VC_HIRAGANA}, {"yen", VC_YEN}, {"kp_comma", VC_KP_COMMA},
+        {"sun_help", VC_SUN_HELP}, {"sun_stop", VC_SUN_STOP}, {"sun_props", VC_SUN_PROPS},
+        {"sun_front", VC_SUN_FRONT}, {"sun_open", VC_SUN_OPEN}, {"sun_find", VC_SUN_FIND},
+        {"sun_again", VC_SUN_AGAIN}, {"sun_undo", VC_SUN_UNDO}, {"sun_copy", VC_SUN_COPY},
+        {"sun_insert", VC_SUN_INSERT}, {"sun_cut", VC_SUN_CUT},
+    };
+
+    // Indexed by MASK_* bit position
+    const uint16_t kModifierKeys[8] = {
+        VC_SHIFT_L, VC_CONTROL_L, VC_META_L, VC_ALT_L,
+        VC_SHIFT_R, VC_CONTROL_R, VC_META_R, VC_ALT_R,
+    };
+
+    // Chord modifiers match either side
+    uint8_t chordModifier(const std::string& name) {
+        if (name == "shift") return KeyRules::kShift;
+        if (name == "ctrl" || name == "control") return KeyRules::kCtrl;
+        if (name == "meta" || name == "cmd" || name == "win") return KeyRules::kMeta;
+        if (name == "alt" || name == "option") return KeyRules::kAlt;
+        return 0;
+    }
+
+    uint32_t parseKey(const std::string& name) {
+        if (!name.empty() && std::isdigit(static_cast<unsigned char>(name[0]))) {
+            char* end = nullptr;
+            unsigned long code = std::strtoul(name.c_str(), &end, 0);
+            if (*end == '\0' && code > 0 && code <= 0xFFFF) {
+                return static_cast<uint32_t>(code);
+            }
+            throw std::runtime_error("bad keycode '" + name + "'");
+        }
+        for (const KeyName& k : kKeyNames) {
+            if (name == k.name) {
+                return k.code;
+            }
+        }
+        // Bare modifier names mean the left key
+        switch (chordModifier(name)) {
+            case KeyRules::kShift: return VC_SHIFT_L;
+            case KeyRules::kCtrl:  return VC_CONTROL_L;
+            case KeyRules::kMeta:  return VC_META_L;
+            case KeyRules::kAlt:   return VC_ALT_L;
+        }
+        throw std::runtime_error("unknown key '" + name + "'");
+    }
+
+    KeyAction parseAction(const std::string& name) {
+        if (name == "host") return KeyAction::SwitchToHost;
+        if (name == "lock") return KeyAction::ToggleLock;
+        throw std::runtime_error("unknown action '" + name + "'");
+    }
+
+    std::string lower(std::string s) {
+        for (char& c : s) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return s;
+    }
+}
+
+KeyRules::KeyRules() {
+    clear();
+}
+
+void KeyRules::clear() {
+    pageOf_.fill(0);
+    pages_.assign(1, Page{});
+    hotkeys_.clear();
+    hotkeyCount_ = 0;
+    remapCount_ = 0;
+    swallowRelease_ = 0;
+    for (int bit = 0; bit < 8; ++bit) {
+        entryFor(kModifierKeys[bit]).modifier = static_cast<uint8_t>(1 << bit);
+    }
+}
+
+uint32_t KeyRules::modifierKeycode(int bit) {
+    return kModifierKeys[bit & 7];
+}
+
+KeyRules::Entry& KeyRules::entryFor(uint32_t keycode) {
+    if (keycode == 0 || keycode > 0xFFFF) {
+        throw std::runtime_error("keycode out of range: " + std::to_string(keycode));
+    }
+    uint8_t& page = pageOf_[keycode >> 8];
+    if (page == 0) {
+        if (pages_.size() > 255) {
+            throw std::runtime_error("too many key pages");
+        }
+        page = static_cast<uint8_t>(pages_.size());
+        pages_.push_back(Page{});
+    }
+    return pages_[page].entries[keycode & 0xFF];
+}
+
+void KeyRules::addHotkey(uint8_t modifiers, uint32_t keycode, KeyAction action) {
+    Entry& e = entryFor(keycode);
+    if (e.hotkeys == 0) {
+        if (hotkeys_.size() >= 255) {
+            throw std::runtime_error("too many hotkey keys");
+        }
+        hotkeys_.push_back(Hotkeys{});
+        e.hotkeys = static_cast<uint8_t>(hotkeys_.size());
+    }
+    hotkeys_[e.hotkeys - 1].byModifiers[modifiers & 0x0F] = action;
+    ++hotkeyCount_;
+}
+
+void KeyRules::addRemap(uint32_t from, uint32_t to) {
+    if (to == 0 || to > 0xFFFF) {
+        throw std::runtime_error("keycode out of range: " + std::to_string(to));
+    }
+    entryFor(from).remap = static_cast<uint16_t>(to);
+    ++remapCount_;
+}
+
+void KeyRules::load(std::istream& in) {
+    clear();
+    std::string line;
+    for (int lineNo = 1; std::getline(in, line); ++lineNo) {
+        line = lower(line.substr(0, line.find('#')));
+        std::istringstream words(line);
+        std::string kind, a, b, extra;
+        if (!(words >> kind)) {
+            continue;
+        }
+        try {
+            if (!(words >> a >> b) || (words >> extra)) {
+                throw std::runtime_error("expected '" + kind + " <key> <value>'");
+            }
+            if (kind == "hotkey") {
+                uint8_t mods = 0;
+                size_t start = 0, plus;
+                while ((plus = a.find('+', start)) != std::string::npos) {
+                    uint8_t m = chordModifier(a.substr(start, plus - start));
+                    if (m == 0) {
+                        throw std::runtime_error("'" + a.substr(start, plus - start) + "' is not a modifier");
+                    }
+                    mods |= m;
+                    start = plus + 1;
+                }
+                addHotkey(mods, parseKey(a.substr(start)), parseAction(b));
+            } else if (kind == "remap") {
+                addRemap(parseKey(a), parseKey(b));
+            } else {
+                throw std::runtime_error("unknown rule '" + kind + "'");
+            }
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error("key rules line " + std::to_string(lineNo) + ": " + e.what());
+        }
+    }
+}
+
+void KeyRules::loadFile(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("cannot open key rules file " + path);
+    }
+    load(in);
+}
+
+KeyAction KeyRules::onKey(uint32_t& keycode, bool pressed) {
+    if (keycode == 0 || keycode > 0xFFFF) {
+        return KeyAction::Forward;
+    }
+    const Entry& e = lookup(keycode);
+    held_ = pressed ? (held_ | e.modifier) : (held_ & ~e.modifier);
+
+    if (keycode == swallowRelease_) {
+        // Auto-repeat and release of a key that fired a hotkey
+        if (!pressed) {
+            swallowRelease_ = 0;
+        }
+        return KeyAction::Swallow;
+    }
+    if (pressed && e.hotkeys != 0) {
+        uint8_t others = held_ & ~e.modifier;
+        KeyAction action = hotkeys_[e.hotkeys - 1].byModifiers[(others | others >> 4) & 0x0F];
+        if (action != KeyAction::Forward) {
+            swallowRelease_ = keycode;
+            return action;
+        }
+    }
+    if (e.remap != 0) {
+        keycode = e.remap;
+    }
+    return KeyAction::Forward;
+}
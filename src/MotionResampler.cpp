@@ -0,0 +1,48 @@
+#include "MotionResampler.h"
+#include <stdexcept>
+
+MotionResampler::MotionResampler(uint32_t rateHz) {
+    setRate(rateHz);
+}
+
+void MotionResampler::setRate(uint32_t rateHz) {
+    if (rateHz == 0) {
+        throw std::invalid_argument("Motion rate must be positive");
+    }
+    rateHz_ = rateHz;
+    periodUs_ = 1000000 / rateHz;
+}
+
+MotionResampler::Outcome MotionResampler::push(const EventPacket& move, uint64_t nowUs, EventPacket& out) {
+    if (holding_) {
+        held_ = move;
+        ++merged_;
+        return Outcome::Merge;
+    }
+    if (!sentAny_ || nowUs >= nextDueUs()) {
+        sentAny_ = true;
+        lastSentUs_ = nowUs;
+        out = move;
+        return Outcome::Send;
+    }
+    held_ = move;
+    holding_ = true;
+    return Outcome::Hold;
+}
+
+bool MotionResampler::popDue(uint64_t nowUs, EventPacket& out) {
+    if (!holding_ || nowUs < nextDueUs()) {
+        return false;
+    }
+    return flush(nowUs, out);
+}
+
+bool MotionResampler::flush(uint64_t nowUs, EventPacket& out) {
+    if (!holding_) {
+        return false;
+    }
+    holding_ = false;
+    lastSentUs_ = nowUs;
+    out = std::move(held_);
+    return true;
+}
@@ -0,0 +1,146 @@
+#include "PacketDecoder.h"
+#include "ByteOrder.h"
+#include "ClipboardSync.h"
+#include "TextInput.h"
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define SAMENESS_SSSE3_DECODE 1
+#include <immintrin.h>
+#endif
+
+namespace {
+    struct Bounds {
+        uint32_t min;
+        uint32_t max;
+    };
+
+    constexpr uint32_t kDigest = sizeof(ClipboardSync::Digest);
+
+    // Indexed by SamenessEventType; {1, 0} marks an unknown type.
+    constexpr Bounds kBounds[] = {
+        {1, 0},                                                 // 0: unused
+        {4, 4},                                                 // KeyPress
+        {4, 4},                                                 // KeyRelease
+        {8, 8},                                                 // MouseMove
+        {9, 9},                                                 // MouseButtonPress
+        {9, 9},                                                 // MouseButtonRelease
+        {kDigest + 8, kDigest + 8},                             // ClipboardOffer
+        {kDigest, kDigest},                                     // ClipboardRequest
+        {kDigest + 8, kDigest + 8 + ClipboardSync::kChunkSize}, // ClipboardChunk
+        {0, 0},                                                 // Heartbeat
+        {1, kMaxTextBytes},                                     // TextInput
+        {16, 16},                                               // SwitchBack
+    };
+    constexpr size_t kKnownTypes = sizeof(kBounds) / sizeof(kBounds[0]);
+
+    inline bool validate(uint8_t type, uint32_t size) {
+        if (type >= kKnownTypes) {
+            return false;
+        }
+        const Bounds& b = kBounds[type];
+        return size >= b.min && size <= b.max;
+    }
+}
+
+bool payloadBounds(SamenessEventType type, uint32_t& minSize, uint32_t& maxSize) {
+    uint8_t t = static_cast<uint8_t>(type);
+    if (t >= kKnownTypes || kBounds[t].min > kBounds[t].max) {
+        return false;
+    }
+    minSize = kBounds[t].min;
+    maxSize = kBounds[t].max;
+    return true;
+}
+
+#if defined(SAMENESS_SSSE3_DECODE)
+// Decodes headers while at least 16 bytes remain, one shuffle per header.
+// Compiled for SSSE3 regardless of the baseline target and only called when
+// the CPU supports it.
+__attribute__((target("ssse3")))
+static void decodeSsse3(const uint8_t* data, size_t len, PacketRecord* out, size_t maxRecords,
+                        DecodeResult& r, size_t& off) {
+    // Bytes 1..8 (timestamp) and 9..12 (size) reversed into two little-endian lanes.
+    const __m128i swap = _mm_setr_epi8(8, 7, 6, 5, 4, 3, 2, 1, 12, 11, 10, 9, -1, -1, -1, -1);
+    while (r.count < maxRecords && len - off >= 16) {
+        __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + off));
+        __m128i hdr = _mm_shuffle_epi8(raw, swap);
+        uint8_t type = data[off];
+        uint64_t timestamp = static_cast<uint64_t>(_mm_cvtsi128_si64(hdr));
+        uint32_t size = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(hdr, 8)));
+        if (!validate(type, size)) {
+            r.malformed = true;
+            return;
+        }
+        if (len - off - EventPacket::kHeaderSize < size) {
+            return;
+        }
+        out[r.count++] = { static_cast<SamenessEventType>(type),
+                           static_cast<uint32_t>(off + EventPacket::kHeaderSize), size, timestamp };
+        off += EventPacket::kHeaderSize + size;
+        r.consumed = off;
+    }
+}
+#endif
+
+DecodeResult decodePackets(const uint8_t* data, size_t len, PacketRecord* out, size_t maxRecords) {
+    DecodeResult r;
+    size_t off = 0;
+
+#if defined(SAMENESS_SSSE3_DECODE)
+    static const bool haveSsse3 = __builtin_cpu_supports("ssse3");
+    if (haveSsse3) {
+        decodeSsse3(data, len, out, maxRecords, r, off);
+        if (r.malformed) {
+            return r;
+        }
+    }
+#endif
+
+    // Tail (or the whole buffer without SSSE3): byte-swap loads
+    while (r.count < maxRecords && len - off >= EventPacket::kHeaderSize) {
+        uint8_t type = data[off];
+        uint64_t timestamp = byteorder::loadBe64(data + off + 1);
+        uint32_t size = byteorder::loadBe32(data + off + 9);
+        if (!validate(type, size)) {
+            r.malformed = true;
+            return r;
+        }
+        if (len - off - EventPacket::kHeaderSize < size) {
+            return r;
+        }
+        out[r.count++] = { static_cast<SamenessEventType>(type),
+                           static_cast<uint32_t>(off + EventPacket::kHeaderSize), size, timestamp };
+        off += EventPacket::kHeaderSize + size;
+        r.consumed = off;
+    }
+    return r;
+}
+
+DecodeResult decodePacketsScalar(const uint8_t* data, size_t len, PacketRecord* out, size_t maxRecords) {
+    DecodeResult r;
+    size_t off = 0;
+    while (r.count < maxRecords && len - off >= EventPacket::kHeaderSize) {
+        uint8_t type = data[off];
+        uint64_t timestamp = 0;
+        for (int i = 0; i < 8; ++i) {
+            timestamp = (timestamp << 8) | data[off + 1 + i];
+        }
+        uint32_t size = 0;
+        for (int i = 0; i < 4; ++i) {
+            size = (size << 8) | data[off + 9 + i];
+        }
+        if (!validate(type, size)) {
+            r.malformed = true;
+            return r;
+        }
+        if (len - off - EventPacket::kHeaderSize < size) {
+            return r;
+        }
+        out[r.count++] = { static_cast<SamenessEventType>(type),
+                           static_cast<uint32_t>(off + EventPacket::kHeaderSize), size, timestamp };
+        off += EventPacket::kHeaderSize + size;
+        r.consumed = off;
+    }
+    return r;
+}
@@ -0,0 +1,191 @@
+#include "Pasteboard.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <csignal>
+#endif
+
+namespace pasteboard {
+
+namespace {
+#if !defined(_WIN32)
+    const char* readCommand() {
+#if defined(__APPLE__)
+        return "pbpaste 2>/dev/null";
+#else
+        return std::getenv("WAYLAND_DISPLAY") ? "wl-paste --no-newline 2>/dev/null"
+                                              : "xclip -selection clipboard -o 2>/dev/null";
+#endif
+    }
+
+    const char* writeCommand() {
+#if defined(__APPLE__)
+        return "pbcopy 2>/dev/null";
+#else
+        return std::getenv("WAYLAND_DISPLAY") ? "wl-copy 2>/dev/null"
+                                              : "xclip -selection clipboard -i 2>/dev/null";
+#endif
+    }
+#endif
+}
+
+bool read(std::vector<uint8_t>& content, size_t maxSize) {
+    content.clear();
+#if defined(_WIN32)
+    if (!OpenClipboard(nullptr)) {
+        return false;
+    }
+    bool ok = false;
+    if (HANDLE data = GetClipboardData(CF_UNICODETEXT)) {
+        if (const wchar_t* text = static_cast<const wchar_t*>(GlobalLock(data))) {
+            int n = WideCharToMultiByte(CP_UTF8, 0, text, -1, nullptr, 0, nullptr, nullptr);
+            if (n > 0 && static_cast<size_t>(n - 1) <= maxSize) {
+                content.resize(static_cast<size_t>(n));
+                WideCharToMultiByte(CP_UTF8, 0, text, -1, reinterpret_cast<char*>(content.data()), n, nullptr, nullptr);
+                content.pop_back();     // the terminator
+                ok = true;
+            }
+            GlobalUnlock(data);
+        }
+    }
+    CloseClipboard();
+    return ok;
+#else
+    FILE* pipe = popen(readCommand(), "r");
+    if (!pipe) {
+        return false;
+    }
+    uint8_t buf[16 * 1024];
+    size_t n = 0;
+    bool tooLarge = false;
+    while ((n = fread(buf, 1, sizeof(buf), pipe)) > 0) {
+        if (content.size() + n > maxSize) {
+            tooLarge = true;
+            break;
+        }
+        content.insert(content.end(), buf, buf + n);
+    }
+    // Closing the pipe early ends a tool still writing
+    int status = pclose(pipe);
+    return !tooLarge && status == 0;
+#endif
+}
+
+bool write(const std::vector<uint8_t>& content) {
+#if defined(_WIN32)
+    const char* utf8 = reinterpret_cast<const char*>(content.data());
+    int n = content.empty() ? 0 : MultiByteToWideChar(CP_UTF8, 0, utf8, static_cast<int>(content.size()), nullptr, 0);
+    if (n == 0 && !content.empty()) {
+        return false;
+    }
+    HGLOBAL mem = GlobalAlloc(GMEM_MOVEABLE, (static_cast<size_t>(n) + 1) * sizeof(wchar_t));
+    if (!mem) {
+        return false;
+    }
+    wchar_t* text = static_cast<wchar_t*>(GlobalLock(mem));
+    if (n > 0) {
+        MultiByteToWideChar(CP_UTF8, 0, utf8, static_cast<int>(content.size()), text, n);
+    }
+    text[n] = L'\0';
+    GlobalUnlock(mem);
+    if (!OpenClipboard(nullptr)) {
+        GlobalFree(mem);
+        return false;
+    }
+    EmptyClipboard();
+    // The clipboard owns the memory once this succeeds
+    bool ok = SetClipboardData(CF_UNICODETEXT, mem) != nullptr;
+    CloseClipboard();
+    if (!ok) {
+        GlobalFree(mem);
+    }
+    return ok;
+#else
+    // A tool that is missing or exits early must not take the process down
+    static const bool ignoreSigpipe = (std::signal(SIGPIPE, SIG_IGN), true);
+    (void)ignoreSigpipe;
+    FILE* pipe = popen(writeCommand(), "w");
+    if (!pipe) {
+        return false;
+    }
+    bool ok = fwrite(content.data(), 1, content.size(), pipe) == content.size();
+    return pclose(pipe) == 0 && ok;
+#endif
+}
+
+}
+
+PasteboardBridge::PasteboardBridge(ClipboardSync& sync, std::chrono::milliseconds interval, Sender send,
+                                   Reader read, Writer write)
+    : sync_(sync), interval_(interval), send_(std::move(send)), read_(std::move(read)), write_(std::move(write)) {
+    if (!read_) {
+        read_ = [](std::vector<uint8_t>& content) { return pasteboard::read(content, ClipboardSync::kMaxContentSize); };
+    }
+    if (!write_) {
+        write_ = [](const std::vector<uint8_t>& content) { return pasteboard::write(content); };
+    }
+    sync_.setOfferHandler([this](const ClipboardSync::Digest&, uint64_t) {
+        EventPacket request;
+        if (sync_.requestRemote(request)) {
+            send_(std::move(request));
+        }
+    });
+    sync_.setContentHandler([this](const std::vector<uint8_t>& content) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            content_ = content;
+            haveContent_ = true;
+        }
+        wake_.notify_one();
+    });
+}
+
+PasteboardBridge::~PasteboardBridge() {
+    stop();
+    sync_.setOfferHandler(nullptr);
+    sync_.setContentHandler(nullptr);
+}
+
+void PasteboardBridge::start() {
+    thread_ = std::thread([this]() { run(); });
+}
+
+void PasteboardBridge::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void PasteboardBridge::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        if (haveContent_) {
+            std::vector<uint8_t> content;
+            content.swap(content_);
+            haveContent_ = false;
+            lock.unlock();
+            if (!write_(content)) {
+                std::cerr << "Could not put " << content.size() << " bytes from the peer on the clipboard" << std::endl;
+            }
+            lock.lock();
+            continue;
+        }
+        lock.unlock();
+        std::vector<uint8_t> content;
+        EventPacket offer;
+        if (read_(content) && sync_.offerLocal(std::move(content), offer)) {
+            send_(std::move(offer));
+        }
+        lock.lock();
+        wake_.wait_for(lock, interval_, [this]() { return stopping_ || haveContent_; });
+    }
+}
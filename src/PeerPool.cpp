@@ -0,0 +1,230 @@
+#include "PeerPool.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+PeerPool::Attempt::Watch::Watch(Attempt& attempt, std::function<void()> cancel)
+    : attempt_(attempt) {
+    std::lock_guard<std::mutex> lock(attempt_.pool_.mutex_);
+    State& state = attempt_.pool_.states_[attempt_.index_];
+    if (state.cancelled) {
+        throw std::runtime_error(attempt_.pool_.stopping_ ? "connection attempt cancelled"
+                                                          : "connection attempt timed out");
+    }
+    state.cancel = std::move(cancel);
+}
+
+PeerPool::Attempt::Watch::~Watch() {
+    std::lock_guard<std::mutex> lock(attempt_.pool_.mutex_);
+    attempt_.pool_.states_[attempt_.index_].cancel = nullptr;
+}
+
+bool PeerPool::Attempt::restart() {
+    {
+        std::lock_guard<std::mutex> lock(pool_.mutex_);
+        if (pool_.stopping_) {
+            return false;
+        }
+        State& state = pool_.states_[index_];
+        state.cancelled = false;
+        state.deadline = std::chrono::steady_clock::now() + pool_.config_.connectTimeout;
+    }
+    pool_.changed_.notify_all();
+    return true;
+}
+
+PeerPool::PeerPool(SessionGroup& group, std::vector<std::string> addresses, Connector connector)
+    : PeerPool(group, std::move(addresses), std::move(connector), Config{}) {}
+
+PeerPool::PeerPool(SessionGroup& group, std::vector<std::string> addresses, Connector connector, const Config& config)
+    : group_(group)
+    , connector_(std::move(connector))
+    , config_(config) {
+    auto now = std::chrono::steady_clock::now();
+    for (std::string& address : addresses) {
+        State state;
+        state.address = std::move(address);
+        state.due = now;
+        state.backoff = config_.retryMin;
+        states_.push_back(std::move(state));
+    }
+}
+
+PeerPool::~PeerPool() {
+    stop();
+}
+
+void PeerPool::start() {
+    for (size_t i = 0; i < states_.size(); ++i) {
+        threads_.emplace_back([this, i]() { run(i); });
+    }
+    watchdog_ = std::thread([this]() { watch(); });
+}
+
+void PeerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (State& state : states_) {
+            if (state.deadline != std::chrono::steady_clock::time_point::max()) {
+                cancel(state);
+            }
+        }
+    }
+    changed_.notify_all();
+    for (std::thread& t : threads_) {
+        t.join();
+    }
+    threads_.clear();
+    if (watchdog_.joinable()) {
+        watchdog_.join();
+    }
+}
+
+size_t PeerPool::waitConnected(std::chrono::milliseconds timeout) {
+    auto upCount = [this]() {
+        return static_cast<size_t>(std::count_if(states_.begin(), states_.end(), [](const State& s) { return s.up; }));
+    };
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait_for(lock, timeout, [&]() { return upCount() == states_.size(); });
+    return upCount();
+}
+
+std::vector<PeerPool::Link> PeerPool::links() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Link> out;
+    for (const State& s : states_) {
+        out.push_back({s.address, s.up, s.connects, s.failures, s.connectUs});
+    }
+    return out;
+}
+
+void PeerPool::run(size_t index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        State& state = states_[index];
+        if (state.up) {
+            changed_.wait(lock);
+            continue;
+        }
+        if (state.due > std::chrono::steady_clock::now()) {
+            changed_.wait_until(lock, state.due);
+            continue;
+        }
+        lock.unlock();
+        connect(index);
+        lock.lock();
+    }
+}
+
+void PeerPool::watch() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        auto now = std::chrono::steady_clock::now();
+        auto next = std::chrono::steady_clock::time_point::max();
+        for (State& state : states_) {
+            if (state.deadline <= now) {
+                cancel(state);
+            } else {
+                next = std::min(next, state.deadline);
+            }
+        }
+        if (next == std::chrono::steady_clock::time_point::max()) {
+            changed_.wait(lock);
+        } else {
+            changed_.wait_until(lock, next);
+        }
+    }
+}
+
+void PeerPool::connect(size_t index) {
+    std::string address;
+    uint64_t generation = 0;
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        State& state = states_[index];
+        generation = ++state.generation;
+        state.closed = false;
+        state.cancelled = stopping_;
+        state.deadline = start + config_.connectTimeout;
+        address = state.address;
+    }
+    changed_.notify_all();
+    Attempt attempt(*this, index);
+    std::shared_ptr<Session> session;
+    try {
+        session = connector_(index, address, attempt, [this, index, generation](const boost::system::error_code&) {
+            dropped(index, generation);
+        });
+    } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        State& state = states_[index];
+        state.deadline = std::chrono::steady_clock::time_point::max();
+        ++state.failures;
+        std::cerr << "Cannot reach " << address << ": " << e.what() << "; retrying in "
+                  << state.backoff.count() << " ms" << std::endl;
+        retryLater(state);
+        return;
+    }
+    uint64_t elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    State& state = states_[index];
+    state.deadline = std::chrono::steady_clock::time_point::max();
+    if (state.closed) {
+        // Dropped before it was ever used
+        ++state.failures;
+        retryLater(state);
+        return;
+    }
+    state.session = session;
+    state.up = true;
+    state.backoff = config_.retryMin;
+    ++state.connects;
+    state.connectUs = elapsedUs;
+    group_.add(std::move(session));
+    lock.unlock();
+    changed_.notify_all();
+    std::cout << "Session to " << address << " ready in " << elapsedUs / 1000.0 << " ms" << std::endl;
+}
+
+void PeerPool::dropped(size_t index, uint64_t generation) {
+    std::shared_ptr<Session> session;
+    bool stopping = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        State& state = states_[index];
+        if (state.generation != generation) {
+            return;
+        }
+        state.closed = true;
+        if (!state.up) {
+            return;
+        }
+        session = std::move(state.session);
+        group_.remove(session.get());
+        state.up = false;
+        state.due = std::chrono::steady_clock::now() + config_.retryMin;
+        stopping = stopping_;
+    }
+    changed_.notify_all();
+    if (!stopping && onDown_) {
+        onDown_(index);
+    }
+}
+
+void PeerPool::retryLater(State& state) {
+    state.due = std::chrono::steady_clock::now() + state.backoff;
+    state.backoff = std::min(state.backoff * 2, config_.retryMax);
+}
+
+void PeerPool::cancel(State& state) {
+    state.cancelled = true;
+    state.deadline = std::chrono::steady_clock::time_point::max();
+    if (state.cancel) {
+        state.cancel();
+        state.cancel = nullptr;
+    }
+}
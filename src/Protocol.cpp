@@ -0,0 +1,209 @@
+#include "Protocol.h"
+#include "ByteOrder.h"
+#include "PacketDecoder.h"
+#include "WireV2.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+namespace {
+    // Headers decoded per pass over a v1 stream
+    constexpr size_t kDecodeBatch = 64;
+
+    Hello makeHello(uint16_t version, uint16_t refreshHz = 0) {
+        Hello h{};
+        std::memcpy(h.magic, kHelloMagic, sizeof(h.magic));
+        h.version = byteorder::toLe(version);
+        h.refreshHz = byteorder::toLe(refreshHz);
+        return h;
+    }
+
+    bool isHello(const Hello& h) {
+        return std::memcmp(h.magic, kHelloMagic, sizeof(h.magic)) == 0;
+    }
+
+    // A v1 client's first byte is the type of its first EventPacket
+    bool startsPacket(uint8_t first) {
+        return first >= static_cast<uint8_t>(SamenessEventType::KeyPress) &&
+               first <= static_cast<uint8_t>(SamenessEventType::SwitchBack);
+    }
+
+    template <typename Stream>
+    uint16_t clientHandshake(Stream& stream, uint16_t maxVersion, uint16_t* peerRefreshHz) {
+        if (peerRefreshHz) {
+            *peerRefreshHz = 0;
+        }
+        if (maxVersion <= kProtocolV1) {
+            return kProtocolV1;
+        }
+        Hello hello = makeHello(maxVersion);
+        boost::asio::write(stream, boost::asio::buffer(&hello, sizeof(hello)));
+
+        Hello reply{};
+        boost::system::error_code ec;
+        boost::asio::read(stream, boost::asio::buffer(&reply, sizeof(reply)), ec);
+        if (ec) {
+            // A v1-only server reads the Hello as a malformed packet and hangs up.
+            throw ProtocolError("Server closed the connection during version negotiation: " + ec.message());
+        }
+        uint16_t version = byteorder::fromLe(reply.version);
+        if (!isHello(reply) || version < kProtocolV1 || version > maxVersion) {
+            throw ProtocolError("Server does not speak a compatible protocol version");
+        }
+        if (peerRefreshHz) {
+            *peerRefreshHz = byteorder::fromLe(reply.refreshHz);
+        }
+        return version;
+    }
+
+    template <typename Stream>
+    uint16_t serverHandshake(Stream& stream, std::vector<uint8_t>& leftover, uint16_t maxVersion, uint16_t refreshHz) {
+        leftover.clear();
+        uint8_t buf[sizeof(Hello)];
+        size_t got = 0;
+
+        // The first byte decides: a Hello starts with 'S', a v1 client's
+        // first EventPacket with its type.
+        got += stream.read_some(boost::asio::buffer(buf, sizeof(buf)));
+        if (buf[0] != kHelloMagic[0]) {
+            if (!startsPacket(buf[0])) {
+                throw ProtocolError("Neither a protocol hello nor an event packet");
+            }
+            leftover.assign(buf, buf + got);
+            return kProtocolV1;
+        }
+        boost::asio::read(stream, boost::asio::buffer(buf + got, sizeof(buf) - got));
+
+        Hello hello;
+        std::memcpy(&hello, buf, sizeof(hello));
+        if (!isHello(hello)) {
+            throw ProtocolError("Malformed protocol hello");
+        }
+        uint16_t version = std::min(byteorder::fromLe(hello.version), maxVersion);
+        Hello reply = makeHello(version, refreshHz);
+        boost::asio::write(stream, boost::asio::buffer(&reply, sizeof(reply)));
+        return version;
+    }
+}
+
+uint16_t negotiateClient(TlsStream& stream, uint16_t maxVersion, uint16_t* peerRefreshHz) {
+    return clientHandshake(stream, maxVersion, peerRefreshHz);
+}
+
+uint16_t negotiateClient(boost::asio::ip::tcp::socket& socket, uint16_t maxVersion, uint16_t* peerRefreshHz) {
+    return clientHandshake(socket, maxVersion, peerRefreshHz);
+}
+
+uint16_t negotiateServer(TlsStream& stream, std::vector<uint8_t>& leftover, uint16_t maxVersion, uint16_t refreshHz) {
+    return serverHandshake(stream, leftover, maxVersion, refreshHz);
+}
+
+uint16_t negotiateServer(boost::asio::ip::tcp::socket& socket, std::vector<uint8_t>& leftover, uint16_t maxVersion, uint16_t refreshHz) {
+    return serverHandshake(socket, leftover, maxVersion, refreshHz);
+}
+
+void asyncNegotiateServer(TlsStream& stream, uint16_t maxVersion, uint16_t refreshHz, NegotiateHandler handler) {
+    // serverHandshake, one read or write at a time
+    struct State {
+        TlsStream& stream;
+        uint16_t maxVersion;
+        uint16_t refreshHz;
+        NegotiateHandler handler;
+        uint8_t buf[sizeof(Hello)];
+        size_t got = 0;
+        Hello reply;
+    };
+    auto state = std::make_shared<State>(State{stream, maxVersion, refreshHz, std::move(handler), {}, 0, {}});
+    auto fail = [state](const boost::system::error_code& ec) { state->handler(ec, 0, {}); };
+
+    stream.async_read_some(boost::asio::buffer(state->buf), [state, fail](const boost::system::error_code& ec, size_t n) {
+        if (ec) {
+            fail(ec);
+            return;
+        }
+        state->got = n;
+        if (state->buf[0] != kHelloMagic[0]) {
+            if (!startsPacket(state->buf[0])) {
+                fail(boost::asio::error::invalid_argument);
+                return;
+            }
+            state->handler({}, kProtocolV1, std::vector<uint8_t>(state->buf, state->buf + state->got));
+            return;
+        }
+        boost::asio::async_read(state->stream, boost::asio::buffer(state->buf + n, sizeof(Hello) - n),
+            [state, fail](const boost::system::error_code& ec, size_t) {
+                Hello hello;
+                std::memcpy(&hello, state->buf, sizeof(hello));
+                if (ec || !isHello(hello)) {
+                    fail(ec ? ec : boost::asio::error::invalid_argument);
+                    return;
+                }
+                uint16_t version = std::min(byteorder::fromLe(hello.version), state->maxVersion);
+                state->reply = makeHello(version, state->refreshHz);
+                boost::asio::async_write(state->stream, boost::asio::buffer(&state->reply, sizeof(state->reply)),
+                    [state, fail, version](const boost::system::error_code& ec, size_t) {
+                        if (ec) {
+                            fail(ec);
+                            return;
+                        }
+                        state->handler({}, version, {});
+                    });
+            });
+    });
+}
+
+void encodePacket(const EventPacket& pkt, uint16_t version, std::vector<uint8_t>& out) {
+    if (version >= kProtocolV2) {
+        wire::encode(pkt, out);
+        return;
+    }
+    pkt.appendTo(out);
+}
+
+bool decodeStream(uint16_t version, const uint8_t* data, size_t len, size_t& consumed,
+                  const std::function<void(const EventPacket&)>& handler) {
+    EventPacket scratch;
+    return decodeStream(version, data, len, consumed, handler, scratch);
+}
+
+bool decodeStream(uint16_t version, const uint8_t* data, size_t len, size_t& consumed,
+                  const std::function<void(const EventPacket&)>& handler, EventPacket& pkt) {
+    consumed = 0;
+    if (version >= kProtocolV2) {
+        size_t n = 0;
+        for (;;) {
+            wire::DecodeStatus status = wire::decode(data + consumed, len - consumed, pkt, n);
+            if (status == wire::DecodeStatus::Malformed) {
+                return false;
+            }
+            if (status == wire::DecodeStatus::NeedMore) {
+                return true;
+            }
+            consumed += n;
+            handler(pkt);
+        }
+    }
+
+    // v1: validate every complete header up front, then hand out the packets.
+    PacketRecord records[kDecodeBatch];
+    for (;;) {
+        DecodeResult r = decodePackets(data + consumed, len - consumed, records, kDecodeBatch);
+        const uint8_t* base = data + consumed;
+        for (size_t i = 0; i < r.count; ++i) {
+            pkt.type = records[i].type;
+            pkt.timestamp = records[i].timestamp;
+            pkt.payloadSize = records[i].payloadSize;
+            pkt.payload.assign(base + records[i].payloadOffset,
+                               base + records[i].payloadOffset + records[i].payloadSize);
+            handler(pkt);
+        }
+        consumed += r.consumed;
+        if (r.malformed) {
+            return false;
+        }
+        if (r.count < kDecodeBatch) {
+            return true;
+        }
+    }
+}
@@ -0,0 +1,358 @@
+#include "Relay.h"
+#include "ByteOrder.h"
+#include "Channels.h"
+#include "Protocol.h"
+#include "Stats.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace ssl = boost::asio::ssl;
+
+namespace {
+    // Largest frame there can be, so a buffer always has room for the next
+    // one; also the largest v1 packet relayed
+    constexpr size_t kRelayBufferSize = kFrameHeaderSize + kMaxFramePayload;
+    constexpr size_t kTlsRecordPayload = 16 * 1024;
+}
+
+// ---------------------------------------------------------------------------
+//  BufferPool
+// ---------------------------------------------------------------------------
+
+BufferPool::BufferPool(size_t count, size_t size)
+    : size_(size)
+    , slab_(count * size) {
+    free_.reserve(count);
+    for (size_t i = count; i > 0; --i) {
+        free_.push_back(slab_.data() + (i - 1) * size);
+    }
+}
+
+uint8_t* BufferPool::acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+        return nullptr;
+    }
+    uint8_t* buffer = free_.back();
+    free_.pop_back();
+    return buffer;
+}
+
+void BufferPool::release(uint8_t* buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(buffer);
+}
+
+size_t BufferPool::available() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+}
+
+// ---------------------------------------------------------------------------
+//  Relay::Pair — one client and its downstream connection
+// ---------------------------------------------------------------------------
+
+class Relay::Pair : public std::enable_shared_from_this<Pair> {
+public:
+    Pair(Relay& relay, tcp::socket client, const tcp::endpoint& peer, const tcp::endpoint& downstream,
+         uint8_t* upBuf, uint8_t* downBuf)
+        : relay_(relay)
+        , peer_(peer)
+        , downstreamEndpoint_(downstream)
+        , upstream_(std::move(client), relay.acceptContext_)
+        , downstream_(upstream_.get_executor(), relay.connectContext_) {
+        up_ = {&upstream_, &downstream_, upBuf};
+        down_ = {&downstream_, &upstream_, downBuf};
+        ++relay_.activePairs_;
+    }
+
+    ~Pair() {
+        relay_.pool_.release(up_.buf);
+        relay_.pool_.release(down_.buf);
+        --relay_.activePairs_;
+        std::cout << "Relay pair closed: " << peer_ << std::endl;
+    }
+
+    boost::asio::any_io_executor executor() { return upstream_.get_executor(); }
+
+    void start() {
+        auto self = shared_from_this();
+        upstream_.lowest_layer().set_option(tcp::no_delay(true));
+        upstream_.async_handshake(ssl::stream_base::server, [self](const boost::system::error_code& ec) {
+            if (ec) {
+                self->close(ec);
+                return;
+            }
+            self->handshakeDone();
+        });
+        downstream_.lowest_layer().async_connect(downstreamEndpoint_, [self](const boost::system::error_code& ec) {
+            if (ec) {
+                std::cerr << "Relay could not reach " << self->downstreamEndpoint_ << ": " << ec.message() << std::endl;
+                self->close(ec);
+                return;
+            }
+            self->downstream_.lowest_layer().set_option(tcp::no_delay(true));
+            self->downstream_.async_handshake(ssl::stream_base::client, [self](const boost::system::error_code& ec) {
+                if (ec) {
+                    self->close(ec);
+                    return;
+                }
+                self->handshakeDone();
+            });
+        });
+    }
+
+private:
+    struct Direction {
+        TlsStream* from;
+        TlsStream* to;
+        uint8_t* buf;
+        size_t filled = 0;
+        size_t opaque = 0;      // bytes to pass through before the packet stream starts
+    };
+
+    void handshakeDone() {
+        if (--handshakes_ > 0 || closed_) {
+            return;
+        }
+        std::cout << "Relaying " << peer_ << " to " << downstreamEndpoint_ << std::endl;
+        // The server only speaks after the client, so the server-to-client
+        // side waits until the first client bytes say whether a Hello leads.
+        read(up_);
+    }
+
+    void read(Direction& d) {
+        auto self = shared_from_this();
+        d.from->async_read_some(boost::asio::buffer(d.buf + d.filled, kRelayBufferSize - d.filled),
+            [self, &d](const boost::system::error_code& ec, size_t n) {
+                if (ec) {
+                    self->close(ec);
+                    return;
+                }
+                stats::add(&stats::Slot::bytesReceived, n);
+                d.filled += n;
+                if (&d == &self->up_ && !self->downStarted_) {
+                    // A Hello starts with the whole magic; anything else is a
+                    // v1 packet stream, which forward() checks packet by packet
+                    size_t seen = std::min(d.filled, sizeof(kHelloMagic));
+                    bool hello = std::memcmp(d.buf, kHelloMagic, seen) == 0;
+                    if (hello && seen < sizeof(kHelloMagic)) {
+                        self->read(d);
+                        return;
+                    }
+                    self->downStarted_ = true;
+                    if (hello) {
+                        self->up_.opaque = self->down_.opaque = sizeof(Hello);
+                    } else {
+                        self->version_ = kProtocolV1;
+                    }
+                    self->read(self->down_);
+                }
+                self->forward(d);
+            });
+    }
+
+    // Writes every complete frame (v2) or packet (v1) at the front of the
+    // buffer in one go and keeps the partial tail for the next read.
+    void forward(Direction& d) {
+        size_t end = 0;
+        if (d.opaque > 0) {
+            if (&d == &down_ && version_ == 0) {
+                // The server's Hello says which of the two streams follows
+                if (d.filled < sizeof(Hello)) {
+                    read(d);
+                    return;
+                }
+                version_ = byteorder::loadLe<uint16_t>(d.buf + offsetof(Hello, version));
+            }
+            end = std::min(d.opaque, d.filled);
+            d.opaque -= end;
+        }
+        if (d.opaque == 0 && d.filled > end) {
+            // A client only goes on after the server's Hello has come through
+            if (version_ == 0) {
+                malformed("data before the server's hello");
+                return;
+            }
+            end = version_ < kProtocolV2 ? packetsEnd(d, end) : framesEnd(d, end);
+            if (end == kMalformed) {
+                malformed(version_ < kProtocolV2 ? "malformed packet" : "malformed frame");
+                return;
+            }
+        }
+        if (end == 0) {
+            read(d);
+            return;
+        }
+
+        auto self = shared_from_this();
+        boost::asio::async_write(*d.to, boost::asio::buffer(d.buf, end),
+            [self, &d, end](const boost::system::error_code& ec, size_t) {
+                if (ec) {
+                    self->close(ec);
+                    return;
+                }
+                stats::add(&stats::Slot::bytesSent, end);
+                stats::add(&stats::Slot::recordsSent, (end + kTlsRecordPayload - 1) / kTlsRecordPayload);
+                std::memmove(d.buf, d.buf + end, d.filled - end);
+                d.filled -= end;
+                self->read(d);
+            });
+    }
+
+    static constexpr size_t kMalformed = ~size_t(0);
+
+    size_t framesEnd(const Direction& d, size_t end) const {
+        while (d.filled - end >= kFrameHeaderSize) {
+            const uint8_t* frame = d.buf + end;
+            if (frame[0] >= kChannelCount) {
+                return kMalformed;
+            }
+            size_t n = (static_cast<size_t>(frame[1]) << 8) | frame[2];
+            if (d.filled - end < kFrameHeaderSize + n) {
+                break;
+            }
+            end += kFrameHeaderSize + n;
+        }
+        return end;
+    }
+
+    // EventPacket::toBytes(): type (1) | timestamp (8) | payload size (4, big-endian) | payload
+    size_t packetsEnd(const Direction& d, size_t end) const {
+        while (d.filled - end >= EventPacket::kHeaderSize) {
+            const uint8_t* pkt = d.buf + end;
+            if (pkt[0] < static_cast<uint8_t>(SamenessEventType::KeyPress) ||
+                pkt[0] > static_cast<uint8_t>(SamenessEventType::SwitchBack)) {
+                return kMalformed;
+            }
+            size_t n = EventPacket::kHeaderSize + byteorder::loadBe32(pkt + 9);
+            if (n > kRelayBufferSize) {
+                return kMalformed;
+            }
+            if (d.filled - end < n) {
+                break;
+            }
+            end += n;
+        }
+        return end;
+    }
+
+    void malformed(const char* what) {
+        std::cerr << "Relay dropping " << peer_ << ": " << what << std::endl;
+        stats::add(&stats::Slot::drops);
+        close(boost::asio::error::invalid_argument);
+    }
+
+    // Either side going away takes the other down with it.
+    void close(const boost::system::error_code& ec) {
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        if (ec != boost::asio::error::eof && ec != ssl::error::stream_truncated
+            && ec != boost::asio::error::operation_aborted && ec != boost::asio::error::invalid_argument) {
+            std::cerr << "Relay pair " << peer_ << ": " << ec.message() << std::endl;
+        }
+        boost::system::error_code ignored;
+        upstream_.lowest_layer().close(ignored);
+        downstream_.lowest_layer().close(ignored);
+    }
+
+    Relay& relay_;
+    tcp::endpoint peer_;
+    tcp::endpoint downstreamEndpoint_;
+    TlsStream upstream_;
+    TlsStream downstream_;
+    Direction up_{};
+    Direction down_{};
+    uint16_t version_ = 0;      // 0 until the client's first bytes or the server's Hello tell
+    int handshakes_ = 2;
+    bool downStarted_ = false;
+    bool closed_ = false;
+};
+
+// ---------------------------------------------------------------------------
+//  Relay
+// ---------------------------------------------------------------------------
+
+Relay::Relay(ssl::context& acceptContext, ssl::context& connectContext)
+    : Relay(acceptContext, connectContext, Config{}) {
+}
+
+Relay::Relay(ssl::context& acceptContext, ssl::context& connectContext, const Config& config)
+    : acceptContext_(acceptContext)
+    , connectContext_(connectContext)
+    , config_(config)
+    , pool_(2 * config.maxPairs, kRelayBufferSize) {
+    for (size_t i = 0; i < std::max<size_t>(config_.threads, 1); ++i) {
+        ios_.push_back(std::make_unique<boost::asio::io_context>(1));
+        work_.push_back(boost::asio::make_work_guard(*ios_.back()));
+    }
+}
+
+Relay::~Relay() {
+    stop();
+}
+
+uint16_t Relay::addRoute(const tcp::endpoint& listen, const tcp::endpoint& downstream) {
+    routes_.push_back(std::unique_ptr<Route>(new Route{tcp::acceptor(*ios_.front(), listen), downstream}));
+    Route& route = *routes_.back();
+    accept(route);
+    return route.acceptor.local_endpoint().port();
+}
+
+void Relay::start() {
+    for (auto& io : ios_) {
+        boost::asio::io_context* raw = io.get();
+        threads_.emplace_back([raw]() { raw->run(); });
+    }
+}
+
+void Relay::stop() {
+    if (ios_.empty()) {
+        return;
+    }
+    work_.clear();
+    for (auto& io : ios_) {
+        io->stop();
+    }
+    for (std::thread& t : threads_) {
+        t.join();
+    }
+    threads_.clear();
+    routes_.clear();
+    // Destroying the contexts destroys the pending handlers and with them every pair
+    ios_.clear();
+}
+
+void Relay::accept(Route& route) {
+    boost::asio::io_context& io = *ios_[nextIo_];
+    nextIo_ = (nextIo_ + 1) % ios_.size();
+    route.acceptor.async_accept(io, [this, &route](const boost::system::error_code& ec, tcp::socket client) {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        if (!ec) {
+            boost::system::error_code ignored;
+            tcp::endpoint peer = client.remote_endpoint(ignored);
+            uint8_t* upBuf = pool_.acquire();
+            uint8_t* downBuf = upBuf ? pool_.acquire() : nullptr;
+            if (!downBuf) {
+                if (upBuf) {
+                    pool_.release(upBuf);
+                }
+                std::cerr << "Relay full (" << config_.maxPairs << " pairs), turning away "
+                          << peer << std::endl;
+                stats::add(&stats::Slot::drops);
+                client.close(ignored);
+            } else {
+                auto pair = std::make_shared<Pair>(*this, std::move(client), peer, route.downstream, upBuf, downBuf);
+                boost::asio::post(pair->executor(), [pair]() { pair->start(); });
+            }
+        } else {
+            std::cerr << "Relay accept failed: " << ec.message() << std::endl;
+        }
+        accept(route);
+    });
+}
@@ -1,4 +1,6 @@
 #include "ScreenEdgeSwitcher.h"
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 
 ScreenEdgeSwitcher::ScreenEdgeSwitcher(int hostWidth, int hostHeight) 
@@ -13,6 +15,10 @@ ControlState ScreenEdgeSwitcher::update(int x, int y) {
     // Add hysteresis to prevent rapid switching
     static const int HYSTERESIS = 5;
     static int lastX = 0;
+
+    if (locked_) {
+        return state_;
+    }
     
     // Log the current position
     std::cout << "Mouse position: (" << x << ", " << y << ")" << std::endl;
@@ -50,6 +56,37 @@ bool ScreenEdgeSwitcher::isClientControlled() const {
     return state_ == ControlState::CLIENT;
 }
 
+void ScreenEdgeSwitcher::forceHost() {
+    locked_ = false;
+    if (state_.exchange(ControlState::HOST) == ControlState::CLIENT) {
+        std::cout << "Forcing host control" << std::endl;
+    }
+}
+
+bool ScreenEdgeSwitcher::returnFromPeer(int peerY, int peerHeight, int& x, int& y) {
+    if (locked_ || peerHeight <= 0) {
+        return false;
+    }
+    ControlState expected = ControlState::CLIENT;
+    if (!state_.compare_exchange_strong(expected, ControlState::HOST)) {
+        return false;
+    }
+    x = hostWidth_ - edgeThreshold_ - 1;
+    y = std::clamp(static_cast<int>(static_cast<int64_t>(peerY) * hostHeight_ / peerHeight), 0, hostHeight_ - 1);
+    std::cout << "Peer handed control back at row " << peerY << " of " << peerHeight << std::endl;
+    return true;
+}
+
+void ScreenEdgeSwitcher::setLocked(bool locked) {
+    locked_ = locked;
+    std::cout << (locked ? "Locked to " : "Unlocked from ")
+              << (state_ == ControlState::HOST ? "host" : "client") << " screen" << std::endl;
+}
+
+bool ScreenEdgeSwitcher::isLocked() const {
+    return locked_;
+}
+
 void ScreenEdgeSwitcher::setEdgeThreshold(int threshold) {
     edgeThreshold_ = threshold;
     std::cout << "Edge threshold set to: " << threshold << " pixels" << std::endl;
@@ -0,0 +1,359 @@
+#include "Session.h"
+#include "Stats.h"
+#include "Trace.h"
+#include <iostream>
+
+namespace {
+    // Largest plaintext carried by one TLS record
+    constexpr size_t kTlsRecordPayload = 16 * 1024;
+}
+
+Session::Session(std::unique_ptr<Transport> transport, uint16_t version, std::vector<uint8_t> leftover)
+    : pool_(&heap_)
+    , transport_(std::move(transport))
+    , version_(version)
+    , leftover_(std::move(leftover))
+    // A read from the TLS stream never returns more than one record
+    , readBuf_(kTlsRecordPayload, &pool_)
+    , decoder_(version, &pool_)
+    , inputQueue_(&pool_)
+    , scheduler_(version, &pool_)
+    , lowerBuf_(&pool_)
+    , writeBuf_(&pool_)
+    , writeTraceIds_(&pool_)
+    , backlogTimer_(transport_->executor())
+    , heartbeatTimer_(transport_->executor()) {
+    transport_->setMemory(&pool_);
+}
+
+Session::Session(std::unique_ptr<Stream> stream, uint16_t version, std::vector<uint8_t> leftover)
+    : Session(std::make_unique<TlsTransport>(std::move(stream)), version, std::move(leftover)) {
+}
+
+Session::MemoryStats Session::memoryStats() const {
+    return {heap_.allocations(), heap_.bytesInUse(), heap_.peakBytes()};
+}
+
+void Session::setBulkSource(Channel channel, BulkSource source) {
+    scheduler_.setSource(channel, std::move(source));
+}
+
+void Session::setHeartbeat(std::chrono::milliseconds deadline, std::chrono::milliseconds interval) {
+    if (version_ < kProtocolV2) {
+        std::cout << "Peer speaks protocol v1, heartbeats disabled" << std::endl;
+        return;
+    }
+    deadline_ = deadline;
+    heartbeatInterval_ = interval.count() > 0 ? interval : deadline / 4;
+    if (heartbeatInterval_ <= std::chrono::steady_clock::duration::zero()) {
+        heartbeatInterval_ = std::chrono::milliseconds(1);
+    }
+}
+
+void Session::setSendBacklogLimit(size_t maxUnsentBytes, std::chrono::microseconds recheck) {
+    backlogLimit_ = maxUnsentBytes;
+    backlogRecheck_ = recheck;
+}
+
+void Session::start(PacketHandler onPacket, CloseHandler onClose) {
+    onPacket_ = std::move(onPacket);
+    onClose_ = std::move(onClose);
+
+    auto self = shared_from_this();
+    boost::asio::post(transport_->executor(), [self]() {
+        // Frames that arrived together with the protocol hello
+        self->lastRead_ = self->lastWrite_ = std::chrono::steady_clock::now();
+        if (self->deadline_ > std::chrono::steady_clock::duration::zero()) {
+            self->armHeartbeat();
+        }
+        std::vector<uint8_t> early;
+        early.swap(self->leftover_);
+        if (!early.empty() && !self->consume(early.data(), early.size())) {
+            return;
+        }
+        self->doRead();
+    });
+}
+
+void Session::send(EventPacket pkt) {
+    if (channelFor(pkt.type) == Channel::Input) {
+        if (!trace::enabled()) {
+            sendFrame(pkt.type, makeFrame(Channel::Input, pkt, version_));
+            return;
+        }
+        uint64_t id = trace::eventId(pkt);
+        uint64_t begin = trace::nowUs();
+        SharedFrame frame = makeFrame(Channel::Input, pkt, version_);
+        trace::span(trace::Stage::Encode, id, begin, trace::nowUs());
+        sendFrame(pkt.type, std::move(frame), id);
+        return;
+    }
+    stats::countEvent(pkt.type);
+    auto self = shared_from_this();
+    boost::asio::post(transport_->executor(), [self, pkt = std::move(pkt)]() {
+        if (self->closed_) {
+            return;
+        }
+        self->encoded_.clear();
+        encodePacket(pkt, self->version_, self->encoded_);
+        self->scheduler_.enqueue(channelFor(pkt.type), self->encoded_);
+        self->pump();
+    });
+}
+
+void Session::sendFrame(SamenessEventType type, SharedFrame frame, uint64_t traceId) {
+    stats::countEvent(type);
+    auto self = shared_from_this();
+    boost::asio::post(transport_->executor(), [self, type, frame = std::move(frame), traceId]() mutable {
+        self->enqueueInput(type, std::move(frame), traceId);
+    });
+}
+
+void Session::enqueueInput(SamenessEventType type, SharedFrame frame, uint64_t traceId) {
+    if (closed_) {
+        return;
+    }
+    uint64_t queuedUs = trace::enabled() ? trace::nowUs() : 0;
+    if (type == SamenessEventType::MouseMove && !inputQueue_.empty()
+        && inputQueue_.back().type == SamenessEventType::MouseMove) {
+        // Only the newest position matters to a peer that is behind
+        inputQueuedBytes_ += frame->size() - inputQueue_.back().frame->size();
+        inputQueue_.back() = {type, std::move(frame), traceId, queuedUs};
+        stats::add(&stats::Slot::coalescedMoves);
+        return;
+    }
+    if (inputQueue_.size() >= kMaxInputBacklog) {
+        std::cerr << "Peer is not keeping up with input, dropping connection" << std::endl;
+        stats::add(&stats::Slot::drops);
+        fail(boost::asio::error::no_buffer_space);
+        return;
+    }
+    inputQueuedBytes_ += frame->size();
+    inputQueue_.push_back({type, std::move(frame), traceId, queuedUs});
+    pump();
+}
+
+void Session::kickBulk() {
+    auto self = shared_from_this();
+    boost::asio::post(transport_->executor(), [self]() {
+        self->pump();
+    });
+}
+
+void Session::close() {
+    auto self = shared_from_this();
+    boost::asio::post(transport_->executor(), [self]() {
+        self->fail(boost::asio::error::operation_aborted);
+    });
+}
+
+void Session::closeWhenSent() {
+    auto self = shared_from_this();
+    boost::asio::post(transport_->executor(), [self]() {
+        self->closeWhenSent_ = true;
+        self->pump();
+    });
+}
+
+std::shared_ptr<Transport::Handler> Session::completions() {
+    // Shares ownership with the session, so a pending operation keeps it alive
+    return std::shared_ptr<Transport::Handler>(shared_from_this(), static_cast<Transport::Handler*>(this));
+}
+
+void Session::doRead() {
+    transport_->asyncRead(boost::asio::buffer(readBuf_), completions());
+}
+
+void Session::onRead(const boost::system::error_code& ec, size_t len) {
+    if (ec) {
+        fail(ec);
+        return;
+    }
+    lastRead_ = std::chrono::steady_clock::now();
+    if (consume(readBuf_.data(), len)) {
+        doRead();
+    }
+}
+
+bool Session::consume(const uint8_t* data, size_t len) {
+    stats::add(&stats::Slot::bytesReceived, len);
+    // While tracing, a packet's read span runs from the bytes arriving to the
+    // end of the packet before it, and its decode span from there on
+    struct {
+        uint64_t readUs;
+        uint64_t previousDoneUs;
+    } times;
+    times.readUs = times.previousDoneUs = trace::enabled() ? trace::nowUs() : 0;
+    // Small enough for std::function to hold without allocating
+    bool ok = decoder_.feed(data, len,
+        [this, &times](Channel channel, const EventPacket& pkt) {
+            stats::countEvent(pkt.type);
+            if (times.readUs != 0) {
+                uint64_t decodedUs = trace::nowUs();
+                trace::observePeerTime(pkt.timestamp, times.readUs);
+                if (channel == Channel::Input) {
+                    uint64_t id = trace::eventId(pkt);
+                    trace::span(trace::Stage::Read, id, times.readUs, times.previousDoneUs);
+                    trace::span(trace::Stage::Decode, id, times.previousDoneUs, decodedUs);
+                }
+            }
+            if (pkt.type != SamenessEventType::Heartbeat && onPacket_) {   // heartbeats only refresh lastRead_
+                onPacket_(pkt);
+            }
+            if (times.readUs != 0) {
+                times.previousDoneUs = trace::nowUs();
+            }
+        });
+    if (!ok) {
+        std::cerr << "Malformed frame from peer" << std::endl;
+        stats::add(&stats::Slot::drops);
+        fail(boost::asio::error::invalid_argument);
+    }
+    return ok;
+}
+
+void Session::pump() {
+    if (writing_ || closed_) {
+        return;
+    }
+    bool haveLower = scheduler_.nextWrite(lowerBuf_);
+    stats::setGauge(stats::Gauge::SendInput, inputQueuedBytes_);
+    stats::setGauge(stats::Gauge::SendControl, scheduler_.pending(Channel::Control));
+    stats::setGauge(stats::Gauge::SendClipboard, scheduler_.pending(Channel::Clipboard));
+    stats::setGauge(stats::Gauge::SendBulk, scheduler_.pending(Channel::Bulk));
+    if (inputQueue_.empty() && !haveLower) {
+        if (closeWhenSent_) {
+            fail(boost::asio::error::operation_aborted);
+        }
+        return;
+    }
+    // Only motion waits for the backlog to drain, collapsing meanwhile;
+    // anything else goes out at once and takes the move along, in order
+    bool motionOnly = !haveLower && inputQueue_.size() == 1
+        && inputQueue_.front().type == SamenessEventType::MouseMove;
+    if (motionOnly && holdForBacklog()) {
+        return;
+    }
+
+    // The TLS stream turns every buffer of a gather write into its own record
+    // and socket write, so anything more than a single buffer is packed first.
+    boost::asio::const_buffer out;
+    if (inputQueue_.size() == 1 && !haveLower) {
+        inFlight_ = std::move(inputQueue_.front().frame);
+        out = boost::asio::buffer(*inFlight_);
+    } else if (inputQueue_.empty()) {
+        out = boost::asio::buffer(lowerBuf_);
+    } else {
+        writeBuf_.clear();
+        for (const QueuedFrame& q : inputQueue_) {
+            writeBuf_.insert(writeBuf_.end(), q.frame->begin(), q.frame->end());
+        }
+        writeBuf_.insert(writeBuf_.end(), lowerBuf_.begin(), lowerBuf_.end());
+        out = boost::asio::buffer(writeBuf_);
+    }
+    if (trace::enabled()) {
+        writeStartUs_ = trace::nowUs();
+        for (const QueuedFrame& q : inputQueue_) {
+            if (q.traceId != 0) {
+                trace::span(trace::Stage::Queue, q.traceId, q.queuedUs, writeStartUs_);
+                writeTraceIds_.push_back(q.traceId);
+            }
+        }
+    }
+    inputQueue_.clear();
+    inputQueuedBytes_ = 0;
+
+    stats::add(&stats::Slot::bytesSent, out.size());
+    stats::add(&stats::Slot::recordsSent, (out.size() + kTlsRecordPayload - 1) / kTlsRecordPayload);
+
+    writing_ = true;
+    lastWrite_ = std::chrono::steady_clock::now();
+    transport_->asyncWrite(out, completions());
+}
+
+bool Session::holdForBacklog() {
+    if (backlogHeld_) {
+        return true;
+    }
+    if (backlogLimit_ == 0 || transport_->unsentBytes() <= backlogLimit_) {
+        return false;
+    }
+    backlogHeld_ = true;
+    stats::add(&stats::Slot::heldWrites);
+    auto self = shared_from_this();
+    backlogTimer_.expires_after(backlogRecheck_);
+    backlogTimer_.async_wait(fromPool(&pool_, [self](const boost::system::error_code& ec) {
+        self->backlogHeld_ = false;
+        if (!ec) {
+            self->pump();
+        }
+    }));
+    return true;
+}
+
+void Session::onWrite(const boost::system::error_code& ec, size_t) {
+    writing_ = false;
+    inFlight_.reset();
+    if (!writeTraceIds_.empty()) {
+        uint64_t now = trace::nowUs();
+        for (uint64_t id : writeTraceIds_) {
+            trace::span(trace::Stage::Write, id, writeStartUs_, now);
+        }
+        writeTraceIds_.clear();
+    }
+    if (ec) {
+        fail(ec);
+        return;
+    }
+    pump();
+}
+
+// Runs every heartbeat interval on the io thread. Any received bytes count as
+// proof of life, and any write doubles as our own heartbeat, so a busy
+// connection never carries an extra message.
+void Session::armHeartbeat() {
+    auto self = shared_from_this();
+    heartbeatTimer_.expires_after(heartbeatInterval_);
+    heartbeatTimer_.async_wait(fromPool(&pool_, [self](const boost::system::error_code& ec) {
+        if (ec || self->closed_) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - self->lastRead_ >= self->deadline_) {
+            auto silent = std::chrono::duration_cast<std::chrono::milliseconds>(now - self->lastRead_);
+            std::cerr << "Peer silent for " << silent.count() << " ms, dropping connection" << std::endl;
+            self->fail(boost::asio::error::timed_out);
+            return;
+        }
+        // Half an interval, so timer jitter never stretches the gap to two ticks
+        if (now - self->lastWrite_ >= self->heartbeatInterval_ / 2) {
+            EventPacket heartbeat;
+            heartbeat.type = SamenessEventType::Heartbeat;
+            heartbeat.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                now.time_since_epoch()).count();
+            heartbeat.payloadSize = 0;
+            self->encoded_.clear();
+            encodePacket(heartbeat, self->version_, self->encoded_);
+            self->scheduler_.enqueue(channelFor(heartbeat.type), self->encoded_);
+            self->pump();
+        }
+        self->armHeartbeat();
+    }));
+}
+
+void Session::fail(const boost::system::error_code& ec) {
+    if (closed_) {
+        return;
+    }
+    closed_ = true;
+    heartbeatTimer_.cancel();
+    backlogTimer_.cancel();
+    if (ec != boost::asio::error::eof && ec != boost::asio::error::operation_aborted
+        && ec != boost::asio::ssl::error::stream_truncated && ec != boost::asio::error::timed_out) {
+        std::cerr << "Session error: " << ec.message() << std::endl;
+    }
+    transport_->close();
+    if (onClose_) {
+        onClose_(ec);
+    }
+}
@@ -0,0 +1,63 @@
+#include "SessionGroup.h"
+#include "Trace.h"
+#include <algorithm>
+
+void SessionGroup::add(std::shared_ptr<Session> session) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessions_.push_back(std::move(session));
+}
+
+void SessionGroup::remove(const Session* session) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessions_.erase(std::remove_if(sessions_.begin(), sessions_.end(),
+                                   [session](const std::shared_ptr<Session>& s) { return s.get() == session; }),
+                    sessions_.end());
+}
+
+size_t SessionGroup::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sessions_.size();
+}
+
+std::shared_ptr<Session> SessionGroup::primary() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sessions_.empty() ? nullptr : sessions_.front();
+}
+
+void SessionGroup::send(const EventPacket& pkt) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (channelFor(pkt.type) != Channel::Input) {
+        for (const auto& s : sessions_) {
+            s->send(pkt);
+        }
+        return;
+    }
+    // One encoding per protocol version, shared by every session speaking it
+    SharedFrame frames[kProtocolVersion + 1];
+    uint64_t traceId = trace::enabled() ? trace::eventId(pkt) : 0;
+    for (const auto& s : sessions_) {
+        uint16_t v = std::min<uint16_t>(s->version(), kProtocolVersion);
+        if (!frames[v]) {
+            uint64_t begin = traceId != 0 ? trace::nowUs() : 0;
+            frames[v] = makeFrame(Channel::Input, pkt, v);
+            if (traceId != 0) {
+                trace::span(trace::Stage::Encode, traceId, begin, trace::nowUs());
+            }
+        }
+        s->sendFrame(pkt.type, frames[v], traceId);
+    }
+}
+
+void SessionGroup::closeAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& s : sessions_) {
+        s->close();
+    }
+}
+
+void SessionGroup::closeAllWhenSent() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& s : sessions_) {
+        s->closeWhenSent();
+    }
+}
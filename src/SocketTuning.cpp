@@ -0,0 +1,113 @@
+#include "SocketTuning.h"
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace {
+    void report(const SocketProfile& profile, const char* option, const boost::system::error_code& ec) {
+        std::cerr << "Socket profile " << profile.name << ": cannot set " << option << ": " << ec.message() << std::endl;
+    }
+
+#if !defined(_WIN32)
+    bool setInt(boost::asio::ip::tcp::socket& socket, int level, int option, int value) {
+        return setsockopt(socket.native_handle(), level, option, &value, sizeof(value)) == 0;
+    }
+
+    boost::system::error_code lastError() {
+        return boost::system::error_code(errno, boost::system::system_category());
+    }
+#endif
+}
+
+SocketProfile SocketProfile::named(const std::string& name) {
+    SocketProfile p;
+    p.name = name;
+    if (name == "default") {
+        return p;
+    }
+    p.quickAck = true;
+    p.dscp = kDscpExpedited;
+    // A few hundred events' worth each way; input never needs more in flight
+    p.sendBuffer = 32 * 1024;
+    p.receiveBuffer = 64 * 1024;
+    if (name == "interactive") {
+        return p;
+    }
+    if (name == "spin") {
+        p.busyPollUs = 50;
+        p.spinRead = true;
+        return p;
+    }
+    throw std::invalid_argument("Unknown socket profile: " + name);
+}
+
+std::vector<std::string> SocketProfile::names() {
+    return {"default", "interactive", "spin"};
+}
+
+void applySocketProfile(boost::asio::ip::tcp::socket& socket, const SocketProfile& profile) {
+    using boost::asio::ip::tcp;
+    boost::system::error_code ec;
+    socket.set_option(tcp::no_delay(profile.noDelay), ec);
+    if (ec) {
+        report(profile, "TCP_NODELAY", ec);
+    }
+    if (profile.sendBuffer > 0) {
+        socket.set_option(boost::asio::socket_base::send_buffer_size(profile.sendBuffer), ec);
+        if (ec) {
+            report(profile, "SO_SNDBUF", ec);
+        }
+    }
+    if (profile.receiveBuffer > 0) {
+        socket.set_option(boost::asio::socket_base::receive_buffer_size(profile.receiveBuffer), ec);
+        if (ec) {
+            report(profile, "SO_RCVBUF", ec);
+        }
+    }
+#if !defined(_WIN32)
+    if (profile.dscp >= 0) {
+        // DSCP is the upper six bits of the TOS / traffic class byte
+        int tos = profile.dscp << 2;
+        bool v6 = socket.local_endpoint(ec).address().is_v6();
+        bool ok = v6 ? setInt(socket, IPPROTO_IPV6, IPV6_TCLASS, tos) : setInt(socket, IPPROTO_IP, IP_TOS, tos);
+        if (!ok) {
+            report(profile, v6 ? "IPV6_TCLASS" : "IP_TOS", lastError());
+        }
+    }
+#endif
+#if defined(__linux__)
+    if (profile.busyPollUs > 0 && !setInt(socket, SOL_SOCKET, SO_BUSY_POLL, profile.busyPollUs)) {
+        // Above the net.core.busy_poll default it needs CAP_NET_ADMIN
+        report(profile, "SO_BUSY_POLL", lastError());
+    }
+    if (profile.quickAck) {
+        rearmQuickAck(socket);
+    }
+#endif
+}
+
+void rearmQuickAck(boost::asio::ip::tcp::socket& socket) {
+#if defined(__linux__)
+    setInt(socket, IPPROTO_TCP, TCP_QUICKACK, 1);
+#else
+    (void)socket;
+#endif
+}
+
+void runIoContext(boost::asio::io_context& io, const SocketProfile& profile) {
+    if (!profile.spinRead) {
+        io.run();
+        return;
+    }
+    // poll() stops the context once it runs out of work, like run()
+    while (!io.stopped()) {
+        io.poll();
+    }
+}
@@ -0,0 +1,224 @@
+#include "Stats.h"
+#include "ByteOrder.h"
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace stats {
+
+namespace {
+    // Used until open() succeeds, and as the fallback where shared memory is unavailable.
+    Block localBlock;
+
+    Block* sharedBlock = nullptr;
+    std::string sharedName;
+
+    std::string shmName(const char* role) {
+        return std::string("/sameness-") + role;
+    }
+
+    void initHeader(Block& b) {
+        b.magic = kMagic;
+        b.version = kVersion;
+#if !defined(_WIN32)
+        b.pid = static_cast<uint64_t>(getpid());
+#endif
+    }
+
+    struct LocalInit {
+        LocalInit() { initHeader(localBlock); }
+    } localInit;
+
+    static_assert(kSlots <= 32, "slotsInUse has a bit per slot");
+
+#if !defined(_WIN32)
+    // Pid of another running process whose block is behind `fd`, 0 if none
+    uint64_t liveOwner(int fd) {
+        constexpr size_t kHeader = offsetof(Block, slotsInUse);
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < kHeader) {
+            return 0;
+        }
+        void* mem = mmap(nullptr, kHeader, PROT_READ, MAP_SHARED, fd, 0);
+        if (mem == MAP_FAILED) {
+            return 0;
+        }
+        const Block* b = static_cast<const Block*>(mem);
+        uint64_t pid = b->magic == kMagic ? b->pid : 0;
+        munmap(mem, kHeader);
+        if (pid == 0 || pid == static_cast<uint64_t>(getpid())) {
+            return 0;
+        }
+        return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM ? pid : 0;
+    }
+#endif
+}
+
+namespace detail {
+    std::atomic<Block*> current{&localBlock};
+    thread_local ThreadSlot tls;
+
+    void claim() {
+        tls.release();
+        Block* b = current.load(std::memory_order_acquire);
+        uint32_t used = b->slotsInUse.load(std::memory_order_relaxed);
+        size_t index = kSlots - 1;
+        for (;;) {
+            uint32_t free = ~used & ((1u << (kSlots - 1)) - 1);
+            if (free == 0) {
+                break;
+            }
+            uint32_t bit = free & (~free + 1);     // the lowest free slot
+            if (b->slotsInUse.compare_exchange_weak(used, used | bit, std::memory_order_acquire)) {
+                index = byteorder::lowestBit(bit);
+                break;
+            }
+        }
+        tls.owner = b;
+        tls.shared = index == kSlots - 1;
+        tls.slot = &b->slots[index];
+    }
+
+    // The block a thread leaves may have been switched away from, but its
+    // mapping stays (see close()), so the bit can always be cleared
+    void ThreadSlot::release() {
+        if (owner && !shared) {
+            uint32_t bit = 1u << static_cast<size_t>(slot - owner->slots);
+            owner->slotsInUse.fetch_and(~bit, std::memory_order_release);
+        }
+        owner = nullptr;
+        slot = nullptr;
+        shared = false;
+    }
+
+    ThreadSlot::~ThreadSlot() {
+        release();
+    }
+}
+
+bool open(const char* role) {
+#if defined(_WIN32)
+    (void)role;
+    return false;
+#else
+    std::string name = shmName(role);
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "Stats: shm_open(" << name << ") failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    // A second process in the same role leaves the first one's block alone
+    if (uint64_t pid = liveOwner(fd)) {
+        std::cerr << "Stats: " << name << " belongs to running process " << pid << std::endl;
+        ::close(fd);
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || (static_cast<size_t>(st.st_size) != sizeof(Block) && ftruncate(fd, sizeof(Block)) != 0)) {
+        std::cerr << "Stats: ftruncate failed: " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* mem = mmap(nullptr, sizeof(Block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        std::cerr << "Stats: mmap failed: " << std::strerror(errno) << std::endl;
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // What is there was left by a process that has exited; zero is a valid
+    // initial state for every atomic.
+    std::memset(mem, 0, sizeof(Block));
+    sharedBlock = static_cast<Block*>(mem);
+    initHeader(*sharedBlock);
+    sharedName = name;
+    detail::current.store(sharedBlock, std::memory_order_release);
+    return true;
+#endif
+}
+
+void close() {
+#if !defined(_WIN32)
+    if (!sharedBlock) {
+        return;
+    }
+    // Threads still running keep writing to the old mapping until they notice the switch,
+    // so the mapping itself is left in place; only the name goes away.
+    detail::current.store(&localBlock, std::memory_order_release);
+    shm_unlink(sharedName.c_str());
+    sharedBlock = nullptr;
+#endif
+}
+
+const Block* attach(const char* role) {
+#if defined(_WIN32)
+    (void)role;
+    return nullptr;
+#else
+    std::string name = shmName(role);
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+    void* mem = mmap(nullptr, sizeof(Block), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) {
+        return nullptr;
+    }
+    const Block* b = static_cast<const Block*>(mem);
+    if (b->magic != kMagic || b->version != kVersion) {
+        munmap(mem, sizeof(Block));
+        return nullptr;
+    }
+    return b;
+#endif
+}
+
+void detach(const Block* block) {
+#if !defined(_WIN32)
+    if (block) {
+        munmap(const_cast<Block*>(block), sizeof(Block));
+    }
+#endif
+}
+
+Snapshot snapshot(const Block& b) {
+    Snapshot s{};
+    for (const Slot& slot : b.slots) {
+        for (size_t i = 0; i < kEventTypes; ++i) {
+            s.events[i] += slot.events[i].load(std::memory_order_relaxed);
+        }
+        s.bytesSent += slot.bytesSent.load(std::memory_order_relaxed);
+        s.recordsSent += slot.recordsSent.load(std::memory_order_relaxed);
+        s.bytesReceived += slot.bytesReceived.load(std::memory_order_relaxed);
+        s.injectCalls += slot.injectCalls.load(std::memory_order_relaxed);
+        s.injectNanos += slot.injectNanos.load(std::memory_order_relaxed);
+        s.drops += slot.drops.load(std::memory_order_relaxed);
+        s.coalescedMoves += slot.coalescedMoves.load(std::memory_order_relaxed);
+        s.playoutMoves += slot.playoutMoves.load(std::memory_order_relaxed);
+        s.playoutNanos += slot.playoutNanos.load(std::memory_order_relaxed);
+        s.heldWrites += slot.heldWrites.load(std::memory_order_relaxed);
+        s.injectQueued += slot.injectQueued.load(std::memory_order_relaxed);
+        s.injectWaitNanos += slot.injectWaitNanos.load(std::memory_order_relaxed);
+        s.echoes += slot.echoes.load(std::memory_order_relaxed);
+        s.refused += slot.refused.load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < static_cast<size_t>(Gauge::Count); ++i) {
+        s.gauges[i] = b.gauges[i].load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+} // namespace stats
@@ -0,0 +1,130 @@
+#include "TextInput.h"
+#include <algorithm>
+#include <uiohook.h>
+
+namespace {
+    constexpr char16_t kReplacement = 0xFFFD;
+
+    bool isContinuation(uint8_t byte) {
+        return (byte & 0xC0) == 0x80;
+    }
+
+    constexpr uint16_t kLetters[26] = {
+        VC_A, VC_B, VC_C, VC_D, VC_E, VC_F, VC_G, VC_H, VC_I, VC_J, VC_K, VC_L, VC_M,
+        VC_N, VC_O, VC_P, VC_Q, VC_R, VC_S, VC_T, VC_U, VC_V, VC_W, VC_X, VC_Y, VC_Z,
+    };
+
+    struct SymbolKey {
+        char plain;
+        char shifted;   // 0 if Shift types nothing printable
+        uint16_t keycode;
+    };
+
+    constexpr SymbolKey kSymbols[] = {
+        {'`', '~', VC_BACKQUOTE}, {'1', '!', VC_1}, {'2', '@', VC_2}, {'3', '#', VC_3},
+        {'4', '$', VC_4}, {'5', '%', VC_5}, {'6', '^', VC_6}, {'7', '&', VC_7},
+        {'8', '*', VC_8}, {'9', '(', VC_9}, {'0', ')', VC_0}, {'-', '_', VC_MINUS},
+        {'=', '+', VC_EQUALS}, {'[', '{', VC_OPEN_BRACKET}, {']', '}', VC_CLOSE_BRACKET},
+        {'\\', '|', VC_BACK_SLASH}, {';', ':', VC_SEMICOLON}, {'\'', '"', VC_QUOTE},
+        {',', '<', VC_COMMA}, {'.', '>', VC_PERIOD}, {'/', '?', VC_SLASH},
+        {' ', 0, VC_SPACE}, {'\t', 0, VC_TAB}, {'\n', 0, VC_ENTER},
+    };
+}
+
+std::vector<EventPacket> makeTextPackets(uint64_t timestamp, const std::string& text) {
+    std::vector<EventPacket> packets;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = std::min(pos + kMaxTextBytes, text.size());
+        // Back off to the start of a character; a run of stray continuation
+        // bytes longer than a packet is cut anyway
+        size_t cut = end;
+        while (cut > pos && cut < text.size() && isContinuation(static_cast<uint8_t>(text[cut]))) {
+            --cut;
+        }
+        if (cut > pos) {
+            end = cut;
+        }
+        EventPacket pkt;
+        pkt.type = SamenessEventType::TextInput;
+        pkt.timestamp = timestamp;
+        pkt.payload.assign(text.begin() + pos, text.begin() + end);
+        pkt.payloadSize = static_cast<uint32_t>(pkt.payload.size());
+        packets.push_back(std::move(pkt));
+        pos = end;
+    }
+    return packets;
+}
+
+bool readText(const EventPacket& pkt, std::string& text) {
+    if (pkt.type != SamenessEventType::TextInput) {
+        return false;
+    }
+    text.assign(pkt.payload.begin(), pkt.payload.end());
+    return true;
+}
+
+std::u16string utf8ToUtf16(const std::string& text) {
+    std::u16string out;
+    out.reserve(text.size());
+    size_t i = 0;
+    while (i < text.size()) {
+        uint8_t lead = static_cast<uint8_t>(text[i]);
+        size_t extra = 0;
+        char32_t cp = 0;
+        char32_t min = 0;
+        if (lead < 0x80) {
+            out.push_back(lead);
+            ++i;
+            continue;
+        } else if ((lead & 0xE0) == 0xC0) {
+            extra = 1; cp = lead & 0x1F; min = 0x80;
+        } else if ((lead & 0xF0) == 0xE0) {
+            extra = 2; cp = lead & 0x0F; min = 0x800;
+        } else if ((lead & 0xF8) == 0xF0) {
+            extra = 3; cp = lead & 0x07; min = 0x10000;
+        } else {
+            out.push_back(kReplacement);
+            ++i;
+            continue;
+        }
+        size_t n = 1;
+        while (n <= extra && i + n < text.size() && isContinuation(static_cast<uint8_t>(text[i + n]))) {
+            cp = (cp << 6) | (static_cast<uint8_t>(text[i + n]) & 0x3F);
+            ++n;
+        }
+        i += n;
+        // Truncated, overlong, a surrogate or past U+10FFFF
+        if (n <= extra || cp < min || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF) {
+            out.push_back(kReplacement);
+        } else if (cp >= 0x10000) {
+            cp -= 0x10000;
+            out.push_back(static_cast<char16_t>(0xD800 + (cp >> 10)));
+            out.push_back(static_cast<char16_t>(0xDC00 + (cp & 0x3FF)));
+        } else {
+            out.push_back(static_cast<char16_t>(cp));
+        }
+    }
+    return out;
+}
+
+bool asciiKey(char c, uint16_t& keycode, bool& shift) {
+    if (c >= 'a' && c <= 'z') {
+        keycode = kLetters[c - 'a'];
+        shift = false;
+        return true;
+    }
+    if (c >= 'A' && c <= 'Z') {
+        keycode = kLetters[c - 'A'];
+        shift = true;
+        return true;
+    }
+    for (const SymbolKey& key : kSymbols) {
+        if (c == key.plain || (key.shifted != 0 && c == key.shifted)) {
+            keycode = key.keycode;
+            shift = c != key.plain;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,289 @@
+#include "ThreadPlacement.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // Splits "<role>=<value>" and checks the role
+    std::string roleOf(const std::string& spec, const std::vector<std::string>& roles, std::string& value) {
+        size_t eq = spec.find('=');
+        if (eq == std::string::npos || eq == 0 || eq + 1 == spec.size()) {
+            throw std::invalid_argument("Expected <role>=<value>, got: " + spec);
+        }
+        std::string role = spec.substr(0, eq);
+        if (std::find(roles.begin(), roles.end(), role) == roles.end()) {
+            throw std::invalid_argument("Unknown thread role: " + role);
+        }
+        value = spec.substr(eq + 1);
+        return role;
+    }
+
+    int parseNumber(const std::string& text, int low, int high, const std::string& spec) {
+        size_t used = 0;
+        int n = 0;
+        try {
+            n = std::stoi(text, &used);
+        } catch (const std::exception&) {
+            used = 0;
+        }
+        if (used == 0 || used != text.size() || n < low || n > high) {
+            throw std::invalid_argument("Expected a number from " + std::to_string(low) + " to "
+                                        + std::to_string(high) + " in: " + spec);
+        }
+        return n;
+    }
+
+    uint64_t steadyMicroseconds() {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t percentile(std::vector<uint64_t> samples, double p) {
+        if (samples.empty()) {
+            return 0;
+        }
+        size_t i = static_cast<size_t>(p / 100.0 * (samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + i, samples.end());
+        return samples[i];
+    }
+
+#if defined(__linux__)
+    void report(const std::string& role, const std::string& what, int err) {
+        std::cerr << "Thread " << role << ": cannot " << what << ": " << std::strerror(err);
+        if (err == EPERM) {
+            std::cerr << " (needs CAP_SYS_NICE or a higher rtprio/nice limit)";
+        }
+        std::cerr << std::endl;
+    }
+
+    // Nice is per thread on Linux: setpriority() on the thread id
+    int setThreadNice(int nice) {
+        pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+        return setpriority(PRIO_PROCESS, static_cast<id_t>(tid), nice) == 0 ? 0 : errno;
+    }
+
+    // Lowest nice value RLIMIT_NICE lets us take without privileges
+    int lowestNiceAllowed() {
+        rlimit limit{};
+        if (getrlimit(RLIMIT_NICE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) {
+            return -20;
+        }
+        return std::max(-20, 20 - static_cast<int>(limit.rlim_cur));
+    }
+#endif
+}
+
+std::string ThreadPlacement::describe() const {
+    if (empty()) {
+        return "unplaced";
+    }
+    std::ostringstream out;
+    if (!cpus.empty()) {
+        out << (cpus.size() == 1 ? "cpu " : "cpus ");
+        for (size_t i = 0; i < cpus.size(); ++i) {
+            out << (i ? "," : "") << cpus[i];
+        }
+        if (policy != Policy::Inherit) {
+            out << ", ";
+        }
+    }
+    switch (policy) {
+        case Policy::Nice: out << "nice " << priority; break;
+        case Policy::Fifo: out << "fifo " << priority; break;
+        case Policy::RoundRobin: out << "rr " << priority; break;
+        case Policy::Inherit: break;
+    }
+    return out.str();
+}
+
+void parsePin(const std::string& spec, const std::vector<std::string>& roles, ThreadPlacements& placements) {
+    std::string value;
+    std::string role = roleOf(spec, roles, value);
+    if (value.back() == ',') {
+        throw std::invalid_argument("Trailing comma in: " + spec);
+    }
+    std::vector<int> cpus;
+    std::istringstream items(value);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        size_t dash = item.find('-');
+        int first = parseNumber(item.substr(0, dash), 0, 1023, spec);
+        int last = dash == std::string::npos ? first : parseNumber(item.substr(dash + 1), first, 1023, spec);
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    if (cpus.empty()) {
+        throw std::invalid_argument("No CPUs in: " + spec);
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    placements[role].cpus = cpus;
+}
+
+void parsePriority(const std::string& spec, const std::vector<std::string>& roles, ThreadPlacements& placements) {
+    std::string value;
+    std::string role = roleOf(spec, roles, value);
+    size_t colon = value.find(':');
+    std::string name = value.substr(0, colon);
+    std::string level = colon == std::string::npos ? "" : value.substr(colon + 1);
+    ThreadPlacement& p = placements[role];
+    if (name == "fifo" || name == "rr") {
+        p.policy = name == "fifo" ? ThreadPlacement::Policy::Fifo : ThreadPlacement::Policy::RoundRobin;
+        p.priority = parseNumber(level, 1, 99, spec);
+    } else if (name == "nice") {
+        p.policy = ThreadPlacement::Policy::Nice;
+        p.priority = parseNumber(level, -20, 19, spec);
+    } else {
+        throw std::invalid_argument("Expected fifo:<1-99>, rr:<1-99> or nice:<-20..19>, got: " + value);
+    }
+}
+
+bool applyThreadPlacement(const ThreadPlacements& placements, const std::string& role) {
+    auto it = placements.find(role);
+    return it == placements.end() || applyThreadPlacement(it->second, role);
+}
+
+#if defined(__linux__)
+
+bool applyThreadPlacement(const ThreadPlacement& placement, const std::string& role) {
+    if (placement.empty()) {
+        return true;
+    }
+    bool ok = true;
+    if (!placement.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : placement.cpus) {
+            CPU_SET(cpu, &set);
+        }
+        if (int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+            ThreadPlacement cpusOnly;
+            cpusOnly.cpus = placement.cpus;
+            report(role, "run on " + cpusOnly.describe(), err);
+            ok = false;
+        }
+    }
+    if (placement.policy == ThreadPlacement::Policy::Fifo || placement.policy == ThreadPlacement::Policy::RoundRobin) {
+        sched_param param{};
+        param.sched_priority = placement.priority;
+        int policy = placement.policy == ThreadPlacement::Policy::Fifo ? SCHED_FIFO : SCHED_RR;
+        if (int err = pthread_setschedparam(pthread_self(), policy, &param)) {
+            report(role, std::string("use ") + (policy == SCHED_FIFO ? "SCHED_FIFO " : "SCHED_RR ")
+                         + std::to_string(placement.priority), err);
+            ok = false;
+            int nice = lowestNiceAllowed();
+            if (nice < 0 && setThreadNice(nice) == 0) {
+                std::cerr << "Thread " << role << ": running at nice " << nice << " instead" << std::endl;
+            }
+        }
+    } else if (placement.policy == ThreadPlacement::Policy::Nice) {
+        if (int err = setThreadNice(placement.priority)) {
+            report(role, "set nice " + std::to_string(placement.priority), err);
+            ok = false;
+        }
+    }
+    if (ok) {
+        std::cout << "Thread " << role << ": " << placement.describe() << std::endl;
+    }
+    return ok;
+}
+
+#else
+
+bool applyThreadPlacement(const ThreadPlacement& placement, const std::string& role) {
+    if (placement.empty()) {
+        return true;
+    }
+    std::cerr << "Thread " << role << ": placement (" << placement.describe()
+              << ") is only supported on Linux, ignored" << std::endl;
+    return false;
+}
+
+#endif
+
+std::vector<uint64_t> probeWakeups(const ThreadPlacement& placement, const WakeupProbe& probe) {
+    size_t cpus = placement.cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : placement.cpus.size();
+    int hogs = probe.hogs > 0 ? probe.hogs : static_cast<int>(cpus) + 1;
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> hogThreads;
+    ThreadPlacement hogPlacement;
+    hogPlacement.cpus = placement.cpus;
+    for (int i = 0; i < hogs; ++i) {
+        hogThreads.emplace_back([&done, &hogPlacement]() {
+#if defined(__linux__)
+            if (!hogPlacement.cpus.empty()) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int cpu : hogPlacement.cpus) {
+                    CPU_SET(cpu, &set);
+                }
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            }
+#endif
+            volatile uint64_t spin = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                spin = spin + 1;
+            }
+        });
+    }
+
+    std::vector<uint64_t> lateness;
+    lateness.reserve(probe.durationMs * 1000 / std::max<uint64_t>(probe.periodUs, 1) + 1);
+    std::thread sleeper([&]() {
+        applyThreadPlacement(placement, "probe");
+        uint64_t end = steadyMicroseconds() + probe.durationMs * 1000;
+        uint64_t target = steadyMicroseconds() + probe.periodUs;
+        while (target < end) {
+            std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(target)));
+            uint64_t now = steadyMicroseconds();
+            lateness.push_back(now - target);
+            // A wakeup later than a period skips the ticks it missed
+            target = std::max(target + probe.periodUs, now + 1);
+        }
+    });
+    sleeper.join();
+    done = true;
+    for (auto& t : hogThreads) {
+        t.join();
+    }
+    return lateness;
+}
+
+void reportWakeups(const ThreadPlacements& placements, const WakeupProbe& probe) {
+    std::cout << "Wakeup lateness, " << probe.periodUs << " us period, " << probe.durationMs << " ms each, "
+              << "CPU hogs on the probe's CPUs" << std::endl;
+    auto run = [&probe](const std::string& label, const ThreadPlacement& placement) {
+        std::vector<uint64_t> us = probeWakeups(placement, probe);
+        std::cout << "  " << label << " (" << placement.describe() << "): n=" << us.size()
+                  << " p50=" << percentile(us, 50) << "us"
+                  << " p99=" << percentile(us, 99) << "us"
+                  << " p99.9=" << percentile(us, 99.9) << "us"
+                  << " max=" << percentile(us, 100) << "us" << std::endl;
+    };
+    run("baseline", ThreadPlacement{});
+    for (const auto& [role, placement] : placements) {
+        // The same CPUs and hogs as the placed run, without the priority
+        ThreadPlacement pinnedOnly;
+        pinnedOnly.cpus = placement.cpus;
+        if (!pinnedOnly.cpus.empty() && placement.policy != ThreadPlacement::Policy::Inherit) {
+            run(role + " cpus only", pinnedOnly);
+        }
+        run(role, placement);
+    }
+}
@@ -0,0 +1,193 @@
+#include "Trace.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace trace {
+
+namespace {
+    struct Record {
+        uint64_t id;
+        uint64_t beginUs;
+        uint64_t endUs;
+        Stage stage;
+    };
+
+    // One thread's ring. Only that thread writes it.
+    struct Buffer {
+        Buffer(size_t capacity, uint32_t thread) : records(capacity), mask(capacity - 1), thread(thread) {}
+
+        std::vector<Record> records;
+        size_t mask;
+        uint32_t thread;
+        std::atomic<uint64_t> written{0};
+    };
+
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    Config config;
+    std::atomic<int64_t> peerOffsetUs{std::numeric_limits<int64_t>::max()};
+
+    thread_local Buffer* local = nullptr;
+
+    Buffer* registerThread() {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        size_t capacity = 1;
+        while (capacity < config.recordsPerThread) {
+            capacity <<= 1;
+        }
+        buffers.push_back(std::make_unique<Buffer>(capacity, static_cast<uint32_t>(buffers.size() + 1)));
+        return buffers.back().get();
+    }
+
+    uint64_t processId() {
+#if defined(_WIN32)
+        return static_cast<uint64_t>(_getpid());
+#else
+        return static_cast<uint64_t>(getpid());
+#endif
+    }
+
+    void writeLines(std::ostream& out, const std::vector<std::string>& lines) {
+        out << "{\"traceEvents\":[\n";
+        for (size_t i = 0; i < lines.size(); ++i) {
+            out << lines[i] << (i + 1 < lines.size() ? ",\n" : "\n");
+        }
+        out << "]}\n";
+    }
+}
+
+namespace detail {
+    std::atomic<bool> enabled{false};
+
+    void record(Stage stage, uint64_t id, uint64_t beginUs, uint64_t endUs) {
+        if (!local) {
+            local = registerThread();
+        }
+        uint64_t n = local->written.load(std::memory_order_relaxed);
+        local->records[n & local->mask] = {id, beginUs, endUs, stage};
+        local->written.store(n + 1, std::memory_order_release);
+    }
+
+    void observe(uint64_t remoteUs, uint64_t localUs) {
+        int64_t offset = static_cast<int64_t>(localUs - remoteUs);
+        int64_t best = peerOffsetUs.load(std::memory_order_relaxed);
+        while (offset < best && !peerOffsetUs.compare_exchange_weak(best, offset, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+const char* stageName(Stage stage) {
+    switch (stage) {
+        case Stage::Hook:   return "hook";
+        case Stage::Encode: return "encode";
+        case Stage::Queue:  return "queue";
+        case Stage::Write:  return "write";
+        case Stage::Read:   return "read";
+        case Stage::Decode: return "decode";
+        case Stage::Inject: return "inject";
+        case Stage::Count:  break;
+    }
+    return "unknown";
+}
+
+void enable(const Config& cfg) {
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        config = cfg;
+    }
+    detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+void disable() {
+    detail::enabled.store(false, std::memory_order_relaxed);
+}
+
+void clear() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto& buffer : buffers) {
+        buffer->written.store(0, std::memory_order_relaxed);
+    }
+    peerOffsetUs.store(std::numeric_limits<int64_t>::max(), std::memory_order_relaxed);
+}
+
+std::vector<Span> collect() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    int64_t offset = peerOffsetUs.load(std::memory_order_relaxed);
+    int64_t shift = config.alignToPeer && offset != std::numeric_limits<int64_t>::max() ? -offset : 0;
+
+    std::vector<Span> spans;
+    for (const auto& buffer : buffers) {
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t first = written > buffer->records.size() ? written - buffer->records.size() : 0;
+        for (uint64_t n = first; n < written; ++n) {
+            const Record& r = buffer->records[n & buffer->mask];
+            spans.push_back({r.stage, r.id, r.beginUs + shift, r.endUs + shift, buffer->thread});
+        }
+    }
+    return spans;
+}
+
+bool writeJson(const std::string& path, const std::string& process) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    uint64_t pid = processId();
+    std::vector<Span> spans = collect();
+    std::vector<std::string> lines;
+    lines.reserve(spans.size() * 2 + 1);
+    lines.push_back("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + std::to_string(pid)
+                    + ",\"tid\":0,\"args\":{\"name\":\"" + process + "\"}}");
+    char line[256];
+    for (const Span& s : spans) {
+        // Async begin/end pairs with a global ID put both sides of an event on one track
+        for (char phase : {'b', 'e'}) {
+            std::snprintf(line, sizeof(line),
+                          "{\"name\":\"%s\",\"cat\":\"input\",\"ph\":\"%c\",\"id2\":{\"global\":\"0x%" PRIx64 "\"},"
+                          "\"pid\":%" PRIu64 ",\"tid\":%u,\"ts\":%" PRIu64 "}",
+                          stageName(s.stage), phase, s.id, pid, s.thread, phase == 'b' ? s.beginUs : s.endUs);
+            lines.emplace_back(line);
+        }
+    }
+    writeLines(out, lines);
+    return static_cast<bool>(out);
+}
+
+bool mergeJson(const std::vector<std::string>& inputs, const std::string& output) {
+    std::vector<std::string> lines;
+    for (const std::string& path : inputs) {
+        std::ifstream in(path);
+        if (!in) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.rfind("{\"name\"", 0) != 0) {
+                continue;
+            }
+            if (line.back() == ',') {
+                line.pop_back();
+            }
+            lines.push_back(std::move(line));
+        }
+    }
+    std::ofstream out(output, std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    writeLines(out, lines);
+    return static_cast<bool>(out);
+}
+
+} // namespace trace
@@ -0,0 +1,304 @@
+#include "Transport.h"
+#include "SocketTuning.h"
+#include "SpscRing.h"
+#include <atomic>
+
+#if defined(__linux__)
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#endif
+
+size_t Transport::unsentBytes() {
+#if defined(__linux__)
+    boost::asio::ip::tcp::socket* s = socket();
+    int queued = 0;
+    if (s && s->is_open() && ioctl(s->native_handle(), SIOCOUTQNSD, &queued) == 0 && queued > 0) {
+        return static_cast<size_t>(queued);
+    }
+#endif
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+//  TlsTransport / TcpTransport
+// ---------------------------------------------------------------------------
+
+namespace {
+    // `quickAck` is the socket to re-arm TCP_QUICKACK on once the read completes, if any.
+    template <typename Stream>
+    void readSome(Stream& stream, std::pmr::memory_resource* memory, boost::asio::mutable_buffer buffer,
+                  std::shared_ptr<Transport::Handler> handler, boost::asio::ip::tcp::socket* quickAck) {
+        stream.async_read_some(buffer, fromPool(memory,
+            [handler = std::move(handler), quickAck](const boost::system::error_code& ec, size_t len) {
+                if (quickAck && !ec) {
+                    rearmQuickAck(*quickAck);
+                }
+                handler->onRead(ec, len);
+            }));
+    }
+
+    template <typename Stream>
+    void writeAll(Stream& stream, std::pmr::memory_resource* memory, boost::asio::const_buffer buffer,
+                  std::shared_ptr<Transport::Handler> handler) {
+        boost::asio::async_write(stream, buffer, fromPool(memory,
+            [handler = std::move(handler)](const boost::system::error_code& ec, size_t len) {
+                handler->onWrite(ec, len);
+            }));
+    }
+}
+
+TlsTransport::TlsTransport(std::unique_ptr<Stream> stream)
+    : stream_(std::move(stream)) {
+}
+
+Transport::Executor TlsTransport::executor() {
+    return stream_->get_executor();
+}
+
+void TlsTransport::asyncRead(boost::asio::mutable_buffer buffer, std::shared_ptr<Handler> handler) {
+    readSome(*stream_, memory_, buffer, std::move(handler), quickAck_ ? &stream_->next_layer() : nullptr);
+}
+
+void TlsTransport::asyncWrite(boost::asio::const_buffer buffer, std::shared_ptr<Handler> handler) {
+    writeAll(*stream_, memory_, buffer, std::move(handler));
+}
+
+void TlsTransport::close() {
+    boost::system::error_code ignored;
+    stream_->lowest_layer().close(ignored);
+}
+
+TcpTransport::TcpTransport(boost::asio::ip::tcp::socket socket)
+    : socket_(std::move(socket)) {
+}
+
+Transport::Executor TcpTransport::executor() {
+    return socket_.get_executor();
+}
+
+void TcpTransport::asyncRead(boost::asio::mutable_buffer buffer, std::shared_ptr<Handler> handler) {
+    readSome(socket_, memory_, buffer, std::move(handler), quickAck_ ? &socket_ : nullptr);
+}
+
+void TcpTransport::asyncWrite(boost::asio::const_buffer buffer, std::shared_ptr<Handler> handler) {
+    writeAll(socket_, memory_, buffer, std::move(handler));
+}
+
+void TcpTransport::close() {
+    boost::system::error_code ignored;
+    socket_.close(ignored);
+}
+
+// ---------------------------------------------------------------------------
+//  MemoryTransport
+// ---------------------------------------------------------------------------
+
+// One direction of a connection.
+struct MemoryTransport::Pipe {
+    explicit Pipe(size_t capacity) : ring(capacity) {}
+
+    SpscRing<uint8_t> ring;
+    std::atomic<bool> closed{false};
+    // Set by an end that found nothing to do: the reader waiting for bytes,
+    // the writer for space. Whoever changes that clears it and wakes them.
+    std::atomic<bool> readerParked{false};
+    std::atomic<bool> writerParked{false};
+    // Fixed before either end starts
+    std::weak_ptr<End> reader;
+    std::weak_ptr<End> writer;
+};
+
+// Everything an end's operations touch. Only its own executor's thread
+// changes it; the peer only goes through the pipes.
+struct MemoryTransport::End {
+    End(Executor executor, std::shared_ptr<Pipe> in, std::shared_ptr<Pipe> out)
+        : executor(std::move(executor)), in(std::move(in)), out(std::move(out)) {}
+
+    Executor executor;
+    std::shared_ptr<Pipe> in;
+    std::shared_ptr<Pipe> out;
+    std::pmr::memory_resource* memory = std::pmr::get_default_resource();
+    bool closed = false;
+
+    boost::asio::mutable_buffer readBuf;
+    std::shared_ptr<Handler> reader;        // set while a read is outstanding
+    boost::asio::const_buffer writeBuf;
+    size_t written = 0;
+    std::shared_ptr<Handler> writer;        // set while a write is outstanding
+    // Like a socket, an outstanding operation keeps the io_context's run() going
+    Executor readWork;
+    Executor writeWork;
+
+    static Executor tracked(const Executor& executor) {
+        return boost::asio::prefer(executor, boost::asio::execution::outstanding_work.tracked);
+    }
+
+    // Makes what progress it can on the outstanding read or write; parks if there is none to make.
+    void read();
+    void write();
+
+    void finishRead(const boost::system::error_code& ec, size_t len) {
+        boost::asio::post(executor, fromPool(memory, [handler = std::move(reader), ec, len]() {
+            handler->onRead(ec, len);
+        }));
+        readWork = Executor();
+    }
+
+    void finishWrite(const boost::system::error_code& ec) {
+        boost::asio::post(executor, fromPool(memory, [handler = std::move(writer), ec, len = written]() {
+            handler->onWrite(ec, len);
+        }));
+        writeWork = Executor();
+    }
+
+    // Wakes the end parked on `flag`, if any. The fence pairs with the one a
+    // parking end issues between setting its flag and looking again, so
+    // either it sees our change or we see its flag.
+    static void wake(std::atomic<bool>& flag, const std::weak_ptr<End>& who, void (End::*resume)()) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!flag.load(std::memory_order_relaxed) || !flag.exchange(false, std::memory_order_relaxed)) {
+            return;
+        }
+        if (std::shared_ptr<End> end = who.lock()) {
+            boost::asio::post(end->executor, [end, resume]() {
+                ((*end).*resume)();
+            });
+        }
+    }
+};
+
+void MemoryTransport::End::read() {
+    bool parked = false;
+    while (reader) {
+        size_t n = in->ring.pop(static_cast<uint8_t*>(readBuf.data()), readBuf.size());
+        if (n > 0 || in->closed.load(std::memory_order_acquire)) {
+            if (parked) {
+                in->readerParked.store(false, std::memory_order_relaxed);
+            }
+            if (n == 0) {
+                // Closed: whatever was written before that is still delivered
+                n = in->ring.pop(static_cast<uint8_t*>(readBuf.data()), readBuf.size());
+            }
+            if (n > 0) {
+                wake(in->writerParked, in->writer, &End::write);
+                finishRead({}, n);
+            } else {
+                finishRead(boost::asio::error::eof, 0);
+            }
+            return;
+        }
+        if (parked) {
+            return;
+        }
+        in->readerParked.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        parked = true;
+    }
+}
+
+void MemoryTransport::End::write() {
+    bool parked = false;
+    while (writer) {
+        if (out->closed.load(std::memory_order_acquire)) {
+            if (parked) {
+                out->writerParked.store(false, std::memory_order_relaxed);
+            }
+            finishWrite(boost::asio::error::broken_pipe);
+            return;
+        }
+        const uint8_t* data = static_cast<const uint8_t*>(writeBuf.data());
+        size_t n = out->ring.push(data + written, writeBuf.size() - written);
+        if (n > 0) {
+            written += n;
+            if (parked) {
+                out->writerParked.store(false, std::memory_order_relaxed);
+                parked = false;
+            }
+            wake(out->readerParked, out->reader, &End::read);
+            if (written == writeBuf.size()) {
+                finishWrite({});
+                return;
+            }
+            continue;
+        }
+        if (parked) {
+            return;
+        }
+        out->writerParked.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        parked = true;
+    }
+}
+
+MemoryTransport::Pair MemoryTransport::connect(boost::asio::io_context& first, boost::asio::io_context& second,
+                                               size_t capacity) {
+    auto forward = std::make_shared<Pipe>(capacity);
+    auto backward = std::make_shared<Pipe>(capacity);
+    auto a = std::make_shared<End>(first.get_executor(), backward, forward);
+    auto b = std::make_shared<End>(second.get_executor(), forward, backward);
+    forward->writer = a;
+    forward->reader = b;
+    backward->writer = b;
+    backward->reader = a;
+    return {std::unique_ptr<MemoryTransport>(new MemoryTransport(a)),
+            std::unique_ptr<MemoryTransport>(new MemoryTransport(b))};
+}
+
+MemoryTransport::MemoryTransport(std::shared_ptr<End> end)
+    : end_(std::move(end)) {
+}
+
+MemoryTransport::~MemoryTransport() {
+    close();
+}
+
+Transport::Executor MemoryTransport::executor() {
+    return end_->executor;
+}
+
+void MemoryTransport::asyncRead(boost::asio::mutable_buffer buffer, std::shared_ptr<Handler> handler) {
+    end_->memory = memory_;
+    end_->readBuf = buffer;
+    end_->reader = std::move(handler);
+    end_->readWork = End::tracked(end_->executor);
+    if (end_->closed) {
+        end_->finishRead(boost::asio::error::operation_aborted, 0);
+        return;
+    }
+    end_->read();
+}
+
+void MemoryTransport::asyncWrite(boost::asio::const_buffer buffer, std::shared_ptr<Handler> handler) {
+    end_->memory = memory_;
+    end_->writeBuf = buffer;
+    end_->written = 0;
+    end_->writer = std::move(handler);
+    end_->writeWork = End::tracked(end_->executor);
+    if (end_->closed) {
+        end_->finishWrite(boost::asio::error::operation_aborted);
+        return;
+    }
+    end_->write();
+}
+
+size_t MemoryTransport::unsentBytes() {
+    return end_->out->ring.size();
+}
+
+void MemoryTransport::close() {
+    End& end = *end_;
+    if (end.closed) {
+        return;
+    }
+    end.closed = true;
+    end.in->closed.store(true, std::memory_order_release);
+    end.out->closed.store(true, std::memory_order_release);
+    End::wake(end.out->readerParked, end.out->reader, &End::read);
+    End::wake(end.in->writerParked, end.in->writer, &End::write);
+    if (end.reader) {
+        end.finishRead(boost::asio::error::operation_aborted, 0);
+    }
+    if (end.writer) {
+        end.finishWrite(boost::asio::error::operation_aborted);
+    }
+}
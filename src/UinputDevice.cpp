@@ -0,0 +1,147 @@
+#include "UinputDevice.h"
+#include "EvdevKeys.h"
+#include "TextInput.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <stdexcept>
+#include <sys/ioctl.h>
+#include <uiohook.h>
+#include <unistd.h>
+
+namespace {
+    void append(std::vector<input_event>& out, uint16_t type, uint16_t code, int32_t value) {
+        input_event ev{};       // the kernel stamps injected events itself
+        ev.type = type;
+        ev.code = code;
+        ev.value = value;
+        out.push_back(ev);
+    }
+
+    // One press and release per character, each its own report so repeated
+    // letters are seen as separate strokes
+    bool encodeText(const EventPacket& pkt, std::vector<input_event>& out) {
+        size_t start = out.size();
+        for (uint8_t byte : pkt.payload) {
+            uint16_t keycode = 0;
+            bool shift = false;
+            uint16_t code = asciiKey(static_cast<char>(byte), keycode, shift) ? virtualKeyToEvdev(keycode) : 0;
+            if (code == 0) {
+                continue;
+            }
+            if (shift) {
+                append(out, EV_KEY, KEY_LEFTSHIFT, 1);
+            }
+            append(out, EV_KEY, code, 1);
+            append(out, EV_SYN, SYN_REPORT, 0);
+            append(out, EV_KEY, code, 0);
+            if (shift) {
+                append(out, EV_KEY, KEY_LEFTSHIFT, 0);
+            }
+            append(out, EV_SYN, SYN_REPORT, 0);
+        }
+        return out.size() > start;
+    }
+
+    void setAxis(int fd, uint16_t axis, int max) {
+        uinput_abs_setup abs{};
+        abs.code = axis;
+        abs.absinfo.minimum = 0;
+        abs.absinfo.maximum = max;
+        ioctl(fd, UI_ABS_SETUP, &abs);
+    }
+}
+
+UinputDevice::UinputDevice(int width, int height) {
+    fd_ = ::open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("Cannot open /dev/uinput: ") + std::strerror(errno));
+    }
+    ioctl(fd_, UI_SET_EVBIT, EV_KEY);
+    ioctl(fd_, UI_SET_EVBIT, EV_ABS);
+    for (int key = KEY_ESC; key < BTN_MISC; ++key) {
+        if (evdevToVirtualKey(static_cast<uint16_t>(key)) != VC_UNDEFINED) {
+            ioctl(fd_, UI_SET_KEYBIT, key);
+        }
+    }
+    for (uint16_t button = MOUSE_BUTTON1; button <= MOUSE_BUTTON5; ++button) {
+        ioctl(fd_, UI_SET_KEYBIT, buttonToEvdev(button));
+    }
+    ioctl(fd_, UI_SET_ABSBIT, ABS_X);
+    ioctl(fd_, UI_SET_ABSBIT, ABS_Y);
+    setAxis(fd_, ABS_X, width - 1);
+    setAxis(fd_, ABS_Y, height - 1);
+
+    uinput_setup setup{};
+    setup.id.bustype = BUS_VIRTUAL;
+    std::strncpy(setup.name, kName, sizeof(setup.name) - 1);
+    if (ioctl(fd_, UI_DEV_SETUP, &setup) < 0 || ioctl(fd_, UI_DEV_CREATE) < 0) {
+        int err = errno;
+        ::close(fd_);
+        throw std::runtime_error(std::string("Cannot create uinput device: ") + std::strerror(err));
+    }
+}
+
+UinputDevice::~UinputDevice() {
+    ioctl(fd_, UI_DEV_DESTROY);
+    ::close(fd_);
+}
+
+bool UinputDevice::available() {
+    return access("/dev/uinput", W_OK) == 0;
+}
+
+bool UinputDevice::encode(const EventPacket& pkt, std::vector<input_event>& out) {
+    uint32_t keycode = 0;
+    uint8_t button = 0;
+    int32_t x = 0;
+    int32_t y = 0;
+    switch (pkt.type) {
+        case SamenessEventType::KeyPress:
+        case SamenessEventType::KeyRelease: {
+            uint16_t code = readKey(pkt, keycode) && keycode <= 0xFFFF ? virtualKeyToEvdev(static_cast<uint16_t>(keycode)) : 0;
+            if (code == 0) {
+                return false;
+            }
+            append(out, EV_KEY, code, pkt.type == SamenessEventType::KeyPress ? 1 : 0);
+            break;
+        }
+        case SamenessEventType::MouseMove:
+            if (!readMouseMove(pkt, x, y)) {
+                return false;
+            }
+            append(out, EV_ABS, ABS_X, x);
+            append(out, EV_ABS, ABS_Y, y);
+            break;
+        case SamenessEventType::MouseButtonPress:
+        case SamenessEventType::MouseButtonRelease: {
+            uint16_t code = readMouseButton(pkt, button, x, y) ? buttonToEvdev(button) : 0;
+            if (code == 0) {
+                return false;
+            }
+            // Clicks land where the packet says, even if the last move was collapsed away
+            append(out, EV_ABS, ABS_X, x);
+            append(out, EV_ABS, ABS_Y, y);
+            append(out, EV_KEY, code, pkt.type == SamenessEventType::MouseButtonPress ? 1 : 0);
+            break;
+        }
+        case SamenessEventType::TextInput:
+            return encodeText(pkt, out);
+        default:
+            return false;
+    }
+    append(out, EV_SYN, SYN_REPORT, 0);
+    return true;
+}
+
+void UinputDevice::inject(const EventPacket& pkt) {
+    records_.clear();
+    if (!encode(pkt, records_)) {
+        return;
+    }
+    size_t bytes = records_.size() * sizeof(input_event);
+    if (::write(fd_, records_.data(), bytes) != static_cast<ssize_t>(bytes)) {
+        throw std::runtime_error(std::string("uinput write failed: ") + std::strerror(errno));
+    }
+}
@@ -0,0 +1,343 @@
+#include "UringServer.h"
+#include "EchoFilter.h"
+#include "Stats.h"
+#include "UinputDevice.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    // Room for a recycle per receive buffer plus the receive, wake, write and
+    // send one iteration may prepare
+    constexpr unsigned kRingEntries = 128;
+    constexpr uint16_t kBufferGroup = 0;
+    constexpr unsigned kReceiveBuffers = 64;
+    constexpr size_t kReceiveBufferSize = 4096;
+    // Largest plaintext carried by one TLS record
+    constexpr size_t kTlsRecordPayload = 16 * 1024;
+
+    boost::system::error_code systemError(int err) {
+        return boost::system::error_code(err, boost::system::system_category());
+    }
+}
+
+UringServer::UringServer(std::unique_ptr<Stream> stream, uint16_t version, std::vector<uint8_t> leftover)
+    : version_(version)
+    , leftover_(std::move(leftover))
+    , decoder_(version)
+    , plain_(kTlsRecordPayload) {
+    if (!IoUring::available()) {
+        throw std::runtime_error("io_uring is not available on this system");
+    }
+    wake_ = eventfd(0, EFD_CLOEXEC);
+    if (wake_ < 0) {
+        throw std::runtime_error(std::string("eventfd failed: ") + std::strerror(errno));
+    }
+
+    // Keep the session alive past the stream, then swap the BIO pair Asio
+    // drives for memory BIOs. Ciphertext Asio already pushed into the pair
+    // and OpenSSL has not consumed yet moves along; plaintext OpenSSL has
+    // buffered stays inside the session.
+    ssl_ = stream->native_handle();
+    SSL_up_ref(ssl_);
+    BIO* pair = SSL_get_rbio(ssl_);
+    in_ = BIO_new(BIO_s_mem());
+    out_ = BIO_new(BIO_s_mem());
+    BIO_set_mem_eof_return(in_, -1);    // empty means "wait for more", not end of stream
+    uint8_t chunk[4096];
+    int n = 0;
+    while ((n = BIO_read(pair, chunk, sizeof(chunk))) > 0) {
+        BIO_write(in_, chunk, n);
+    }
+    SSL_set_bio(ssl_, in_, out_);
+    fd_ = stream->next_layer().release();
+    stream.reset();
+}
+
+UringServer::~UringServer() {
+    SSL_free(ssl_);
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    ::close(wake_);
+}
+
+void UringServer::setHeartbeat(std::chrono::milliseconds deadline, std::chrono::milliseconds interval) {
+    if (version_ < kProtocolV2) {
+        std::cout << "Peer speaks protocol v1, heartbeats disabled" << std::endl;
+        return;
+    }
+    deadline_ = deadline;
+    heartbeatInterval_ = interval.count() > 0 ? interval : deadline / 4;
+    if (heartbeatInterval_ <= std::chrono::steady_clock::duration::zero()) {
+        heartbeatInterval_ = std::chrono::milliseconds(1);
+    }
+}
+
+void UringServer::stop() {
+    uint64_t one = 1;
+    ssize_t ignored = ::write(wake_, &one, sizeof(one));
+    (void)ignored;
+}
+
+boost::system::error_code UringServer::run(PacketHandler onPacket) {
+    onPacket_ = std::move(onPacket);
+    onFrame_ = [this](Channel channel, const EventPacket& pkt) {
+        stats::countEvent(pkt.type);
+        // Heartbeats only refresh lastRead_; lower priority channels are not served here
+        if (channel == Channel::Input && UinputDevice::encode(pkt, pending_)) {
+            // Noted before the batched write reaches the kernel
+            echoFilter().note(pkt, std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+            ++counters_.packets;
+            if (onPacket_) {
+                onPacket_(pkt);
+            }
+        }
+    };
+    // The ring belongs to the thread that serves it
+    ring_ = std::make_unique<IoUring>(kRingEntries);
+    buffers_ = std::make_unique<IoUring::BufferGroup>(*ring_, kBufferGroup, kReceiveBuffers, kReceiveBufferSize);
+    armWake();
+    armReceive();
+
+    boost::system::error_code result;
+    lastRead_ = lastWrite_ = std::chrono::steady_clock::now();
+    if (!leftover_.empty() && !decoder_.feed(leftover_.data(), leftover_.size(), onFrame_)) {
+        result = boost::asio::error::invalid_argument;
+    }
+    leftover_.clear();
+    // Records from OpenSSL's own buffer, if the client was already sending
+    bool received = true;
+
+    while (!result) {
+        if (received) {
+            received = false;
+            if (!decrypt(result)) {
+                break;
+            }
+        }
+        flushInjections();
+
+        auto now = std::chrono::steady_clock::now();
+        int64_t timeoutUs = -1;
+        if (deadline_ > std::chrono::steady_clock::duration::zero()) {
+            if (now - lastRead_ >= deadline_) {
+                auto silent = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastRead_);
+                std::cerr << "Peer silent for " << silent.count() << " ms, dropping connection" << std::endl;
+                result = boost::asio::error::timed_out;
+                break;
+            }
+            if (now - lastWrite_ >= heartbeatInterval_) {
+                queueHeartbeat();
+                lastWrite_ = now;
+            }
+            auto next = std::min(lastRead_ + deadline_, lastWrite_ + heartbeatInterval_);
+            timeoutUs = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(next - now).count());
+        }
+        flushSends();
+
+        ring_->submitAndWait(1, timeoutUs);
+        ring_->drain([&](const io_uring_cqe& cqe) {
+            switch (cqe.user_data) {
+                case Receive:
+                    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                        receiveArmed_ = false;
+                    }
+                    if (cqe.res > 0) {
+                        uint16_t id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                        BIO_write(in_, buffers_->data(id), cqe.res);
+                        buffers_->recycle(id);
+                        stats::add(&stats::Slot::bytesReceived, static_cast<uint64_t>(cqe.res));
+                        ++counters_.receives;
+                        received = true;
+                        lastRead_ = std::chrono::steady_clock::now();
+                    } else if (cqe.res == 0) {
+                        result = boost::asio::error::eof;
+                    } else if (cqe.res != -ENOBUFS && !result) {
+                        // Out of buffers only pauses the receive; it is re-armed below
+                        result = systemError(-cqe.res);
+                    }
+                    break;
+                case Send:
+                    sendInFlight_ = false;
+                    if (cqe.res < 0) {
+                        result = systemError(-cqe.res);
+                    } else if ((sent_ += static_cast<size_t>(cqe.res)) < sending_.size()) {
+                        // Short send: the rest goes first next time
+                        sendQueue_.insert(sendQueue_.begin(), sending_.begin() + sent_, sending_.end());
+                    }
+                    break;
+                case Inject:
+                    injectInFlight_ = false;
+                    ++counters_.injectWrites;
+                    stats::add(&stats::Slot::injectCalls);
+                    if (cqe.res < 0) {
+                        std::cerr << "Injection failed: " << std::strerror(-cqe.res) << std::endl;
+                    }
+                    break;
+                case Wake:
+                    wakeArmed_ = false;
+                    result = boost::asio::error::operation_aborted;
+                    break;
+            }
+        });
+        if (!result && !receiveArmed_) {
+            armReceive();
+        }
+    }
+
+    drainInFlight();
+    counters_.enterCalls = ring_->enterCalls();
+    ring_.reset();
+    buffers_.reset();
+    return result;
+}
+
+void UringServer::armReceive() {
+    io_uring_sqe* sqe = ring_->getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd_;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    sqe->user_data = Receive;
+    receiveArmed_ = true;
+}
+
+void UringServer::armWake() {
+    io_uring_sqe* sqe = ring_->getSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wake_;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeValue_);
+    sqe->len = sizeof(wakeValue_);
+    sqe->user_data = Wake;
+    wakeArmed_ = true;
+}
+
+bool UringServer::decrypt(boost::system::error_code& ec) {
+    for (;;) {
+        int n = SSL_read(ssl_, plain_.data(), static_cast<int>(plain_.size()));
+        if (n > 0) {
+            if (!decoder_.feed(plain_.data(), static_cast<size_t>(n), onFrame_)) {
+                std::cerr << "Malformed frame from peer" << std::endl;
+                stats::add(&stats::Slot::drops);
+                ec = boost::asio::error::invalid_argument;
+                return false;
+            }
+            continue;
+        }
+        switch (SSL_get_error(ssl_, n)) {
+            case SSL_ERROR_WANT_READ:
+                return true;
+            case SSL_ERROR_ZERO_RETURN:
+                ec = boost::asio::error::eof;
+                return false;
+            default: {
+                // ERR_error_string_n always writes a string, even for an empty queue
+                char reason[256];
+                ERR_error_string_n(ERR_get_error(), reason, sizeof(reason));
+                std::cerr << "TLS error: " << reason << std::endl;
+                ERR_clear_error();
+                ec = boost::asio::error::connection_aborted;
+                return false;
+            }
+        }
+    }
+}
+
+void UringServer::flushInjections() {
+    if (injectInFlight_ || pending_.empty()) {
+        return;
+    }
+    if (injectFd_ < 0) {
+        pending_.clear();
+        return;
+    }
+    injecting_.swap(pending_);
+    pending_.clear();
+    io_uring_sqe* sqe = ring_->getSqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = injectFd_;
+    sqe->addr = reinterpret_cast<uint64_t>(injecting_.data());
+    sqe->len = static_cast<uint32_t>(injecting_.size() * sizeof(input_event));
+    sqe->off = static_cast<uint64_t>(-1);    // the file's own position; devices and pipes have none
+    sqe->user_data = Inject;
+    injectInFlight_ = true;
+}
+
+void UringServer::send(const EventPacket& pkt) {
+    queuePacket(pkt);
+    lastWrite_ = std::chrono::steady_clock::now();
+}
+
+void UringServer::queueHeartbeat() {
+    EventPacket heartbeat;
+    heartbeat.type = SamenessEventType::Heartbeat;
+    heartbeat.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    heartbeat.payloadSize = 0;
+    queuePacket(heartbeat);
+}
+
+void UringServer::queuePacket(const EventPacket& pkt) {
+    SharedFrame frame = makeFrame(channelFor(pkt.type), pkt, version_);
+    // Memory BIOs take any amount, so a write never comes back short
+    SSL_write(ssl_, frame->data(), static_cast<int>(frame->size()));
+    uint8_t chunk[4096];
+    int n = 0;
+    while ((n = BIO_read(out_, chunk, sizeof(chunk))) > 0) {
+        sendQueue_.insert(sendQueue_.end(), chunk, chunk + n);
+    }
+}
+
+void UringServer::flushSends() {
+    if (sendInFlight_ || sendQueue_.empty()) {
+        return;
+    }
+    sending_.swap(sendQueue_);
+    sendQueue_.clear();
+    sent_ = 0;
+    io_uring_sqe* sqe = ring_->getSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(sending_.data());
+    sqe->len = static_cast<uint32_t>(sending_.size());
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = Send;
+    sendInFlight_ = true;
+}
+
+void UringServer::drainInFlight() {
+    // The kernel may still be reading our buffers; shutting the socket down
+    // ends the receive and any send, and a stop() read is answered by a wake
+    ::shutdown(fd_, SHUT_RDWR);
+    if (wakeArmed_) {
+        stop();
+    }
+    while (receiveArmed_ || sendInFlight_ || injectInFlight_ || wakeArmed_) {
+        ring_->submitAndWait(1);
+        ring_->drain([this](const io_uring_cqe& cqe) {
+            switch (cqe.user_data) {
+                case Receive:
+                    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                        receiveArmed_ = false;
+                    }
+                    if (cqe.flags & IORING_CQE_F_BUFFER) {
+                        buffers_->recycle(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+                    }
+                    break;
+                case Send:   sendInFlight_ = false; break;
+                case Inject: injectInFlight_ = false; break;
+                case Wake:   wakeArmed_ = false; break;
+            }
+        });
+    }
+}
@@ -0,0 +1,276 @@
+#include "WireV2.h"
+#include "ByteOrder.h"
+#include "ClipboardSync.h"
+#include "TextInput.h"
+#include <algorithm>
+#include <cstring>
+
+namespace wire {
+
+namespace {
+    using byteorder::fromLe;
+    using byteorder::toLe;
+
+    // Field-wise conversion between wire (little-endian) and host order.
+    // Every call is a no-op on little-endian hosts.
+    void swapHeader(MsgHeader& h) {
+        h.size = toLe(h.size);
+        h.timestamp = toLe(h.timestamp);
+    }
+    void swap(KeyMsg& m) { swapHeader(m.header); m.keycode = toLe(m.keycode); }
+    void swap(MouseMoveMsg& m) { swapHeader(m.header); m.x = toLe(m.x); m.y = toLe(m.y); }
+    void swap(MouseButtonMsg& m) { swapHeader(m.header); m.x = toLe(m.x); m.y = toLe(m.y); }
+    void swap(ClipboardOfferMsg& m) { swapHeader(m.header); m.size = toLe(m.size); }
+    void swap(ClipboardRequestMsg& m) { swapHeader(m.header); }
+    void swap(ClipboardChunkMsg& m) {
+        swapHeader(m.header);
+        m.offset = toLe(m.offset);
+        m.length = toLe(m.length);
+    }
+    void swap(HeartbeatMsg& m) { swapHeader(m.header); }
+    void swap(TextInputMsg& m) { swapHeader(m.header); m.length = toLe(m.length); }
+    void swap(SwitchBackMsg& m) {
+        swapHeader(m.header);
+        m.x = toLe(m.x);
+        m.y = toLe(m.y);
+        m.width = toLe(m.width);
+        m.height = toLe(m.height);
+    }
+
+    constexpr size_t padded(size_t n) {
+        return (n + 7) & ~size_t(7);
+    }
+
+    template <typename T>
+    T makeMsg(const EventPacket& pkt, size_t size = sizeof(T)) {
+        T m{};
+        m.header.type = static_cast<uint8_t>(pkt.type);
+        m.header.size = static_cast<uint32_t>(size);
+        m.header.timestamp = pkt.timestamp;
+        return m;
+    }
+
+    template <typename T>
+    void append(T m, std::vector<uint8_t>& out) {
+        swap(m);
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&m);
+        out.insert(out.end(), p, p + sizeof(T));
+    }
+
+    // Resizes in place so a caller reusing `pkt` keeps its payload allocation.
+    uint8_t* resizePayload(EventPacket& pkt, size_t n) {
+        pkt.payloadSize = static_cast<uint32_t>(n);
+        pkt.payload.resize(n);
+        return pkt.payload.data();
+    }
+
+}
+
+template <typename T>
+bool load(const uint8_t* data, size_t len, T& out) {
+    if (len < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&out, data, sizeof(T));
+    swap(out);
+    return true;
+}
+
+template bool load<KeyMsg>(const uint8_t*, size_t, KeyMsg&);
+template bool load<MouseMoveMsg>(const uint8_t*, size_t, MouseMoveMsg&);
+template bool load<MouseButtonMsg>(const uint8_t*, size_t, MouseButtonMsg&);
+template bool load<ClipboardOfferMsg>(const uint8_t*, size_t, ClipboardOfferMsg&);
+template bool load<ClipboardRequestMsg>(const uint8_t*, size_t, ClipboardRequestMsg&);
+template bool load<ClipboardChunkMsg>(const uint8_t*, size_t, ClipboardChunkMsg&);
+template bool load<HeartbeatMsg>(const uint8_t*, size_t, HeartbeatMsg&);
+template bool load<TextInputMsg>(const uint8_t*, size_t, TextInputMsg&);
+template bool load<SwitchBackMsg>(const uint8_t*, size_t, SwitchBackMsg&);
+
+void encode(const EventPacket& pkt, std::vector<uint8_t>& out) {
+    switch (pkt.type) {
+        case SamenessEventType::KeyPress:
+        case SamenessEventType::KeyRelease: {
+            auto m = makeMsg<KeyMsg>(pkt);
+            readKey(pkt, m.keycode);
+            append(m, out);
+            break;
+        }
+        case SamenessEventType::MouseMove: {
+            auto m = makeMsg<MouseMoveMsg>(pkt);
+            readMouseMove(pkt, m.x, m.y);
+            append(m, out);
+            break;
+        }
+        case SamenessEventType::MouseButtonPress:
+        case SamenessEventType::MouseButtonRelease: {
+            auto m = makeMsg<MouseButtonMsg>(pkt);
+            readMouseButton(pkt, m.button, m.x, m.y);
+            append(m, out);
+            break;
+        }
+        // Clipboard payloads keep their v1 layout in memory: digest, then big-endian u64s.
+        case SamenessEventType::ClipboardOffer: {
+            auto m = makeMsg<ClipboardOfferMsg>(pkt);
+            if (pkt.payload.size() >= sizeof(m.digest) + 8) {
+                std::memcpy(m.digest, pkt.payload.data(), sizeof(m.digest));
+                m.size = byteorder::loadBe64(pkt.payload.data() + sizeof(m.digest));
+            }
+            append(m, out);
+            break;
+        }
+        case SamenessEventType::ClipboardRequest: {
+            auto m = makeMsg<ClipboardRequestMsg>(pkt);
+            std::memcpy(m.digest, pkt.payload.data(), std::min(pkt.payload.size(), sizeof(m.digest)));
+            append(m, out);
+            break;
+        }
+        case SamenessEventType::ClipboardChunk: {
+            size_t prefix = sizeof(ClipboardChunkMsg::digest) + 8;
+            size_t n = pkt.payload.size() > prefix ? pkt.payload.size() - prefix : 0;
+            auto m = makeMsg<ClipboardChunkMsg>(pkt, padded(sizeof(ClipboardChunkMsg) + n));
+            if (pkt.payload.size() >= prefix) {
+                std::memcpy(m.digest, pkt.payload.data(), sizeof(m.digest));
+                m.offset = byteorder::loadBe64(pkt.payload.data() + sizeof(m.digest));
+            }
+            m.length = static_cast<uint32_t>(n);
+            append(m, out);
+            out.insert(out.end(), pkt.payload.begin() + (pkt.payload.size() - n), pkt.payload.end());
+            out.resize(out.size() + (m.header.size - sizeof(ClipboardChunkMsg) - n), 0);
+            break;
+        }
+        case SamenessEventType::Heartbeat:
+            append(makeMsg<HeartbeatMsg>(pkt), out);
+            break;
+        case SamenessEventType::TextInput: {
+            size_t n = pkt.payload.size();
+            auto m = makeMsg<TextInputMsg>(pkt, padded(sizeof(TextInputMsg) + n));
+            m.length = static_cast<uint32_t>(n);
+            append(m, out);
+            out.insert(out.end(), pkt.payload.begin(), pkt.payload.end());
+            out.resize(out.size() + (m.header.size - sizeof(TextInputMsg) - n), 0);
+            break;
+        }
+        case SamenessEventType::SwitchBack: {
+            auto m = makeMsg<SwitchBackMsg>(pkt);
+            readSwitchBack(pkt, m.x, m.y, m.width, m.height);
+            append(m, out);
+            break;
+        }
+    }
+}
+
+DecodeStatus decode(const uint8_t* data, size_t len, EventPacket& out, size_t& consumed) {
+    if (len < sizeof(MsgHeader)) {
+        return DecodeStatus::NeedMore;
+    }
+    MsgHeader h;
+    std::memcpy(&h, data, sizeof(h));
+    swapHeader(h);
+    if (h.size < sizeof(MsgHeader) || h.size > kMaxMessageSize || h.size % 8 != 0) {
+        return DecodeStatus::Malformed;
+    }
+    if (len < h.size) {
+        return DecodeStatus::NeedMore;
+    }
+
+    out.type = static_cast<SamenessEventType>(h.type);
+    out.timestamp = h.timestamp;
+    switch (out.type) {
+        case SamenessEventType::KeyPress:
+        case SamenessEventType::KeyRelease: {
+            KeyMsg m;
+            if (h.size != sizeof(m) || !load(data, len, m)) {
+                return DecodeStatus::Malformed;
+            }
+            byteorder::storeLe(resizePayload(out, 4), m.keycode);
+            break;
+        }
+        case SamenessEventType::MouseMove: {
+            MouseMoveMsg m;
+            if (h.size != sizeof(m) || !load(data, len, m)) {
+                return DecodeStatus::Malformed;
+            }
+            uint8_t* p = resizePayload(out, 8);
+            byteorder::storeLe(p, m.x);
+            byteorder::storeLe(p + 4, m.y);
+            break;
+        }
+        case SamenessEventType::MouseButtonPress:
+        case SamenessEventType::MouseButtonRelease: {
+            MouseButtonMsg m;
+            if (h.size != sizeof(m) || !load(data, len, m)) {
+                return DecodeStatus::Malformed;
+            }
+            uint8_t* p = resizePayload(out, 9);
+            p[0] = m.button;
+            byteorder::storeLe(p + 1, m.x);
+            byteorder::storeLe(p + 5, m.y);
+            break;
+        }
+        case SamenessEventType::ClipboardOffer: {
+            ClipboardOfferMsg m;
+            if (h.size != sizeof(m) || !load(data, len, m)) {
+                return DecodeStatus::Malformed;
+            }
+            uint8_t* p = resizePayload(out, sizeof(m.digest) + 8);
+            std::memcpy(p, m.digest, sizeof(m.digest));
+            byteorder::storeBe64(p + sizeof(m.digest), m.size);
+            break;
+        }
+        case SamenessEventType::ClipboardRequest: {
+            ClipboardRequestMsg m;
+            if (h.size != sizeof(m) || !load(data, len, m)) {
+                return DecodeStatus::Malformed;
+            }
+            std::memcpy(resizePayload(out, sizeof(m.digest)), m.digest, sizeof(m.digest));
+            break;
+        }
+        case SamenessEventType::ClipboardChunk: {
+            ClipboardChunkMsg m;
+            if (!load(data, len, m) || m.length > ClipboardSync::kChunkSize
+                || h.size != padded(sizeof(m) + m.length)) {
+                return DecodeStatus::Malformed;
+            }
+            uint8_t* p = resizePayload(out, sizeof(m.digest) + 8 + m.length);
+            std::memcpy(p, m.digest, sizeof(m.digest));
+            byteorder::storeBe64(p + sizeof(m.digest), m.offset);
+            std::memcpy(p + sizeof(m.digest) + 8, data + sizeof(m), m.length);
+            break;
+        }
+        case SamenessEventType::Heartbeat: {
+            HeartbeatMsg m;
+            if (h.size != sizeof(m) || !load(data, len, m)) {
+                return DecodeStatus::Malformed;
+            }
+            resizePayload(out, 0);
+            break;
+        }
+        case SamenessEventType::TextInput: {
+            TextInputMsg m;
+            if (!load(data, len, m) || m.length == 0 || m.length > kMaxTextBytes
+                || h.size != padded(sizeof(m) + m.length)) {
+                return DecodeStatus::Malformed;
+            }
+            std::memcpy(resizePayload(out, m.length), data + sizeof(m), m.length);
+            break;
+        }
+        case SamenessEventType::SwitchBack: {
+            SwitchBackMsg m;
+            if (h.size != sizeof(m) || !load(data, len, m)) {
+                return DecodeStatus::Malformed;
+            }
+            uint8_t* p = resizePayload(out, 16);
+            byteorder::storeLe(p, m.x);
+            byteorder::storeLe(p + 4, m.y);
+            byteorder::storeLe(p + 8, m.width);
+            byteorder::storeLe(p + 12, m.height);
+            break;
+        }
+        default:
+            return DecodeStatus::Malformed;
+    }
+    consumed = h.size;
+    return DecodeStatus::Ok;
+}
+
+} // namespace wire
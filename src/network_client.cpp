@@ -1,70 +1,367 @@
 #include "EventPacket.h"
+#include "ClipboardSync.h"
+#include "EchoFilter.h"
+#include "KeyRules.h"
+#include "MotionResampler.h"
+#include "Pasteboard.h"
+#include "PeerPool.h"
+#include "Protocol.h"
 #include "ScreenEdgeSwitcher.h"
+#include "Session.h"
+#include "SessionGroup.h"
+#include "SocketTuning.h"
+#include "Stats.h"
+#include "TextInput.h"
+#include "ThreadPlacement.h"
+#include "Trace.h"
 #include "input_helper.h"    // uiohook event types
+#include <algorithm>
+#include <atomic>
+#include <bitset>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
+#include <fstream>
 #include <iostream>
-#include <cstring>           // memcpy
+#include <iterator>
+#include <mutex>
 #include <stdexcept>
 #include <system_error>
 #include <uiohook.h>
 #include <chrono>
+#include <thread>
 #include <openssl/x509.h>
 #include "Injectors.h"
+#ifdef __linux__
+#include "EvdevCapture.h"
+#endif
 
 // Default display settings
 static int HOST_SCREEN_WIDTH = 1920;
 static int HOST_SCREEN_HEIGHT = 1080;
 static int EDGE_THRESHOLD = 20;
+static int PROTOCOL_VERSION = kProtocolVersion;
+static int PEER_DEADLINE_MS = 1000;
+static int SEND_BACKLOG_BYTES = 8192;
+static SocketProfile SOCKET_PROFILE;
+static std::string KEY_RULES_PATH;
+static std::string CAPTURE_BACKEND = "uiohook";
+static std::string TRACE_PATH;
+static ThreadPlacements THREAD_PLACEMENT;
+static const std::vector<std::string> THREAD_ROLES = {"hook", "io"};
+static int PROBE_WAKEUPS_S = 0;
+static std::string MOTION_RATE = "auto";
+static std::string TYPE_PATH;
+static bool PEER_MODE = false;
+static int CLIPBOARD_POLL_MS = 0;
+
+// How long startup waits for the servers before capturing without the missing ones
+static constexpr std::chrono::seconds kInitialConnectWait{3};
 
 // Global switcher instance (will be initialized in main)
 static std::unique_ptr<ScreenEdgeSwitcher> edgeSwitcher;
 
-// Global pointer for SSL socket
-static boost::asio::ssl::stream<boost::asio::ip::tcp::socket>* g_ssl_socket_ptr = nullptr;
+// Sessions to every server this client drives; writes happen on the io thread
+static SessionGroup g_sessions;
+
+// Clipboard state shared with the server
+static ClipboardSync g_clipboard;
+// The first server's session, which the clipboard is shared with
+static std::mutex g_clipboardPeerMutex;
+static std::weak_ptr<Session> g_clipboardPeer;
+
+// Hotkeys and remaps; only touched from the hook thread
+static KeyRules g_keyRules;
 
 // Forward declaration for hook_callback
-void hook_callback(uiohook_event * const event, boost::asio::ssl::stream<boost::asio::ip::tcp::socket>& ssl_socket);
+void hook_callback(uiohook_event * const event, SessionGroup& sessions, uint64_t timestamp);
 
-// Static dispatch function for uiohook
+// Utility to get current time in microseconds
+inline uint64_t currentMicroseconds() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Static dispatch function for uiohook; events are stamped when they reach us
 static void dispatch_hook(uiohook_event* const event) {
-    if (g_ssl_socket_ptr) {
-        hook_callback(event, *g_ssl_socket_ptr);
+    if (!g_sessions.empty()) {
+        hook_callback(event, g_sessions, currentMicroseconds());
     }
 }
 
-// Network error handling
-class NetworkError : public std::runtime_error {
-public:
-    explicit NetworkError(const std::string& message) 
-        : std::runtime_error(message) {}
-};
+#ifdef __linux__
+// Set while the evdev backend runs, so a disconnect can stop it
+static std::atomic<EvdevCapture*> g_evdev{nullptr};
 
-// Safe network write with error handling
-void safeWrite(boost::asio::ssl::stream<boost::asio::ip::tcp::socket>& ssl_socket, 
-               const std::vector<uint8_t>& data) {
-    try {
-        boost::asio::write(ssl_socket, boost::asio::buffer(data));
-    } catch (const boost::system::system_error& e) {
-        throw NetworkError("Network write failed: " + std::string(e.what()));
+// Captures from /dev/input until stopped. Kernel timestamps are on the steady
+// clock's timebase, so they go out as they are. The devices are grabbed while
+// a server has control, so the local desktop never sees that input.
+static void runEvdevCapture() {
+    EvdevCapture capture(2 * HOST_SCREEN_WIDTH, HOST_SCREEN_HEIGHT);
+    if (capture.openAll() == 0) {
+        throw std::runtime_error("No readable input devices in /dev/input (is this user in the input group?)");
     }
+    g_evdev = &capture;
+    capture.run([&capture](const EvdevCapture::Captured* events, size_t count) {
+        for (size_t i = 0; i < count && !g_sessions.empty(); ++i) {
+            uiohook_event event = events[i].event;
+            try {
+                hook_callback(&event, g_sessions, events[i].timestampUs);
+            } catch (const std::exception& e) {
+                std::cerr << "Dropped input event: " << e.what() << std::endl;
+            }
+        }
+        if (capture.grabbed() != edgeSwitcher->isClientControlled()) {
+            capture.setGrab(edgeSwitcher->isClientControlled());
+        }
+    });
+    g_evdev = nullptr;
 }
+#endif
 
-// Utility to get current time in microseconds
-inline uint64_t currentMicroseconds() {
-    using namespace std::chrono;
-    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+// Pointer motion resampling (--motion-rate). The capture thread feeds the
+// resampler and the io thread's timer sends a held move once it falls due;
+// input is sent under the lock so a held move never overtakes a later key.
+static std::mutex g_motionMutex;
+static std::unique_ptr<MotionResampler> g_motion;
+static boost::asio::steady_timer* g_motionTimer = nullptr;
+
+static void sendDueMotion(SessionGroup& sessions);
+
+// io thread
+static void armMotionTimer(SessionGroup& sessions, uint64_t dueUs) {
+    g_motionTimer->expires_at(std::chrono::steady_clock::time_point(std::chrono::microseconds(dueUs)));
+    g_motionTimer->async_wait([&sessions](const boost::system::error_code& ec) {
+        if (!ec) {
+            sendDueMotion(sessions);
+        }
+    });
+}
+
+static void sendDueMotion(SessionGroup& sessions) {
+    std::lock_guard<std::mutex> lock(g_motionMutex);
+    EventPacket move;
+    if (g_motion->popDue(currentMicroseconds(), move)) {
+        sessions.send(move);
+    } else if (g_motion->holding()) {
+        armMotionTimer(sessions, g_motion->nextDueUs());
+    }
+}
+
+static void sendInput(const EventPacket& pkt, SessionGroup& sessions) {
+    if (!g_motion) {
+        sessions.send(pkt);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_motionMutex);
+    uint64_t now = currentMicroseconds();
+    EventPacket out;
+    if (pkt.type != SamenessEventType::MouseMove) {
+        if (g_motion->flush(now, out)) {
+            sessions.send(out);
+        }
+        sessions.send(pkt);
+        return;
+    }
+    switch (g_motion->push(pkt, now, out)) {
+        case MotionResampler::Outcome::Send:
+            sessions.send(out);
+            break;
+        case MotionResampler::Outcome::Hold: {
+            uint64_t due = g_motion->nextDueUs();
+            boost::asio::post(g_motionTimer->get_executor(), [&sessions, due]() { armMotionTimer(sessions, due); });
+            break;
+        }
+        case MotionResampler::Outcome::Merge:
+            stats::add(&stats::Slot::coalescedMoves);
+            break;
+    }
+}
+
+// Keys and buttons forwarded as pressed while the peer has control, so that
+// every switch back to this machine can release them there. Forwarding and
+// switching back both hold g_forwardMutex: a press is either sent and then
+// released by the switch, or not sent at all.
+static std::mutex g_forwardMutex;
+static std::bitset<0x10000> g_forwardedKeys;
+static uint32_t g_forwardedButtons = 0;
+static int32_t g_forwardedX = 0;    // last forwarded pointer position, for button releases
+static int32_t g_forwardedY = 0;
+
+// Under g_forwardMutex
+static void trackForwarded(const EventPacket& pkt) {
+    uint32_t keycode = 0;
+    uint8_t button = 0;
+    switch (pkt.type) {
+        case SamenessEventType::KeyPress:
+        case SamenessEventType::KeyRelease:
+            if (readKey(pkt, keycode) && keycode < g_forwardedKeys.size()) {
+                g_forwardedKeys.set(keycode, pkt.type == SamenessEventType::KeyPress);
+            }
+            break;
+        case SamenessEventType::MouseMove:
+            readMouseMove(pkt, g_forwardedX, g_forwardedY);
+            break;
+        case SamenessEventType::MouseButtonPress:
+        case SamenessEventType::MouseButtonRelease:
+            if (readMouseButton(pkt, button, g_forwardedX, g_forwardedY) && button < 32) {
+                uint32_t bit = 1u << button;
+                g_forwardedButtons = pkt.type == SamenessEventType::MouseButtonPress ? g_forwardedButtons | bit
+                                                                                      : g_forwardedButtons & ~bit;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// A move the resampler still holds was captured while the peer had control:
+// it goes out now, ahead of the releases, and the timer that would have sent
+// it is cancelled so nothing follows once control is back here
+static void flushMotion(SessionGroup& sessions) {
+    if (!g_motion) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(g_motionMutex);
+    EventPacket move;
+    if (g_motion->flush(currentMicroseconds(), move)) {
+        sessions.send(move);
+    }
+    boost::asio::post(g_motionTimer->get_executor(), []() { g_motionTimer->cancel(); });
 }
 
-void hook_callback(uiohook_event * const event, boost::asio::ssl::stream<boost::asio::ip::tcp::socket>& ssl_socket) {
+// Under g_forwardMutex, once control is back on this machine
+static void releaseForwarded(SessionGroup& sessions) {
+    flushMotion(sessions);
+    uint64_t now = currentMicroseconds();
+    for (uint8_t button = 0; g_forwardedButtons != 0; ++button, g_forwardedButtons >>= 1) {
+        if (g_forwardedButtons & 1) {
+            sendInput(makeMouseButtonPacket(SamenessEventType::MouseButtonRelease, now, button, g_forwardedX, g_forwardedY),
+                      sessions);
+        }
+    }
+    for (size_t keycode = 0; g_forwardedKeys.any() && keycode < g_forwardedKeys.size(); ++keycode) {
+        if (g_forwardedKeys.test(keycode)) {
+            g_forwardedKeys.reset(keycode);
+            sendInput(makeKeyPacket(SamenessEventType::KeyRelease, now, static_cast<uint32_t>(keycode)), sessions);
+        }
+    }
+}
+
+// Takes control back from the peer, releasing everything it still sees held
+static void switchToHost(SessionGroup& sessions) {
+    std::lock_guard<std::mutex> lock(g_forwardMutex);
+    if (!edgeSwitcher->isClientControlled()) {
+        return;
+    }
+    releaseForwarded(sessions);
+    edgeSwitcher->forceHost();
+}
+
+// Feeds a pointer position to the edge switcher; crossing back to this
+// machine releases what the peer still sees held
+static ControlState updateControl(int x, int y, SessionGroup& sessions) {
+    std::lock_guard<std::mutex> lock(g_forwardMutex);
+    bool wasClient = edgeSwitcher->isClientControlled();
+    ControlState state = edgeSwitcher->update(x, y);
+    if (wasClient && state == ControlState::HOST) {
+        releaseForwarded(sessions);
+    }
+    return state;
+}
+
+// io thread: the server's pointer reached the edge facing this machine (see
+// EdgeWatcher.h). Control comes back here at once, with the cursor at the
+// mirrored point of the right edge.
+static void returnFromPeer(const EventPacket& pkt) {
+    int32_t peerX = 0, peerY = 0, peerWidth = 0, peerHeight = 0;
+    int x = 0, y = 0;
+    if (!readSwitchBack(pkt, peerX, peerY, peerWidth, peerHeight)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(g_forwardMutex);
+        if (!edgeSwitcher->returnFromPeer(peerY, peerHeight, x, y)) {
+            return;
+        }
+        releaseForwarded(g_sessions);
+    }
+#ifdef __linux__
+    if (EvdevCapture* capture = g_evdev.load()) {
+        capture->warp(x, y);
+    } else
+#endif
+    {
+        injectMouseMove(makeMouseMovePacket(currentMicroseconds(), x, y));
+    }
+    // Stamped with the capture time of the move that reached the edge
+    std::cout << "Control back on this machine " << currentMicroseconds() - pkt.timestamp
+              << " us after the pointer left the server's screen" << std::endl;
+}
+
+// Whether the echo filter holds an injection matching `event`
+static bool isEcho(const uiohook_event& event, uint64_t timestamp) {
+    switch (event.type) {
+        case EVENT_KEY_PRESSED:
+        case EVENT_KEY_RELEASED:
+            return echoFilter().takeEcho(makeKeyPacket(event.type == EVENT_KEY_PRESSED ? SamenessEventType::KeyPress : SamenessEventType::KeyRelease,
+                                                       timestamp, event.data.keyboard.keycode), timestamp);
+        case EVENT_MOUSE_MOVED:
+        case EVENT_MOUSE_DRAGGED:
+            return echoFilter().takeEcho(makeMouseMovePacket(timestamp, event.data.mouse.x, event.data.mouse.y), timestamp);
+        case EVENT_MOUSE_PRESSED:
+        case EVENT_MOUSE_RELEASED:
+            return echoFilter().takeEcho(makeMouseButtonPacket(event.type == EVENT_MOUSE_PRESSED ? SamenessEventType::MouseButtonPress : SamenessEventType::MouseButtonRelease,
+                                                               timestamp, static_cast<uint8_t>(event.data.mouse.button), event.data.mouse.x, event.data.mouse.y), timestamp);
+        default:
+            return false;
+    }
+}
+
+static void runKeyAction(KeyAction action, SessionGroup& sessions) {
+    switch (action) {
+        case KeyAction::SwitchToHost:
+            switchToHost(sessions);
+            break;
+        case KeyAction::ToggleLock:
+            edgeSwitcher->setLocked(!edgeSwitcher->isLocked());
+            break;
+        case KeyAction::Forward:
+        case KeyAction::Swallow:
+            break;
+    }
+}
+
+void hook_callback(uiohook_event * const event, SessionGroup& sessions, uint64_t timestamp) {
     if (!event) {
         throw std::runtime_error("Null event received in hook_callback");
     }
 
     std::cout << "Received event type: " << event->type << std::endl;
 
+    // The local server injected this; sending it on would bounce it back here
+    if (PEER_MODE && isEcho(*event, timestamp)) {
+        stats::add(&stats::Slot::echoes);
+        return;
+    }
+
+    uint64_t hookedUs = trace::enabled() ? trace::nowUs() : 0;
     EventPacket pkt;
-    pkt.timestamp = currentMicroseconds();
+    pkt.timestamp = timestamp;
+
+    // Key rules see every key event, whichever machine has control, so the
+    // modifier state they track stays right.
+    uint32_t keycode = 0;
+    if (event->type == EVENT_KEY_PRESSED || event->type == EVENT_KEY_RELEASED) {
+        keycode = event->data.keyboard.keycode;
+        if (keycode == 0) {
+            throw std::runtime_error("Invalid key code");
+        }
+        KeyAction action = g_keyRules.onKey(keycode, event->type == EVENT_KEY_PRESSED);
+        if (action != KeyAction::Forward) {
+            runKeyAction(action, sessions);
+            return;
+        }
+    }
 
     // Handle mouse movement with edge switching
     if (event->type == EVENT_MOUSE_MOVED) {
@@ -78,7 +375,7 @@ void hook_callback(uiohook_event * const event, boost::asio::ssl::stream<boost::
             throw std::runtime_error("Invalid mouse coordinates");
         }
         
-        ControlState newState = edgeSwitcher->update(x, y);
+        ControlState newState = updateControl(x, y, sessions);
         std::cout << "Control state: " << (newState == ControlState::HOST ? "HOST" : "CLIENT") << std::endl;
 
         if (newState == ControlState::HOST) {
@@ -86,14 +383,9 @@ void hook_callback(uiohook_event * const event, boost::asio::ssl::stream<boost::
             return;
         }
         
-        // CLIENT-controlled: forward this mouse move to peer
-        pkt.type = SamenessEventType::MouseMove;
-        pkt.payloadSize = sizeof(int32_t) * 2;
-        pkt.payload.resize(pkt.payloadSize);
-        
-        // Convert to client-relative coordinates
-        int32_t coords[2] = { x - HOST_SCREEN_WIDTH, y }; 
-        std::memcpy(pkt.payload.data(), coords, pkt.payloadSize);
+        // CLIENT-controlled: forward this mouse move to peer,
+        // converted to client-relative coordinates
+        pkt = makeMouseMovePacket(pkt.timestamp, x - HOST_SCREEN_WIDTH, y);
 
     } else {
         // Other events: only forward if in CLIENT state
@@ -103,35 +395,16 @@ void hook_callback(uiohook_event * const event, boost::asio::ssl::stream<boost::
 
         switch (event->type) {
             case EVENT_KEY_PRESSED:
-                pkt.type = SamenessEventType::KeyPress;
-                {
-                    uint32_t code = event->data.keyboard.keycode;
-                    std::cout << "Key pressed: " << code << std::endl;
-                    if (code == 0) {
-                        throw std::runtime_error("Invalid key code");
-                    }
-                    pkt.payloadSize = sizeof(code);
-                    pkt.payload.resize(pkt.payloadSize);
-                    std::memcpy(pkt.payload.data(), &code, pkt.payloadSize);
-                }
+                std::cout << "Key pressed: " << keycode << std::endl;
+                pkt = makeKeyPacket(SamenessEventType::KeyPress, pkt.timestamp, keycode);
                 break;
 
             case EVENT_KEY_RELEASED:
-                pkt.type = SamenessEventType::KeyRelease;
-                {
-                    uint32_t code = event->data.keyboard.keycode;
-                    std::cout << "Key released: " << code << std::endl;
-                    if (code == 0) {
-                        throw std::runtime_error("Invalid key code");
-                    }
-                    pkt.payloadSize = sizeof(code);
-                    pkt.payload.resize(pkt.payloadSize);
-                    std::memcpy(pkt.payload.data(), &code, pkt.payloadSize);
-                }
+                std::cout << "Key released: " << keycode << std::endl;
+                pkt = makeKeyPacket(SamenessEventType::KeyRelease, pkt.timestamp, keycode);
                 break;
 
             case EVENT_MOUSE_PRESSED:
-                pkt.type = SamenessEventType::MouseButtonPress;
                 {
                     uint8_t button = static_cast<uint8_t>(event->data.mouse.button);
                     if (button == 0) {
@@ -145,19 +418,11 @@ void hook_callback(uiohook_event * const event, boost::asio::ssl::stream<boost::
                         throw std::runtime_error("Invalid mouse coordinates");
                     }
                     
-                    pkt.payloadSize = sizeof(button) + sizeof(int32_t)*2;
-                    pkt.payload.resize(pkt.payloadSize);
-                    size_t off = 0;
-                    std::memcpy(pkt.payload.data() + off, &button, sizeof(button));
-                    off += sizeof(button);
-                    std::memcpy(pkt.payload.data() + off, &x, sizeof(x));
-                    off += sizeof(x);
-                    std::memcpy(pkt.payload.data() + off, &y, sizeof(y));
+                    pkt = makeMouseButtonPacket(SamenessEventType::MouseButtonPress, pkt.timestamp, button, x, y);
                 }
                 break;
 
             case EVENT_MOUSE_RELEASED:
-                pkt.type = SamenessEventType::MouseButtonRelease;
                 {
                     uint8_t button = static_cast<uint8_t>(event->data.mouse.button);
                     if (button == 0) {
@@ -171,14 +436,7 @@ void hook_callback(uiohook_event * const event, boost::asio::ssl::stream<boost::
                         throw std::runtime_error("Invalid mouse coordinates");
                     }
                     
-                    pkt.payloadSize = sizeof(button) + sizeof(int32_t)*2;
-                    pkt.payload.resize(pkt.payloadSize);
-                    size_t off = 0;
-                    std::memcpy(pkt.payload.data() + off, &button, sizeof(button));
-                    off += sizeof(button);
-                    std::memcpy(pkt.payload.data() + off, &x, sizeof(x));
-                    off += sizeof(x);
-                    std::memcpy(pkt.payload.data() + off, &y, sizeof(y));
+                    pkt = makeMouseButtonPacket(SamenessEventType::MouseButtonRelease, pkt.timestamp, button, x, y);
                 }
                 break;
 
@@ -187,23 +445,98 @@ void hook_callback(uiohook_event * const event, boost::asio::ssl::stream<boost::
         }
     }
 
-    try {
-        // Serialize and send
-        auto bytes = pkt.toBytes();
-        safeWrite(ssl_socket, bytes);
-    } catch (const std::exception& e) {
-        std::cerr << "Error sending event: " << e.what() << std::endl;
-        // You might want to handle this error differently, e.g., by reconnecting
-        throw;
+    if (hookedUs != 0) {
+        trace::span(trace::Stage::Hook, trace::eventId(pkt), timestamp, hookedUs);
     }
+
+    // Encoded once and queued for every server; input always goes ahead of clipboard chunks.
+    // Control may have come back here since the check above (returnFromPeer).
+    std::lock_guard<std::mutex> lock(g_forwardMutex);
+    if (!edgeSwitcher->isClientControlled()) {
+        return;
+    }
+    trackForwarded(pkt);
+    sendInput(pkt, sessions);
+}
+
+// Connects, completes TLS and negotiates a protocol version no newer than maxVersion
+static std::unique_ptr<TlsStream> connectToServer(boost::asio::io_context& io_context,
+                                                  boost::asio::ssl::context& ssl_context,
+                                                  const std::string& serverAddress,
+                                                  PeerPool::Attempt& attempt,
+                                                  uint16_t maxVersion,
+                                                  uint16_t& version,
+                                                  uint16_t& refreshHz) {
+    // Create SSL socket
+    auto ssl_socket = std::make_unique<TlsStream>(io_context, ssl_context);
+
+    // Resolve server address; host:port reaches a server behind sameness_relay
+    std::string host = serverAddress;
+    std::string port = "12345";
+    size_t colon = serverAddress.rfind(':');
+    if (colon != std::string::npos && serverAddress.find(':') == colon) {
+        host = serverAddress.substr(0, colon);
+        port = serverAddress.substr(colon + 1);
+    }
+    boost::asio::ip::tcp::resolver resolver(io_context);
+    auto endpoints = resolver.resolve(host, port);
+
+    // A server that never answers is given up on by shutting the socket down
+    // under whichever call waits for it (see PeerPool::Attempt)
+    TlsStream* raw = ssl_socket.get();
+    auto cancel = [raw]() {
+        boost::system::error_code ignored;
+        raw->lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+    };
+
+    // Connect to server, one endpoint after the other; each gets a new socket
+    boost::system::error_code ec = boost::asio::error::host_not_found;
+    for (const auto& entry : endpoints) {
+        boost::system::error_code ignored;
+        ssl_socket->lowest_layer().close(ignored);
+        ssl_socket->lowest_layer().open(entry.endpoint().protocol(), ec);
+        if (ec) {
+            continue;
+        }
+        PeerPool::Attempt::Watch watch(attempt, cancel);
+        ssl_socket->lowest_layer().connect(entry.endpoint(), ec);
+        if (!ec) {
+            break;
+        }
+    }
+    if (ec) {
+        throw boost::system::system_error(ec);
+    }
+    applySocketProfile(ssl_socket->next_layer(), SOCKET_PROFILE);
+
+    PeerPool::Attempt::Watch watch(attempt, cancel);
+    // Perform SSL handshake
+    ssl_socket->handshake(boost::asio::ssl::stream_base::client);
+
+    version = negotiateClient(*ssl_socket, maxVersion, &refreshHz);
+    return ssl_socket;
 }
 
 void printUsage(const char* programName) {
-    std::cerr << "Usage: " << programName << " <server_address> [--width <width>] [--height <height>] [--edge <edge_threshold>] [--help]" << std::endl;
-    std::cerr << "  server_address: The address of the server to connect to." << std::endl;
+    std::cerr << "Usage: " << programName << " <server_address> [<server_address> ...] [--width <width>] [--height <height>] [--edge <edge_threshold>] [--protocol <version>] [--deadline <ms>] [--send-backlog <bytes>] [--socket-profile <name>] [--rules <file>] [--capture <backend>] [--pin <role>=<cpus>] [--priority <role>=<policy>] [--probe-wakeups <seconds>] [--motion-rate <hz>] [--type <file>] [--clipboard <ms>] [--peer] [--trace <file>] [--help]" << std::endl;
+    std::cerr << "  server_address: host[:port] of the server or relay to connect to (port default: 12345). With several, every event is broadcast to all of them. Sessions are opened at startup, kept warm with heartbeats and reopened in the background when they drop." << std::endl;
     std::cerr << "  --width: The width of the screen in pixels (default: " << HOST_SCREEN_WIDTH << ")." << std::endl;
     std::cerr << "  --height: The height of the screen in pixels (default: " << HOST_SCREEN_HEIGHT << ")." << std::endl;
     std::cerr << "  --edge: The edge threshold in pixels (default: " << EDGE_THRESHOLD << ")." << std::endl;
+    std::cerr << "  --protocol: Newest wire protocol version to offer (default: " << PROTOCOL_VERSION << ")." << std::endl;
+    std::cerr << "  --deadline: Milliseconds of silence before the server is considered dead and control returns to this machine (default: " << PEER_DEADLINE_MS << ")." << std::endl;
+    std::cerr << "  --send-backlog: Unsent bytes in the socket beyond which motion is collapsed to the latest position instead of queued, 0 for never (default: " << SEND_BACKLOG_BYTES << ")." << std::endl;
+    std::cerr << "  --socket-profile: Socket options, default, interactive or spin (see SocketTuning.h) (default: " << SOCKET_PROFILE.name << ")." << std::endl;
+    std::cerr << "  --rules: Hotkey and key remap rules file (see KeyRules.h)." << std::endl;
+    std::cerr << "  --capture: Input capture backend, uiohook or evdev (Linux only; reads /dev/input directly) (default: " << CAPTURE_BACKEND << ")." << std::endl;
+    std::cerr << "  --pin: Run a thread (hook or io) only on these CPUs, e.g. hook=2 or io=0-1 (Linux; see ThreadPlacement.h)." << std::endl;
+    std::cerr << "  --priority: Scheduling for a thread (hook or io): fifo:<1-99>, rr:<1-99> or nice:<-20..19>; may need CAP_SYS_NICE (Linux)." << std::endl;
+    std::cerr << "  --probe-wakeups: Measure thread wakeup lateness under a CPU hog for this many seconds per placement, then exit without connecting." << std::endl;
+    std::cerr << "  --motion-rate: Send pointer motion at most this many times a second, auto for the fastest connected server's display refresh rate (unresampled if none is known at startup), or off (default: " << MOTION_RATE << ")." << std::endl;
+    std::cerr << "  --type: Type the UTF-8 text in this file (- for stdin) on the servers as TextInput, then exit without capturing input." << std::endl;
+    std::cerr << "  --clipboard: Share the system clipboard with the first server, checking it for changes this often; 0 for off (see Pasteboard.h) (default: " << CLIPBOARD_POLL_MS << ")." << std::endl;
+    std::cerr << "  --peer: A server runs on this machine too; drop captured input it injected instead of sending it back (see EchoFilter.h)." << std::endl;
+    std::cerr << "  --trace: Record each event's path through the client and write it to this file on exit (Chrome trace-event JSON; see Trace.h)." << std::endl;
     std::cerr << "  --help: Display this help message and exit." << std::endl;
 }
 
@@ -213,7 +546,7 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    std::string serverAddress = argv[1];
+    std::vector<std::string> serverAddresses = { argv[1] };
 
     // Parse command line arguments
     for (int i = 2; i < argc; i++) {
@@ -224,10 +557,102 @@ int main(int argc, char* argv[]) {
             HOST_SCREEN_HEIGHT = std::stoi(argv[++i]);
         } else if (arg == "--edge" && i + 1 < argc) {
             EDGE_THRESHOLD = std::stoi(argv[++i]);
+        } else if (arg == "--protocol" && i + 1 < argc) {
+            PROTOCOL_VERSION = std::stoi(argv[++i]);
+        } else if (arg == "--deadline" && i + 1 < argc) {
+            PEER_DEADLINE_MS = std::stoi(argv[++i]);
+        } else if (arg == "--send-backlog" && i + 1 < argc) {
+            SEND_BACKLOG_BYTES = std::stoi(argv[++i]);
+        } else if (arg == "--socket-profile" && i + 1 < argc) {
+            try {
+                SOCKET_PROFILE = SocketProfile::named(argv[++i]);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                return 1;
+            }
+        } else if (arg == "--rules" && i + 1 < argc) {
+            KEY_RULES_PATH = argv[++i];
+        } else if (arg == "--capture" && i + 1 < argc) {
+            CAPTURE_BACKEND = argv[++i];
+        } else if ((arg == "--pin" || arg == "--priority") && i + 1 < argc) {
+            try {
+                if (arg == "--pin") {
+                    parsePin(argv[++i], THREAD_ROLES, THREAD_PLACEMENT);
+                } else {
+                    parsePriority(argv[++i], THREAD_ROLES, THREAD_PLACEMENT);
+                }
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                return 1;
+            }
+        } else if (arg == "--probe-wakeups" && i + 1 < argc) {
+            PROBE_WAKEUPS_S = std::stoi(argv[++i]);
+        } else if (arg == "--motion-rate" && i + 1 < argc) {
+            MOTION_RATE = argv[++i];
+        } else if (arg == "--type" && i + 1 < argc) {
+            TYPE_PATH = argv[++i];
+        } else if (arg == "--clipboard" && i + 1 < argc) {
+            CLIPBOARD_POLL_MS = std::stoi(argv[++i]);
+        } else if (arg == "--peer") {
+            PEER_MODE = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            TRACE_PATH = argv[++i];
         } else if (arg == "--help") {
             printUsage(argv[0]);
             return 0;
+        } else if (arg.rfind("--", 0) != 0) {
+            serverAddresses.push_back(arg);
+        }
+    }
+
+    // -1: the servers' refresh rate; 0: every sample goes out
+    int motionRateHz = -1;
+    if (MOTION_RATE == "off") {
+        motionRateHz = 0;
+    } else if (MOTION_RATE != "auto") {
+        try {
+            motionRateHz = std::stoi(MOTION_RATE);
+        } catch (const std::exception&) {
+            motionRateHz = -1;
         }
+        if (motionRateHz <= 0) {
+            std::cerr << "Error: --motion-rate takes a rate in Hz, auto or off" << std::endl;
+            return 1;
+        }
+    }
+
+    bool evdevAvailable = false;
+#ifdef __linux__
+    evdevAvailable = true;
+#endif
+    if (CAPTURE_BACKEND != "uiohook" && !(CAPTURE_BACKEND == "evdev" && evdevAvailable)) {
+        std::cerr << "Error: unsupported capture backend " << CAPTURE_BACKEND << std::endl;
+        return 1;
+    }
+
+    std::string typedText;
+    if (!TYPE_PATH.empty()) {
+        std::ifstream file;
+        if (TYPE_PATH != "-") {
+            file.open(TYPE_PATH, std::ios::binary);
+            if (!file) {
+                std::cerr << "Error: cannot read " << TYPE_PATH << std::endl;
+                return 1;
+            }
+        }
+        std::istream& in = TYPE_PATH == "-" ? std::cin : file;
+        typedText.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        if (typedText.empty()) {
+            std::cerr << "Error: nothing to type in " << TYPE_PATH << std::endl;
+            return 1;
+        }
+    }
+
+    if (PROBE_WAKEUPS_S > 0) {
+        WakeupProbe probe;
+        probe.durationMs = static_cast<uint64_t>(PROBE_WAKEUPS_S) * 1000;
+        reportWakeups(THREAD_PLACEMENT, probe);
+        return 0;
     }
 
     std::cout << "Display settings:\n"
@@ -239,6 +664,26 @@ int main(int argc, char* argv[]) {
     edgeSwitcher = std::make_unique<ScreenEdgeSwitcher>(HOST_SCREEN_WIDTH, HOST_SCREEN_HEIGHT);
     edgeSwitcher->setEdgeThreshold(EDGE_THRESHOLD);
 
+    if (!KEY_RULES_PATH.empty()) {
+        try {
+            g_keyRules.loadFile(KEY_RULES_PATH);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Loaded " << g_keyRules.hotkeyCount() << " hotkeys and "
+                  << g_keyRules.remapCount() << " remaps from " << KEY_RULES_PATH << std::endl;
+    }
+
+    // Live counters for sameness_stat
+    stats::open("client");
+    if (PEER_MODE && !echoFilter().attachShared()) {
+        std::cerr << "Warning: peer mode without a shared echo filter; input the server injects may be sent back" << std::endl;
+    }
+    if (!TRACE_PATH.empty()) {
+        trace::enable();
+    }
+
     try {
         boost::asio::io_context io_context;
         
@@ -268,36 +713,205 @@ int main(int argc, char* argv[]) {
             throw std::runtime_error("Could not load SSL certificate from any location");
         }
         
-        // Create SSL socket
-        boost::asio::ssl::stream<boost::asio::ip::tcp::socket> ssl_socket(io_context, ssl_context);
-        g_ssl_socket_ptr = &ssl_socket;
-        
-        // Resolve server address
-        boost::asio::ip::tcp::resolver resolver(io_context);
-        auto endpoints = resolver.resolve(serverAddress, "12345");
-        
-        // Connect to server
-        boost::asio::connect(ssl_socket.lowest_layer(), endpoints);
-        ssl_socket.lowest_layer().set_option(boost::asio::ip::tcp::no_delay(true));
-        
-        // Perform SSL handshake
-        ssl_socket.handshake(boost::asio::ssl::stream_base::client);
-        
-        std::cout << "Connected to server at " << serverAddress << std::endl;
-        
-        // Set up uiohook
-        hook_set_dispatch_proc(dispatch_hook);
-        if (hook_run() != UIOHOOK_SUCCESS) {
+        g_clipboard.setOfferHandler([](const ClipboardSync::Digest&, uint64_t size) {
+            std::cout << "Server clipboard available (" << size << " bytes)" << std::endl;
+        });
+
+        // Keeps the io thread running while no server is connected
+        auto work = boost::asio::make_work_guard(io_context);
+        // Run the io_context on its own thread; the hook owns this one
+        std::thread io_thread([&io_context]() {
+            applyThreadPlacement(THREAD_PLACEMENT, "io");
+            io_context.run();
+        });
+
+        // Sessions to every server are opened, and reopened, in the
+        // background, so crossing onto their screen never waits for a
+        // handshake. Motion follows the fastest display among them.
+        std::atomic<uint16_t> fastestRefreshHz{0};
+        PeerPool peers(g_sessions, serverAddresses,
+            [&io_context, &ssl_context, &fastestRefreshHz](size_t n, const std::string& serverAddress,
+                                                            PeerPool::Attempt& attempt, Session::CloseHandler onClose) {
+                uint16_t version = kProtocolV1;
+                uint16_t refreshHz = 0;
+                std::unique_ptr<TlsStream> ssl_socket;
+                try {
+                    ssl_socket = connectToServer(io_context, ssl_context, serverAddress, attempt, PROTOCOL_VERSION,
+                                                 version, refreshHz);
+                } catch (const ProtocolError& e) {
+                    // Servers from before the version handshake drop the hello, or
+                    // ignore it until the attempt times out; retry in v1
+                    if (!attempt.restart()) {
+                        throw;
+                    }
+                    std::cout << e.what() << ", retrying with protocol v1" << std::endl;
+                    ssl_socket = connectToServer(io_context, ssl_context, serverAddress, attempt, kProtocolV1,
+                                                 version, refreshHz);
+                }
+
+                std::cout << "Connected to server at " << serverAddress << " (protocol v" << version;
+                if (refreshHz != 0) {
+                    std::cout << ", display " << refreshHz << " Hz";
+                }
+                std::cout << ")" << std::endl;
+                uint16_t fastest = fastestRefreshHz.load();
+                while (refreshHz > fastest && !fastestRefreshHz.compare_exchange_weak(fastest, refreshHz)) {
+                }
+                // A faster display joining later raises the rate; before the
+                // resampler exists, startup picks the new fastest up itself
+                if (refreshHz > fastest && MOTION_RATE == "auto") {
+                    std::lock_guard<std::mutex> lock(g_motionMutex);
+                    if (g_motion && refreshHz > g_motion->rateHz()) {
+                        g_motion->setRate(refreshHz);
+                        std::cout << "Sending pointer motion at up to " << refreshHz << " Hz" << std::endl;
+                    }
+                }
+
+                auto session = std::make_shared<Session>(std::move(ssl_socket), version);
+                session->setHeartbeat(std::chrono::milliseconds(PEER_DEADLINE_MS));
+                session->setSendBacklogLimit(static_cast<size_t>(std::max(SEND_BACKLOG_BYTES, 0)));
+                session->transport().setQuickAck(SOCKET_PROFILE.quickAck);
+                // The clipboard is shared with the first server only
+                bool primary = n == 0;
+                if (primary) {
+                    session->setBulkSource(Channel::Clipboard, [](EventPacket& chunk) {
+                        return g_clipboard.nextChunk(chunk);
+                    });
+                    std::lock_guard<std::mutex> lock(g_clipboardPeerMutex);
+                    g_clipboardPeer = session;
+                }
+                Session* raw = session.get();
+                session->start(
+                    [primary, raw](const EventPacket& pkt) {
+                        if (pkt.type == SamenessEventType::SwitchBack) {
+                            returnFromPeer(pkt);
+                            return;
+                        }
+                        if (primary && g_clipboard.handlePacket(pkt)) {
+                            raw->kickBulk();
+                            return;
+                        }
+                        std::cerr << "Unexpected packet from server: " << static_cast<int>(pkt.type) << std::endl;
+                    },
+                    std::move(onClose));
+                return session;
+            });
+        peers.setDownHandler([&serverAddresses](size_t n) {
+            std::cerr << "Disconnected from server " << serverAddresses[n] << ", reconnecting in the background" << std::endl;
+            if (g_sessions.empty()) {
+                // Give the keyboard and mouse back; evdev capture releases its grab on the next event.
+                // No server is left to release the forwarded keys on.
+                std::lock_guard<std::mutex> lock(g_forwardMutex);
+                edgeSwitcher->forceHost();
+                g_forwardedKeys.reset();
+                g_forwardedButtons = 0;
+            }
+        });
+        peers.start();
+        size_t connected = peers.waitConnected(kInitialConnectWait);
+        if (connected < serverAddresses.size()) {
+            std::cerr << connected << " of " << serverAddresses.size()
+                      << " servers connected; the rest join when they come up" << std::endl;
+        }
+
+        boost::asio::steady_timer motionTimer(io_context);
+        g_motionTimer = &motionTimer;
+        {
+            // Under the lock, so a server connecting now either sees the
+            // resampler or has already raised fastestRefreshHz
+            std::lock_guard<std::mutex> lock(g_motionMutex);
+            if (motionRateHz < 0) {
+                motionRateHz = fastestRefreshHz.load();
+            }
+            if (motionRateHz > 0) {
+                g_motion = std::make_unique<MotionResampler>(static_cast<uint32_t>(motionRateHz));
+                std::cout << "Sending pointer motion at up to " << motionRateHz << " Hz" << std::endl;
+            }
+        }
+
+        std::unique_ptr<PasteboardBridge> pasteboardBridge;
+
+        // Stops reconnecting, closes every session and waits for the io thread
+        auto shutDown = [&](bool whenSent) {
+            if (pasteboardBridge) {
+                pasteboardBridge->stop();
+            }
+            peers.stop();
+            if (whenSent) {
+                g_sessions.closeAllWhenSent();
+            } else {
+                g_sessions.closeAll();
+            }
+            work.reset();
+            io_thread.join();
+        };
+
+        if (!typedText.empty()) {
+            // One-shot: the whole text goes out as TextInput, no capture
+            if (connected == 0) {
+                shutDown(false);
+                throw std::runtime_error("No server to type on");
+            }
+            std::vector<EventPacket> packets = makeTextPackets(currentMicroseconds(), typedText);
+            for (const EventPacket& pkt : packets) {
+                g_sessions.send(pkt);
+            }
+            shutDown(true);
+            std::cout << "Typed " << typedText.size() << " bytes in " << packets.size() << " packets" << std::endl;
+            stats::close();
+            return 0;
+        }
+
+        if (CLIPBOARD_POLL_MS > 0) {
+            pasteboardBridge = std::make_unique<PasteboardBridge>(
+                g_clipboard, std::chrono::milliseconds(CLIPBOARD_POLL_MS), [](EventPacket pkt) {
+                    std::lock_guard<std::mutex> lock(g_clipboardPeerMutex);
+                    if (std::shared_ptr<Session> peer = g_clipboardPeer.lock()) {
+                        peer->send(std::move(pkt));
+                    }
+                });
+            pasteboardBridge->start();
+            std::cout << "Sharing the clipboard with " << serverAddresses[0] << std::endl;
+        }
+
+        // Both capture backends run on this thread
+        applyThreadPlacement(THREAD_PLACEMENT, "hook");
+        int status = UIOHOOK_SUCCESS;
+#ifdef __linux__
+        if (CAPTURE_BACKEND == "evdev") {
+            try {
+                runEvdevCapture();
+            } catch (...) {
+                shutDown(false);
+                throw;
+            }
+        } else
+#endif
+        {
+            // Set up uiohook
+            hook_set_dispatch_proc(dispatch_hook);
+            status = hook_run();
+        }
+
+        shutDown(false);
+
+        if (!TRACE_PATH.empty()) {
+            trace::disable();
+            if (!trace::writeJson(TRACE_PATH, "client")) {
+                std::cerr << "Could not write trace to " << TRACE_PATH << std::endl;
+            }
+        }
+
+        if (status != UIOHOOK_SUCCESS) {
             throw std::runtime_error("Failed to start input hook");
         }
         
-        // Run the io_context
-        io_context.run();
-        
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
+        stats::close();
         return 1;
     }
     
+    stats::close();
     return 0;
 }
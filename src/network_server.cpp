@@ -2,90 +2,691 @@
 #include <vector>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
 
+#if defined(__linux__)
+#include <sys/prctl.h>
+#include "UinputDevice.h"
+#include "UringServer.h"
+#endif
+
+#include "ClipboardSync.h"
+#include "ControlArbiter.h"
+#include "EchoFilter.h"
+#include "EdgeWatcher.h"
 #include "EventPacket.h"
+#include "InjectionQueue.h"
 #include "Injectors.h"
+#include "JitterBuffer.h"
+#include "Pasteboard.h"
+#include "Protocol.h"
+#include "Session.h"
+#include "SocketTuning.h"
+#include "Stats.h"
+#include "ThreadPlacement.h"
+#include "Trace.h"
 
 using boost::asio::ip::tcp;
 namespace ssl = boost::asio::ssl;
 
-int main() {
+// Silence from the client longer than this drops the session
+static int PEER_DEADLINE_MS = 1000;
+
+// Socket options and how the io thread waits (--socket-profile)
+static SocketProfile SOCKET_PROFILE;
+
+// Upper bound on jitter buffer delay for pointer motion; 0 disables the buffer
+static int JITTER_BUFFER_MS = 0;
+
+// Event lifecycle trace written on exit (--trace)
+static std::string TRACE_PATH;
+
+// What serves the connection once it is up: asio, or uring (Linux; see UringServer.h)
+static std::string BACKEND = "asio";
+
+// CPUs and scheduling for the io and inject threads (--pin, --priority)
+static ThreadPlacements THREAD_PLACEMENT;
+static const std::vector<std::string> THREAD_ROLES = {"io", "inject"};
+
+// Seconds of wakeup latency probing to run instead of serving (--probe-wakeups)
+static int PROBE_WAKEUPS_S = 0;
+
+// Display refresh rate reported to the client, which paces pointer motion to
+// it; -1 asks the platform, 0 reports nothing (--refresh-rate)
+static int REFRESH_RATE_HZ = -1;
+
+// Screen size: the pointer range of the uring backend's uinput device, and
+// what switch-back positions are clamped to and reported against
+static int SCREEN_WIDTH = 1920;
+static int SCREEN_HEIGHT = 1080;
+static bool SCREEN_WIDTH_GIVEN = false;
+static bool SCREEN_HEIGHT_GIVEN = false;
+
+// Columns at the left edge where the pointer goes back to the client's
+// machine; 0 leaves switching back to the client (--switch-edge)
+static int SWITCH_EDGE = 2;
+static bool SWITCH_EDGE_GIVEN = false;
+
+// A client on this machine drives the peer too; share injections with it (--peer)
+static bool PEER_MODE = false;
+
+// How often the system clipboard is checked for changes to share; 0 is off (--clipboard)
+static int CLIPBOARD_POLL_MS = 0;
+
+// Records the injection thread may have waiting; 0 injects on the io thread
+static size_t INJECT_QUEUE = 1024;
+
+// Clients that may drive this machine at once, and which of them has control
+// (--controllers, --arbitration, --idle-takeover; see ControlArbiter.h)
+static size_t CONTROLLERS = 1;
+static ControlArbiter::Config ARBITRATION;
+
+// A further controller that has not finished its TLS handshake and Hello by
+// then is dropped, and no longer counts against --controllers
+static constexpr std::chrono::seconds kControllerHandshakeTimeout{5};
+
+static bool isInputType(SamenessEventType type) {
+    switch (type) {
+        case SamenessEventType::KeyPress:
+        case SamenessEventType::KeyRelease:
+        case SamenessEventType::MouseMove:
+        case SamenessEventType::MouseButtonPress:
+        case SamenessEventType::MouseButtonRelease:
+        case SamenessEventType::TextInput:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Hand input packets to the platform injector, in one call where it takes batches
+static void injectPackets(const EventPacket* packets, size_t count) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t startUs = trace::enabled() ? trace::nowUs() : 0;
+    size_t injected = 0;
+    for (size_t i = 0; i < count; ++i) {
+        switch (packets[i].type) {
+            case SamenessEventType::KeyPress:
+                std::cout << "Received KeyPress event" << std::endl;
+                break;
+            case SamenessEventType::KeyRelease:
+                std::cout << "Received KeyRelease event" << std::endl;
+                break;
+            case SamenessEventType::MouseMove:
+                std::cout << "Received MouseMove event" << std::endl;
+                break;
+            case SamenessEventType::MouseButtonPress:
+                std::cout << "Received MouseButtonPress event" << std::endl;
+                break;
+            case SamenessEventType::MouseButtonRelease:
+                std::cout << "Received MouseButtonRelease event" << std::endl;
+                break;
+            case SamenessEventType::TextInput:
+                std::cout << "Received TextInput event (" << packets[i].payload.size() << " bytes)" << std::endl;
+                break;
+            default:
+                std::cerr << "Unknown event type: " << static_cast<int>(packets[i].type) << "\n";
+                stats::add(&stats::Slot::drops);
+                continue;
+        }
+        ++injected;
+    }
+    if (injected == 0) {
+        return;
+    }
+    // Only the input goes on to the injector
+    std::vector<EventPacket> input;
+    if (injected != count) {
+        input.reserve(injected);
+        std::copy_if(packets, packets + count, std::back_inserter(input),
+                     [](const EventPacket& pkt) { return isInputType(pkt.type); });
+        packets = input.data();
+        count = input.size();
+    }
+    injectBatch(packets, count);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (startUs != 0) {
+        uint64_t endUs = trace::nowUs();
+        for (size_t i = 0; i < count; ++i) {
+            trace::span(trace::Stage::Inject, trace::eventId(packets[i]), startUs, endUs);
+        }
+    }
+    stats::add(&stats::Slot::injectCalls, injected);
+    stats::add(&stats::Slot::injectNanos, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
+
+// Input on its way to the injection thread (--inject-queue); pushed from the io thread
+static InjectionQueue* g_injectQueue = nullptr;
+
+static void injectPacket(const EventPacket& pkt) {
+    if (!g_injectQueue) {
+        injectPackets(&pkt, 1);
+    } else if (!isInputType(pkt.type)) {
+        std::cerr << "Unknown event type: " << static_cast<int>(pkt.type) << "\n";
+        stats::add(&stats::Slot::drops);
+    } else if (!g_injectQueue->push(pkt)) {
+        std::cerr << "Malformed input packet of type " << static_cast<int>(pkt.type) << "\n";
+        stats::add(&stats::Slot::drops);
+    }
+}
+
+// Pointer motion playout (--jitter-buffer). Everything here runs on the io thread.
+static std::unique_ptr<JitterBuffer> g_jitter;
+static boost::asio::steady_timer* g_playoutTimer = nullptr;
+
+static uint64_t steadyMicroseconds() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void playMove(const EventPacket& move, uint64_t heldUs) {
+    stats::add(&stats::Slot::playoutMoves);
+    stats::add(&stats::Slot::playoutNanos, heldUs * 1000);
+    try {
+        injectPacket(move);
+    } catch (const std::exception& e) {
+        std::cerr << "Injection failed: " << e.what() << "\n";
+    }
+}
+
+static void armPlayout();
+
+static void playDueMoves() {
+    uint64_t now = steadyMicroseconds();
+    EventPacket move;
+    uint64_t heldUs = 0;
+    while (g_jitter->popDue(now, move, heldUs)) {
+        playMove(move, heldUs);
+    }
+    armPlayout();
+}
+
+static void armPlayout() {
+    uint64_t due = 0;
+    if (!g_jitter->nextDue(due)) {
+        return;
+    }
+    g_playoutTimer->expires_at(std::chrono::steady_clock::time_point(std::chrono::microseconds(due)));
+    g_playoutTimer->async_wait([](const boost::system::error_code& ec) {
+        if (!ec) {
+            playDueMoves();
+        }
+    });
+}
+
+// Motion is scheduled by capture time when the jitter buffer is on; keys and
+// buttons are never delayed, they only flush pending motion ahead of them.
+static void routeInput(const EventPacket& pkt) {
+    if (!g_jitter) {
+        injectPacket(pkt);
+        return;
+    }
+    uint64_t now = steadyMicroseconds();
+    if (pkt.type == SamenessEventType::MouseMove) {
+        bool wasIdle = g_jitter->pending() == 0;
+        if (!g_jitter->push(pkt, now)) {
+            stats::add(&stats::Slot::coalescedMoves);
+        }
+        stats::setGauge(stats::Gauge::MoveJitterUs, g_jitter->jitterUs());
+        stats::setGauge(stats::Gauge::PlayoutDelayUs, g_jitter->targetDelayUs());
+        if (wasIdle) {
+            armPlayout();
+        }
+        return;
+    }
+    EventPacket latest;
+    uint64_t heldUs = 0;
+    size_t dropped = 0;
+    if (g_jitter->flush(now, latest, heldUs, dropped)) {
+        stats::add(&stats::Slot::coalescedMoves, dropped);
+        playMove(latest, heldUs);
+    }
+    injectPacket(pkt);
+}
+
+// Follows the pointer the client drives; true, with the SwitchBack in `back`,
+// when it has just reached the edge facing the client's machine
+static bool watchEdge(EdgeWatcher* watcher, const EventPacket& pkt, EventPacket& back) {
+    int32_t x = 0;
+    int32_t y = 0;
+    if (!watcher || pkt.type != SamenessEventType::MouseMove || !readMouseMove(pkt, x, y) || !watcher->onMove(x, y)) {
+        return false;
+    }
+    back = watcher->switchBack(pkt.timestamp);
+    std::cout << "Pointer reached the left edge at row " << watcher->y() << ", handing control back\n";
+    return true;
+}
+
+static void writeTrace() {
+    if (TRACE_PATH.empty()) {
+        return;
+    }
+    trace::disable();
+    if (!trace::writeJson(TRACE_PATH, "server")) {
+        std::cerr << "Could not write trace to " << TRACE_PATH << "\n";
+    }
+}
+
+static void printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " [--deadline <ms>] [--jitter-buffer <max_ms>] [--inject-queue <records>] [--socket-profile <name>] [--pin <role>=<cpus>] [--priority <role>=<policy>] [--probe-wakeups <seconds>] [--refresh-rate <hz>] [--trace <file>] [--backend <name>] [--width <width>] [--height <height>] [--switch-edge <px>] [--clipboard <ms>] [--peer] [--controllers <n>] [--arbitration <policy>] [--idle-takeover <ms>]\n";
+    std::cerr << "  --deadline: Milliseconds of client silence before the session is dropped (default: " << PEER_DEADLINE_MS << ").\n";
+    std::cerr << "  --jitter-buffer: Smooth bursty pointer motion, adding at most this much delay (default: off).\n";
+    std::cerr << "  --inject-queue: Records queued for the injection thread before motion is collapsed; 0 injects on the network thread (default: " << INJECT_QUEUE << ").\n";
+    std::cerr << "  --socket-profile: Socket options, default, interactive or spin; spin also busy-polls on the io thread (see SocketTuning.h) (default: " << SOCKET_PROFILE.name << ").\n";
+    std::cerr << "  --pin: Run a thread (io or inject) only on these CPUs, e.g. inject=2 or io=0-1 (Linux; see ThreadPlacement.h).\n";
+    std::cerr << "  --priority: Scheduling for a thread (io or inject): fifo:<1-99>, rr:<1-99> or nice:<-20..19>; may need CAP_SYS_NICE (Linux).\n";
+    std::cerr << "  --probe-wakeups: Measure thread wakeup lateness under a CPU hog for this many seconds per placement, then exit.\n";
+    std::cerr << "  --refresh-rate: Display refresh rate to report to the client, which sends pointer motion no faster; 0 for none (default: the platform's, where it says).\n";
+    std::cerr << "  --trace: Record each event's path through the server, on the client's clock, and write it to this file on exit.\n";
+    std::cerr << "  --backend: asio, or uring to receive and inject through io_uring and uinput; input only, no clipboard or jitter buffer (Linux) (default: " << BACKEND << ").\n";
+    std::cerr << "  --width, --height: Screen size; the uring backend maps pointer positions onto it and --switch-edge watches its left edge (default: " << SCREEN_WIDTH << "x" << SCREEN_HEIGHT << "; with --switch-edge, the main display's size where the platform reports it; where it does not, edge watching is off unless both are given).\n";
+    std::cerr << "  --switch-edge: Hand control back to the client when the pointer reaches this many columns at the left edge; 0 leaves it to the client (see EdgeWatcher.h) (default: " << SWITCH_EDGE << ").\n";
+    std::cerr << "  --clipboard: Share the system clipboard with the client that has it, checking it for changes this often; 0 for off (see Pasteboard.h) (default: " << CLIPBOARD_POLL_MS << ").\n";
+    std::cerr << "  --peer: A client runs on this machine too; note injections where it can see them so it does not send them back (see EchoFilter.h).\n";
+    std::cerr << "  --controllers: Clients that may connect at once, up to " << ControlArbiter::kMaxControllers << "; one at a time drives input, and the clipboard is shared with one of them, the first until it leaves (default: " << CONTROLLERS << ").\n";
+    std::cerr << "  --arbitration: Which controller drives: last-active (until idle, then whoever sends next) or lock (the first to send, until it leaves) (default: " << ControlArbiter::policyName(ARBITRATION.policy) << ").\n";
+    std::cerr << "  --idle-takeover: Milliseconds the controller in control must be idle before another takes over with last-active (default: " << ARBITRATION.idle.count() << ").\n";
+}
+
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--deadline" && i + 1 < argc) {
+            PEER_DEADLINE_MS = std::stoi(argv[++i]);
+        } else if (arg == "--jitter-buffer" && i + 1 < argc) {
+            JITTER_BUFFER_MS = std::stoi(argv[++i]);
+        } else if (arg == "--inject-queue" && i + 1 < argc) {
+            INJECT_QUEUE = std::stoul(argv[++i]);
+        } else if (arg == "--socket-profile" && i + 1 < argc) {
+            try {
+                SOCKET_PROFILE = SocketProfile::named(argv[++i]);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else if ((arg == "--pin" || arg == "--priority") && i + 1 < argc) {
+            try {
+                if (arg == "--pin") {
+                    parsePin(argv[++i], THREAD_ROLES, THREAD_PLACEMENT);
+                } else {
+                    parsePriority(argv[++i], THREAD_ROLES, THREAD_PLACEMENT);
+                }
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (arg == "--probe-wakeups" && i + 1 < argc) {
+            PROBE_WAKEUPS_S = std::stoi(argv[++i]);
+        } else if (arg == "--refresh-rate" && i + 1 < argc) {
+            REFRESH_RATE_HZ = std::stoi(argv[++i]);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            TRACE_PATH = argv[++i];
+        } else if (arg == "--backend" && i + 1 < argc) {
+            BACKEND = argv[++i];
+        } else if (arg == "--width" && i + 1 < argc) {
+            SCREEN_WIDTH = std::stoi(argv[++i]);
+            SCREEN_WIDTH_GIVEN = true;
+        } else if (arg == "--height" && i + 1 < argc) {
+            SCREEN_HEIGHT = std::stoi(argv[++i]);
+            SCREEN_HEIGHT_GIVEN = true;
+        } else if (arg == "--switch-edge" && i + 1 < argc) {
+            SWITCH_EDGE = std::stoi(argv[++i]);
+            SWITCH_EDGE_GIVEN = true;
+        } else if (arg == "--clipboard" && i + 1 < argc) {
+            CLIPBOARD_POLL_MS = std::stoi(argv[++i]);
+        } else if (arg == "--peer") {
+            PEER_MODE = true;
+        } else if (arg == "--controllers" && i + 1 < argc) {
+            CONTROLLERS = std::stoul(argv[++i]);
+        } else if (arg == "--arbitration" && i + 1 < argc) {
+            try {
+                ARBITRATION.policy = ControlArbiter::parsePolicy(argv[++i]);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "Error: " << e.what() << "\n";
+                return 1;
+            }
+        } else if (arg == "--idle-takeover" && i + 1 < argc) {
+            ARBITRATION.idle = std::chrono::milliseconds(std::stoi(argv[++i]));
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+#if defined(__linux__)
+    bool backendKnown = BACKEND == "asio" || BACKEND == "uring";
+#else
+    bool backendKnown = BACKEND == "asio";
+#endif
+    if (!backendKnown) {
+        std::cerr << "Error: unknown or unsupported backend: " << BACKEND << "\n";
+        return 1;
+    }
+    if (BACKEND == "uring" && JITTER_BUFFER_MS > 0) {
+        std::cerr << "Error: the uring backend has no jitter buffer\n";
+        return 1;
+    }
+    if (CONTROLLERS == 0 || CONTROLLERS > ControlArbiter::kMaxControllers) {
+        std::cerr << "Error: --controllers takes 1 to " << ControlArbiter::kMaxControllers << "\n";
+        return 1;
+    }
+    if (BACKEND == "uring" && CONTROLLERS > 1) {
+        std::cerr << "Error: the uring backend serves one controller\n";
+        return 1;
+    }
+    std::unique_ptr<EdgeWatcher> edgeWatcher;
+    if (SWITCH_EDGE > 0) {
+        // The edge must be the real screen's; the defaults are only a guess
+        if (!SCREEN_WIDTH_GIVEN || !SCREEN_HEIGHT_GIVEN) {
+            int width = 0;
+            int height = 0;
+            if (displaySize(width, height)) {
+                SCREEN_WIDTH = SCREEN_WIDTH_GIVEN ? SCREEN_WIDTH : width;
+                SCREEN_HEIGHT = SCREEN_HEIGHT_GIVEN ? SCREEN_HEIGHT : height;
+            } else if (SWITCH_EDGE_GIVEN) {
+                std::cerr << "Error: --switch-edge needs --width and --height here; the screen size is not known\n";
+                return 1;
+            } else {
+                std::cerr << "Warning: the screen size is not known; switching back is left to the client"
+                             " (pass --width and --height to watch the edge)\n";
+                SWITCH_EDGE = 0;
+            }
+        }
+    }
+    if (SWITCH_EDGE > 0) {
+        try {
+            edgeWatcher = std::make_unique<EdgeWatcher>(SCREEN_WIDTH, SCREEN_HEIGHT, SWITCH_EDGE);
+        } catch (const std::invalid_argument& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+    }
+    if (PROBE_WAKEUPS_S > 0) {
+        WakeupProbe probe;
+        probe.durationMs = static_cast<uint64_t>(PROBE_WAKEUPS_S) * 1000;
+        reportWakeups(THREAD_PLACEMENT, probe);
+        return 0;
+    }
+    if (THREAD_PLACEMENT.count("inject") && (INJECT_QUEUE == 0 || BACKEND == "uring")) {
+        std::cerr << "Warning: no injection thread runs with this configuration; its placement is ignored\n";
+    }
+
+    stats::open("server");
+    if (PEER_MODE && !echoFilter().attachShared()) {
+        std::cerr << "Warning: peer mode without a shared echo filter; the client may send injected input back\n";
+    }
+    if (!TRACE_PATH.empty()) {
+        trace::Config traceConfig;
+        traceConfig.alignToPeer = true;
+        trace::enable(traceConfig);
+    }
     try {
         boost::asio::io_context io_context;
+        boost::asio::steady_timer playoutTimer(io_context);
+        g_playoutTimer = &playoutTimer;
         ssl::context ctx(ssl::context::tlsv12_server);
         ctx.set_options(ssl::context::default_workarounds);
         ctx.set_verify_mode(ssl::verify_none);
         ctx.use_certificate_chain_file("server.crt");
         ctx.use_private_key_file("server.key", ssl::context::pem);
 
+        if (JITTER_BUFFER_MS > 0) {
+            JitterBuffer::Config cfg;
+            cfg.maxDelayUs = static_cast<uint64_t>(JITTER_BUFFER_MS) * 1000;
+            g_jitter = std::make_unique<JitterBuffer>(cfg);
+#if defined(__linux__)
+            // Playout timers fire on this thread; the default 50 us slack is a visible share of the budget
+            prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+#endif
+            std::cout << "Jitter buffer on, max delay " << JITTER_BUFFER_MS << " ms\n";
+        }
+
         tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 12345));
         std::cout << "Server listening on port 12345...\n";
 
-        ssl::stream<tcp::socket> socket(io_context, ctx);
-        acceptor.accept(socket.next_layer());
-        socket.handshake(ssl::stream_base::server);
+        auto socket = std::make_unique<ssl::stream<tcp::socket>>(io_context, ctx);
+        acceptor.accept(socket->next_layer());
+        applySocketProfile(socket->next_layer(), SOCKET_PROFILE);
+        socket->handshake(ssl::stream_base::server);
 
-        std::vector<uint8_t> buffer(4096);
-        boost::system::error_code ec;
+        std::vector<uint8_t> leftover;
+        uint16_t refreshHz = REFRESH_RATE_HZ < 0 ? displayRefreshHz() : static_cast<uint16_t>(REFRESH_RATE_HZ);
+        uint16_t version = negotiateServer(*socket, leftover, kProtocolVersion, refreshHz);
+        std::cout << "Client speaks protocol v" << version << "\n";
 
-        while (true) {
-            size_t len = socket.read_some(boost::asio::buffer(buffer), ec);
-            if (ec == boost::asio::error::eof) {
-                std::cout << "Client disconnected.\n";
-                break;
+#if defined(__linux__)
+        if (BACKEND == "uring") {
+            applyThreadPlacement(THREAD_PLACEMENT, "io");
+            UinputDevice device(SCREEN_WIDTH, SCREEN_HEIGHT);
+            UringServer server(std::move(socket), version, std::move(leftover));
+            server.setInjectFd(device.fd());
+            server.setHeartbeat(std::chrono::milliseconds(PEER_DEADLINE_MS));
+            std::cout << "Serving through io_uring\n";
+            server.run([&server, &edgeWatcher](const EventPacket& pkt) {
+                EventPacket back;
+                if (watchEdge(edgeWatcher.get(), pkt, back)) {
+                    server.send(back);
+                }
+            });
+            std::cout << "Client disconnected.\n";
+            const UringServer::Counters& c = server.counters();
+            std::cout << c.packets << " events in " << c.injectWrites << " injection writes, "
+                      << c.enterCalls << " io_uring_enter calls\n";
+            writeTrace();
+            stats::close();
+            return 0;
+        }
+#endif
+
+        // Declared after io_context so its thread is joined first
+        std::unique_ptr<InjectionQueue> injectQueue;
+        if (INJECT_QUEUE > 0) {
+            injectQueue = std::make_unique<InjectionQueue>(INJECT_QUEUE);
+            g_injectQueue = injectQueue.get();
+            g_injectQueue->setSpaceHandler([&io_context]() {
+                boost::asio::post(io_context, []() { g_injectQueue->retry(); });
+            });
+            g_injectQueue->start(
+                [](const EventPacket* packets, size_t count) {
+                    try {
+                        injectPackets(packets, count);
+                    } catch (const std::exception& e) {
+                        std::cerr << "Injection failed: " << e.what() << "\n";
+                    }
+                },
+                []() { applyThreadPlacement(THREAD_PLACEMENT, "inject"); });
+        }
+
+        ClipboardSync clipboard;
+        clipboard.setOfferHandler([](const ClipboardSync::Digest&, uint64_t size) {
+            std::cout << "Client clipboard available (" << size << " bytes)" << std::endl;
+        });
+
+        // One controller drives input at a time; what a controller holds is
+        // released, through the same path as its input, when it loses control
+        ControlArbiter arbiter(ARBITRATION);
+        arbiter.setReleaseHandler([](const EventPacket& release) {
+            try {
+                routeInput(release);
+            } catch (const std::exception& e) {
+                std::cerr << "Injection failed: " << e.what() << "\n";
             }
-            if (ec) throw boost::system::system_error(ec);
-
-            // Deserialize packet
-            std::vector<uint8_t> data(buffer.begin(), buffer.begin() + len);
-            
-            // Validate minimum packet size (type + timestamp + payloadSize)
-            if (len < 13) { // 1 + 8 + 4 bytes minimum
-                std::cerr << "Received packet too small: " << len << " bytes\n";
-                continue;
+        });
+        // Everything below is used on the io thread only
+        std::map<size_t, std::shared_ptr<Session>> controllers;
+        size_t lastOwner = ControlArbiter::kNone;
+        size_t handshaking = 0;
+        // The controller sharing the clipboard: the first, and when it leaves,
+        // one still connected (or the next to connect)
+        size_t clipboardOwner = ControlArbiter::kNone;
+
+        auto startController = [&](std::unique_ptr<ssl::stream<tcp::socket>> stream, uint16_t peerVersion,
+                                   std::vector<uint8_t> peerLeftover) {
+            size_t id = arbiter.join();
+            if (clipboardOwner == ControlArbiter::kNone) {
+                clipboardOwner = id;
             }
-            
-            EventPacket pkt = EventPacket::fromBytes(data);
-            
-            // Validate payload size matches declared size
-            if (pkt.payload.size() != pkt.payloadSize) {
-                std::cerr << "Payload size mismatch: declared " << pkt.payloadSize 
-                         << " but got " << pkt.payload.size() << " bytes\n";
-                continue;
+            auto session = std::make_shared<Session>(std::move(stream), peerVersion, std::move(peerLeftover));
+            Session* self = session.get();
+            session->setHeartbeat(std::chrono::milliseconds(PEER_DEADLINE_MS));
+            session->transport().setQuickAck(SOCKET_PROFILE.quickAck);
+            session->setBulkSource(Channel::Clipboard, [&, id](EventPacket& chunk) {
+                return clipboardOwner == id && clipboard.nextChunk(chunk);
+            });
+            controllers[id] = session;
+            if (CONTROLLERS > 1) {
+                std::cout << "Controller " << id << " connected (protocol v" << peerVersion << ")\n";
             }
+            session->start(
+                [&, id, self](const EventPacket& pkt) {
+                    if (clipboardOwner == id && clipboard.handlePacket(pkt)) {
+                        self->kickBulk();
+                        return;
+                    }
+                    if (!arbiter.admit(id, pkt, steadyMicroseconds())) {
+                        stats::add(&stats::Slot::refused);
+                        return;
+                    }
+                    if (CONTROLLERS > 1 && lastOwner != id && arbiter.owner() == id) {
+                        std::cout << "Controller " << id << " has control\n";
+                        lastOwner = id;
+                    }
+                    // Ahead of the move itself, which may sit in the jitter buffer
+                    EventPacket back;
+                    if (watchEdge(edgeWatcher.get(), pkt, back)) {
+                        self->send(back);
+                    }
+                    try {
+                        routeInput(pkt);
+                    } catch (const std::exception& e) {
+                        std::cerr << "Injection failed: " << e.what() << "\n";
+                    }
+                },
+                [&, id](const boost::system::error_code&) {
+                    std::cout << "Client disconnected.\n";
+                    arbiter.leave(id, steadyMicroseconds());
+                    controllers.erase(id);
+                    if (clipboardOwner == id) {
+                        clipboard.reset();
+                        clipboardOwner = controllers.empty() ? ControlArbiter::kNone : controllers.begin()->first;
+                        if (clipboardOwner != ControlArbiter::kNone) {
+                            std::cout << "Controller " << clipboardOwner << " has the clipboard\n";
+                        }
+                    }
+                    // Once nobody is connected or on the way, stop accepting and let the server exit
+                    if (controllers.empty() && handshaking == 0) {
+                        acceptor.close();
+                    }
+                });
+        };
 
-            // Route to injection
-            switch (pkt.type) {
-                case SamenessEventType::KeyPress:
-                    std::cout << "Received KeyPress event" << std::endl;
-                    injectKeyPress(pkt);
-                    break;
-                case SamenessEventType::KeyRelease:
-                    std::cout << "Received KeyRelease event" << std::endl;
-                    injectKeyRelease(pkt);
-                    break;
-                case SamenessEventType::MouseMove:
-                    std::cout << "Received MouseMove event" << std::endl;
-                    injectMouseMove(pkt);
-                    break;
-                case SamenessEventType::MouseButtonPress:
-                    std::cout << "Received MouseButtonPress event" << std::endl;
-                    injectMouseButtonPress(pkt);
-                    break;
-                case SamenessEventType::MouseButtonRelease:
-                    std::cout << "Received MouseButtonRelease event" << std::endl;
-                    injectMouseButtonRelease(pkt);
-                    break;
-                default:
-                    std::cerr << "Unknown event type: " << static_cast<int>(pkt.type) << "\n";
-                    break;
-            }
+        // Further controllers are accepted, handshaken and negotiated with on
+        // the io thread without blocking it, so the one in control is never
+        // held up by a new connection, and one that goes quiet is closed
+        struct PendingController {
+            PendingController(tcp::socket peer, ssl::context& context, boost::asio::io_context& io)
+                : stream(std::make_unique<ssl::stream<tcp::socket>>(std::move(peer), context))
+                , deadline(io) {}
+            std::unique_ptr<ssl::stream<tcp::socket>> stream;
+            boost::asio::steady_timer deadline;
+        };
+        std::function<void()> acceptNext = [&]() {
+            acceptor.async_accept([&](const boost::system::error_code& ec, tcp::socket peer) {
+                if (ec) {
+                    if (ec != boost::asio::error::operation_aborted) {
+                        std::cerr << "Accept failed: " << ec.message() << "\n";
+                    }
+                    return;
+                }
+                if (controllers.size() + handshaking >= CONTROLLERS) {
+                    std::cerr << "Turning a client away: " << CONTROLLERS << " controllers already connected\n";
+                    boost::system::error_code ignored;
+                    peer.close(ignored);
+                    acceptNext();
+                    return;
+                }
+                ++handshaking;
+                auto pending = std::make_shared<PendingController>(std::move(peer), ctx, io_context);
+                applySocketProfile(pending->stream->next_layer(), SOCKET_PROFILE);
+                pending->deadline.expires_after(kControllerHandshakeTimeout);
+                pending->deadline.async_wait([pending](const boost::system::error_code& ec) {
+                    if (!ec && pending->stream) {
+                        // Fails the handshake or Hello step under way
+                        boost::system::error_code ignored;
+                        pending->stream->lowest_layer().close(ignored);
+                    }
+                });
+                auto finish = [&, pending](const boost::system::error_code& ec, uint16_t peerVersion,
+                                           std::vector<uint8_t> peerLeftover) {
+                    pending->deadline.cancel();
+                    --handshaking;
+                    if (!ec) {
+                        startController(std::move(pending->stream), peerVersion, std::move(peerLeftover));
+                        return;
+                    }
+                    std::cerr << "Controller handshake failed: "
+                              << (ec == boost::asio::error::operation_aborted ? "timed out" : ec.message()) << "\n";
+                    pending->stream.reset();
+                    if (controllers.empty() && handshaking == 0) {
+                        acceptor.close();
+                    }
+                };
+                pending->stream->async_handshake(ssl::stream_base::server,
+                    [&, pending, finish](const boost::system::error_code& ec) {
+                        if (ec) {
+                            finish(ec, 0, {});
+                            return;
+                        }
+                        asyncNegotiateServer(*pending->stream, kProtocolVersion, refreshHz, finish);
+                    });
+                acceptNext();
+            });
+        };
+
+        startController(std::move(socket), version, std::move(leftover));
+        if (CONTROLLERS > 1) {
+            std::cout << "Taking up to " << CONTROLLERS << " controllers, arbitration "
+                      << ControlArbiter::policyName(ARBITRATION.policy) << "\n";
+            acceptNext();
+        }
+
+        // Offers and requests go to the clipboard's controller on the io thread
+        std::unique_ptr<PasteboardBridge> pasteboardBridge;
+        if (CLIPBOARD_POLL_MS > 0) {
+            pasteboardBridge = std::make_unique<PasteboardBridge>(
+                clipboard, std::chrono::milliseconds(CLIPBOARD_POLL_MS), [&](EventPacket pkt) {
+                    boost::asio::post(io_context, [&, pkt = std::move(pkt)]() mutable {
+                        auto owner = controllers.find(clipboardOwner);
+                        if (owner != controllers.end()) {
+                            owner->second->send(std::move(pkt));
+                        }
+                    });
+                });
+            pasteboardBridge->start();
+        }
+
+        applyThreadPlacement(THREAD_PLACEMENT, "io");
+        runIoContext(io_context, SOCKET_PROFILE);
+        if (pasteboardBridge) {
+            pasteboardBridge->stop();
+        }
+        if (injectQueue) {
+            injectQueue->stop();
         }
+        writeTrace();
     }
     catch (const std::exception& e) {
         std::cerr << "Server error: " << e.what() << "\n";
+        stats::close();
         return 1;
     }
+    stats::close();
     return 0;
 }
@@ -0,0 +1,122 @@
+// sameness_relay — forwards client sessions to servers on another subnet.
+//
+//   sameness_relay --route <listen_port>=<host>[:<port>] [--route ...] [--threads <n>] [--max-pairs <n>]
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Relay.h"
+#include "Stats.h"
+
+using boost::asio::ip::tcp;
+namespace ssl = boost::asio::ssl;
+
+void printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " --route <listen_port>=<host>[:<port>] [--route ...] [--threads <n>] [--max-pairs <n>]" << std::endl;
+    std::cerr << "  --route: Accept clients on listen_port and forward them to the server at host (port default: 12345). Repeatable." << std::endl;
+    std::cerr << "  --threads: Forwarding threads (default: " << Relay::Config{}.threads << ")." << std::endl;
+    std::cerr << "  --max-pairs: Concurrent sessions before new clients are turned away (default: " << Relay::Config{}.maxPairs << ")." << std::endl;
+}
+
+struct RouteSpec {
+    uint16_t listenPort;
+    std::string host;
+    std::string port;
+};
+
+// Parses <listen_port>=<host>[:<port>]; false on anything else, so the
+// caller prints the usage
+static bool parseRoute(const std::string& text, RouteSpec& route) {
+    size_t eq = text.find('=');
+    if (eq == std::string::npos || eq == 0 || eq + 1 == text.size()) {
+        return false;
+    }
+    int listenPort = 0;
+    try {
+        size_t used = 0;
+        listenPort = std::stoi(text.substr(0, eq), &used);
+        if (used != eq) {
+            return false;
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (listenPort < 0 || listenPort > 65535) {
+        return false;
+    }
+    route.listenPort = static_cast<uint16_t>(listenPort);
+    std::string target = text.substr(eq + 1);
+    size_t colon = target.rfind(':');
+    if (colon == std::string::npos) {
+        route.host = target;
+        route.port = "12345";
+    } else {
+        route.host = target.substr(0, colon);
+        route.port = target.substr(colon + 1);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Relay::Config config;
+    std::vector<RouteSpec> routes;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        RouteSpec route;
+        if (arg == "--route" && i + 1 < argc && parseRoute(argv[i + 1], route)) {
+            routes.push_back(route);
+            ++i;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            config.threads = std::stoul(argv[++i]);
+        } else if (arg == "--max-pairs" && i + 1 < argc) {
+            config.maxPairs = std::stoul(argv[++i]);
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (routes.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    stats::open("relay");
+    try {
+        // Clients see the relay as their server, so it presents the server certificate
+        ssl::context acceptContext(ssl::context::tlsv12_server);
+        acceptContext.set_options(ssl::context::default_workarounds);
+        acceptContext.set_verify_mode(ssl::verify_none);
+        acceptContext.use_certificate_chain_file("server.crt");
+        acceptContext.use_private_key_file("server.key", ssl::context::pem);
+        ssl::context connectContext(ssl::context::tlsv12_client);
+
+        Relay relay(acceptContext, connectContext, config);
+        boost::asio::io_context io_context;
+        tcp::resolver resolver(io_context);
+        for (const RouteSpec& route : routes) {
+            tcp::endpoint downstream = *resolver.resolve(route.host, route.port).begin();
+            relay.addRoute(tcp::endpoint(tcp::v4(), route.listenPort), downstream);
+            std::cout << "Relaying port " << route.listenPort << " to " << route.host << ":" << route.port
+                      << " (" << downstream << ")" << std::endl;
+        }
+        relay.start();
+
+        boost::asio::signal_set signals(io_context, SIGINT, SIGTERM);
+        signals.async_wait([](const boost::system::error_code&, int) {
+            std::cout << "Shutting down relay" << std::endl;
+        });
+        io_context.run();
+        relay.stop();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Relay error: " << e.what() << std::endl;
+        stats::close();
+        return 1;
+    }
+    stats::close();
+    return 0;
+}
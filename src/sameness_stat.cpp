@@ -0,0 +1,117 @@
+// sameness_stat — print live rates from a running client, server or relay, vmstat style.
+//
+//   sameness_stat [client|server|relay] [interval_seconds] [count]
+//   sameness_stat --merge-traces <output> <trace> [<trace> ...]
+
+#include "Stats.h"
+#include "Trace.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+void printUsage(const char* programName) {
+    std::cerr << "Usage: " << programName << " [client|server|relay] [interval] [count]" << std::endl;
+    std::cerr << "  client|server|relay: Which process to attach to (default: server)." << std::endl;
+    std::cerr << "  interval: Seconds between reports (default: 1)." << std::endl;
+    std::cerr << "  count: Number of reports, 0 for unlimited (default: 0)." << std::endl;
+    std::cerr << "   or: " << programName << " --merge-traces <output> <trace> [<trace> ...]" << std::endl;
+    std::cerr << "  --merge-traces: Combine client and server --trace files into one timeline." << std::endl;
+}
+
+static void printHeader() {
+    std::printf("%7s %7s %7s %7s %7s %7s %9s %7s %9s %7s %7s %6s %6s %6s %7s %7s %7s %7s %7s %7s %7s %7s %6s %6s\n",
+                "kp/s", "kr/s", "mm/s", "bp/s", "br/s", "clip/s",
+                "txKB/s", "rec/s", "rxKB/s",
+                "inj/s", "injus", "drop", "coal", "held",
+                "q_in", "q_ctl", "q_clip", "q_bulk",
+                "jitus", "holdus", "q_inj", "qwaitus", "echo", "refuse");
+}
+
+int main(int argc, char* argv[]) {
+    std::string role = "server";
+    double interval = 1.0;
+    long count = 0;
+
+    if (argc > 3 && std::string(argv[1]) == "--merge-traces") {
+        std::vector<std::string> inputs(argv + 3, argv + argc);
+        if (!trace::mergeJson(inputs, argv[2])) {
+            std::cerr << "Could not merge traces into " << argv[2] << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (argc > 1) {
+        std::string arg = argv[1];
+        if (arg == "--help" || (arg != "client" && arg != "server" && arg != "relay")) {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+        role = arg;
+    }
+    if (argc > 2) {
+        interval = std::stod(argv[2]);
+    }
+    if (argc > 3) {
+        count = std::stol(argv[3]);
+    }
+
+    const stats::Block* block = stats::attach(role.c_str());
+    if (!block) {
+        std::cerr << "No running " << role << " found (/sameness-" << role << ")" << std::endl;
+        return 1;
+    }
+    std::cout << "Attached to " << role << " pid " << block->pid << std::endl;
+
+    auto toRate = [interval](uint64_t now, uint64_t before) {
+        return static_cast<double>(now - before) / interval;
+    };
+
+    stats::Snapshot prev = stats::snapshot(*block);
+    for (long n = 0; count == 0 || n < count; ++n) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+        stats::Snapshot cur = stats::snapshot(*block);
+
+        if (n % 20 == 0) {
+            printHeader();
+        }
+
+        auto ev = [&](SamenessEventType t) {
+            size_t i = static_cast<size_t>(t);
+            return toRate(cur.events[i], prev.events[i]);
+        };
+        uint64_t calls = cur.injectCalls - prev.injectCalls;
+        double injUs = calls ? (cur.injectNanos - prev.injectNanos) / 1000.0 / calls : 0.0;
+        uint64_t played = cur.playoutMoves - prev.playoutMoves;
+        double holdUs = played ? (cur.playoutNanos - prev.playoutNanos) / 1000.0 / played : 0.0;
+        uint64_t dequeued = cur.injectQueued - prev.injectQueued;
+        double waitUs = dequeued ? (cur.injectWaitNanos - prev.injectWaitNanos) / 1000.0 / dequeued : 0.0;
+        double clip = ev(SamenessEventType::ClipboardOffer) + ev(SamenessEventType::ClipboardRequest)
+                    + ev(SamenessEventType::ClipboardChunk);
+
+        std::printf("%7.0f %7.0f %7.0f %7.0f %7.0f %7.0f %9.1f %7.0f %9.1f %7.0f %7.1f %6llu %6llu %6llu %7lld %7lld %7lld %7lld %7lld %7.0f %7lld %7.1f %6llu %6llu\n",
+                    ev(SamenessEventType::KeyPress), ev(SamenessEventType::KeyRelease),
+                    ev(SamenessEventType::MouseMove), ev(SamenessEventType::MouseButtonPress),
+                    ev(SamenessEventType::MouseButtonRelease), clip,
+                    toRate(cur.bytesSent, prev.bytesSent) / 1024.0,
+                    toRate(cur.recordsSent, prev.recordsSent),
+                    toRate(cur.bytesReceived, prev.bytesReceived) / 1024.0,
+                    toRate(cur.injectCalls, prev.injectCalls), injUs,
+                    static_cast<unsigned long long>(cur.drops - prev.drops),
+                    static_cast<unsigned long long>(cur.coalescedMoves - prev.coalescedMoves),
+                    static_cast<unsigned long long>(cur.heldWrites - prev.heldWrites),
+                    static_cast<long long>(cur.gauges[0]), static_cast<long long>(cur.gauges[1]),
+                    static_cast<long long>(cur.gauges[2]), static_cast<long long>(cur.gauges[3]),
+                    static_cast<long long>(cur.gauges[4]), holdUs,
+                    static_cast<long long>(cur.gauges[static_cast<size_t>(stats::Gauge::InjectQueueDepth)]), waitUs,
+                    static_cast<unsigned long long>(cur.echoes - prev.echoes),
+                    static_cast<unsigned long long>(cur.refused - prev.refused));
+        std::fflush(stdout);
+        prev = cur;
+    }
+
+    stats::detach(block);
+    return 0;
+}
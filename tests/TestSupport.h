@@ -0,0 +1,76 @@
+#pragma once
+// Shared helpers for the sameness tests. Each test is a standalone executable
+// that exits non-zero on the first failed CHECK.
+
+#include "Session.h"
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #cond << std::endl; \
+        std::exit(1); \
+    } \
+} while (0)
+
+namespace test {
+
+inline uint64_t nowMicroseconds() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns the p-th percentile (0..100) of a sample set.
+inline uint64_t percentile(std::vector<uint64_t> samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t idx = static_cast<size_t>((p / 100.0) * (samples.size() - 1));
+    return samples[idx];
+}
+
+inline void printLatency(const std::string& label, const std::vector<uint64_t>& us) {
+    std::cout << label << ": n=" << us.size()
+              << " p50=" << percentile(us, 50) << "us"
+              << " p99=" << percentile(us, 99) << "us"
+              << " max=" << percentile(us, 100) << "us" << std::endl;
+}
+
+// A connected, handshaken TLS pair over loopback using the repo's server cert.
+// Each side lives on its own io_context so it can be run by its own thread.
+struct LoopbackTls {
+    boost::asio::ssl::context serverCtx{boost::asio::ssl::context::tlsv12_server};
+    boost::asio::ssl::context clientCtx{boost::asio::ssl::context::tlsv12_client};
+    std::unique_ptr<Session::Stream> server;
+    std::unique_ptr<Session::Stream> client;
+
+    LoopbackTls(boost::asio::io_context& serverIo, boost::asio::io_context& clientIo) {
+        using boost::asio::ip::tcp;
+        serverCtx.use_certificate_chain_file(SAMENESS_SOURCE_DIR "/server.crt");
+        serverCtx.use_private_key_file(SAMENESS_SOURCE_DIR "/server.key", boost::asio::ssl::context::pem);
+
+        tcp::acceptor acceptor(serverIo, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        server = std::make_unique<Session::Stream>(serverIo, serverCtx);
+        client = std::make_unique<Session::Stream>(clientIo, clientCtx);
+
+        client->lowest_layer().connect(acceptor.local_endpoint());
+        acceptor.accept(server->next_layer());
+        client->lowest_layer().set_option(tcp::no_delay(true));
+
+        std::thread serverSide([this]() { server->handshake(boost::asio::ssl::stream_base::server); });
+        client->handshake(boost::asio::ssl::stream_base::client);
+        serverSide.join();
+    }
+};
+
+} // namespace test
@@ -0,0 +1,318 @@
+// Several controllers on one server: one drives at a time under either
+// policy, keys held by a controller that loses control are released before
+// the next one's input, and under a load generator driving several sessions
+// at once no key is ever released by a controller other than the one that
+// pressed it.
+
+#include "ControlArbiter.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+
+namespace {
+    struct IoThread {
+        boost::asio::io_context io;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{io.get_executor()};
+        std::thread thread{[this]() { io.run(); }};
+
+        ~IoThread() {
+            io.stop();
+            thread.join();
+        }
+    };
+
+    struct Releases {
+        std::vector<EventPacket> packets;
+
+        void attach(ControlArbiter& arbiter) {
+            arbiter.setReleaseHandler([this](const EventPacket& release) { packets.push_back(release); });
+        }
+    };
+
+    EventPacket press(uint32_t keycode) {
+        return makeKeyPacket(SamenessEventType::KeyPress, 0, keycode);
+    }
+
+    EventPacket release(uint32_t keycode) {
+        return makeKeyPacket(SamenessEventType::KeyRelease, 0, keycode);
+    }
+
+    ControlArbiter::Config policy(ControlArbiter::Policy p, int idleMs) {
+        ControlArbiter::Config config;
+        config.policy = p;
+        config.idle = std::chrono::milliseconds(idleMs);
+        return config;
+    }
+}
+
+static void test_last_active() {
+    ControlArbiter arbiter(policy(ControlArbiter::Policy::LastActive, 100));
+    Releases releases;
+    releases.attach(arbiter);
+    size_t a = arbiter.join();
+    size_t b = arbiter.join();
+    CHECK(a != b && a != ControlArbiter::kNone && b != ControlArbiter::kNone);
+    CHECK(arbiter.owner() == ControlArbiter::kNone);
+
+    CHECK(arbiter.admit(a, press(30), 1000000));
+    CHECK(arbiter.admit(a, makeMouseButtonPacket(SamenessEventType::MouseButtonPress, 0, 1, 40, 50), 1010000));
+    CHECK(arbiter.admit(a, makeMouseMovePacket(0, 60, 70), 1020000));
+    CHECK(arbiter.owner() == a);
+    // Busy: b is refused, and so is its release of a's key
+    CHECK(!arbiter.admit(b, press(31), 1050000));
+    CHECK(!arbiter.admit(b, release(30), 1060000));
+    // Other traffic is never arbitrated
+    EventPacket heartbeat;
+    heartbeat.type = SamenessEventType::Heartbeat;
+    CHECK(arbiter.admit(b, heartbeat, 1060000));
+    CHECK(releases.packets.empty());
+
+    // a has been idle for 100 ms since its last input: b takes over, and
+    // what a holds is released first, the button at the last pointer position
+    CHECK(arbiter.admit(b, press(31), 1120000));
+    CHECK(arbiter.owner() == b);
+    CHECK(arbiter.takeovers() == 1);
+    CHECK(releases.packets.size() == 2);
+    uint8_t button = 0;
+    int32_t x = 0, y = 0;
+    CHECK(readMouseButton(releases.packets[0], button, x, y));
+    CHECK(releases.packets[0].type == SamenessEventType::MouseButtonRelease);
+    CHECK(button == 1 && x == 60 && y == 70);
+    uint32_t keycode = 0;
+    CHECK(releases.packets[1].type == SamenessEventType::KeyRelease);
+    CHECK(readKey(releases.packets[1], keycode) && keycode == 30);
+
+    // a's own late release is refused: its key is up already
+    CHECK(!arbiter.admit(a, release(30), 1130000));
+    releases.packets.clear();
+    CHECK(arbiter.admit(b, release(31), 1140000));
+    // Released, so nothing is left to release when a takes it back
+    CHECK(arbiter.admit(a, press(32), 1300000));
+    CHECK(releases.packets.empty());
+
+    // Leaving with control releases what is held and frees the slot
+    arbiter.leave(a, 1310000);
+    CHECK(arbiter.owner() == ControlArbiter::kNone);
+    CHECK(releases.packets.size() == 1 && readKey(releases.packets[0], keycode) && keycode == 32);
+    CHECK(arbiter.join() == a);
+}
+
+static void test_lock() {
+    ControlArbiter arbiter(policy(ControlArbiter::Policy::Lock, 100));
+    Releases releases;
+    releases.attach(arbiter);
+    size_t a = arbiter.join();
+    size_t b = arbiter.join();
+    CHECK(arbiter.admit(a, press(30), 1000000));
+    // Locked: however long a is idle, b never gets in
+    CHECK(!arbiter.admit(b, press(31), 1000000000));
+    CHECK(arbiter.owner() == a);
+    arbiter.leave(a, 1000000001);
+    CHECK(releases.packets.size() == 1);
+    CHECK(arbiter.admit(b, press(31), 1000000002));
+    CHECK(arbiter.owner() == b);
+    CHECK(arbiter.takeovers() == 0);
+
+    for (size_t i = 1; i < ControlArbiter::kMaxControllers; ++i) {
+        CHECK(arbiter.join() != ControlArbiter::kNone);
+    }
+    CHECK(arbiter.join() == ControlArbiter::kNone);
+
+    bool threw = false;
+    try {
+        ControlArbiter::parsePolicy("first-come");
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(ControlArbiter::parsePolicy("lock") == ControlArbiter::Policy::Lock);
+}
+
+// Threads call admit() directly with no idle time, so control changes hands
+// constantly. Whatever the interleaving, every press that got through is
+// matched by a release, and the check itself stays cheap.
+static void test_contended_admit() {
+    constexpr size_t kThreads = 4;
+    constexpr uint32_t kRounds = 200000;
+    ControlArbiter arbiter(policy(ControlArbiter::Policy::LastActive, 0));
+    std::mutex mutex;
+    std::map<uint32_t, int64_t> balance;    // presses injected minus releases, per key
+    arbiter.setReleaseHandler([&](const EventPacket& pkt) {
+        uint32_t keycode = 0;
+        readKey(pkt, keycode);
+        std::lock_guard<std::mutex> lock(mutex);
+        --balance[keycode];
+    });
+
+    std::atomic<uint64_t> admitted{0};
+    std::vector<std::thread> threads;
+    uint64_t start = test::nowMicroseconds();
+    for (size_t t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            size_t id = arbiter.join();
+            std::vector<EventPacket> presses, releases;
+            for (uint32_t k = 0; k < 8; ++k) {
+                presses.push_back(press(100 + static_cast<uint32_t>(t) * 8 + k));
+                releases.push_back(release(100 + static_cast<uint32_t>(t) * 8 + k));
+            }
+            int64_t local[8] = {};
+            uint64_t passed = 0;
+            for (uint32_t i = 0; i < kRounds; ++i) {
+                uint64_t now = test::nowMicroseconds();
+                if (arbiter.admit(id, presses[i % 8], now)) {
+                    ++local[i % 8];
+                    ++passed;
+                }
+                if (arbiter.admit(id, releases[i % 8], now)) {
+                    --local[i % 8];
+                    ++passed;
+                }
+            }
+            arbiter.leave(id, test::nowMicroseconds());
+            std::lock_guard<std::mutex> lock(mutex);
+            for (uint32_t k = 0; k < 8; ++k) {
+                balance[100 + static_cast<uint32_t>(t) * 8 + k] += local[k];
+            }
+            admitted += passed;
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    uint64_t elapsedUs = test::nowMicroseconds() - start;
+    uint64_t calls = uint64_t(kThreads) * kRounds * 2;
+    std::cout << kThreads << " threads, " << calls << " admit calls: " << admitted << " admitted, "
+              << arbiter.takeovers() << " takeovers, " << elapsedUs * 1000.0 / calls << " ns per call overall"
+              << std::endl;
+    CHECK(arbiter.takeovers() > 0);
+    CHECK(arbiter.owner() == ControlArbiter::kNone);
+    // A release can get through without its press (the press was taken back
+    // at a takeover), never the other way round
+    for (const auto& k : balance) {
+        CHECK(k.second <= 0);
+    }
+}
+
+// A load generator per controller drives its own session into one server io
+// thread, in bursts with random pauses around the idle timeout. The server
+// side admits and "injects" into a model of the target machine's key state.
+static void test_load_generator() {
+    constexpr size_t kControllers = 3;
+    constexpr int kBursts = 300;
+    IoThread serverIo, clientIo;
+    ControlArbiter arbiter(policy(ControlArbiter::Policy::LastActive, 2));
+
+    // Server io thread only
+    std::map<uint32_t, size_t> down;    // key held on the target, by controller
+    size_t injected = 0;
+    size_t refused = 0;
+    size_t released = 0;
+    bool consistent = true;
+    arbiter.setReleaseHandler([&](const EventPacket& pkt) {
+        uint32_t keycode = 0;
+        consistent = consistent && readKey(pkt, keycode) && down.count(keycode) == 1;
+        down.erase(keycode);
+        ++released;
+    });
+
+    std::vector<std::shared_ptr<Session>> servers, clients;
+    std::atomic<size_t> closed{0};
+    for (size_t c = 0; c < kControllers; ++c) {
+        test::LoopbackTls tls(serverIo.io, clientIo.io);
+        servers.push_back(std::make_shared<Session>(std::move(tls.server)));
+        clients.push_back(std::make_shared<Session>(std::move(tls.client)));
+        size_t id = arbiter.join();
+        servers.back()->start([&, id](const EventPacket& pkt) {
+            if (!arbiter.admit(id, pkt, test::nowMicroseconds())) {
+                ++refused;
+                return;
+            }
+            ++injected;
+            uint32_t keycode = 0;
+            if (!readKey(pkt, keycode)) {
+                return;
+            }
+            if (pkt.type == SamenessEventType::KeyPress) {
+                // Nobody else's key is still down on the target
+                for (const auto& k : down) {
+                    consistent = consistent && k.second == id;
+                }
+                down[keycode] = id;
+            } else if (down.count(keycode) == 1) {
+                // Only the controller that pressed a key releases it
+                consistent = consistent && down[keycode] == id;
+                down.erase(keycode);
+            }
+        }, [&, id](const boost::system::error_code&) {
+            arbiter.leave(id, test::nowMicroseconds());
+            ++closed;
+        });
+        clients.back()->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+    }
+
+    std::vector<std::thread> generators;
+    for (size_t c = 0; c < kControllers; ++c) {
+        generators.emplace_back([&, c]() {
+            std::mt19937 rng(static_cast<uint32_t>(c) + 1);
+            std::uniform_int_distribution<int> pauseUs(0, 4000);
+            std::uniform_int_distribution<uint32_t> key(30, 40);   // shared by every controller
+            for (int burst = 0; burst < kBursts; ++burst) {
+                uint32_t keycode = key(rng);
+                Session& s = *clients[c];
+                s.send(makeKeyPacket(SamenessEventType::KeyPress, test::nowMicroseconds(), keycode));
+                for (int i = 0; i < 8; ++i) {
+                    s.send(makeMouseMovePacket(test::nowMicroseconds(), burst, i));
+                }
+                // Every other burst leaves its key down across the pause
+                if (burst % 2 == 0) {
+                    s.send(makeKeyPacket(SamenessEventType::KeyRelease, test::nowMicroseconds(), keycode));
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(pauseUs(rng)));
+                if (burst % 2 != 0) {
+                    s.send(makeKeyPacket(SamenessEventType::KeyRelease, test::nowMicroseconds(), keycode));
+                }
+            }
+        });
+    }
+    for (std::thread& g : generators) {
+        g.join();
+    }
+    for (auto& c : clients) {
+        c->close();
+    }
+    uint64_t deadline = test::nowMicroseconds() + 5000000;
+    while (closed < kControllers && test::nowMicroseconds() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(closed == kControllers);
+
+    // The io thread is done with the sessions; read its state from there
+    std::atomic<bool> checked{false};
+    boost::asio::post(serverIo.io, [&]() {
+        std::cout << kControllers << " controllers: " << injected << " events injected, " << refused
+                  << " refused, " << arbiter.takeovers() << " takeovers, " << released
+                  << " keys released for a controller" << std::endl;
+        CHECK(consistent);
+        CHECK(down.empty());
+        CHECK(arbiter.takeovers() > 0);
+        CHECK(refused > 0);
+        checked = true;
+    });
+    while (!checked) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (auto& s : servers) {
+        s->close();
+    }
+}
+
+int main() {
+    test_last_active();
+    test_lock();
+    test_contended_admit();
+    test_load_generator();
+    std::cout << "arbiter_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,183 @@
+// Channel framing, strict-priority scheduling and keystroke latency under bulk load.
+
+#include "Channels.h"
+#include "ClipboardSync.h"
+#include "Session.h"
+#include "TestSupport.h"
+#include <atomic>
+
+static EventPacket makePacket(SamenessEventType type, size_t payloadSize, uint64_t timestamp = 0) {
+    EventPacket pkt;
+    pkt.type = type;
+    pkt.timestamp = timestamp;
+    pkt.payloadSize = static_cast<uint32_t>(payloadSize);
+    pkt.payload.assign(payloadSize, 0xAB);
+    return pkt;
+}
+
+static void test_priority_and_quantum() {
+    ChannelScheduler sched(kProtocolV2);
+    std::pmr::vector<uint8_t> out;
+    CHECK(!sched.nextWrite(out));
+
+    sched.enqueue(Channel::Bulk, makePacket(SamenessEventType::ClipboardChunk, 10000).toBytes());
+    sched.enqueue(Channel::Input, makePacket(SamenessEventType::KeyPress, 4).toBytes());
+    sched.enqueue(Channel::Input, makePacket(SamenessEventType::KeyRelease, 4).toBytes());
+
+    // First write: all input, then exactly one capped bulk frame.
+    CHECK(sched.nextWrite(out));
+    CHECK(out[0] == static_cast<uint8_t>(Channel::Input));
+    size_t inputLen = (out[1] << 8) | out[2];
+    CHECK(inputLen == 2 * (EventPacket::kHeaderSize + 4));
+    size_t off = kFrameHeaderSize + inputLen;
+    CHECK(out[off] == static_cast<uint8_t>(Channel::Bulk));
+    CHECK(((out[off + 1] << 8) | out[off + 2]) == static_cast<int>(kBulkQuantum));
+    CHECK(out.size() == off + kFrameHeaderSize + kBulkQuantum);
+
+    // A keystroke queued mid-transfer goes out ahead of the next bulk frame.
+    sched.enqueue(Channel::Input, makePacket(SamenessEventType::KeyPress, 4).toBytes());
+    CHECK(sched.nextWrite(out));
+    CHECK(out[0] == static_cast<uint8_t>(Channel::Input));
+
+    // Control preempts bulk.
+    sched.enqueue(Channel::Control, makePacket(SamenessEventType::ClipboardRequest, 32).toBytes());
+    CHECK(sched.nextWrite(out));
+    CHECK(out[0] == static_cast<uint8_t>(Channel::Control));
+}
+
+// v1 has no frames: the same queues go out as whole, bare packets.
+static void test_v1_unframed() {
+    ChannelScheduler sched(kProtocolV1);
+    std::vector<uint8_t> chunk = makePacket(SamenessEventType::ClipboardChunk, 10000).toBytes();
+    std::vector<uint8_t> key = makePacket(SamenessEventType::KeyPress, 4).toBytes();
+    sched.enqueue(Channel::Bulk, chunk);
+    sched.enqueue(Channel::Input, key);
+
+    std::pmr::vector<uint8_t> out;
+    CHECK(sched.nextWrite(out));
+    std::vector<uint8_t> expected = key;
+    expected.insert(expected.end(), chunk.begin(), chunk.end());
+    CHECK(std::vector<uint8_t>(out.begin(), out.end()) == expected);
+    CHECK(!sched.nextWrite(out));
+
+    SharedFrame frame = makeFrame(Channel::Input, makePacket(SamenessEventType::KeyPress, 4), kProtocolV1);
+    CHECK(*frame == key);
+}
+
+static void test_decoder_roundtrip(uint16_t version) {
+    ChannelScheduler sched(version);
+    int remaining = 3;
+    sched.setSource(Channel::Clipboard, [&](EventPacket& pkt) {
+        if (remaining == 0) {
+            return false;
+        }
+        --remaining;
+        pkt = makePacket(SamenessEventType::ClipboardChunk, 5000);
+        return true;
+    });
+    for (int i = 0; i < 10; ++i) {
+        std::vector<uint8_t> bytes;
+        encodePacket(makePacket(SamenessEventType::MouseMove, 8, i), version, bytes);
+        sched.enqueue(Channel::Input, bytes);
+    }
+
+    std::vector<uint8_t> wire;
+    std::pmr::vector<uint8_t> out;
+    while (sched.nextWrite(out)) {
+        wire.insert(wire.end(), out.begin(), out.end());
+    }
+
+    // Feed one byte at a time to exercise every partial-frame path.
+    FrameDecoder decoder(version);
+    int moves = 0, chunks = 0;
+    for (uint8_t b : wire) {
+        CHECK(decoder.feed(&b, 1, [&](Channel ch, const EventPacket& pkt) {
+            if (pkt.type == SamenessEventType::MouseMove) {
+                CHECK(ch == Channel::Input);
+                CHECK(pkt.timestamp == static_cast<uint64_t>(moves));
+                ++moves;
+            } else {
+                CHECK(ch == Channel::Clipboard);
+                CHECK(pkt.payload.size() == 5000);
+                ++chunks;
+            }
+        }));
+    }
+    CHECK(moves == 10);
+    CHECK(chunks == 3);
+
+    // An unknown channel (v2) or event type (v1)
+    std::vector<uint8_t> bad(EventPacket::kHeaderSize, 0);
+    bad[0] = version < kProtocolV2 ? 0xEE : 9;
+    CHECK(!FrameDecoder(version).feed(bad.data(), bad.size(), [](Channel, const EventPacket&) {}));
+}
+
+static void test_keystroke_latency_under_bulk() {
+    boost::asio::io_context serverIo, clientIo;
+    test::LoopbackTls tls(serverIo, clientIo);
+
+    auto client = std::make_shared<Session>(std::move(tls.client));
+    auto server = std::make_shared<Session>(std::move(tls.server));
+
+    // Saturating bulk stream: never runs dry while the test is active.
+    std::atomic<bool> saturate{true};
+    std::atomic<uint64_t> bulkBytes{0};
+    client->setBulkSource(Channel::Bulk, [&](EventPacket& pkt) {
+        if (!saturate) {
+            return false;
+        }
+        pkt = makePacket(SamenessEventType::ClipboardChunk, ClipboardSync::kChunkSize);
+        return true;
+    });
+
+    std::vector<uint64_t> latencies;
+    std::atomic<int> keys{0};
+    server->start(
+        [&](const EventPacket& pkt) {
+            if (pkt.type == SamenessEventType::KeyPress) {
+                latencies.push_back(test::nowMicroseconds() - pkt.timestamp);
+                ++keys;
+            } else {
+                bulkBytes += pkt.payload.size();
+            }
+        },
+        [](const boost::system::error_code&) {});
+    client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+
+    std::thread serverThread([&]() { serverIo.run(); });
+    std::thread clientThread([&]() { clientIo.run(); });
+
+    client->kickBulk();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));  // let the bulk stream fill the pipe
+
+    const int kKeys = 200;
+    for (int i = 0; i < kKeys; ++i) {
+        client->send(makePacket(SamenessEventType::KeyPress, 4, test::nowMicroseconds()));
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    for (int i = 0; i < 500 && keys < kKeys; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    saturate = false;
+
+    client->close();
+    server->close();
+    clientThread.join();
+    serverThread.join();
+
+    CHECK(keys == kKeys);
+    CHECK(bulkBytes > 0);
+    std::cout << "bulk bytes delivered: " << bulkBytes << std::endl;
+    test::printLatency("KeyPress latency under saturating bulk", latencies);
+    CHECK(test::percentile(latencies, 99) < 50000);
+}
+
+int main() {
+    test_priority_and_quantum();
+    test_v1_unframed();
+    test_decoder_roundtrip(kProtocolV1);
+    test_decoder_roundtrip(kProtocolV2);
+    test_keystroke_latency_under_bulk();
+    std::cout << "channels_test passed" << std::endl;
+    return 0;
+}
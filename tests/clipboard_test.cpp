@@ -0,0 +1,291 @@
+// Clipboard sync: dedupe, lazy fetch, the pasteboard bridge over a session
+// and input latency during a large transfer.
+
+#include "ClipboardSync.h"
+#include "Pasteboard.h"
+#include "Session.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <atomic>
+#include <random>
+
+static void test_dedupe() {
+    ClipboardSync local;
+    EventPacket offer;
+    std::vector<uint8_t> content(1000, 0x42);
+
+    CHECK(local.offerLocal(content, offer));
+    CHECK(offer.type == SamenessEventType::ClipboardOffer);
+    CHECK(!local.offerLocal(content, offer));    // same content again: skipped
+
+    // Copying something else and then the first content again offers it again
+    CHECK(local.offerLocal(std::vector<uint8_t>(10, 0x43), offer));
+    CHECK(local.offerLocal(content, offer));
+    CHECK(offer.payload.size() == sizeof(ClipboardSync::Digest) + sizeof(uint64_t));
+    CHECK(std::equal(offer.payload.begin(), offer.payload.begin() + 32,
+                     ClipboardSync::digestOf(content.data(), content.size()).begin()));
+
+    // The peer takes the re-offer too, though it saw that content before
+    ClipboardSync peer;
+    int offers = 0;
+    peer.setOfferHandler([&](const ClipboardSync::Digest&, uint64_t) { ++offers; });
+    for (uint8_t fill : {0x42, 0x43, 0x42}) {
+        CHECK(local.offerLocal(std::vector<uint8_t>(10, fill), offer));
+        CHECK(peer.handlePacket(offer));
+    }
+    CHECK(offers == 3);
+    EventPacket request;
+    CHECK(peer.requestRemote(request));
+    CHECK(std::equal(request.payload.begin(), request.payload.end(), offer.payload.begin()));
+
+    // A new peer gets the unchanged clipboard offered again
+    CHECK(!local.offerLocal(std::vector<uint8_t>(10, 0x42), offer));
+    local.reset();
+    CHECK(local.offerLocal(std::vector<uint8_t>(10, 0x42), offer));
+}
+
+static void test_lazy_fetch() {
+    ClipboardSync a, b;
+    std::vector<uint8_t> content(3 * ClipboardSync::kChunkSize + 17);
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<uint8_t>(i * 31);
+    }
+
+    bool offered = false;
+    std::vector<uint8_t> received;
+    b.setOfferHandler([&](const ClipboardSync::Digest&, uint64_t size) {
+        offered = true;
+        CHECK(size == content.size());
+    });
+    b.setContentHandler([&](const std::vector<uint8_t>& data) { received = data; });
+
+    EventPacket pkt;
+    CHECK(!b.requestRemote(pkt));                // nothing on offer yet
+    CHECK(a.offerLocal(content, pkt));
+    CHECK(!a.hasPendingChunks());                // nothing streams before a paste
+    CHECK(b.handlePacket(pkt));
+    CHECK(offered);
+
+    CHECK(b.requestRemote(pkt));
+    CHECK(a.handlePacket(pkt));
+    int chunks = 0;
+    while (a.nextChunk(pkt)) {
+        CHECK(pkt.payload.size() <= ClipboardSync::kChunkSize + 40);
+        CHECK(b.handlePacket(pkt));
+        ++chunks;
+    }
+    CHECK(chunks == 4);
+    CHECK(received == content);
+
+    // Content that just arrived from the peer is not echoed back to it.
+    CHECK(!b.offerLocal(content, pkt));
+}
+
+static void test_input_latency_during_transfer() {
+    boost::asio::io_context serverIo, clientIo;
+    test::LoopbackTls tls(serverIo, clientIo);
+
+    ClipboardSync clientClip, serverClip;
+    auto client = std::make_shared<Session>(std::move(tls.client));
+    auto server = std::make_shared<Session>(std::move(tls.server));
+    client->setBulkSource(Channel::Clipboard, [&](EventPacket& p) { return clientClip.nextChunk(p); });
+    server->setBulkSource(Channel::Clipboard, [&](EventPacket& p) { return serverClip.nextChunk(p); });
+
+    std::vector<uint8_t> content(20 * 1024 * 1024);
+    std::mt19937 rng(1);
+    for (auto& b : content) {
+        b = static_cast<uint8_t>(rng());
+    }
+
+    std::atomic<bool> done{false};
+    std::vector<uint64_t> latencies;
+    std::vector<uint8_t> received;
+
+    // Paste as soon as the offer arrives
+    serverClip.setOfferHandler([&](const ClipboardSync::Digest&, uint64_t) {
+        EventPacket req;
+        CHECK(serverClip.requestRemote(req));
+        server->send(std::move(req));
+    });
+    serverClip.setContentHandler([&](const std::vector<uint8_t>& data) {
+        received = data;
+        done = true;
+    });
+
+    server->start(
+        [&](const EventPacket& pkt) {
+            if (serverClip.handlePacket(pkt)) {
+                server->kickBulk();
+                return;
+            }
+            if (!done) {
+                latencies.push_back(test::nowMicroseconds() - pkt.timestamp);
+            }
+        },
+        [](const boost::system::error_code&) {});
+    client->start(
+        [&](const EventPacket& pkt) {
+            if (clientClip.handlePacket(pkt)) {
+                client->kickBulk();
+            }
+        },
+        [](const boost::system::error_code&) {});
+
+    std::thread serverThread([&]() { serverIo.run(); });
+    std::thread clientThread([&]() { clientIo.run(); });
+
+    EventPacket offer;
+    CHECK(clientClip.offerLocal(content, offer));
+    client->send(std::move(offer));
+
+    auto start = std::chrono::steady_clock::now();
+    while (!done) {
+        EventPacket move;
+        move.type = SamenessEventType::MouseMove;
+        move.timestamp = test::nowMicroseconds();
+        move.payloadSize = 8;
+        move.payload.assign(8, 0);
+        client->send(std::move(move));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(60));
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+    client->close();
+    server->close();
+    clientThread.join();
+    serverThread.join();
+
+    CHECK(received == content);
+    CHECK(!latencies.empty());
+    std::cout << "20 MB clipboard transferred in " << elapsed.count() << " ms" << std::endl;
+    test::printLatency("MouseMove latency during transfer", latencies);
+    // Input only ever waits behind one small clipboard frame.
+    CHECK(test::percentile(latencies, 99) < 50000);
+}
+
+// An offer larger than kMaxContentSize is ignored, whatever it claims.
+static void test_oversized_offer() {
+    ClipboardSync local;
+    bool offered = false;
+    local.setOfferHandler([&](const ClipboardSync::Digest&, uint64_t) { offered = true; });
+
+    EventPacket offer;
+    CHECK(ClipboardSync().offerLocal(std::vector<uint8_t>(10, 0x42), offer));
+    for (size_t i = 0; i < 8; ++i) {
+        offer.payload[offer.payload.size() - 8 + i] = 0xFF;      // size: 2^64 - 1
+    }
+    CHECK(local.handlePacket(offer));
+    CHECK(!offered);
+    EventPacket request;
+    CHECK(!local.requestRemote(request));
+
+    CHECK(!local.offerLocal(std::vector<uint8_t>(ClipboardSync::kMaxContentSize + 1), offer));
+}
+
+// Two clipboards bridged over a session: A, B and A again all reach the
+// other side, and nothing that arrives is offered back.
+static void test_pasteboard_bridge() {
+    struct FakePasteboard {
+        std::mutex mutex;
+        std::vector<uint8_t> content;
+        int writes = 0;
+
+        bool read(std::vector<uint8_t>& out) {
+            std::lock_guard<std::mutex> lock(mutex);
+            out = content;
+            return !out.empty();
+        }
+        bool write(const std::vector<uint8_t>& in) {
+            std::lock_guard<std::mutex> lock(mutex);
+            content = in;
+            ++writes;
+            return true;
+        }
+        std::vector<uint8_t> get() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return content;
+        }
+    };
+
+    boost::asio::io_context serverIo, clientIo;
+    test::LoopbackTls tls(serverIo, clientIo);
+    ClipboardSync clientClip, serverClip;
+    FakePasteboard clientBoard, serverBoard;
+    auto client = std::make_shared<Session>(std::move(tls.client));
+    auto server = std::make_shared<Session>(std::move(tls.server));
+    client->setBulkSource(Channel::Clipboard, [&](EventPacket& p) { return clientClip.nextChunk(p); });
+    server->setBulkSource(Channel::Clipboard, [&](EventPacket& p) { return serverClip.nextChunk(p); });
+    std::atomic<int> serverOffers{0};
+
+    constexpr auto kInterval = std::chrono::milliseconds(5);
+    PasteboardBridge clientBridge(clientClip, kInterval, [&](EventPacket pkt) { client->send(std::move(pkt)); },
+        [&](std::vector<uint8_t>& c) { return clientBoard.read(c); },
+        [&](const std::vector<uint8_t>& c) { return clientBoard.write(c); });
+    PasteboardBridge serverBridge(serverClip, kInterval,
+        [&](EventPacket pkt) {
+            if (pkt.type == SamenessEventType::ClipboardOffer) {
+                ++serverOffers;
+            }
+            server->send(std::move(pkt));
+        },
+        [&](std::vector<uint8_t>& c) { return serverBoard.read(c); },
+        [&](const std::vector<uint8_t>& c) { return serverBoard.write(c); });
+
+    server->start([&](const EventPacket& pkt) {
+        if (serverClip.handlePacket(pkt)) {
+            server->kickBulk();
+        }
+    }, [](const boost::system::error_code&) {});
+    client->start([&](const EventPacket& pkt) {
+        if (clientClip.handlePacket(pkt)) {
+            client->kickBulk();
+        }
+    }, [](const boost::system::error_code&) {});
+    std::thread serverThread([&]() { serverIo.run(); });
+    std::thread clientThread([&]() { clientIo.run(); });
+    clientBridge.start();
+    serverBridge.start();
+
+    auto waitFor = [](const std::function<bool()>& cond) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!cond() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return cond();
+    };
+    std::vector<uint8_t> a(3 * ClipboardSync::kChunkSize, 'a');
+    std::vector<uint8_t> b(100, 'b');
+    for (const std::vector<uint8_t>* copied : {&a, &b, &a}) {
+        clientBoard.write(*copied);
+        CHECK(waitFor([&]() { return serverBoard.get() == *copied; }));
+    }
+    CHECK(serverBoard.writes == 3);
+
+    // A copy on the server goes the other way
+    serverBoard.write(b);
+    CHECK(waitFor([&]() { return clientBoard.get() == b; }));
+
+    // Let a few more checks go by: nothing bounces
+    std::this_thread::sleep_for(10 * kInterval);
+    CHECK(serverOffers == 1);
+    CHECK(serverBoard.writes == 4);
+    CHECK(clientBoard.writes == 4);
+
+    clientBridge.stop();
+    serverBridge.stop();
+    client->close();
+    server->close();
+    clientThread.join();
+    serverThread.join();
+}
+
+int main() {
+    test_dedupe();
+    test_lazy_fetch();
+    test_oversized_offer();
+    test_pasteboard_bridge();
+    test_input_latency_during_transfer();
+    std::cout << "clipboard_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,305 @@
+// Congestion: over an emulated link slower than the pointer, a session that
+// watches its send backlog keeps motion latency bounded by collapsing moves,
+// while every key still arrives, in order. Without the limit, motion queues
+// in the link's send buffer and its latency grows for as long as it is fed.
+// Keys are never held back by the limit. Also checks that a real socket
+// reports its unsent bytes.
+
+#include "TestSupport.h"
+#include "Transport.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+namespace {
+    using boost::asio::ip::tcp;
+
+    struct IoThread {
+        boost::asio::io_context io;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{io.get_executor()};
+        std::thread thread{[this]() { io.run(); }};
+
+        ~IoThread() {
+            io.stop();
+            thread.join();
+        }
+    };
+
+    // A link of fixed bandwidth in front of another transport. Writes land in
+    // a send buffer, as in a kernel, and complete at once while it has room;
+    // a timer drains it into the inner transport at `bytesPerSecond`.
+    class ThrottledTransport final : public Transport {
+    public:
+        ThrottledTransport(std::unique_ptr<Transport> inner, size_t bytesPerSecond, size_t sendBuffer)
+            : link_(std::make_shared<Link>(std::move(inner), bytesPerSecond, sendBuffer)) {
+            boost::asio::post(link_->timer.get_executor(), [link = link_]() { link->tick(); });
+        }
+
+        Executor executor() override { return link_->inner->executor(); }
+        void asyncRead(boost::asio::mutable_buffer buffer, std::shared_ptr<Handler> handler) override {
+            link_->inner->asyncRead(buffer, std::move(handler));
+        }
+        void asyncWrite(boost::asio::const_buffer buffer, std::shared_ptr<Handler> handler) override {
+            link_->pendingWrite = buffer;
+            link_->writer = std::move(handler);
+            link_->accept();
+        }
+        void close() override {
+            link_->closed = true;
+            link_->timer.cancel();
+            link_->inner->close();
+        }
+        size_t unsentBytes() override { return link_->buffered.size(); }
+
+    private:
+        struct Link : Transport::Handler, std::enable_shared_from_this<Link> {
+            Link(std::unique_ptr<Transport> t, size_t rate, size_t capacity)
+                : inner(std::move(t)), timer(inner->executor()), bytesPerSecond(rate), sendBuffer(capacity),
+                  lastTickUs(test::nowMicroseconds()) {}
+
+            std::unique_ptr<Transport> inner;
+            boost::asio::steady_timer timer;
+            size_t bytesPerSecond;
+            size_t sendBuffer;
+            std::deque<uint8_t> buffered;
+            boost::asio::const_buffer pendingWrite;
+            std::shared_ptr<Handler> writer;
+            std::vector<uint8_t> onWire;
+            bool sending = false;
+            bool closed = false;
+            uint64_t lastTickUs;
+            double credit = 0;
+
+            // Takes the waiting write if the send buffer has room for it.
+            void accept() {
+                if (!writer || buffered.size() + pendingWrite.size() > sendBuffer) {
+                    return;
+                }
+                const uint8_t* data = static_cast<const uint8_t*>(pendingWrite.data());
+                buffered.insert(buffered.end(), data, data + pendingWrite.size());
+                boost::asio::post(timer.get_executor(), [handler = std::move(writer), n = pendingWrite.size()]() {
+                    handler->onWrite({}, n);
+                });
+            }
+
+            void tick() {
+                if (closed) {
+                    return;
+                }
+                uint64_t now = test::nowMicroseconds();
+                credit += (now - lastTickUs) * 1e-6 * bytesPerSecond;
+                lastTickUs = now;
+                if (!sending && credit >= 1 && !buffered.empty()) {
+                    size_t n = std::min(buffered.size(), static_cast<size_t>(credit));
+                    credit -= n;
+                    onWire.assign(buffered.begin(), buffered.begin() + n);
+                    buffered.erase(buffered.begin(), buffered.begin() + n);
+                    sending = true;
+                    inner->asyncWrite(boost::asio::buffer(onWire), shared_from_this());
+                    accept();
+                }
+                if (buffered.empty()) {
+                    credit = std::min(credit, 64.0);   // an idle link does not save up
+                }
+                timer.expires_after(std::chrono::milliseconds(1));
+                timer.async_wait([self = shared_from_this()](const boost::system::error_code& ec) {
+                    if (!ec) {
+                        self->tick();
+                    }
+                });
+            }
+
+            void onRead(const boost::system::error_code&, size_t) override {}
+            void onWrite(const boost::system::error_code&, size_t) override { sending = false; }
+        };
+
+        std::shared_ptr<Link> link_;
+    };
+
+    // Passes writes straight through, but reports whatever backlog it is told to.
+    class BackloggedTransport final : public Transport {
+    public:
+        explicit BackloggedTransport(std::unique_ptr<Transport> inner) : inner_(std::move(inner)) {}
+
+        Executor executor() override { return inner_->executor(); }
+        void asyncRead(boost::asio::mutable_buffer buffer, std::shared_ptr<Handler> handler) override {
+            inner_->asyncRead(buffer, std::move(handler));
+        }
+        void asyncWrite(boost::asio::const_buffer buffer, std::shared_ptr<Handler> handler) override {
+            inner_->asyncWrite(buffer, std::move(handler));
+        }
+        void close() override { inner_->close(); }
+        size_t unsentBytes() override { return unsent; }
+
+        std::atomic<size_t> unsent{0};
+
+    private:
+        std::unique_ptr<Transport> inner_;
+    };
+
+    struct Result {
+        std::vector<uint64_t> moveLatencyUs;    // of moves received in the second half
+        uint32_t keysSent = 0;
+        uint32_t keysReceived = 0;
+        bool keysInOrder = true;
+    };
+
+    // One second of 1 kHz pointer motion with a key press and release every
+    // 50 ms, over a 16 KB/s link: v2 motion alone needs about 27 KB/s.
+    Result runLink(size_t backlogLimit) {
+        IoThread clientIo, serverIo;
+        MemoryTransport::Pair ends = MemoryTransport::connect(clientIo.io, serverIo.io);
+        auto link = std::make_unique<ThrottledTransport>(std::move(ends.first), 16 * 1024, 256 * 1024);
+        auto client = std::make_shared<Session>(std::move(link));
+        auto server = std::make_shared<Session>(std::move(ends.second));
+        client->setSendBacklogLimit(backlogLimit);
+
+        constexpr uint64_t kRunUs = 1000000;
+        uint64_t start = test::nowMicroseconds();
+        Result result;
+        std::mutex mutex;
+        std::atomic<uint32_t> keysReceived{0};
+        server->start([&](const EventPacket& pkt) {
+            uint64_t now = test::nowMicroseconds();
+            std::lock_guard<std::mutex> lock(mutex);
+            uint32_t code = 0;
+            if (pkt.type == SamenessEventType::MouseMove) {
+                if (pkt.timestamp - start > kRunUs / 2) {
+                    result.moveLatencyUs.push_back(now - pkt.timestamp);
+                }
+            } else if (readKey(pkt, code)) {
+                result.keysInOrder = result.keysInOrder && code == keysReceived / 2;
+                ++keysReceived;
+            }
+        }, [](const boost::system::error_code&) {});
+        client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+
+        for (uint32_t ms = 0; ms < kRunUs / 1000; ++ms) {
+            while (test::nowMicroseconds() < start + ms * 1000) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            uint64_t now = test::nowMicroseconds();
+            client->send(makeMouseMovePacket(now, static_cast<int32_t>(ms), 0));
+            if (ms % 50 == 0) {
+                uint32_t key = result.keysSent / 2;
+                client->send(makeKeyPacket(SamenessEventType::KeyPress, now, key));
+                client->send(makeKeyPacket(SamenessEventType::KeyRelease, now, key));
+                result.keysSent += 2;
+            }
+        }
+        // Whatever is queued drains at the link's rate
+        uint64_t deadline = test::nowMicroseconds() + 10000000;
+        while (keysReceived < result.keysSent && test::nowMicroseconds() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        client->close();
+        server->close();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::lock_guard<std::mutex> lock(mutex);
+        result.keysReceived = keysReceived;
+        return result;
+    }
+}
+
+static void test_throttled_link() {
+    Result unlimited = runLink(0);
+    test::printLatency("throttled link, no backlog limit, motion latency", unlimited.moveLatencyUs);
+    Result limited = runLink(512);
+    test::printLatency("throttled link, 512 byte backlog limit, motion latency", limited.moveLatencyUs);
+
+    for (const Result* r : {&unlimited, &limited}) {
+        CHECK(r->keysReceived == r->keysSent);
+        CHECK(r->keysInOrder);
+        CHECK(!r->moveLatencyUs.empty());
+    }
+    // Queued: half a second in, moves wait behind everything the link could not carry
+    CHECK(test::percentile(unlimited.moveLatencyUs, 50) > 200000);
+    // Held: a move waits for at most the backlog limit, its key neighbours and a recheck
+    CHECK(test::percentile(limited.moveLatencyUs, 99) < 150000);
+}
+
+// Over the limit, a lone move waits; a key goes out at once and takes the
+// waiting move with it, ahead of itself.
+static void test_only_motion_is_held() {
+    IoThread clientIo, serverIo;
+    MemoryTransport::Pair ends = MemoryTransport::connect(clientIo.io, serverIo.io);
+    auto backlogged = std::make_unique<BackloggedTransport>(std::move(ends.first));
+    BackloggedTransport& link = *backlogged;
+    link.unsent = 1 << 20;
+    auto client = std::make_shared<Session>(std::move(backlogged));
+    auto server = std::make_shared<Session>(std::move(ends.second));
+    client->setSendBacklogLimit(512);
+
+    std::mutex mutex;
+    std::vector<SamenessEventType> received;
+    server->start([&](const EventPacket& pkt) {
+        std::lock_guard<std::mutex> lock(mutex);
+        received.push_back(pkt.type);
+    }, [](const boost::system::error_code&) {});
+    client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+    auto receivedCount = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return received.size();
+    };
+    auto waitReceived = [&](size_t n) {
+        uint64_t deadline = test::nowMicroseconds() + 2000000;
+        while (receivedCount() < n && test::nowMicroseconds() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return receivedCount() >= n;
+    };
+
+    client->send(makeMouseMovePacket(test::nowMicroseconds(), 1, 0));
+    client->send(makeMouseMovePacket(test::nowMicroseconds(), 2, 0));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    CHECK(receivedCount() == 0);
+
+    uint64_t sent = test::nowMicroseconds();
+    client->send(makeKeyPacket(SamenessEventType::KeyPress, sent, 30));
+    CHECK(waitReceived(2));
+    uint64_t keyUs = test::nowMicroseconds() - sent;
+    std::cout << "key behind a held move arrived after " << keyUs << " us" << std::endl;
+    CHECK(keyUs < 20000);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(received.size() == 2);
+        CHECK(received[0] == SamenessEventType::MouseMove && received[1] == SamenessEventType::KeyPress);
+    }
+
+    link.unsent = 0;
+    client->send(makeMouseMovePacket(test::nowMicroseconds(), 3, 0));
+    CHECK(waitReceived(3));
+
+    client->close();
+    server->close();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+static void test_socket_unsent() {
+    boost::asio::io_context io;
+    tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    tcp::socket client(io);
+    tcp::socket server(io);
+    client.connect(acceptor.local_endpoint());
+    acceptor.accept(server);
+    TcpTransport transport(std::move(client));
+    CHECK(transport.unsentBytes() == 0);
+#if defined(__linux__)
+    // Nobody reads the server end, so writes pile up once its receive buffer is full
+    std::vector<uint8_t> chunk(64 * 1024);
+    boost::system::error_code ec;
+    transport.socket()->non_blocking(true);
+    while (!ec) {
+        transport.socket()->write_some(boost::asio::buffer(chunk), ec);
+    }
+    CHECK(transport.unsentBytes() > 0);
+#endif
+}
+
+int main() {
+    test_socket_unsent();
+    test_only_motion_is_held();
+    test_throttled_link();
+    std::cout << "congestion_test passed" << std::endl;
+    return 0;
+}
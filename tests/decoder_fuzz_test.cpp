@@ -0,0 +1,115 @@
+// Randomized fuzzing of the batch header decoder against the scalar reference.
+// Every input must decode identically on both paths and never read past the
+// buffer (build with -fsanitize=address to catch the latter).
+
+#include "EventPacket.h"
+#include "PacketDecoder.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+static std::vector<uint8_t> validStream(std::mt19937& rng, size_t packets) {
+    static const SamenessEventType types[] = {
+        SamenessEventType::KeyPress, SamenessEventType::KeyRelease, SamenessEventType::MouseMove,
+        SamenessEventType::MouseButtonPress, SamenessEventType::MouseButtonRelease,
+        SamenessEventType::ClipboardRequest, SamenessEventType::ClipboardChunk, SamenessEventType::Heartbeat,
+        SamenessEventType::TextInput, SamenessEventType::SwitchBack,
+    };
+    std::vector<uint8_t> stream;
+    for (size_t i = 0; i < packets; ++i) {
+        EventPacket pkt;
+        pkt.type = types[rng() % (sizeof(types) / sizeof(types[0]))];
+        pkt.timestamp = (static_cast<uint64_t>(rng()) << 32) | rng();
+        uint32_t lo = 0, hi = 0;
+        CHECK(payloadBounds(pkt.type, lo, hi));
+        pkt.payloadSize = lo + (hi > lo ? rng() % std::min<uint32_t>(hi - lo + 1, 200) : 0);
+        pkt.payload.resize(pkt.payloadSize);
+        for (auto& b : pkt.payload) {
+            b = static_cast<uint8_t>(rng());
+        }
+        auto bytes = pkt.toBytes();
+        stream.insert(stream.end(), bytes.begin(), bytes.end());
+    }
+    return stream;
+}
+
+static void checkSame(const std::vector<uint8_t>& input) {
+    // Copy into an exactly sized heap block so ASan flags any overread
+    // (one byte for empty input, which must not be read at all).
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[std::max<size_t>(input.size(), 1)]);
+    std::memcpy(buf.get(), input.data(), input.size());
+
+    const size_t kMax = 512;
+    std::vector<PacketRecord> a(kMax), b(kMax);
+    DecodeResult ra = decodePackets(buf.get(), input.size(), a.data(), kMax);
+    DecodeResult rb = decodePacketsScalar(buf.get(), input.size(), b.data(), kMax);
+
+    CHECK(ra.count == rb.count);
+    CHECK(ra.consumed == rb.consumed);
+    CHECK(ra.malformed == rb.malformed);
+    CHECK(ra.consumed <= input.size());
+    for (size_t i = 0; i < ra.count; ++i) {
+        CHECK(a[i].type == b[i].type);
+        CHECK(a[i].timestamp == b[i].timestamp);
+        CHECK(a[i].payloadSize == b[i].payloadSize);
+        CHECK(a[i].payloadOffset == b[i].payloadOffset);
+        CHECK(static_cast<size_t>(a[i].payloadOffset) + a[i].payloadSize <= input.size());
+    }
+}
+
+int main() {
+    std::mt19937 rng(12345);
+
+    // Valid streams decode fully and round-trip through toBytes/fromBytes.
+    for (int iter = 0; iter < 2000; ++iter) {
+        std::vector<uint8_t> stream = validStream(rng, 1 + rng() % 40);
+        checkSame(stream);
+        std::vector<PacketRecord> recs(64);
+        DecodeResult r = decodePackets(stream.data(), stream.size(), recs.data(), recs.size());
+        CHECK(!r.malformed);
+        CHECK(r.consumed == stream.size());
+        for (size_t i = 0; i < r.count; ++i) {
+            auto begin = stream.begin() + (recs[i].payloadOffset - EventPacket::kHeaderSize);
+            std::vector<uint8_t> bytes(begin, stream.begin() + recs[i].payloadOffset + recs[i].payloadSize);
+            EventPacket pkt = EventPacket::fromBytes(bytes);
+            CHECK(pkt.type == recs[i].type);
+            CHECK(pkt.timestamp == recs[i].timestamp);
+            CHECK(pkt.payloadSize == recs[i].payloadSize);
+            CHECK(pkt.toBytes() == bytes);
+        }
+    }
+
+    // Truncations, bit flips and pure noise.
+    for (int iter = 0; iter < 20000; ++iter) {
+        std::vector<uint8_t> stream = validStream(rng, 1 + rng() % 20);
+        switch (rng() % 3) {
+            case 0:
+                stream.resize(rng() % (stream.size() + 1));
+                break;
+            case 1:
+                for (int flips = 1 + rng() % 4; flips > 0; --flips) {
+                    stream[rng() % stream.size()] ^= static_cast<uint8_t>(1u << (rng() % 8));
+                }
+                break;
+            default:
+                for (auto& b : stream) {
+                    b = static_cast<uint8_t>(rng());
+                }
+                break;
+        }
+        checkSame(stream);
+    }
+
+    // fromBytes rejects truncated input instead of reading past it.
+    bool threw = false;
+    try {
+        EventPacket::fromBytes(std::vector<uint8_t>(5, 0));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    std::cout << "decoder_fuzz_test passed" << std::endl;
+    return 0;
+}
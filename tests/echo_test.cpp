@@ -0,0 +1,219 @@
+// Echo suppression for peer mode: injected input is recognized once when
+// capture sees it again, and two machines that both capture and inject
+// forward one real key press once instead of bouncing it back and forth.
+
+#include "EchoFilter.h"
+#include "TestSupport.h"
+#include "TextInput.h"
+#include "Transport.h"
+#include <atomic>
+#include <uiohook.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    EventPacket key(SamenessEventType type, uint32_t keycode) {
+        return makeKeyPacket(type, 1, keycode);
+    }
+
+    // One machine in peer mode: a server session that injects what the other
+    // machine sends, and a client session that forwards what is captured
+    // here. Injected input comes back through capture, as the OS would hand
+    // it to the hook.
+    struct Machine {
+        EchoFilter filter;
+        bool filtering = true;
+        std::shared_ptr<Session> out;
+        size_t* hops = nullptr;     // injections on both machines
+        size_t hopCap = 0;
+        size_t injected = 0;
+        size_t echoes = 0;
+
+        void capture(const EventPacket& pkt) {
+            if (filtering && filter.takeEcho(pkt, test::nowMicroseconds())) {
+                ++echoes;
+                return;
+            }
+            if (*hops < hopCap) {
+                out->send(pkt);
+            }
+        }
+
+        void inject(const EventPacket& pkt) {
+            filter.note(pkt, test::nowMicroseconds());
+            ++injected;
+            ++*hops;
+            // The injector rescales positions, so capture sees a different one
+            EventPacket seen = pkt;
+            int32_t x = 0;
+            int32_t y = 0;
+            if (readMouseMove(pkt, x, y)) {
+                seen = makeMouseMovePacket(pkt.timestamp, x * 2, y * 2);
+            }
+            capture(seen);
+        }
+    };
+
+    // Connects a to b and b to a, then captures `real` on a. Returns the
+    // injections on both machines once nothing is left in flight.
+    size_t storm(bool filtering, const std::vector<EventPacket>& real, Machine& a, Machine& b) {
+        boost::asio::io_context io;
+        MemoryTransport::Pair ab = MemoryTransport::connect(io, io);
+        MemoryTransport::Pair ba = MemoryTransport::connect(io, io);
+        size_t hops = 0;
+        std::vector<std::shared_ptr<Session>> sessions;
+        auto wire = [&](Machine& from, Machine& to, MemoryTransport::Pair& ends) {
+            from.out = std::make_shared<Session>(std::move(ends.first), kProtocolV2);
+            auto server = std::make_shared<Session>(std::move(ends.second), kProtocolV2);
+            from.out->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+            server->start([&to](const EventPacket& pkt) { to.inject(pkt); }, [](const boost::system::error_code&) {});
+            sessions.push_back(server);
+        };
+        for (Machine* m : {&a, &b}) {
+            m->filtering = filtering;
+            m->hops = &hops;
+            m->hopCap = 64;
+        }
+        wire(a, b, ab);
+        wire(b, a, ba);
+        for (const EventPacket& pkt : real) {
+            a.capture(pkt);
+        }
+        io.run_for(std::chrono::milliseconds(200));
+        for (Machine* m : {&a, &b}) {
+            m->out->close();
+        }
+        for (auto& server : sessions) {
+            server->close();
+        }
+        io.restart();
+        io.poll();
+        return hops;
+    }
+}
+
+static void test_take_once() {
+    EchoFilter filter;
+    uint64_t now = test::nowMicroseconds();
+    filter.note(key(SamenessEventType::KeyPress, VC_A), now);
+    CHECK(!filter.takeEcho(key(SamenessEventType::KeyRelease, VC_A), now));
+    CHECK(!filter.takeEcho(key(SamenessEventType::KeyPress, VC_B), now));
+    CHECK(filter.takeEcho(key(SamenessEventType::KeyPress, VC_A), now + 1000));
+    // The injection was used up; a real press of the same key goes through
+    CHECK(!filter.takeEcho(key(SamenessEventType::KeyPress, VC_A), now + 2000));
+
+    // Any injected move covers one captured move, wherever it lands
+    filter.note(makeMouseMovePacket(1, 10, 10), now);
+    CHECK(filter.takeEcho(makeMouseMovePacket(1, 640, 480), now));
+    CHECK(!filter.takeEcho(makeMouseMovePacket(1, 640, 480), now));
+
+    filter.note(makeMouseButtonPacket(SamenessEventType::MouseButtonPress, 1, MOUSE_BUTTON1, 0, 0), now);
+    CHECK(!filter.takeEcho(makeMouseButtonPacket(SamenessEventType::MouseButtonPress, 1, MOUSE_BUTTON2, 0, 0), now));
+    CHECK(filter.takeEcho(makeMouseButtonPacket(SamenessEventType::MouseButtonPress, 1, MOUSE_BUTTON1, 5, 5), now));
+}
+
+static void test_window() {
+    EchoFilter filter(100);
+    uint64_t now = test::nowMicroseconds();
+    filter.note(key(SamenessEventType::KeyPress, VC_A), now);
+    CHECK(!filter.takeEcho(key(SamenessEventType::KeyPress, VC_A), now + 150 * 1000));
+}
+
+// Text is only noted where the injector types it as key strokes
+static void test_text() {
+    EchoFilter filter;
+    uint64_t now = test::nowMicroseconds();
+    filter.note(makeTextPackets(1, "aB")[0], now);
+#if defined(__APPLE__) || defined(_WIN32)
+    CHECK(!filter.takeEcho(key(SamenessEventType::KeyPress, VC_A), now));
+    return;
+#endif
+    for (const EventPacket& pkt : {key(SamenessEventType::KeyPress, VC_A), key(SamenessEventType::KeyRelease, VC_A),
+                                   key(SamenessEventType::KeyPress, VC_SHIFT_L), key(SamenessEventType::KeyPress, VC_B),
+                                   key(SamenessEventType::KeyRelease, VC_B), key(SamenessEventType::KeyRelease, VC_SHIFT_L)}) {
+        CHECK(filter.takeEcho(pkt, now));
+    }
+}
+
+// A server process notes, a client process on the same machine takes
+static void test_shared() {
+#if !defined(_WIN32)
+    std::string name = "/sameness-echo-test-" + std::to_string(getpid());
+    shm_unlink(name.c_str());
+    {
+        EchoFilter injector;
+        EchoFilter capturer;
+        CHECK(injector.attachShared(name));
+        CHECK(capturer.attachShared(name));
+        uint64_t now = test::nowMicroseconds();
+        injector.note(key(SamenessEventType::KeyPress, VC_Q), now);
+        CHECK(capturer.takeEcho(key(SamenessEventType::KeyPress, VC_Q), now));
+        CHECK(!injector.takeEcho(key(SamenessEventType::KeyPress, VC_Q), now));
+    }
+    shm_unlink(name.c_str());
+#endif
+}
+
+// Injection and capture run on different threads with no lock between them
+static void test_concurrent() {
+    constexpr size_t kEvents = 2000;
+    EchoFilter filter;
+    std::atomic<size_t> noted{0};
+    std::thread injector([&]() {
+        for (size_t i = 0; i < kEvents; ++i) {
+            filter.note(key(SamenessEventType::KeyPress, 1 + i % 200), test::nowMicroseconds());
+            noted.store(i + 1, std::memory_order_release);
+        }
+    });
+    size_t taken = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (taken < kEvents && std::chrono::steady_clock::now() < deadline) {
+        if (taken >= noted.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+            continue;
+        }
+        CHECK(filter.takeEcho(key(SamenessEventType::KeyPress, 1 + taken % 200), test::nowMicroseconds()));
+        ++taken;
+    }
+    injector.join();
+    CHECK(taken == kEvents);
+    CHECK(!filter.takeEcho(key(SamenessEventType::KeyPress, 1), test::nowMicroseconds()));
+}
+
+static void test_loopback_storm() {
+    std::vector<EventPacket> real = {
+        makeMouseMovePacket(1, 100, 100),
+        key(SamenessEventType::KeyPress, VC_A),
+        key(SamenessEventType::KeyRelease, VC_A),
+    };
+
+    Machine a;
+    Machine b;
+    size_t hops = storm(true, real, a, b);
+    std::cout << "with the filter: " << hops << " injections, " << b.echoes << " echoes dropped" << std::endl;
+    CHECK(hops == real.size());
+    CHECK(a.injected == 0);
+    CHECK(b.injected == real.size());
+    CHECK(b.echoes == real.size());
+
+    // Without it every event goes round until the cap stops it
+    Machine c;
+    Machine d;
+    hops = storm(false, real, c, d);
+    std::cout << "without the filter: " << hops << " injections" << std::endl;
+    CHECK(hops >= 64);
+    CHECK(c.injected > 0 && d.injected > 0);
+}
+
+int main() {
+    test_take_once();
+    test_window();
+    test_text();
+    test_shared();
+    test_concurrent();
+    test_loopback_storm();
+    std::cout << "echo_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,228 @@
+// evdev capture: whatever a device has buffered comes out as one batch with
+// its kernel timestamps, keycodes match libuiohook's, motion is summed per
+// report and kept in bounds, and a grabbed device feeds nobody else. The
+// last part needs /dev/uinput and is skipped where it is missing.
+
+#include "EvdevCapture.h"
+#include "TestSupport.h"
+#include <cstring>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace {
+    input_event record(uint64_t us, uint16_t type, uint16_t code, int32_t value) {
+        input_event ev{};
+        ev.input_event_sec = us / 1000000;
+        ev.input_event_usec = us % 1000000;
+        ev.type = type;
+        ev.code = code;
+        ev.value = value;
+        return ev;
+    }
+
+    void writeAll(int fd, const std::vector<input_event>& events) {
+        const char* data = reinterpret_cast<const char*>(events.data());
+        size_t left = events.size() * sizeof(input_event);
+        while (left > 0) {
+            ssize_t n = ::write(fd, data, left);
+            CHECK(n > 0);
+            data += n;
+            left -= static_cast<size_t>(n);
+        }
+    }
+
+    // Polls until `want` events have arrived or a second has passed.
+    std::vector<EvdevCapture::Captured> collect(EvdevCapture& capture, size_t want, size_t* batches = nullptr) {
+        std::vector<EvdevCapture::Captured> got;
+        uint64_t deadline = test::nowMicroseconds() + 1000000;
+        while (got.size() < want && test::nowMicroseconds() < deadline) {
+            capture.poll(10, [&](const EvdevCapture::Captured* events, size_t count) {
+                got.insert(got.end(), events, events + count);
+                if (batches) {
+                    ++*batches;
+                }
+            });
+        }
+        return got;
+    }
+
+    // A keyboard-and-mouse device made through uinput; -1 without it.
+    struct VirtualDevice {
+        int fd = -1;
+        std::string path;
+
+        VirtualDevice() {
+            fd = ::open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            ioctl(fd, UI_SET_EVBIT, EV_KEY);
+            ioctl(fd, UI_SET_EVBIT, EV_REL);
+            for (int key = KEY_ESC; key <= KEY_KPDOT; ++key) {
+                ioctl(fd, UI_SET_KEYBIT, key);
+            }
+            ioctl(fd, UI_SET_KEYBIT, BTN_LEFT);
+            ioctl(fd, UI_SET_RELBIT, REL_X);
+            ioctl(fd, UI_SET_RELBIT, REL_Y);
+            uinput_setup setup{};
+            setup.id.bustype = BUS_VIRTUAL;
+            std::strcpy(setup.name, "sameness evdev_test");
+            char sysname[64] = {};
+            if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0 ||
+                ioctl(fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0) {
+                ::close(fd);
+                fd = -1;
+                return;
+            }
+            // The event node is the one child of the sysfs input device
+            std::string dir = std::string("/sys/devices/virtual/input/") + sysname;
+            for (int n = 0; n < 1024 && path.empty(); ++n) {
+                if (::access((dir + "/event" + std::to_string(n)).c_str(), F_OK) == 0) {
+                    path = "/dev/input/event" + std::to_string(n);
+                }
+            }
+            // udev may still be creating the node
+            for (int i = 0; i < 100 && ::access(path.c_str(), R_OK) != 0; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        ~VirtualDevice() {
+            if (fd >= 0) {
+                ioctl(fd, UI_DEV_DESTROY);
+                ::close(fd);
+            }
+        }
+
+        void emit(uint16_t type, uint16_t code, int32_t value) {
+            input_event ev = record(0, type, code, value);
+            CHECK(::write(fd, &ev, sizeof(ev)) == static_cast<ssize_t>(sizeof(ev)));
+        }
+    };
+}
+
+static void test_batch_from_pipe() {
+    int fds[2];
+    CHECK(::pipe(fds) == 0);
+    EvdevCapture capture(3840, 1080);
+    capture.adopt(fds[0], "pipe");
+    capture.setPosition(100, 100);
+
+    writeAll(fds[1], {
+        record(5000001, EV_KEY, KEY_A, 1),
+        record(5000001, EV_SYN, SYN_REPORT, 0),
+        record(5000002, EV_KEY, KEY_A, 2),              // autorepeat
+        record(5000003, EV_KEY, KEY_A, 0),
+        record(5000003, EV_KEY, KEY_RIGHTCTRL, 1),
+        record(5000003, EV_KEY, KEY_UP, 1),
+        record(5000003, EV_KEY, KEY_102ND, 1),
+        record(5000003, EV_SYN, SYN_REPORT, 0),
+        record(5008000, EV_REL, REL_X, 10),
+        record(5008000, EV_REL, REL_Y, -4),
+        record(5008000, EV_REL, REL_X, 5),
+        record(5008000, EV_SYN, SYN_REPORT, 0),
+        record(5009000, EV_KEY, BTN_RIGHT, 1),
+        record(5009000, EV_SYN, SYN_REPORT, 0),
+    });
+    size_t batches = 0;
+    std::vector<EvdevCapture::Captured> got = collect(capture, 7, &batches);
+    CHECK(batches == 1);
+    CHECK(got.size() == 7);
+
+    CHECK(got[0].event.type == EVENT_KEY_PRESSED && got[0].event.data.keyboard.keycode == VC_A);
+    CHECK(got[0].timestampUs == 5000001);
+    CHECK(got[1].event.type == EVENT_KEY_RELEASED && got[1].event.data.keyboard.keycode == VC_A);
+    CHECK(got[1].timestampUs == 5000003);
+    CHECK(got[2].event.data.keyboard.keycode == VC_CONTROL_R);
+    CHECK(got[3].event.data.keyboard.keycode == VC_UP);
+    CHECK(got[4].event.data.keyboard.keycode == VC_LESSER_GREATER);
+    // Three motion records, one move
+    CHECK(got[5].event.type == EVENT_MOUSE_MOVED);
+    CHECK(got[5].event.data.mouse.x == 115 && got[5].event.data.mouse.y == 96);
+    CHECK(got[5].timestampUs == 5008000);
+    CHECK(got[6].event.type == EVENT_MOUSE_PRESSED && got[6].event.data.mouse.button == MOUSE_BUTTON2);
+    CHECK(got[6].event.data.mouse.x == 115 && got[6].event.data.mouse.y == 96);
+
+    // Pointer stays in bounds; a report cut short by SYN_DROPPED is discarded
+    writeAll(fds[1], {
+        record(6000000, EV_REL, REL_X, 100000),
+        record(6000000, EV_REL, REL_Y, -100000),
+        record(6000000, EV_SYN, SYN_REPORT, 0),
+        record(6000001, EV_KEY, KEY_B, 1),
+        record(6000002, EV_SYN, SYN_DROPPED, 0),
+        record(6000002, EV_REL, REL_X, -50),
+        record(6000002, EV_KEY, KEY_C, 1),
+        record(6000003, EV_SYN, SYN_REPORT, 0),
+        record(6000004, EV_KEY, KEY_D, 1),
+        record(6000004, EV_SYN, SYN_REPORT, 0),
+    });
+    got = collect(capture, 3);
+    CHECK(got.size() == 3);
+    CHECK(got[0].event.data.mouse.x == 3839 && got[0].event.data.mouse.y == 0);
+    CHECK(got[1].event.data.keyboard.keycode == VC_B);
+    CHECK(got[2].event.data.keyboard.keycode == VC_D);
+    CHECK(capture.x() == 3839);
+
+    // The writer going away removes the device
+    ::close(fds[1]);
+    collect(capture, 1);
+    CHECK(capture.deviceCount() == 0);
+}
+
+static void test_stop() {
+    EvdevCapture capture(100, 100);
+    std::thread runner([&]() { capture.run([](const EvdevCapture::Captured*, size_t) {}); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    capture.stop();
+    runner.join();
+}
+
+static void test_uinput_device() {
+    VirtualDevice device;
+    if (device.fd < 0 || device.path.empty()) {
+        std::cout << "evdev_test: /dev/uinput unavailable, skipping virtual device test" << std::endl;
+        return;
+    }
+    EvdevCapture capture(3840, 1080);
+    EvdevCapture bystander(3840, 1080);
+    capture.open(device.path);
+    bystander.open(device.path);
+    capture.setPosition(0, 0);
+
+    uint64_t before = test::nowMicroseconds();
+    device.emit(EV_KEY, KEY_Q, 1);
+    device.emit(EV_KEY, KEY_Q, 0);
+    device.emit(EV_REL, REL_X, 7);
+    device.emit(EV_SYN, SYN_REPORT, 0);
+    std::vector<EvdevCapture::Captured> got = collect(capture, 3);
+    CHECK(got.size() == 3);
+    CHECK(got[0].event.data.keyboard.keycode == VC_Q);
+    CHECK(got[2].event.type == EVENT_MOUSE_MOVED && got[2].event.data.mouse.x == 7);
+    // Kernel timestamps share the steady clock's timebase
+    CHECK(got[0].timestampUs >= before && got[0].timestampUs <= test::nowMicroseconds());
+    CHECK(collect(bystander, 3).size() == 3);
+
+    // Grabbed: only the grabbing capture sees input
+    CHECK(capture.setGrab(true));
+    device.emit(EV_KEY, KEY_W, 1);
+    device.emit(EV_SYN, SYN_REPORT, 0);
+    CHECK(collect(capture, 1).size() == 1);
+    CHECK(collect(bystander, 1).empty());
+
+    CHECK(capture.setGrab(false));
+    device.emit(EV_KEY, KEY_W, 0);
+    device.emit(EV_SYN, SYN_REPORT, 0);
+    CHECK(collect(capture, 1).size() == 1);
+    CHECK(collect(bystander, 1).size() == 1);
+}
+
+int main() {
+    test_batch_from_pipe();
+    test_stop();
+    test_uinput_device();
+    std::cout << "evdev_test passed" << std::endl;
+    return 0;
+}
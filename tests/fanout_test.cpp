@@ -0,0 +1,174 @@
+// Broadcast to N loopback targets: every target sees every key in order, one
+// stalled target does not hold up the rest, and throughput/latency are
+// reported for 1, 8 and 64 targets.
+
+#include "SessionGroup.h"
+#include "Stats.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <list>
+
+namespace {
+    struct Target {
+        test::LoopbackTls tls;
+        std::shared_ptr<Session> server;
+        std::shared_ptr<Session> client;
+        std::atomic<uint32_t> keys{0};
+        std::atomic<int32_t> lastX{-1};
+        bool inOrder = true;
+
+        Target(boost::asio::io_context& serverIo, boost::asio::io_context& clientIo)
+            : tls(serverIo, clientIo)
+            , server(std::make_shared<Session>(std::move(tls.server), kProtocolV2))
+            , client(std::make_shared<Session>(std::move(tls.client), kProtocolV2)) {
+        }
+    };
+
+    // All servers on one thread and all clients on another, like the real client
+    struct Room {
+        boost::asio::io_context serverIo, clientIo;
+        // Servers may be started after the threads are (see test_stalled_target)
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> serverWork =
+            boost::asio::make_work_guard(serverIo);
+        std::list<Target> targets;
+        SessionGroup group;
+        std::thread serverThread, clientThread;
+        std::vector<uint64_t> latencies;       // only touched on the server thread
+
+        explicit Room(size_t n, bool startServers = true) {
+            for (size_t i = 0; i < n; ++i) {
+                targets.emplace_back(serverIo, clientIo);
+                Target& t = targets.back();
+                if (startServers) {
+                    startServer(t);
+                }
+                t.client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+                group.add(t.client);
+            }
+            serverThread = std::thread([this]() { serverIo.run(); });
+            clientThread = std::thread([this]() { clientIo.run(); });
+        }
+
+        void startServer(Target& t) {
+            t.server->start([this, &t](const EventPacket& pkt) {
+                uint32_t code = 0;
+                int32_t x = 0, y = 0;
+                if (pkt.type == SamenessEventType::KeyPress && readKey(pkt, code)) {
+                    t.inOrder = t.inOrder && code == t.keys;
+                    ++t.keys;
+                    latencies.push_back(test::nowMicroseconds() - pkt.timestamp);
+                } else if (pkt.type == SamenessEventType::MouseMove && readMouseMove(pkt, x, y)) {
+                    t.lastX = x;
+                }
+            }, [](const boost::system::error_code&) {});
+        }
+
+        bool allHaveKeys(uint32_t n, size_t skip = 0) const {
+            size_t i = 0;
+            for (const Target& t : targets) {
+                if (i++ >= skip && t.keys < n) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void shutdown() {
+            group.closeAll();
+            for (Target& t : targets) {
+                t.server->close();
+            }
+            serverWork.reset();
+            clientThread.join();
+            serverThread.join();
+        }
+    };
+
+    bool waitFor(const std::function<bool()>& cond, uint64_t timeoutUs = 10000000) {
+        uint64_t deadline = test::nowMicroseconds() + timeoutUs;
+        while (!cond()) {
+            if (test::nowMicroseconds() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        return true;
+    }
+}
+
+static void measure(size_t n) {
+    Room room(n);
+    constexpr uint32_t kKeys = 4000;
+    constexpr uint32_t kWindow = 256;     // keys in flight before the sender waits
+
+    uint64_t start = test::nowMicroseconds();
+    for (uint32_t i = 0; i < kKeys; ++i) {
+        if (i >= kWindow) {
+            CHECK(waitFor([&]() { return room.allHaveKeys(i - kWindow); }));
+        }
+        room.group.send(makeKeyPacket(SamenessEventType::KeyPress, test::nowMicroseconds(), i));
+    }
+    CHECK(waitFor([&]() { return room.allHaveKeys(kKeys); }));
+    double seconds = (test::nowMicroseconds() - start) / 1e6;
+
+    room.shutdown();
+    for (const Target& t : room.targets) {
+        CHECK(t.inOrder && t.keys == kKeys);
+    }
+    std::cout << n << " targets: " << static_cast<uint64_t>(kKeys / seconds) << " events/s, "
+              << static_cast<uint64_t>(kKeys * n / seconds) << " deliveries/s" << std::endl;
+    test::printLatency(std::to_string(n) + " targets: key latency", room.latencies);
+}
+
+// One target stops reading. Its socket buffers fill, its session coalesces
+// motion, and the others keep getting everything promptly.
+static void test_stalled_target() {
+    Room room(4, false);
+    size_t i = 0;
+    for (Target& t : room.targets) {
+        if (i++ > 0) {
+            room.startServer(t);
+        }
+    }
+    Target& stalled = room.targets.front();
+    boost::system::error_code ec;
+    stalled.server->transport().socket()->set_option(boost::asio::socket_base::receive_buffer_size(4096), ec);
+
+    uint64_t coalescedBefore = stats::snapshot(stats::block()).coalescedMoves;
+    constexpr int32_t kMoves = 100000;
+    uint64_t start = test::nowMicroseconds();
+    for (int32_t x = 1; x <= kMoves; ++x) {
+        room.group.send(makeMouseMovePacket(test::nowMicroseconds(), x, 0));
+        if (x % 1000 == 0) {
+            room.group.send(makeKeyPacket(SamenessEventType::KeyPress, test::nowMicroseconds(), x / 1000 - 1));
+        }
+    }
+    uint64_t sendUs = test::nowMicroseconds() - start;
+    CHECK(waitFor([&]() { return room.allHaveKeys(kMoves / 1000, 1); }));
+    CHECK(waitFor([&]() {
+        size_t j = 0;
+        for (const Target& t : room.targets) {
+            if (j++ > 0 && t.lastX != kMoves) {
+                return false;
+            }
+        }
+        return true;
+    }));
+    uint64_t coalesced = stats::snapshot(stats::block()).coalescedMoves - coalescedBefore;
+    std::cout << "stalled target: " << kMoves << " moves sent in " << sendUs / 1000 << " ms, "
+              << coalesced << " coalesced, stalled peer saw " << stalled.keys << " keys" << std::endl;
+    CHECK(coalesced > 0);
+    test::printLatency("stalled target: key latency at healthy targets", room.latencies);
+    CHECK(test::percentile(room.latencies, 99) < 100000);
+
+    room.shutdown();
+}
+
+int main() {
+    for (size_t n : {1, 8, 64}) {
+        measure(n);
+    }
+    test_stalled_target();
+    std::cout << "fanout_test passed" << std::endl;
+    return 0;
+}
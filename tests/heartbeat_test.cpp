@@ -0,0 +1,124 @@
+// Heartbeats keep an idle session alive; a dead server hands control back to
+// the host within the configured deadline.
+
+#include "ScreenEdgeSwitcher.h"
+#include "Session.h"
+#include "TestSupport.h"
+#include <atomic>
+
+using std::chrono::milliseconds;
+
+namespace {
+    constexpr milliseconds kDeadline(100);
+
+    struct Pair {
+        boost::asio::io_context serverIo, clientIo;
+        test::LoopbackTls tls{serverIo, clientIo};
+        std::shared_ptr<Session> server = std::make_shared<Session>(std::move(tls.server), kProtocolV2);
+        std::shared_ptr<Session> client = std::make_shared<Session>(std::move(tls.client), kProtocolV2);
+        std::thread serverThread, clientThread;
+
+        void run() {
+            serverThread = std::thread([this]() { serverIo.run(); });
+            clientThread = std::thread([this]() { clientIo.run(); });
+        }
+    };
+}
+
+static void test_idle_session_survives() {
+    Pair p;
+    std::atomic<int> closes{0};
+    for (auto* s : {&p.server, &p.client}) {
+        (*s)->setHeartbeat(kDeadline);
+        (*s)->start([](const EventPacket&) { CHECK(!"heartbeats are not delivered"); },
+                    [&](const boost::system::error_code&) { ++closes; });
+    }
+    p.run();
+    std::this_thread::sleep_for(kDeadline * 5);
+    CHECK(closes == 0);
+
+    p.client->close();
+    p.server->close();
+    p.clientThread.join();
+    p.serverThread.join();
+}
+
+// The server stops responding without closing its socket (crash behind NAT,
+// pulled cable): only the deadline can notice.
+static void test_silent_server_restores_host() {
+    Pair p;
+    ScreenEdgeSwitcher switcher(1920, 1080);
+    switcher.update(1919, 500);
+    CHECK(switcher.isClientControlled());
+
+    std::atomic<uint64_t> restoredAt{0};
+    boost::system::error_code closeReason;
+    p.server->setHeartbeat(kDeadline);
+    p.server->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+    p.client->setHeartbeat(kDeadline);
+    p.client->start([](const EventPacket&) {}, [&](const boost::system::error_code& ec) {
+        switcher.forceHost();
+        closeReason = ec;
+        restoredAt = test::nowMicroseconds();
+    });
+    p.run();
+    std::this_thread::sleep_for(kDeadline * 2);
+    CHECK(switcher.isClientControlled());
+
+    uint64_t killedAt = test::nowMicroseconds();
+    p.serverIo.stop();
+    p.serverThread.join();
+
+    p.clientThread.join();   // the client's io_context runs out of work once the session fails
+    CHECK(!switcher.isClientControlled());
+    CHECK(closeReason == boost::asio::error::timed_out);
+    uint64_t restoreUs = restoredAt - killedAt;
+    std::cout << "silent server: host restored after " << restoreUs / 1000 << " ms (deadline "
+              << kDeadline.count() << " ms)" << std::endl;
+    // The last heartbeat may have arrived up to one interval before the kill.
+    CHECK(restoreUs >= static_cast<uint64_t>((kDeadline / 2).count()) * 1000);
+    CHECK(restoreUs <= static_cast<uint64_t>((kDeadline * 3).count()) * 1000);
+
+    p.serverIo.restart();
+    p.server->close();
+    p.serverIo.run();
+}
+
+// A server process that exits closes its socket; that is noticed at once.
+static void test_closed_server_restores_host() {
+    Pair p;
+    ScreenEdgeSwitcher switcher(1920, 1080);
+    switcher.update(1919, 500);
+
+    std::atomic<uint64_t> restoredAt{0};
+    p.server->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+    p.client->setHeartbeat(kDeadline * 10);
+    p.client->start([](const EventPacket&) {}, [&](const boost::system::error_code&) {
+        switcher.forceHost();
+        restoredAt = test::nowMicroseconds();
+    });
+    p.run();
+    std::this_thread::sleep_for(kDeadline);
+
+    uint64_t killedAt = test::nowMicroseconds();
+    boost::asio::post(p.serverIo, [&]() {
+        boost::system::error_code ignored;
+        p.server->transport().socket()->close(ignored);
+    });
+    p.clientThread.join();
+    CHECK(!switcher.isClientControlled());
+    uint64_t restoreUs = restoredAt - killedAt;
+    std::cout << "closed server: host restored after " << restoreUs << " us" << std::endl;
+    CHECK(restoreUs < static_cast<uint64_t>(kDeadline.count()) * 1000);
+
+    p.server->close();
+    p.serverThread.join();
+}
+
+int main() {
+    test_idle_session_survives();
+    test_silent_server_restores_host();
+    test_closed_server_restores_host();
+    std::cout << "heartbeat_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,161 @@
+// The injection queue delivers input in order on its own thread, collapses
+// motion rather than keys when the injector falls behind, and never makes the
+// network thread wait for the injector.
+
+#include "InjectionQueue.h"
+#include "Stats.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace {
+    // Event i of a test stream: every tenth a key, the rest pointer motion.
+    // Keycode or x carries i, so the order received can be checked.
+    EventPacket streamEvent(int i) {
+        if (i % 10 == 9) {
+            auto type = (i / 10) % 2 ? SamenessEventType::KeyRelease : SamenessEventType::KeyPress;
+            return makeKeyPacket(type, i, static_cast<uint32_t>(i));
+        }
+        return makeMouseMovePacket(i, i, 2 * i);
+    }
+
+    int sequenceOf(const EventPacket& pkt) {
+        uint32_t code;
+        int32_t x, y;
+        if (readKey(pkt, code)) {
+            return static_cast<int>(code);
+        }
+        CHECK(readMouseMove(pkt, x, y));
+        CHECK(y == 2 * x);
+        return x;
+    }
+
+    struct Collector {
+        std::mutex mutex;
+        std::vector<EventPacket> received;
+        std::vector<size_t> batches;
+        std::thread::id thread;
+
+        InjectionQueue::BatchHandler handler() {
+            return [this](const EventPacket* packets, size_t count) {
+                std::lock_guard<std::mutex> lock(mutex);
+                thread = std::this_thread::get_id();
+                received.insert(received.end(), packets, packets + count);
+                batches.push_back(count);
+            };
+        }
+    };
+}
+
+static void test_order_and_batches() {
+    Collector c;
+    InjectionQueue queue(4096);
+    queue.start(c.handler());
+    const int kEvents = 2000;
+    for (int i = 0; i < kEvents; ++i) {
+        CHECK(queue.push(streamEvent(i)));
+    }
+    queue.stop();
+
+    CHECK(c.received.size() == size_t(kEvents));
+    CHECK(c.thread != std::this_thread::get_id());
+    for (int i = 0; i < kEvents; ++i) {
+        CHECK(c.received[i].type == streamEvent(i).type);
+        CHECK(c.received[i].timestamp == uint64_t(i));
+        CHECK(sequenceOf(c.received[i]) == i);
+    }
+    for (size_t n : c.batches) {
+        CHECK(n >= 1 && n <= InjectionQueue::kMaxBatch);
+    }
+    std::cout << "  " << kEvents << " events in " << c.batches.size() << " batches" << std::endl;
+
+    // Not input: refused, nothing queued
+    EventPacket offer;
+    offer.type = SamenessEventType::ClipboardOffer;
+    CHECK(!queue.push(offer));
+}
+
+// A stalled injector: the ring fills, the producer keeps going, motion
+// collapses and every key arrives in order once the injector recovers.
+static void test_overflow_keeps_keys() {
+    Collector c;
+    std::mutex gate;
+    std::unique_lock<std::mutex> stalled(gate);
+    std::atomic<bool> space{false};
+
+    InjectionQueue queue(16);
+    queue.setSpaceHandler([&space]() { space = true; });
+    auto collect = c.handler();
+    queue.start([&](const EventPacket* packets, size_t count) {
+        std::lock_guard<std::mutex> wait(gate);
+        collect(packets, count);
+    });
+
+    uint64_t coalescedBefore = stats::snapshot(stats::block()).coalescedMoves;
+    const int kEvents = 5000;
+    uint64_t start = test::nowMicroseconds();
+    for (int i = 0; i < kEvents; ++i) {
+        CHECK(queue.push(streamEvent(i)));
+    }
+    uint64_t pushUs = test::nowMicroseconds() - start;
+    CHECK(queue.depth() > 16);
+
+    // Recover; the space handler stands in for a post to the network thread
+    stalled.unlock();
+    while (queue.depth() > 0) {
+        if (space.exchange(false)) {
+            queue.retry();
+        }
+        std::this_thread::yield();
+    }
+    queue.stop();
+
+    uint64_t coalesced = stats::snapshot(stats::block()).coalescedMoves - coalescedBefore;
+    std::cout << "  stalled injector: " << kEvents << " pushed in " << pushUs << " us, "
+              << c.received.size() << " injected, " << coalesced << " moves collapsed" << std::endl;
+    CHECK(coalesced > 0);
+    CHECK(c.received.size() + coalesced == size_t(kEvents));
+
+    int keys = 0;
+    int last = -1;
+    for (const EventPacket& pkt : c.received) {
+        int seq = sequenceOf(pkt);
+        CHECK(seq > last);
+        last = seq;
+        keys += pkt.type != SamenessEventType::MouseMove;
+    }
+    CHECK(keys == kEvents / 10);
+    CHECK(last == kEvents - 1);     // the final position always lands
+}
+
+static void test_wait_metrics() {
+    stats::Snapshot before = stats::snapshot(stats::block());
+    InjectionQueue queue(64);
+    queue.start([](const EventPacket*, size_t) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    });
+    // The first event keeps the injector busy while the rest queue up
+    queue.push(streamEvent(0));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    for (int i = 1; i < 40; ++i) {
+        queue.push(streamEvent(i));
+    }
+    queue.stop();
+    stats::Snapshot after = stats::snapshot(stats::block());
+
+    uint64_t queued = after.injectQueued - before.injectQueued;
+    uint64_t waitedUs = (after.injectWaitNanos - before.injectWaitNanos) / 1000;
+    std::cout << "  40 events, average wait " << waitedUs / queued << " us" << std::endl;
+    CHECK(queued == 40);
+    CHECK(waitedUs / queued >= 500);
+    CHECK(after.gauges[static_cast<size_t>(stats::Gauge::InjectQueueDepth)] == 0);
+}
+
+int main() {
+    test_order_and_batches();
+    test_overflow_keeps_keys();
+    test_wait_metrics();
+    std::cout << "injection_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,149 @@
+// Jitter buffer playout: bursty arrivals come out with their capture spacing,
+// clean links add almost no delay, and flush() never reorders input.
+
+#include "JitterBuffer.h"
+#include "TestSupport.h"
+#include <cmath>
+#include <random>
+
+namespace {
+    constexpr uint64_t kCaptureSpacingUs = 8000;    // 125 Hz mouse
+    // The client's steady clock is unrelated to the server's
+    constexpr uint64_t kClientEpochUs = 5000000000ull;
+
+    struct Arrival {
+        uint64_t atUs;
+        EventPacket move;
+    };
+
+    // Runs arrivals through the buffer on a simulated clock and returns playout times.
+    std::vector<uint64_t> play(JitterBuffer& jb, const std::vector<Arrival>& arrivals,
+                               std::vector<uint64_t>* held = nullptr) {
+        std::vector<uint64_t> out;
+        size_t next = 0;
+        uint64_t now = arrivals.front().atUs;
+        while (next < arrivals.size() || jb.pending() > 0) {
+            while (next < arrivals.size() && arrivals[next].atUs <= now) {
+                jb.push(arrivals[next].move, now);
+                ++next;
+            }
+            EventPacket move;
+            uint64_t heldUs = 0;
+            while (jb.popDue(now, move, heldUs)) {
+                out.push_back(now);
+                if (held) {
+                    held->push_back(heldUs);
+                }
+            }
+            now += 100;
+        }
+        return out;
+    }
+
+    double gapStddevUs(const std::vector<uint64_t>& times, size_t skip) {
+        std::vector<double> gaps;
+        for (size_t i = skip + 1; i < times.size(); ++i) {
+            gaps.push_back(static_cast<double>(times[i] - times[i - 1]));
+        }
+        double mean = 0;
+        for (double g : gaps) mean += g;
+        mean /= gaps.size();
+        double var = 0;
+        for (double g : gaps) var += (g - mean) * (g - mean);
+        return std::sqrt(var / gaps.size());
+    }
+
+    EventPacket moveAt(size_t i) {
+        return makeMouseMovePacket(kClientEpochUs + i * kCaptureSpacingUs, static_cast<int32_t>(i), 0);
+    }
+}
+
+// Wi-Fi style delivery: moves are held back and released five at a time.
+static void test_bursts_are_smoothed() {
+    std::mt19937 rng(3);
+    std::vector<Arrival> arrivals;
+    const uint64_t serverStart = 1000000;
+    uint64_t release = 0;
+    for (size_t i = 0; i < 1000; ++i) {
+        if (i % 5 == 0) {
+            release = serverStart + (i + 4) * kCaptureSpacingUs + 2000 + rng() % 3000;
+        }
+        arrivals.push_back({release, moveAt(i)});
+    }
+    std::vector<uint64_t> rawTimes;
+    for (const auto& a : arrivals) {
+        rawTimes.push_back(a.atUs);
+    }
+
+    JitterBuffer jb;
+    std::vector<uint64_t> held;
+    std::vector<uint64_t> played = play(jb, arrivals, &held);
+    CHECK(played.size() == arrivals.size());
+
+    double raw = gapStddevUs(rawTimes, 100);
+    double smoothed = gapStddevUs(played, 100);
+    std::vector<uint64_t> steadyHeld(held.begin() + 100, held.end());
+    std::cout << "bursty link: arrival gap stddev " << raw / 1000 << " ms, playout gap stddev "
+              << smoothed / 1000 << " ms, jitter " << jb.jitterUs() << " us, target delay "
+              << jb.targetDelayUs() << " us" << std::endl;
+    test::printLatency("bursty link: added delay", steadyHeld);
+    CHECK(smoothed < raw / 4);
+    CHECK(test::percentile(steadyHeld, 99) <= JitterBuffer::Config{}.maxDelayUs);
+}
+
+// A clean link should cost next to nothing.
+static void test_clean_link_adds_little_delay() {
+    std::vector<Arrival> arrivals;
+    for (size_t i = 0; i < 500; ++i) {
+        arrivals.push_back({1000000 + i * kCaptureSpacingUs + 1500, moveAt(i)});
+    }
+    JitterBuffer jb;
+    std::vector<uint64_t> held;
+    play(jb, arrivals, &held);
+    std::vector<uint64_t> steadyHeld(held.begin() + 50, held.end());
+    test::printLatency("clean link: added delay", steadyHeld);
+    CHECK(test::percentile(steadyHeld, 99) <= 200);
+}
+
+static void test_flush_returns_latest() {
+    JitterBuffer::Config cfg;
+    cfg.minDelayUs = 20000;
+    JitterBuffer jb(cfg);
+    for (size_t i = 0; i < 4; ++i) {
+        jb.push(moveAt(i), 1000000 + i * kCaptureSpacingUs);
+    }
+    uint64_t due = 0;
+    CHECK(jb.nextDue(due));
+    CHECK(due == 1000000 + cfg.minDelayUs);
+
+    EventPacket latest;
+    uint64_t heldUs = 0;
+    size_t dropped = 0;
+    CHECK(jb.flush(1000000 + 3 * kCaptureSpacingUs, latest, heldUs, dropped));
+    int32_t x = -1, y = -1;
+    CHECK(readMouseMove(latest, x, y) && x == 3);
+    CHECK(dropped == 3);
+    CHECK(jb.pending() == 0);
+    CHECK(!jb.flush(0, latest, heldUs, dropped));
+}
+
+static void test_max_pending() {
+    JitterBuffer::Config cfg;
+    cfg.minDelayUs = cfg.maxDelayUs;
+    cfg.maxPending = 8;
+    JitterBuffer jb(cfg);
+    for (size_t i = 0; i < 8; ++i) {
+        CHECK(jb.push(moveAt(i), 1000000));
+    }
+    CHECK(!jb.push(moveAt(8), 1000000));
+    CHECK(jb.pending() == 8);
+}
+
+int main() {
+    test_bursts_are_smoothed();
+    test_clean_link_adds_little_delay();
+    test_flush_returns_latest();
+    test_max_pending();
+    std::cout << "jitter_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Key rule parsing, hotkey chords, remaps and modifier tracking.
+
+#include "KeyRules.h"
+#include "TestSupport.h"
+#include <sstream>
+#include <stdexcept>
+#include <uiohook.h>
+
+static KeyAction press(KeyRules& rules, uint32_t& code) {
+    return rules.onKey(code, true);
+}
+
+static KeyAction release(KeyRules& rules, uint32_t& code) {
+    return rules.onKey(code, false);
+}
+
+static void load(KeyRules& rules, const char* text) {
+    std::istringstream in(text);
+    rules.load(in);
+}
+
+static void test_hotkey_chord() {
+    KeyRules rules;
+    load(rules,
+         "# switch back\n"
+         "hotkey ctrl+alt+h host\n"
+         "hotkey scroll_lock lock   # toggle\n");
+    CHECK(rules.hotkeyCount() == 2);
+
+    // Without the chord, h is forwarded untouched.
+    uint32_t h = VC_H;
+    CHECK(press(rules, h) == KeyAction::Forward && h == VC_H);
+    CHECK(release(rules, h) == KeyAction::Forward);
+
+    // Either side's modifiers complete the chord.
+    uint32_t ctrl = VC_CONTROL_R, alt = VC_ALT_L;
+    CHECK(press(rules, ctrl) == KeyAction::Forward);
+    CHECK(press(rules, alt) == KeyAction::Forward);
+    CHECK(rules.heldModifiers() == ((KeyRules::kCtrl << 4) | KeyRules::kAlt));
+    h = VC_H;
+    CHECK(press(rules, h) == KeyAction::SwitchToHost);
+    // Auto-repeat and the release of the hotkey key never reach the peer.
+    CHECK(press(rules, h) == KeyAction::Swallow);
+    CHECK(release(rules, h) == KeyAction::Swallow);
+    CHECK(release(rules, alt) == KeyAction::Forward);
+    CHECK(release(rules, ctrl) == KeyAction::Forward);
+    CHECK(rules.heldModifiers() == 0);
+
+    // Extra modifiers make it a different chord.
+    uint32_t shift = VC_SHIFT_L;
+    press(rules, ctrl);
+    press(rules, alt);
+    press(rules, shift);
+    h = VC_H;
+    CHECK(press(rules, h) == KeyAction::Forward);
+    release(rules, h);
+    release(rules, shift);
+    release(rules, alt);
+    release(rules, ctrl);
+
+    uint32_t scroll = VC_SCROLL_LOCK;
+    CHECK(press(rules, scroll) == KeyAction::ToggleLock);
+    CHECK(release(rules, scroll) == KeyAction::Swallow);
+}
+
+static void test_remap() {
+    KeyRules rules;
+    load(rules, "remap caps_lock ctrl\nremap 0x0E5B 0x38\n");
+    CHECK(rules.remapCount() == 2);
+
+    uint32_t caps = VC_CAPS_LOCK;
+    CHECK(press(rules, caps) == KeyAction::Forward && caps == VC_CONTROL_L);
+    caps = VC_CAPS_LOCK;
+    CHECK(release(rules, caps) == KeyAction::Forward && caps == VC_CONTROL_L);
+    // Remaps change what is forwarded, not the local modifier state.
+    CHECK(rules.heldModifiers() == 0);
+
+    uint32_t meta = VC_META_L;
+    CHECK(press(rules, meta) == KeyAction::Forward && meta == VC_ALT_L);
+    CHECK(rules.heldModifiers() == KeyRules::kMeta);
+    CHECK(rules.remapOf(KeyRules::modifierKeycode(2)) == VC_ALT_L);
+
+    // Reloading replaces the old rules.
+    load(rules, "");
+    caps = VC_CAPS_LOCK;
+    CHECK(press(rules, caps) == KeyAction::Forward && caps == VC_CAPS_LOCK);
+}
+
+static void test_bad_rules() {
+    const char* bad[] = {
+        "hotkey ctrl+h\n",                  // missing action
+        "hotkey ctrl+alt+nosuchkey host\n",
+        "hotkey h+ctrl host\n",             // key before modifier
+        "hotkey ctrl+h reboot\n",
+        "remap a\n",
+        "remap a 0x10000\n",
+        "swap a b\n",
+    };
+    for (const char* text : bad) {
+        KeyRules rules;
+        bool threw = false;
+        try {
+            load(rules, text);
+        } catch (const std::runtime_error& e) {
+            threw = std::string(e.what()).find("line 1") != std::string::npos;
+        }
+        CHECK(threw);
+    }
+}
+
+int main() {
+    test_hotkey_chord();
+    test_remap();
+    test_bad_rules();
+    std::cout << "keyrules_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,182 @@
+// Per-session memory under a multi-session load: once warm, receiving and
+// queueing allocate nothing per packet, every session's pool stays flat, and
+// resident memory per session is reported.
+
+#include "Stats.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <list>
+#include <new>
+
+// Heap allocations made on threads that opted in (the io threads below)
+static std::atomic<uint64_t> g_ioAllocations{0};
+static thread_local bool t_countAllocations = false;
+
+// Out of line so the compiler does not pair malloc/free with new/delete at call sites
+__attribute__((noinline)) void* operator new(size_t n) {
+    if (t_countAllocations) {
+        g_ioAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* p = std::malloc(n ? n : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+    struct Pair {
+        test::LoopbackTls tls;
+        std::shared_ptr<Session> server;
+        std::shared_ptr<Session> client;
+        std::atomic<uint32_t> received{0};
+
+        Pair(boost::asio::io_context& serverIo, boost::asio::io_context& clientIo, uint16_t version)
+            : tls(serverIo, clientIo)
+            , server(std::make_shared<Session>(std::move(tls.server), version))
+            , client(std::make_shared<Session>(std::move(tls.client), version)) {
+        }
+    };
+
+    size_t residentKb() {
+        std::ifstream statm("/proc/self/statm");
+        size_t pages = 0, resident = 0;
+        statm >> pages >> resident;
+        return resident * 4;
+    }
+
+    bool waitFor(const std::function<bool()>& cond, uint64_t timeoutUs = 20000000) {
+        uint64_t deadline = test::nowMicroseconds() + timeoutUs;
+        while (!cond()) {
+            if (test::nowMicroseconds() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return true;
+    }
+}
+
+// One round of traffic per pair: input of every kind plus a control message.
+static void sendRound(Pair& pair, uint32_t i) {
+    pair.client->send(makeMouseMovePacket(test::nowMicroseconds(), static_cast<int32_t>(i), 7));
+    pair.client->send(makeKeyPacket(SamenessEventType::KeyPress, test::nowMicroseconds(), i));
+    pair.client->send(makeKeyPacket(SamenessEventType::KeyRelease, test::nowMicroseconds(), i));
+    pair.client->send(makeMouseButtonPacket(SamenessEventType::MouseButtonPress, test::nowMicroseconds(), 1, 3, 4));
+    EventPacket offer;
+    offer.type = SamenessEventType::ClipboardOffer;     // digest and size
+    offer.timestamp = test::nowMicroseconds();
+    offer.payload.assign(40, static_cast<uint8_t>(i));
+    offer.payloadSize = static_cast<uint32_t>(offer.payload.size());
+    pair.client->send(offer);
+}
+
+static void test_sessions_under_load() {
+    constexpr size_t kPairs = 16;
+    constexpr uint32_t kWarmRounds = 500;
+    constexpr uint32_t kRounds = 5000;
+    constexpr uint32_t kPacketsPerRound = 5;
+
+    size_t rssBefore = residentKb();
+    boost::asio::io_context serverIo, clientIo;
+    std::list<Pair> pairs;
+    for (size_t i = 0; i < kPairs; ++i) {
+        pairs.emplace_back(serverIo, clientIo, i % 2 == 0 ? kProtocolV2 : kProtocolV1);
+        Pair& p = pairs.back();
+        p.server->start([&p](const EventPacket&) { ++p.received; }, [](const boost::system::error_code&) {});
+        p.client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+    }
+    std::thread serverThread([&]() {
+        t_countAllocations = true;
+        serverIo.run();
+    });
+    std::thread clientThread([&]() {
+        t_countAllocations = true;
+        clientIo.run();
+    });
+
+    auto runRounds = [&](uint32_t first, uint32_t count) {
+        for (uint32_t i = first; i < first + count; ++i) {
+            for (Pair& p : pairs) {
+                sendRound(p, i);
+            }
+            // Keep the backlog bounded so every round reuses the same memory
+            if (i % 50 == 0) {
+                CHECK(waitFor([&]() {
+                    for (Pair& p : pairs) {
+                        if (p.received < (i - first) * kPacketsPerRound) {
+                            return false;
+                        }
+                    }
+                    return true;
+                }));
+            }
+        }
+        CHECK(waitFor([&]() {
+            for (Pair& p : pairs) {
+                if (p.received != (first + count) * kPacketsPerRound) {
+                    return false;
+                }
+            }
+            return true;
+        }));
+    };
+
+    runRounds(0, kWarmRounds);
+    size_t rssWarm = residentKb();
+    std::vector<Session::MemoryStats> warm;
+    for (Pair& p : pairs) {
+        warm.push_back(p.server->memoryStats());
+        warm.push_back(p.client->memoryStats());
+    }
+    uint64_t ioAllocsBefore = g_ioAllocations.load();
+
+    runRounds(kWarmRounds, kRounds);
+    uint64_t ioAllocs = g_ioAllocations.load() - ioAllocsBefore;
+    uint64_t packets = static_cast<uint64_t>(kPairs) * kRounds * kPacketsPerRound;
+
+    size_t i = 0;
+    uint64_t poolAllocs = 0;
+    size_t peak = 0;
+    for (Pair& p : pairs) {
+        for (const auto& s : {p.server, p.client}) {
+            Session::MemoryStats now = s->memoryStats();
+            poolAllocs += now.allocations - warm[i].allocations;
+            peak = std::max(peak, now.peakBytes);
+            ++i;
+        }
+    }
+    std::cout << kPairs << " pairs, " << packets << " packets: " << ioAllocs << " heap allocations on io threads, "
+              << poolAllocs << " by session pools after warm-up" << std::endl;
+    std::cout << "per session: peak pool " << peak / 1024 << " KiB, resident "
+              << (rssWarm - rssBefore) / (2 * kPairs) << " KiB (TLS included)" << std::endl;
+
+    // The client io thread builds nothing per packet either: frames come from senders
+    CHECK(ioAllocs < packets / 100);
+    // A pool only grows when a deeper backlog than any before shows up, and
+    // that stops long before the traffic does
+    CHECK(poolAllocs < 2 * kPairs * 16);
+    CHECK(peak < 1024 * 1024);
+
+    for (Pair& p : pairs) {
+        p.client->close();
+        p.server->close();
+    }
+    serverThread.join();
+    clientThread.join();
+}
+
+int main() {
+    test_sessions_under_load();
+    std::cout << "memory_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,257 @@
+// Warm sessions: the pool connects every server in the background, puts a
+// dropped one back when it can, and backs off while it cannot. With the
+// session already up, the first event after a crossing reaches the server in
+// one network hop instead of a TCP connect, a TLS handshake and a version
+// negotiation.
+
+#include "PeerPool.h"
+#include "TestSupport.h"
+#include "Transport.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+    struct IoThread {
+        boost::asio::io_context io;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{io.get_executor()};
+        std::thread thread{[this]() { io.run(); }};
+
+        ~IoThread() {
+            io.stop();
+            thread.join();
+        }
+    };
+
+    // Servers reached over MemoryTransport; their ends are kept by address
+    struct FakeServers {
+        explicit FakeServers(boost::asio::io_context& context) : io(context) {}
+
+        boost::asio::io_context& io;
+        std::mutex mutex;
+        std::map<std::string, std::shared_ptr<Session>> servers;
+        std::map<std::string, int> refusals;    // attempts still to fail, per address
+        std::atomic<int> attempts{0};
+
+        std::shared_ptr<Session> connect(const std::string& address, Session::CloseHandler onClose) {
+            ++attempts;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (refusals[address] > 0) {
+                    --refusals[address];
+                    throw std::runtime_error("connection refused");
+                }
+            }
+            MemoryTransport::Pair ends = MemoryTransport::connect(io, io);
+            auto server = std::make_shared<Session>(std::move(ends.second));
+            auto client = std::make_shared<Session>(std::move(ends.first));
+            server->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+            client->start([](const EventPacket&) {}, std::move(onClose));
+            std::lock_guard<std::mutex> lock(mutex);
+            servers[address] = server;
+            return client;
+        }
+
+        void drop(const std::string& address) {
+            std::lock_guard<std::mutex> lock(mutex);
+            servers[address]->close();
+        }
+    };
+
+    PeerPool::Config fastRetry() {
+        PeerPool::Config config;
+        config.retryMin = std::chrono::milliseconds(10);
+        config.retryMax = std::chrono::milliseconds(40);
+        return config;
+    }
+
+    bool waitFor(const std::function<bool()>& condition) {
+        uint64_t deadline = test::nowMicroseconds() + 2000000;
+        while (!condition() && test::nowMicroseconds() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return condition();
+    }
+}
+
+static void test_connect_and_reconnect() {
+    IoThread io;
+    FakeServers fake(io.io);
+    SessionGroup group;
+    std::atomic<int> downs{0};
+    {
+        PeerPool pool(group, {"left", "right"}, [&fake](size_t, const std::string& address, PeerPool::Attempt&, Session::CloseHandler onClose) {
+            return fake.connect(address, std::move(onClose));
+        }, fastRetry());
+        pool.setDownHandler([&downs](size_t index) {
+            CHECK(index == 1);
+            ++downs;
+        });
+        pool.start();
+        CHECK(pool.waitConnected(std::chrono::seconds(2)) == 2);
+        CHECK(group.size() == 2);
+
+        fake.drop("right");
+        CHECK(waitFor([&]() { return downs == 1; }));
+        CHECK(pool.waitConnected(std::chrono::seconds(2)) == 2);
+        CHECK(group.size() == 2);
+        std::vector<PeerPool::Link> links = pool.links();
+        CHECK(links[0].address == "left" && links[0].connects == 1);
+        CHECK(links[1].address == "right" && links[1].connects == 2 && links[1].up);
+
+        pool.stop();
+        CHECK(group.size() == 2);   // left for the caller to close
+        group.closeAll();
+        CHECK(waitFor([&]() { return group.empty(); }));
+    }
+    CHECK(downs == 1);
+}
+
+static void test_backoff() {
+    IoThread io;
+    FakeServers fake(io.io);
+    fake.refusals["flaky"] = 4;
+    SessionGroup group;
+    PeerPool pool(group, {"flaky"}, [&fake](size_t, const std::string& address, PeerPool::Attempt&, Session::CloseHandler onClose) {
+        return fake.connect(address, std::move(onClose));
+    }, fastRetry());
+    uint64_t start = test::nowMicroseconds();
+    pool.start();
+    CHECK(pool.waitConnected(std::chrono::seconds(2)) == 1);
+    uint64_t elapsedUs = test::nowMicroseconds() - start;
+    // Waits of 10, 20, 40 and 40 ms: doubling, then held at retryMax
+    CHECK(elapsedUs >= 110000);
+    CHECK(fake.attempts == 5);
+    CHECK(pool.links()[0].failures == 4);
+    pool.stop();
+    group.closeAll();
+    waitFor([&]() { return group.empty(); });
+}
+
+// A server that takes the TCP connection but never answers the TLS handshake
+// costs only its own attempts, each cut off at connectTimeout, and stop()
+// does not wait for one under way.
+static void test_server_that_never_answers() {
+    IoThread io;
+    FakeServers fake(io.io);
+    // Listening, never accepting: the kernel completes the TCP handshake and
+    // the client's read then waits forever
+    boost::asio::io_context listenIo;
+    boost::asio::ip::tcp::acceptor silent(listenIo, {boost::asio::ip::address_v4::loopback(), 0});
+    boost::asio::ip::tcp::endpoint endpoint = silent.local_endpoint();
+    boost::asio::ssl::context tlsContext(boost::asio::ssl::context::tlsv12_client);
+
+    std::atomic<int> silentAttempts{0};
+    auto connector = [&](size_t index, const std::string& address, PeerPool::Attempt& attempt,
+                         Session::CloseHandler onClose) -> std::shared_ptr<Session> {
+        if (index == 1) {
+            return fake.connect(address, std::move(onClose));
+        }
+        ++silentAttempts;
+        TlsStream stream(io.io, tlsContext);
+        stream.lowest_layer().connect(endpoint);
+        PeerPool::Attempt::Watch watch(attempt, [&stream]() {
+            boost::system::error_code ignored;
+            stream.lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+        });
+        stream.handshake(boost::asio::ssl::stream_base::client);
+        throw std::runtime_error("the silent server answered");
+    };
+
+    SessionGroup group;
+    PeerPool::Config config = fastRetry();
+    config.connectTimeout = std::chrono::milliseconds(100);
+    {
+        PeerPool pool(group, {"silent", "good"}, connector, config);
+        uint64_t start = test::nowMicroseconds();
+        pool.start();
+        CHECK(waitFor([&]() { return pool.links()[1].up; }));
+        CHECK(test::nowMicroseconds() - start < 100000);
+        CHECK(waitFor([&]() { return pool.links()[0].failures >= 2; }));
+        CHECK(!pool.links()[0].up);
+        pool.stop();
+        group.closeAll();
+        CHECK(waitFor([&]() { return group.empty(); }));
+    }
+
+    config.connectTimeout = std::chrono::seconds(60);
+    silentAttempts = 0;
+    {
+        PeerPool pool(group, {"silent"}, connector, config);
+        pool.start();
+        CHECK(waitFor([&]() { return silentAttempts == 1; }));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));     // into the handshake
+        uint64_t start = test::nowMicroseconds();
+        pool.stop();
+        uint64_t stopUs = test::nowMicroseconds() - start;
+        std::cout << "stop() with an attempt blocked on a silent server: " << stopUs << " us" << std::endl;
+        CHECK(stopUs < 100000);
+        CHECK(pool.links()[0].failures == 1);
+    }
+}
+
+// The time from a crossing to the server handling the first event, with a
+// connection made at the crossing (cold) and with one kept warm.
+static void test_first_event_after_crossing() {
+    IoThread serverIo, clientIo;
+    std::atomic<uint64_t> injectedAt{0};
+    auto startServer = [&injectedAt](std::shared_ptr<Session> server) {
+        server->start([&injectedAt](const EventPacket&) { injectedAt = test::nowMicroseconds(); },
+                      [](const boost::system::error_code&) {});
+    };
+    auto waitInjected = [&injectedAt]() {
+        CHECK(waitFor([&]() { return injectedAt != 0; }));
+        uint64_t at = injectedAt;
+        injectedAt = 0;
+        return at;
+    };
+
+    std::vector<uint64_t> cold;
+    for (int round = 0; round < 20; ++round) {
+        uint64_t crossing = test::nowMicroseconds();
+        test::LoopbackTls tls(serverIo.io, clientIo.io);
+        std::vector<uint8_t> leftover;
+        uint16_t version = 0;
+        std::thread negotiation([&]() { version = negotiateServer(*tls.server, leftover); });
+        uint16_t clientVersion = negotiateClient(*tls.client);
+        negotiation.join();
+        auto server = std::make_shared<Session>(std::move(tls.server), version, std::move(leftover));
+        auto client = std::make_shared<Session>(std::move(tls.client), clientVersion);
+        startServer(server);
+        client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+        client->send(makeMouseMovePacket(crossing, 0, 500));
+        cold.push_back(waitInjected() - crossing);
+        client->close();
+        server->close();
+    }
+
+    std::vector<uint64_t> warm;
+    {
+        test::LoopbackTls tls(serverIo.io, clientIo.io);
+        auto server = std::make_shared<Session>(std::move(tls.server));
+        auto client = std::make_shared<Session>(std::move(tls.client));
+        startServer(server);
+        client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+        for (int round = 0; round < 200; ++round) {
+            uint64_t crossing = test::nowMicroseconds();
+            client->send(makeMouseMovePacket(crossing, 0, 500));
+            warm.push_back(waitInjected() - crossing);
+        }
+        client->close();
+        server->close();
+    }
+
+    test::printLatency("first event after a crossing, connecting then (TCP, TLS, hello)", cold);
+    test::printLatency("first event after a crossing, warm session", warm);
+    CHECK(test::percentile(warm, 50) * 5 < test::percentile(cold, 50));
+}
+
+int main() {
+    test_connect_and_reconnect();
+    test_backoff();
+    test_server_that_never_answers();
+    test_first_event_after_crossing();
+    std::cout << "peerpool_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,264 @@
+// The client→server pipeline without sockets: MemoryTransport delivers every
+// byte in order across threads, a session pair over it runs at full rate next
+// to TCP and TLS, and on one thread with a VirtualClock a run is exactly
+// repeatable, down to when the jitter buffer plays each move.
+
+#include "JitterBuffer.h"
+#include "TestSupport.h"
+#include "Transport.h"
+#include "VirtualClock.h"
+#include <atomic>
+#include <cstring>
+
+namespace {
+    using boost::asio::ip::tcp;
+
+    // Runs an io_context on its own thread until destroyed.
+    struct IoThread {
+        boost::asio::io_context io;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{io.get_executor()};
+        std::thread thread{[this]() { io.run(); }};
+
+        ~IoThread() {
+            io.stop();
+            thread.join();
+        }
+    };
+
+    // Writes `data` in chunks of varying size, then closes.
+    struct Writer : Transport::Handler, std::enable_shared_from_this<Writer> {
+        Transport& transport;
+        const std::vector<uint8_t>& data;
+        size_t offset = 0;
+        size_t chunk = 1;
+
+        Writer(Transport& t, const std::vector<uint8_t>& d) : transport(t), data(d) {}
+
+        void next() {
+            if (offset == data.size()) {
+                transport.close();
+                return;
+            }
+            size_t n = std::min(data.size() - offset, chunk);
+            chunk = chunk * 7 % 5003 + 1;
+            transport.asyncWrite(boost::asio::buffer(data.data() + offset, n), shared_from_this());
+            offset += n;
+        }
+        void onRead(const boost::system::error_code&, size_t) override {}
+        void onWrite(const boost::system::error_code& ec, size_t) override {
+            CHECK(!ec);
+            next();
+        }
+    };
+
+    // Reads until eof.
+    struct Reader : Transport::Handler, std::enable_shared_from_this<Reader> {
+        Transport& transport;
+        std::vector<uint8_t> received;
+        uint8_t buf[700];
+        std::atomic<bool> done{false};
+
+        explicit Reader(Transport& t) : transport(t) {}
+
+        void onWrite(const boost::system::error_code&, size_t) override {}
+        void onRead(const boost::system::error_code& ec, size_t len) override {
+            if (ec) {
+                CHECK(ec == boost::asio::error::eof);
+                done = true;
+                return;
+            }
+            received.insert(received.end(), buf, buf + len);
+            transport.asyncRead(boost::asio::buffer(buf), shared_from_this());
+        }
+    };
+
+    struct Link {
+        std::shared_ptr<Session> client;
+        std::shared_ptr<Session> server;
+    };
+
+    // A connected, negotiated plain TCP pair over loopback.
+    Link connectTcp(boost::asio::io_context& clientIo, boost::asio::io_context& serverIo) {
+        tcp::acceptor acceptor(serverIo, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        tcp::socket client(clientIo);
+        tcp::socket server(serverIo);
+        client.connect(acceptor.local_endpoint());
+        acceptor.accept(server);
+        client.set_option(tcp::no_delay(true));
+        server.set_option(tcp::no_delay(true));
+
+        std::vector<uint8_t> leftover;
+        uint16_t serverVersion = 0;
+        std::thread serverSide([&]() { serverVersion = negotiateServer(server, leftover); });
+        uint16_t clientVersion = negotiateClient(client);
+        serverSide.join();
+        CHECK(clientVersion == kProtocolVersion && serverVersion == kProtocolVersion);
+        return {std::make_shared<Session>(std::make_unique<TcpTransport>(std::move(client))),
+                std::make_shared<Session>(std::make_unique<TcpTransport>(std::move(server)), serverVersion,
+                                          std::move(leftover))};
+    }
+
+    Link connectMemory(boost::asio::io_context& clientIo, boost::asio::io_context& serverIo) {
+        MemoryTransport::Pair ends = MemoryTransport::connect(clientIo, serverIo);
+        return {std::make_shared<Session>(std::move(ends.first)), std::make_shared<Session>(std::move(ends.second))};
+    }
+
+    // Events per second through a link: moves, a key press and a key release
+    // per round, with at most kWindow keys in flight so no backlog builds up.
+    double measureRate(const std::string& label, Link link) {
+        constexpr uint32_t kRounds = 200000;
+        constexpr uint32_t kWindow = 1024;
+        std::atomic<uint32_t> keys{0};
+        std::atomic<bool> inOrder{true};
+        link.server->start([&](const EventPacket& pkt) {
+            uint32_t code = 0;
+            if (pkt.type == SamenessEventType::KeyPress && readKey(pkt, code)) {
+                inOrder = inOrder && code == keys;
+                ++keys;
+            }
+        }, [](const boost::system::error_code&) {});
+        link.client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+
+        uint64_t start = test::nowMicroseconds();
+        for (uint32_t i = 0; i < kRounds; ++i) {
+            while (i - keys.load(std::memory_order_relaxed) > kWindow) {
+                std::this_thread::yield();
+            }
+            link.client->send(makeMouseMovePacket(i, static_cast<int32_t>(i), 0));
+            link.client->send(makeMouseMovePacket(i, static_cast<int32_t>(i), 1));
+            link.client->send(makeKeyPacket(SamenessEventType::KeyPress, i, i));
+            link.client->send(makeKeyPacket(SamenessEventType::KeyRelease, i, i));
+        }
+        while (keys != kRounds) {
+            std::this_thread::yield();
+        }
+        double seconds = (test::nowMicroseconds() - start) / 1e6;
+        double rate = kRounds * 4 / seconds;
+        std::cout << label << ": " << static_cast<uint64_t>(rate) << " events/s" << std::endl;
+        CHECK(inOrder);
+
+        link.client->close();
+        link.server->close();
+        return rate;
+    }
+
+    // One thread polls both ends and time only moves when told to: capture,
+    // encode, frame, decode and playout come out the same on every run.
+    // Returns the virtual time each move was played.
+    std::vector<uint64_t> simulatePlayout(uint64_t spacingUs, size_t moves, size_t burst) {
+        VirtualClock clock(1000000);
+        boost::asio::io_context io;
+        Link link = connectMemory(io, io);
+        JitterBuffer::Config config;
+        config.maxDelayUs = 100000;
+        JitterBuffer jitter(config);
+        std::vector<uint64_t> played;
+
+        auto playDue = [&]() {
+            EventPacket move;
+            uint64_t heldUs = 0;
+            while (jitter.popDue(clock.nowUs(), move, heldUs)) {
+                int32_t x = 0, y = 0;
+                CHECK(readMouseMove(move, x, y) && x == static_cast<int32_t>(played.size()));
+                played.push_back(clock.nowUs());
+            }
+        };
+        link.server->start([&](const EventPacket& pkt) { jitter.push(pkt, clock.nowUs()); },
+                           [](const boost::system::error_code&) {});
+        link.client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+
+        // Captured every spacingUs, but the link holds them and delivers `burst` at a time
+        uint64_t captureStart = clock.nowUs();
+        for (size_t i = 0; i < moves; ++i) {
+            link.client->send(makeMouseMovePacket(captureStart + i * spacingUs, static_cast<int32_t>(i), 0));
+            while (io.poll() > 0) {
+            }
+            if (i % burst == burst - 1) {
+                for (uint64_t t = 0; t < burst * spacingUs; t += 500) {
+                    clock.advance(500);
+                    playDue();
+                }
+            }
+        }
+        for (int i = 0; i < 400; ++i) {
+            clock.advance(500);
+            playDue();
+        }
+        link.client->close();
+        link.server->close();
+        io.poll();
+        return played;
+    }
+}
+
+// Raw transport: a megabyte in odd-sized writes through a 4 KiB ring.
+static void test_memory_transport_bytes() {
+    IoThread a, b;
+    MemoryTransport::Pair ends = MemoryTransport::connect(a.io, b.io, 4096);
+    std::vector<uint8_t> data(1 << 20);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 131 + (i >> 11));
+    }
+
+    auto reader = std::make_shared<Reader>(*ends.second);
+    auto writer = std::make_shared<Writer>(*ends.first, data);
+    boost::asio::post(b.io, [&]() { ends.second->asyncRead(boost::asio::buffer(reader->buf), reader); });
+    boost::asio::post(a.io, [&]() { writer->next(); });
+
+    uint64_t deadline = test::nowMicroseconds() + 10000000;
+    while (!reader->done && test::nowMicroseconds() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(reader->done);
+    CHECK(reader->received == data);
+}
+
+static void test_rates() {
+    double memory = 0;
+    {
+        IoThread clientIo, serverIo;
+        memory = measureRate("memory transport, two threads", connectMemory(clientIo.io, serverIo.io));
+    }
+    {
+        IoThread io;
+        measureRate("memory transport, one thread", connectMemory(io.io, io.io));
+    }
+    {
+        IoThread clientIo, serverIo;
+        measureRate("plain TCP", connectTcp(clientIo.io, serverIo.io));
+    }
+    {
+        IoThread clientIo, serverIo;
+        test::LoopbackTls tls(serverIo.io, clientIo.io);
+        measureRate("TLS", {std::make_shared<Session>(std::move(tls.client)),
+                            std::make_shared<Session>(std::move(tls.server))});
+    }
+    // A floor far below what any machine manages, so only a real per-event regression trips it
+    CHECK(memory > 100000);
+}
+
+static void test_virtual_time() {
+    constexpr uint64_t kSpacingUs = 8000;
+    constexpr size_t kMoves = 200;
+    std::vector<uint64_t> played = simulatePlayout(kSpacingUs, kMoves, 5);
+    CHECK(played.size() == kMoves);
+    CHECK(simulatePlayout(kSpacingUs, kMoves, 5) == played);
+
+    // Arrivals are 0 or 40 ms apart; once the buffer has adapted, playout never is
+    uint64_t minGap = UINT64_MAX, maxGap = 0;
+    for (size_t i = kMoves / 2; i < kMoves; ++i) {
+        minGap = std::min(minGap, played[i] - played[i - 1]);
+        maxGap = std::max(maxGap, played[i] - played[i - 1]);
+    }
+    std::cout << "virtual time: moves captured " << kSpacingUs << " us apart and delivered in bursts play "
+              << minGap << "-" << maxGap << " us apart, identically on every run" << std::endl;
+    CHECK(minGap >= kSpacingUs / 2 && maxGap <= kSpacingUs * 2);
+}
+
+int main() {
+    test_memory_transport_bytes();
+    test_rates();
+    test_virtual_time();
+    std::cout << "pipeline_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,306 @@
+// Wire protocol v1/v2 round trips, v2 validation and version negotiation.
+
+#include "ClipboardSync.h"
+#include "Protocol.h"
+#include "Session.h"
+#include "TestSupport.h"
+#include "TextInput.h"
+#include "WireV2.h"
+#include <atomic>
+
+static std::vector<EventPacket> samplePackets() {
+    std::vector<EventPacket> pkts;
+    pkts.push_back(makeKeyPacket(SamenessEventType::KeyPress, 1, 30));
+    pkts.push_back(makeKeyPacket(SamenessEventType::KeyRelease, 2, 30));
+    pkts.push_back(makeMouseMovePacket(3, -1920, 1079));
+    pkts.push_back(makeMouseButtonPacket(SamenessEventType::MouseButtonPress, 4, 1, -5, 7));
+    pkts.push_back(makeMouseButtonPacket(SamenessEventType::MouseButtonRelease, 5, 3, 100000, -100000));
+
+    ClipboardSync clip;
+    EventPacket offer;
+    std::vector<uint8_t> content(1234);
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<uint8_t>(i);
+    }
+    CHECK(clip.offerLocal(content, offer));
+    offer.timestamp = 6;
+    pkts.push_back(offer);
+
+    EventPacket request = offer;
+    request.type = SamenessEventType::ClipboardRequest;
+    request.payload.resize(32);
+    request.payloadSize = 32;
+    pkts.push_back(request);
+
+    EventPacket chunk = offer;
+    chunk.type = SamenessEventType::ClipboardChunk;
+    chunk.payload.insert(chunk.payload.end(), content.begin(), content.begin() + 13);  // odd length exercises padding
+    chunk.payloadSize = static_cast<uint32_t>(chunk.payload.size());
+    pkts.push_back(chunk);
+
+    EventPacket heartbeat;
+    heartbeat.type = SamenessEventType::Heartbeat;
+    heartbeat.timestamp = 9;
+    heartbeat.payloadSize = 0;
+    pkts.push_back(heartbeat);
+
+    std::vector<EventPacket> text = makeTextPackets(10, "caf\xc3\xa9 \xf0\x9f\x99\x82");  // odd length again
+    pkts.insert(pkts.end(), text.begin(), text.end());
+    pkts.push_back(makeSwitchBackPacket(11, 0, 719, 2560, 1440));
+    return pkts;
+}
+
+static void test_roundtrip(uint16_t version) {
+    std::vector<EventPacket> pkts = samplePackets();
+    std::vector<uint8_t> stream;
+    for (const auto& p : pkts) {
+        size_t before = stream.size();
+        encodePacket(p, version, stream);
+        if (version == kProtocolV2) {
+            CHECK((stream.size() - before) % 8 == 0);
+        }
+    }
+
+    // Every prefix decodes a prefix of the packets and nothing more.
+    for (size_t cut = 0; cut <= stream.size(); ++cut) {
+        size_t consumed = 0;
+        size_t n = 0;
+        CHECK(decodeStream(version, stream.data(), cut, consumed, [&](const EventPacket& got) {
+            CHECK(n < pkts.size());
+            CHECK(got.type == pkts[n].type);
+            CHECK(got.timestamp == pkts[n].timestamp);
+            CHECK(got.payload == pkts[n].payload);
+            CHECK(got.payloadSize == got.payload.size());
+            ++n;
+        }));
+        CHECK(consumed <= cut);
+        if (cut == stream.size()) {
+            CHECK(n == pkts.size());
+            CHECK(consumed == stream.size());
+        }
+    }
+}
+
+static void test_v2_layout() {
+    std::vector<uint8_t> bytes;
+    wire::encode(makeMouseMovePacket(0x0102030405060708ull, -2, 3), bytes);
+    CHECK(bytes.size() == sizeof(wire::MouseMoveMsg));
+    CHECK(bytes[0] == static_cast<uint8_t>(SamenessEventType::MouseMove));
+    CHECK(bytes[4] == sizeof(wire::MouseMoveMsg));     // size, little-endian
+    CHECK(bytes[8] == 0x08 && bytes[15] == 0x01);       // timestamp, little-endian
+    CHECK(bytes[16] == 0xFE && bytes[19] == 0xFF);      // x = -2
+
+    wire::MouseMoveMsg m;
+    CHECK(wire::load(bytes.data(), bytes.size(), m));
+    CHECK(m.x == -2 && m.y == 3);
+    CHECK(!wire::load(bytes.data(), bytes.size() - 1, m));
+
+    // Wrong size for the type, unaligned size and unknown type are all rejected.
+    EventPacket out;
+    size_t consumed = 0;
+    std::vector<uint8_t> bad = bytes;
+    bad[4] = 32;
+    bad.resize(32);
+    CHECK(wire::decode(bad.data(), bad.size(), out, consumed) == wire::DecodeStatus::Malformed);
+    bad = bytes;
+    bad[4] = 23;
+    CHECK(wire::decode(bad.data(), bad.size(), out, consumed) == wire::DecodeStatus::Malformed);
+    bad = bytes;
+    bad[0] = 0xEE;
+    CHECK(wire::decode(bad.data(), bad.size(), out, consumed) == wire::DecodeStatus::Malformed);
+    CHECK(wire::decode(bytes.data(), 10, out, consumed) == wire::DecodeStatus::NeedMore);
+}
+
+// Runs both sides of the handshake over loopback; returns {client, server} versions.
+static std::pair<uint16_t, uint16_t> negotiate(uint16_t clientMax, uint16_t serverMax) {
+    boost::asio::io_context serverIo, clientIo;
+    test::LoopbackTls tls(serverIo, clientIo);
+
+    uint16_t serverVersion = 0;
+    std::vector<uint8_t> leftover;
+    std::thread server([&]() { serverVersion = negotiateServer(*tls.server, leftover, serverMax); });
+    uint16_t clientVersion = negotiateClient(*tls.client, clientMax);
+    if (clientMax == kProtocolV1) {
+        // A legacy client just starts talking
+        boost::asio::write(*tls.client, boost::asio::buffer(makeKeyPacket(SamenessEventType::KeyPress, 1, 30).toBytes()));
+    }
+    server.join();
+    if (clientMax == kProtocolV1) {
+        CHECK(leftover.size() >= 1 && leftover[0] == static_cast<uint8_t>(SamenessEventType::KeyPress));
+    }
+    return { clientVersion, serverVersion };
+}
+
+static void test_negotiation() {
+    CHECK(negotiate(kProtocolV2, kProtocolV2) == std::make_pair(kProtocolV2, kProtocolV2));
+    CHECK(negotiate(kProtocolV2, kProtocolV1) == std::make_pair(kProtocolV1, kProtocolV1));
+    CHECK(negotiate(kProtocolV1, kProtocolV2) == std::make_pair(kProtocolV1, kProtocolV1));
+}
+
+// The server's reply carries its display refresh rate; a legacy client gets none.
+static void test_refresh_rate() {
+    for (uint16_t clientMax : {kProtocolV2, kProtocolV1}) {
+        boost::asio::io_context serverIo, clientIo;
+        test::LoopbackTls tls(serverIo, clientIo);
+        std::vector<uint8_t> leftover;
+        std::thread server([&]() { negotiateServer(*tls.server, leftover, kProtocolVersion, 144); });
+        uint16_t refreshHz = 1;
+        negotiateClient(*tls.client, clientMax, &refreshHz);
+        if (clientMax == kProtocolV1) {
+            boost::asio::write(*tls.client, boost::asio::buffer(makeKeyPacket(SamenessEventType::KeyPress, 1, 30).toBytes()));
+        }
+        server.join();
+        CHECK(refreshHz == (clientMax == kProtocolV1 ? 0 : 144));
+    }
+}
+
+// A legacy client's first frames arrive with the bytes used to detect it and
+// must still reach the session.
+static void test_legacy_client_session() {
+    boost::asio::io_context serverIo, clientIo;
+    test::LoopbackTls tls(serverIo, clientIo);
+
+    auto client = std::make_shared<Session>(std::move(tls.client), kProtocolV1);
+    client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+    std::thread clientThread([&]() { clientIo.run(); });
+    for (int i = 0; i < 5; ++i) {
+        client->send(makeKeyPacket(SamenessEventType::KeyPress, i, 42));
+    }
+
+    std::vector<uint8_t> leftover;
+    CHECK(negotiateServer(*tls.server, leftover) == kProtocolV1);
+    CHECK(!leftover.empty());
+    auto server = std::make_shared<Session>(std::move(tls.server), kProtocolV1, std::move(leftover));
+
+    std::atomic<int> keys{0};
+    server->start([&](const EventPacket& pkt) {
+        uint32_t code = 0;
+        CHECK(readKey(pkt, code) && code == 42);
+        if (++keys == 5) {
+            server->close();
+        }
+    }, [](const boost::system::error_code&) {});
+    serverIo.run();
+
+    client->close();
+    clientThread.join();
+    CHECK(keys == 5);
+}
+
+// A client that predates the Hello writes each packet's toBytes() straight to
+// the socket. Every input type must be detected as v1 and decoded whole;
+// anything else as a first byte is refused.
+static void test_baseline_client_stream() {
+    std::vector<EventPacket> sent = {
+        makeMouseMovePacket(1, 640, 480),
+        makeKeyPacket(SamenessEventType::KeyPress, 2, 30),
+        makeKeyPacket(SamenessEventType::KeyRelease, 3, 30),
+        makeMouseButtonPacket(SamenessEventType::MouseButtonPress, 4, 1, 640, 480),
+        makeMouseButtonPacket(SamenessEventType::MouseButtonRelease, 5, 1, 641, 481),
+    };
+    for (size_t first = 0; first < sent.size(); ++first) {
+        boost::asio::io_context serverIo, clientIo;
+        test::LoopbackTls tls(serverIo, clientIo);
+        std::vector<uint8_t> bytes;
+        for (size_t i = 0; i < sent.size(); ++i) {
+            std::vector<uint8_t> pkt = sent[(first + i) % sent.size()].toBytes();
+            bytes.insert(bytes.end(), pkt.begin(), pkt.end());
+        }
+        boost::asio::write(*tls.client, boost::asio::buffer(bytes));
+
+        std::vector<uint8_t> leftover;
+        CHECK(negotiateServer(*tls.server, leftover) == kProtocolV1);
+        auto server = std::make_shared<Session>(std::move(tls.server), kProtocolV1, std::move(leftover));
+        size_t got = 0;
+        server->start([&](const EventPacket& pkt) {
+            const EventPacket& want = sent[(first + got) % sent.size()];
+            CHECK(pkt.type == want.type);
+            CHECK(pkt.timestamp == want.timestamp);
+            CHECK(pkt.payload == want.payload);
+            if (++got == sent.size()) {
+                server->close();
+            }
+        }, [](const boost::system::error_code&) {});
+        serverIo.run();
+        CHECK(got == sent.size());
+    }
+
+    boost::asio::io_context serverIo, clientIo;
+    test::LoopbackTls tls(serverIo, clientIo);
+    std::vector<uint8_t> junk(EventPacket::kHeaderSize, 0);
+    boost::asio::write(*tls.client, boost::asio::buffer(junk));
+    std::vector<uint8_t> leftover;
+    bool refused = false;
+    try {
+        negotiateServer(*tls.server, leftover);
+    } catch (const ProtocolError&) {
+        refused = true;
+    }
+    CHECK(refused);
+}
+
+// The server's non-blocking handshake, for controllers beyond the first:
+// the same answers as negotiateServer, and a silent peer is given up on by
+// closing its stream from a timer, without any thread waiting on it.
+static void test_async_negotiation() {
+    struct Outcome {
+        boost::system::error_code ec;
+        uint16_t version = 0;
+        std::vector<uint8_t> leftover;
+        bool done = false;
+    };
+    auto run = [](const std::function<void(TlsStream& client)>& clientSide, bool silent) {
+        boost::asio::io_context serverIo, clientIo;
+        test::LoopbackTls tls(serverIo, clientIo);
+        Outcome out;
+        boost::asio::steady_timer deadline(serverIo);
+        if (silent) {
+            deadline.expires_after(std::chrono::milliseconds(50));
+            deadline.async_wait([&](const boost::system::error_code& ec) {
+                if (!ec) {
+                    boost::system::error_code ignored;
+                    tls.server->lowest_layer().close(ignored);
+                }
+            });
+        }
+        asyncNegotiateServer(*tls.server, kProtocolVersion, 120,
+            [&](const boost::system::error_code& ec, uint16_t version, std::vector<uint8_t> leftover) {
+                deadline.cancel();
+                out = {ec, version, std::move(leftover), true};
+            });
+        std::thread client([&]() { clientSide(*tls.client); });
+        serverIo.run();
+        client.join();
+        return out;
+    };
+
+    uint16_t refreshHz = 0;
+    Outcome hello = run([&](TlsStream& client) { negotiateClient(client, kProtocolV2, &refreshHz); }, false);
+    CHECK(hello.done && !hello.ec && hello.version == kProtocolV2 && hello.leftover.empty());
+    CHECK(refreshHz == 120);
+
+    std::vector<uint8_t> key = makeKeyPacket(SamenessEventType::KeyPress, 1, 30).toBytes();
+    Outcome legacy = run([&](TlsStream& client) { boost::asio::write(client, boost::asio::buffer(key)); }, false);
+    CHECK(legacy.done && !legacy.ec && legacy.version == kProtocolV1);
+    CHECK(!legacy.leftover.empty() && legacy.leftover[0] == key[0]);
+
+    std::vector<uint8_t> junk(sizeof(Hello), 0);
+    Outcome bad = run([&](TlsStream& client) { boost::asio::write(client, boost::asio::buffer(junk)); }, false);
+    CHECK(bad.done && bad.ec == boost::asio::error::invalid_argument);
+
+    Outcome silent = run([](TlsStream&) {}, true);
+    CHECK(silent.done && silent.ec);
+}
+
+int main() {
+    test_roundtrip(kProtocolV1);
+    test_roundtrip(kProtocolV2);
+    test_v2_layout();
+    test_negotiation();
+    test_refresh_rate();
+    test_legacy_client_session();
+    test_baseline_client_stream();
+    test_async_negotiation();
+    std::cout << "protocol_test passed" << std::endl;
+    return 0;
+}
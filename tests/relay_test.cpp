@@ -0,0 +1,348 @@
+// Relay forwarding over loopback TLS: latency added per hop, many concurrent
+// pairs with v1 and v2 clients, and clients turned away or dropped cleanly.
+
+#include "ByteOrder.h"
+#include "Protocol.h"
+#include "Relay.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <mutex>
+
+namespace {
+    using boost::asio::ip::tcp;
+    namespace ssl = boost::asio::ssl;
+
+    ssl::context serverContext() {
+        ssl::context ctx(ssl::context::tlsv12_server);
+        ctx.use_certificate_chain_file(SAMENESS_SOURCE_DIR "/server.crt");
+        ctx.use_private_key_file(SAMENESS_SOURCE_DIR "/server.key", ssl::context::pem);
+        return ctx;
+    }
+
+    // What one end of a session has received.
+    struct Peer {
+        std::atomic<uint32_t> keys{0};
+        std::atomic<bool> inOrder{true};
+        std::atomic<bool> closed{false};
+        uint16_t version = 0;
+        std::vector<uint64_t> latencies;    // written before `keys` is bumped
+
+        void onPacket(const EventPacket& pkt) {
+            uint32_t code = 0;
+            if (pkt.type != SamenessEventType::KeyPress || !readKey(pkt, code)) {
+                return;
+            }
+            latencies.push_back(test::nowMicroseconds() - pkt.timestamp);
+            if (code != keys) {
+                inOrder = false;
+            }
+            ++keys;
+        }
+    };
+
+    // Runs an io_context on its own thread until destroyed.
+    struct IoThread {
+        boost::asio::io_context io;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{io.get_executor()};
+        std::thread thread{[this]() { io.run(); }};
+
+        ~IoThread() {
+            io.stop();
+            thread.join();
+        }
+    };
+
+    // Stand-in for sameness_server: accepts `expected` sessions and echoes every key back.
+    struct Downstream {
+        ssl::context ctx = serverContext();
+        IoThread ioThread;
+        tcp::acceptor acceptor{ioThread.io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)};
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Session>> sessions;
+        std::vector<std::shared_ptr<Peer>> peers;
+        std::thread acceptThread;
+        std::vector<std::thread> handshakes;
+
+        // A v1 client says nothing until it has input, so each negotiation gets its own thread
+        explicit Downstream(size_t expected) {
+            acceptThread = std::thread([this, expected]() {
+                for (size_t i = 0; i < expected; ++i) {
+                    auto stream = std::make_unique<Session::Stream>(ioThread.io, ctx);
+                    acceptor.accept(stream->next_layer());
+                    handshakes.emplace_back([this, s = stream.release()]() {
+                        negotiate(std::unique_ptr<Session::Stream>(s));
+                    });
+                }
+            });
+        }
+
+        ~Downstream() {
+            acceptThread.join();
+            for (std::thread& t : handshakes) {
+                t.join();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& s : sessions) {
+                s->close();
+            }
+        }
+
+        void negotiate(std::unique_ptr<Session::Stream> stream) {
+            stream->next_layer().set_option(tcp::no_delay(true));
+            stream->handshake(ssl::stream_base::server);
+            std::vector<uint8_t> leftover;
+            uint16_t version = negotiateServer(*stream, leftover);
+
+            auto peer = std::make_shared<Peer>();
+            peer->version = version;
+            auto session = std::make_shared<Session>(std::move(stream), version, std::move(leftover));
+            Session* raw = session.get();
+            session->start([peer, raw](const EventPacket& pkt) {
+                peer->onPacket(pkt);
+                raw->send(pkt);
+            }, [peer](const boost::system::error_code&) { peer->closed = true; });
+
+            std::lock_guard<std::mutex> lock(mutex);
+            sessions.push_back(std::move(session));
+            peers.push_back(std::move(peer));
+        }
+
+        tcp::endpoint endpoint() const { return acceptor.local_endpoint(); }
+
+        std::vector<std::shared_ptr<Peer>> snapshot() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return peers;
+        }
+    };
+
+    std::unique_ptr<Session::Stream> connectTls(boost::asio::io_context& io, ssl::context& ctx, uint16_t port) {
+        auto stream = std::make_unique<Session::Stream>(io, ctx);
+        stream->lowest_layer().connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+        stream->lowest_layer().set_option(tcp::no_delay(true));
+        stream->handshake(ssl::stream_base::client);
+        return stream;
+    }
+
+    // A client session whose echoes are recorded in `peer`.
+    std::shared_ptr<Session> connectClient(boost::asio::io_context& io, ssl::context& ctx, uint16_t port,
+                                           uint16_t maxVersion, const std::shared_ptr<Peer>& peer) {
+        auto stream = connectTls(io, ctx, port);
+        peer->version = negotiateClient(*stream, maxVersion);
+        auto session = std::make_shared<Session>(std::move(stream), peer->version);
+        session->start([peer](const EventPacket& pkt) { peer->onPacket(pkt); },
+                       [peer](const boost::system::error_code&) { peer->closed = true; });
+        return session;
+    }
+
+    bool waitFor(const std::function<bool()>& cond, uint64_t timeoutUs = 10000000) {
+        uint64_t deadline = test::nowMicroseconds() + timeoutUs;
+        while (!cond()) {
+            if (test::nowMicroseconds() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+        return true;
+    }
+
+    struct RelayFixture {
+        ssl::context acceptCtx = serverContext();
+        ssl::context connectCtx{ssl::context::tlsv12_client};
+        ssl::context clientCtx{ssl::context::tlsv12_client};
+        Relay relay;
+        uint16_t port = 0;
+
+        RelayFixture(const tcp::endpoint& downstream, const Relay::Config& config)
+            : relay(acceptCtx, connectCtx, config) {
+            port = relay.addRoute(tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0), downstream);
+            relay.start();
+        }
+    };
+}
+
+// One key at a time, so every sample is the idle path latency.
+static void test_added_latency() {
+    Downstream downstream(2);
+    RelayFixture fx(downstream.endpoint(), Relay::Config{});
+    IoThread client;
+
+    auto directEcho = std::make_shared<Peer>();
+    auto direct = connectClient(client.io, fx.clientCtx, downstream.endpoint().port(), kProtocolVersion, directEcho);
+    CHECK(waitFor([&]() { return downstream.snapshot().size() == 1; }));
+    auto relayedEcho = std::make_shared<Peer>();
+    auto relayed = connectClient(client.io, fx.clientCtx, fx.port, kProtocolVersion, relayedEcho);
+    CHECK(relayedEcho->version == kProtocolVersion);
+    CHECK(waitFor([&]() { return downstream.snapshot().size() == 2; }));
+    std::vector<std::shared_ptr<Peer>> peers = downstream.snapshot();
+
+    constexpr uint32_t kSamples = 2000;
+    for (size_t which = 0; which < 2; ++which) {
+        Session& session = which == 0 ? *direct : *relayed;
+        Peer& server = *peers[which];
+        for (uint32_t i = 0; i < kSamples; ++i) {
+            session.send(makeKeyPacket(SamenessEventType::KeyPress, test::nowMicroseconds(), i));
+            CHECK(waitFor([&]() { return server.keys == i + 1; }));
+        }
+        CHECK(server.inOrder);
+    }
+    CHECK(waitFor([&]() { return directEcho->keys == kSamples && relayedEcho->keys == kSamples; }));
+
+    std::vector<uint64_t> directUs(peers[0]->latencies.begin() + 100, peers[0]->latencies.end());
+    std::vector<uint64_t> relayedUs(peers[1]->latencies.begin() + 100, peers[1]->latencies.end());
+    test::printLatency("direct: key latency", directUs);
+    test::printLatency("relayed: key latency", relayedUs);
+    int64_t added = static_cast<int64_t>(test::percentile(relayedUs, 50)) - static_cast<int64_t>(test::percentile(directUs, 50));
+    std::cout << "relay adds " << added << " us at p50" << std::endl;
+    CHECK(added < 250);
+
+    direct->close();
+    relayed->close();
+}
+
+// Many pairs at once, v1 and v2 mixed, traffic in both directions.
+static void test_many_pairs() {
+    constexpr size_t kPairs = 32;
+    constexpr uint32_t kKeys = 200;
+    Downstream downstream(kPairs);
+    Relay::Config config;
+    config.maxPairs = kPairs;
+    RelayFixture fx(downstream.endpoint(), config);
+    IoThread client;
+
+    std::vector<std::shared_ptr<Peer>> echoes;
+    std::vector<std::shared_ptr<Session>> sessions;
+    size_t legacy = 0;
+    for (size_t i = 0; i < kPairs; ++i) {
+        uint16_t maxVersion = i % 4 == 0 ? kProtocolV1 : kProtocolVersion;
+        legacy += maxVersion == kProtocolV1;
+        echoes.push_back(std::make_shared<Peer>());
+        sessions.push_back(connectClient(client.io, fx.clientCtx, fx.port, maxVersion, echoes.back()));
+        CHECK(echoes.back()->version == maxVersion);
+    }
+    for (uint32_t k = 0; k < kKeys; ++k) {
+        for (auto& s : sessions) {
+            s->send(makeMouseMovePacket(test::nowMicroseconds(), static_cast<int32_t>(k), 0));
+            s->send(makeKeyPacket(SamenessEventType::KeyPress, test::nowMicroseconds(), k));
+        }
+    }
+    CHECK(waitFor([&]() {
+        for (auto& e : echoes) {
+            if (e->keys < kKeys) {
+                return false;
+            }
+        }
+        return true;
+    }));
+    CHECK(fx.relay.activePairs() == kPairs);
+
+    std::vector<std::shared_ptr<Peer>> peers = downstream.snapshot();
+    CHECK(peers.size() == kPairs);
+    size_t v1Peers = 0;
+    for (size_t i = 0; i < kPairs; ++i) {
+        CHECK(peers[i]->keys == kKeys && peers[i]->inOrder);
+        CHECK(echoes[i]->keys == kKeys && echoes[i]->inOrder);
+        v1Peers += peers[i]->version == kProtocolV1;
+    }
+    CHECK(v1Peers == legacy);
+
+    // Clients leaving take their downstream connections with them
+    for (auto& s : sessions) {
+        s->close();
+    }
+    CHECK(waitFor([&]() { return fx.relay.activePairs() == 0; }));
+    CHECK(waitFor([&]() {
+        for (auto& p : peers) {
+            if (!p->closed) {
+                return false;
+            }
+        }
+        return true;
+    }));
+    std::cout << kPairs << " pairs: " << kKeys << " keys each way, " << legacy << " on protocol v1" << std::endl;
+}
+
+// A full relay turns clients away; a malformed frame drops the pair and frees its buffers.
+static void test_full_and_malformed() {
+    Downstream downstream(2);
+    Relay::Config config;
+    config.maxPairs = 1;
+    RelayFixture fx(downstream.endpoint(), config);
+    boost::asio::io_context io;
+
+    auto first = connectTls(io, fx.clientCtx, fx.port);
+    CHECK(negotiateClient(*first) == kProtocolVersion);
+    CHECK(waitFor([&]() { return downstream.snapshot().size() == 1; }));
+
+    bool refused = false;
+    try {
+        auto second = connectTls(io, fx.clientCtx, fx.port);
+        negotiateClient(*second);
+    } catch (const std::exception&) {
+        refused = true;
+    }
+    CHECK(refused);
+
+    const uint8_t garbage[] = {0x09, 0x00, 0x00};
+    boost::asio::write(*first, boost::asio::buffer(garbage));
+    uint8_t byte = 0;
+    boost::system::error_code ec;
+    boost::asio::read(*first, boost::asio::buffer(&byte, 1), ec);
+    CHECK(ec);
+    CHECK(waitFor([&]() { return downstream.snapshot()[0]->closed && fx.relay.activePairs() == 0; }));
+
+    auto third = connectTls(io, fx.clientCtx, fx.port);
+    CHECK(negotiateClient(*third) == kProtocolVersion);
+    CHECK(waitFor([&]() { return downstream.snapshot().size() == 2; }));
+}
+
+// The relay tells a Hello from a v1 stream by its whole magic, even when it
+// arrives a byte at a time, and relays a client from before the Hello,
+// writing bare toBytes() packets, as v1.
+static void test_hello_sniffing() {
+    Downstream downstream(2);
+    RelayFixture fx(downstream.endpoint(), Relay::Config{});
+    boost::asio::io_context io;
+
+    auto split = connectTls(io, fx.clientCtx, fx.port);
+    Hello hello{};
+    std::memcpy(hello.magic, kHelloMagic, sizeof(hello.magic));
+    hello.version = byteorder::toLe(kProtocolVersion);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&hello);
+    for (size_t i = 0; i < sizeof(hello); ++i) {
+        boost::asio::write(*split, boost::asio::buffer(bytes + i, 1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    Hello reply{};
+    boost::asio::read(*split, boost::asio::buffer(&reply, sizeof(reply)));
+    CHECK(std::memcmp(reply.magic, kHelloMagic, sizeof(reply.magic)) == 0);
+    CHECK(byteorder::fromLe(reply.version) == kProtocolVersion);
+
+    auto baseline = connectTls(io, fx.clientCtx, fx.port);
+    constexpr uint32_t kKeys = 10;
+    for (uint32_t k = 0; k < kKeys; ++k) {
+        boost::asio::write(*baseline, boost::asio::buffer(
+            makeKeyPacket(SamenessEventType::KeyPress, test::nowMicroseconds(), k).toBytes()));
+    }
+    CHECK(waitFor([&]() {
+        for (auto& p : downstream.snapshot()) {
+            if (p->version == kProtocolV1 && p->keys == kKeys) {
+                return true;
+            }
+        }
+        return false;
+    }));
+    std::vector<std::shared_ptr<Peer>> peers = downstream.snapshot();
+    CHECK(peers.size() == 2);
+    for (auto& p : peers) {
+        CHECK(p->inOrder);
+    }
+}
+
+int main() {
+    test_added_latency();
+    test_many_pairs();
+    test_full_and_malformed();
+    test_hello_sniffing();
+    std::cout << "relay_test passed" << std::endl;
+    return 0;
+}
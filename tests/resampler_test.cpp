@@ -0,0 +1,127 @@
+// Motion resampling: an 8 kHz mouse comes out at the target rate, the last
+// position of every burst still goes out, and keys and buttons never
+// overtake motion captured before them.
+
+#include "MotionResampler.h"
+#include "TestSupport.h"
+
+namespace {
+    constexpr uint64_t kMouseSpacingUs = 125;       // 8 kHz
+    constexpr uint32_t kRateHz = 120;
+    constexpr uint64_t kPeriodUs = 1000000 / kRateHz;
+
+    struct Sent {
+        uint64_t atUs;
+        EventPacket pkt;
+    };
+
+    // Drives the resampler on a simulated clock with a timer that fires when
+    // the held move falls due, like the client's io thread.
+    struct Driver {
+        MotionResampler resampler{kRateHz};
+        std::vector<Sent> sent;
+        bool timerArmed = false;
+        uint64_t timerUs = 0;
+
+        void advanceTo(uint64_t nowUs) {
+            if (timerArmed && timerUs <= nowUs) {
+                timerArmed = false;
+                EventPacket move;
+                if (resampler.popDue(timerUs, move)) {
+                    sent.push_back({timerUs, move});
+                }
+            }
+        }
+
+        void input(const EventPacket& pkt, uint64_t nowUs) {
+            advanceTo(nowUs);
+            EventPacket out;
+            if (pkt.type != SamenessEventType::MouseMove) {
+                if (resampler.flush(nowUs, out)) {
+                    sent.push_back({nowUs, out});
+                }
+                sent.push_back({nowUs, pkt});
+                return;
+            }
+            switch (resampler.push(pkt, nowUs, out)) {
+                case MotionResampler::Outcome::Send:
+                    sent.push_back({nowUs, out});
+                    break;
+                case MotionResampler::Outcome::Hold:
+                    timerArmed = true;
+                    timerUs = resampler.nextDueUs();
+                    break;
+                case MotionResampler::Outcome::Merge:
+                    break;
+            }
+        }
+    };
+}
+
+static void test_rate_and_final_position() {
+    Driver d;
+    const uint64_t kDurationUs = 1000000;
+    int32_t x = 0;
+    uint64_t now = 0;
+    for (; now < kDurationUs; now += kMouseSpacingUs) {
+        x += 3;
+        d.input(makeMouseMovePacket(now, x, 100), now);
+    }
+    d.advanceTo(now + kPeriodUs);
+
+    size_t inputs = kDurationUs / kMouseSpacingUs;
+    std::cout << "  " << inputs << " moves in, " << d.sent.size() << " out at " << kRateHz << " Hz" << std::endl;
+    CHECK(d.sent.size() >= kRateHz - 1 && d.sent.size() <= kRateHz + 2);
+    CHECK(d.resampler.merged() + d.sent.size() == inputs);
+    for (size_t i = 1; i < d.sent.size(); ++i) {
+        CHECK(d.sent[i].atUs - d.sent[i - 1].atUs >= kPeriodUs);
+    }
+    // Absolute positions: the last move carries all the distance
+    int32_t lastX, lastY;
+    CHECK(readMouseMove(d.sent.back().pkt, lastX, lastY));
+    CHECK(lastX == x && lastY == 100);
+}
+
+static void test_quiet_mouse_is_not_delayed() {
+    Driver d;
+    // 100 Hz office mouse: every move is already slower than the target rate
+    for (uint64_t now = 0; now < 100000; now += 10000) {
+        d.input(makeMouseMovePacket(now, static_cast<int32_t>(now / 100), 0), now);
+        CHECK(!d.resampler.holding());
+        CHECK(d.sent.back().atUs == now);
+    }
+    CHECK(d.sent.size() == 10);
+    CHECK(d.resampler.merged() == 0);
+}
+
+static void test_keys_flush_motion() {
+    Driver d;
+    d.input(makeMouseMovePacket(0, 10, 10), 0);          // goes at once
+    d.input(makeMouseMovePacket(125, 11, 10), 125);      // held
+    d.input(makeMouseMovePacket(250, 12, 10), 250);      // replaces it
+    d.input(makeMouseButtonPacket(SamenessEventType::MouseButtonPress, 375, 1, 12, 10), 375);
+    d.input(makeKeyPacket(SamenessEventType::KeyPress, 500, 65), 500);
+    d.advanceTo(kPeriodUs * 2);
+
+    CHECK(d.sent.size() == 4);
+    int32_t x, y;
+    CHECK(readMouseMove(d.sent[0].pkt, x, y) && x == 10);
+    CHECK(readMouseMove(d.sent[1].pkt, x, y) && x == 12);
+    CHECK(d.sent[1].atUs == 375);       // flushed ahead of the button, not at the timer
+    CHECK(d.sent[2].pkt.type == SamenessEventType::MouseButtonPress);
+    CHECK(d.sent[3].pkt.type == SamenessEventType::KeyPress);
+    CHECK(!d.resampler.holding());
+
+    // The next move after a flush waits out a full period from the flush
+    d.input(makeMouseMovePacket(600, 13, 10), 600);
+    CHECK(d.resampler.holding());
+    CHECK(d.resampler.nextDueUs() == 375 + kPeriodUs);
+}
+
+int main() {
+    test_rate_and_final_position();
+    test_quiet_mouse_is_not_delayed();
+    test_keys_flush_motion();
+    std::cout << "resampler_test passed" << std::endl;
+    return 0;
+}
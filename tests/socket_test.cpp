@@ -0,0 +1,76 @@
+// Socket profiles: every named profile applies to a live connection, the
+// options land on the socket, and a spinning io loop still returns once its
+// work is done.
+
+#include "SocketTuning.h"
+#include "TestSupport.h"
+#include "Transport.h"
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/socket.h>
+
+namespace {
+    using boost::asio::ip::tcp;
+
+    int getInt(tcp::socket& socket, int level, int option) {
+        int value = -1;
+        socklen_t len = sizeof(value);
+        CHECK(getsockopt(socket.native_handle(), level, option, &value, &len) == 0);
+        return value;
+    }
+}
+
+static void test_profiles() {
+    for (const std::string& name : SocketProfile::names()) {
+        SocketProfile profile = SocketProfile::named(name);
+        CHECK(profile.name == name);
+
+        boost::asio::io_context io;
+        tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        tcp::socket client(io);
+        tcp::socket server(io);
+        client.connect(acceptor.local_endpoint());
+        acceptor.accept(server);
+        applySocketProfile(client, profile);
+
+        CHECK(getInt(client, IPPROTO_TCP, TCP_NODELAY) != 0);
+        if (profile.dscp >= 0) {
+            CHECK(getInt(client, IPPROTO_IP, IP_TOS) == profile.dscp << 2);
+        }
+        if (profile.sendBuffer > 0) {
+            // Linux reports double what was asked, for its bookkeeping
+            CHECK(getInt(client, SOL_SOCKET, SO_SNDBUF) >= profile.sendBuffer);
+        }
+
+        // A round trip with QUICKACK re-armed on each read, run the profile's way
+        TcpTransport transport(std::move(server));
+        transport.setQuickAck(profile.quickAck);
+        struct Reader : Transport::Handler {
+            size_t received = 0;
+            void onRead(const boost::system::error_code& ec, size_t len) override { received = ec ? 0 : len; }
+            void onWrite(const boost::system::error_code&, size_t) override {}
+        };
+        auto reader = std::make_shared<Reader>();
+        uint8_t buf[16];
+        transport.asyncRead(boost::asio::buffer(buf), reader);
+        boost::asio::write(client, boost::asio::buffer("ping", 4));
+        runIoContext(io, profile);
+        CHECK(reader->received == 4);
+    }
+
+    bool threw = false;
+    try {
+        SocketProfile::named("turbo");
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+int main() {
+    test_profiles();
+    std::cout << "socket_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,61 @@
+// Shared-memory statistics: per-thread slots and cross-process style attach.
+
+#include "Stats.h"
+#include "TestSupport.h"
+#include <string>
+#include <unistd.h>
+
+int main() {
+    // A per-run name so parallel test runs do not collide
+    std::string role = "test-" + std::to_string(getpid());
+    CHECK(stats::open(role.c_str()));
+
+    const int kThreads = stats::kSlots + 4;     // more threads than slots exercises the shared slot
+    const int kPerThread = 100000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([]() {
+            for (int i = 0; i < kPerThread; ++i) {
+                stats::countEvent(SamenessEventType::MouseMove);
+                stats::add(&stats::Slot::bytesSent, 13);
+            }
+            stats::countEvent(SamenessEventType::KeyPress);
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    stats::setGauge(stats::Gauge::SendInput, 42);
+
+    // Exited threads gave their slots back; the next one takes the first
+    std::thread([]() {
+        stats::add(&stats::Slot::drops);
+        CHECK(stats::detail::tls.slot == &stats::block().slots[0]);
+    }).join();
+    CHECK(stats::block().slotsInUse.load() == 0);
+
+    const stats::Block* attached = stats::attach(role.c_str());
+    CHECK(attached != nullptr);
+    CHECK(attached->pid == static_cast<uint64_t>(getpid()));
+
+    stats::Snapshot s = stats::snapshot(*attached);
+    CHECK(s.events[static_cast<size_t>(SamenessEventType::MouseMove)] == uint64_t(kThreads) * kPerThread);
+    CHECK(s.events[static_cast<size_t>(SamenessEventType::KeyPress)] == uint64_t(kThreads));
+    CHECK(s.bytesSent == uint64_t(kThreads) * kPerThread * 13);
+    CHECK(s.gauges[static_cast<size_t>(stats::Gauge::SendInput)] == 42);
+
+    // A block whose owner is still running is not taken over: pose as the
+    // parent process, which is
+    uint64_t pid = stats::block().pid;
+    stats::block().pid = static_cast<uint64_t>(getppid());
+    CHECK(!stats::open(role.c_str()));
+    CHECK(stats::snapshot(*attached).bytesSent == uint64_t(kThreads) * kPerThread * 13);
+    stats::block().pid = pid;
+
+    stats::detach(attached);
+    stats::close();
+    CHECK(stats::attach(role.c_str()) == nullptr);
+
+    std::cout << "stats_test passed" << std::endl;
+    return 0;
+}
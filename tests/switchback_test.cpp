@@ -0,0 +1,144 @@
+// Switching back from the server's side: the server notices its pointer
+// reaching the edge that faces the client, the client takes control back
+// with its cursor at the mirrored point, and over loopback TLS that takes
+// about one network hop.
+
+#include "EdgeWatcher.h"
+#include "ScreenEdgeSwitcher.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+    struct IoThread {
+        boost::asio::io_context io;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{io.get_executor()};
+        std::thread thread{[this]() { io.run(); }};
+
+        ~IoThread() {
+            io.stop();
+            thread.join();
+        }
+    };
+
+    // Puts the switcher in client control, as crossing its right edge does
+    void enterPeer(ScreenEdgeSwitcher& switcher) {
+        switcher.update(1910, 300);
+        CHECK(switcher.isClientControlled());
+    }
+}
+
+static void test_watcher() {
+    EdgeWatcher watcher(1920, 1080, 2);
+    // Arriving through the edge, and hovering near it, sends nothing back
+    CHECK(!watcher.onMove(0, 500));
+    CHECK(!watcher.onMove(10, 500));
+    CHECK(!watcher.onMove(1, 500));
+    CHECK(!watcher.armed());
+
+    CHECK(!watcher.onMove(2 + EdgeWatcher::kRearmPixels, 500));
+    CHECK(watcher.armed());
+    CHECK(!watcher.onMove(5, 500));
+    // Positions are clamped to the screen, as the system clamps the cursor
+    CHECK(watcher.onMove(-40, 2000));
+    CHECK(watcher.x() == 0 && watcher.y() == 1079);
+    CHECK(!watcher.onMove(0, 1079));
+
+    int32_t x = 0, y = 0, width = 0, height = 0;
+    EventPacket back = watcher.switchBack(42);
+    CHECK(back.type == SamenessEventType::SwitchBack);
+    CHECK(back.timestamp == 42);
+    CHECK(readSwitchBack(back, x, y, width, height));
+    CHECK(x == 0 && y == 1079 && width == 1920 && height == 1080);
+
+    bool threw = false;
+    try {
+        EdgeWatcher tooNarrow(10, 10, 2);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+static void test_mirror() {
+    ScreenEdgeSwitcher switcher(1920, 1080);
+    int x = 0, y = 0;
+    CHECK(!switcher.returnFromPeer(500, 1080, x, y));
+
+    enterPeer(switcher);
+    // Row 720 of a 1440-row screen is two thirds down; so is row 540 here
+    CHECK(switcher.returnFromPeer(720, 1440, x, y));
+    CHECK(!switcher.isClientControlled());
+    CHECK(x == 1920 - 20 - 1 && y == 540);
+    // The cursor lands outside the switch zone, so it stays here
+    CHECK(switcher.update(x, y) == ControlState::HOST);
+    CHECK(!switcher.returnFromPeer(720, 1440, x, y));
+
+    enterPeer(switcher);
+    switcher.setLocked(true);
+    CHECK(!switcher.returnFromPeer(720, 1440, x, y));
+    CHECK(switcher.isClientControlled());
+}
+
+// Moves out to the middle of the server's screen and back to its edge, then
+// waits for the SwitchBack; the latency is from the capture of the move that
+// reached the edge to the client's switcher handing control back.
+static void test_loopback_latency() {
+    constexpr int kRounds = 200;
+    IoThread serverIo, clientIo;
+    test::LoopbackTls tls(serverIo.io, clientIo.io);
+    auto server = std::make_shared<Session>(std::move(tls.server));
+    auto client = std::make_shared<Session>(std::move(tls.client));
+
+    EdgeWatcher watcher(1920, 1080);
+    server->start([&](const EventPacket& pkt) {
+        int32_t x = 0, y = 0;
+        if (readMouseMove(pkt, x, y) && watcher.onMove(x, y)) {
+            server->send(watcher.switchBack(pkt.timestamp));
+        }
+    }, [](const boost::system::error_code&) {});
+
+    ScreenEdgeSwitcher switcher(1920, 1080);
+    std::mutex mutex;
+    std::vector<uint64_t> latencyUs;
+    std::atomic<int> returned{0};
+    client->start([&](const EventPacket& pkt) {
+        int32_t peerX = 0, peerY = 0, width = 0, height = 0;
+        int x = 0, y = 0;
+        if (!readSwitchBack(pkt, peerX, peerY, width, height) || !switcher.returnFromPeer(peerY, height, x, y)) {
+            return;
+        }
+        uint64_t now = test::nowMicroseconds();
+        std::lock_guard<std::mutex> lock(mutex);
+        latencyUs.push_back(now - pkt.timestamp);
+        ++returned;
+    }, [](const boost::system::error_code&) {});
+
+    for (int round = 0; round < kRounds; ++round) {
+        enterPeer(switcher);
+        client->send(makeMouseMovePacket(test::nowMicroseconds(), 960, 100 + round));
+        client->send(makeMouseMovePacket(test::nowMicroseconds(), 0, 100 + round));
+        uint64_t deadline = test::nowMicroseconds() + 2000000;
+        while (returned.load() <= round && test::nowMicroseconds() < deadline) {
+            std::this_thread::yield();
+        }
+        CHECK(returned.load() == round + 1);
+    }
+    client->close();
+    server->close();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    test::printLatency("switch-back over loopback TLS", latencyUs);
+    CHECK(latencyUs.size() == static_cast<size_t>(kRounds));
+    // One hop there and one back; generous for a loaded single-core machine
+    CHECK(test::percentile(latencyUs, 50) < 20000);
+}
+
+int main() {
+    test_watcher();
+    test_mirror();
+    test_loopback_latency();
+    std::cout << "switchback_test passed" << std::endl;
+    return 0;
+}
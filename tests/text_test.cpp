@@ -0,0 +1,143 @@
+// TextInput: long text splits on character boundaries, crosses a session
+// intact and ahead of nothing it was typed after, and becomes key strokes
+// where the platform only injects keys.
+
+#include "InjectionQueue.h"
+#include "Session.h"
+#include "TestSupport.h"
+#include "TextInput.h"
+#include "Transport.h"
+#include <uiohook.h>
+#ifdef __linux__
+#include "UinputDevice.h"
+#endif
+
+namespace {
+    // ASCII with a four-byte character every so often, so some packet
+    // boundary falls inside one
+    std::string sampleText(size_t bytes) {
+        std::string text;
+        for (size_t i = 0; text.size() < bytes; ++i) {
+            if (i % 37 == 36) {
+                text += "\xf0\x9f\x99\x82";     // U+1F642
+            } else {
+                text += static_cast<char>('a' + i % 26);
+            }
+        }
+        return text;
+    }
+}
+
+static void test_split() {
+    CHECK(makeTextPackets(1, "").empty());
+
+    std::string text = sampleText(10 * 1024);
+    std::vector<EventPacket> packets = makeTextPackets(7, text);
+    CHECK(packets.size() == (text.size() + kMaxTextBytes - 1) / kMaxTextBytes);
+    std::string joined;
+    for (const EventPacket& pkt : packets) {
+        CHECK(pkt.type == SamenessEventType::TextInput);
+        CHECK(pkt.timestamp == 7);
+        CHECK(pkt.payloadSize == pkt.payload.size());
+        CHECK(pkt.payload.size() >= 1 && pkt.payload.size() <= kMaxTextBytes);
+        CHECK((pkt.payload[0] & 0xC0) != 0x80);     // starts on a character
+        std::string part;
+        CHECK(readText(pkt, part));
+        joined += part;
+    }
+    CHECK(joined == text);
+
+    std::string part;
+    CHECK(!readText(makeKeyPacket(SamenessEventType::KeyPress, 1, VC_A), part));
+}
+
+static void test_utf16() {
+    CHECK(utf8ToUtf16("a\xc3\xa9\xe2\x82\xac\xf0\x9f\x99\x82") == std::u16string(u"aé€\U0001F642"));
+    CHECK(utf8ToUtf16("\xf0\x9f\x99\x82").size() == 2);     // a surrogate pair
+    // Truncated, overlong, a stray continuation byte and an encoded surrogate
+    CHECK(utf8ToUtf16("x\xc3") == std::u16string(u"x�"));
+    CHECK(utf8ToUtf16("\xc0\xaf") == std::u16string(u"�"));
+    CHECK(utf8ToUtf16("\x80y") == std::u16string(u"�y"));
+    CHECK(utf8ToUtf16("\xed\xa0\x80") == std::u16string(u"�"));
+}
+
+static void test_ascii_keys() {
+    uint16_t keycode = 0;
+    bool shift = true;
+    CHECK(asciiKey('q', keycode, shift) && keycode == VC_Q && !shift);
+    CHECK(asciiKey('Q', keycode, shift) && keycode == VC_Q && shift);
+    CHECK(asciiKey('?', keycode, shift) && keycode == VC_SLASH && shift);
+    CHECK(asciiKey('\n', keycode, shift) && keycode == VC_ENTER && !shift);
+    CHECK(!asciiKey('\x01', keycode, shift));
+    CHECK(!asciiKey('\xc3', keycode, shift));
+}
+
+// A key typed before the text and one after it arrive on either side of it
+static void test_session_and_queue() {
+    boost::asio::io_context io;
+    MemoryTransport::Pair ends = MemoryTransport::connect(io, io);
+    auto client = std::make_shared<Session>(std::move(ends.first), kProtocolV2);
+    auto server = std::make_shared<Session>(std::move(ends.second), kProtocolV2);
+
+    std::vector<EventPacket> injected;
+    InjectionQueue queue(16);
+    queue.start([&](const EventPacket* packets, size_t count) {
+        injected.insert(injected.end(), packets, packets + count);
+    });
+    bool closed = false;
+    server->start([&](const EventPacket& pkt) { CHECK(queue.push(pkt)); },
+                  [&](const boost::system::error_code&) { closed = true; });
+    client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+
+    std::string text = sampleText(10 * 1024);
+    std::vector<EventPacket> packets = makeTextPackets(2, text);
+    client->send(makeKeyPacket(SamenessEventType::KeyPress, 1, VC_A));
+    for (const EventPacket& pkt : packets) {
+        client->send(pkt);
+    }
+    client->send(makeKeyPacket(SamenessEventType::KeyPress, 3, VC_B));
+    client->closeWhenSent();
+    io.run();
+    queue.stop();
+
+    CHECK(closed);
+    CHECK(injected.size() == packets.size() + 2);
+    uint32_t code = 0;
+    CHECK(readKey(injected.front(), code) && code == VC_A);
+    CHECK(readKey(injected.back(), code) && code == VC_B);
+    std::string joined, part;
+    for (size_t i = 1; i + 1 < injected.size(); ++i) {
+        CHECK(readText(injected[i], part));
+        joined += part;
+    }
+    CHECK(joined == text);
+}
+
+static void test_uinput_encode() {
+#ifdef __linux__
+    std::vector<input_event> records;
+    // H: shift, key, report, key, shift, report; i: 4; the emoji has no key
+    CHECK(UinputDevice::encode(makeTextPackets(1, "Hi\xf0\x9f\x99\x82")[0], records));
+    CHECK(records.size() == 10);
+    CHECK(records[0].type == EV_KEY && records[0].code == KEY_LEFTSHIFT && records[0].value == 1);
+    CHECK(records[1].type == EV_KEY && records[1].code == KEY_H && records[1].value == 1);
+    CHECK(records[2].type == EV_SYN);
+    CHECK(records[4].code == KEY_LEFTSHIFT && records[4].value == 0);
+    CHECK(records[6].code == KEY_I && records[6].value == 1);
+    CHECK(records.back().type == EV_SYN);
+
+    records.clear();
+    CHECK(!UinputDevice::encode(makeTextPackets(1, "\xc3\xa9")[0], records));
+    CHECK(records.empty());
+#endif
+}
+
+int main() {
+    test_split();
+    test_utf16();
+    test_ascii_keys();
+    test_session_and_queue();
+    test_uinput_encode();
+    std::cout << "text_test passed" << std::endl;
+    return 0;
+}
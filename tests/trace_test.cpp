@@ -0,0 +1,171 @@
+// Event tracing: nothing is recorded while it is off; while on, every key sent
+// through a session pair leaves one span per stage in order, the server's
+// times can be moved onto the client's clock, and the export is trace-event
+// JSON that merges across processes.
+
+#include "SessionGroup.h"
+#include "TestSupport.h"
+#include "Trace.h"
+#include "Transport.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+namespace {
+    using Stages = std::map<trace::Stage, trace::Span>;
+
+    std::map<uint64_t, Stages> byEvent(const std::vector<trace::Span>& spans) {
+        std::map<uint64_t, Stages> events;
+        for (const trace::Span& s : spans) {
+            CHECK(s.beginUs <= s.endUs);
+            events[s.id][s.stage] = s;
+        }
+        return events;
+    }
+
+    std::string tempPath(const std::string& name) {
+        return (std::filesystem::temp_directory_path() / name).string();
+    }
+
+    size_t countLines(const std::string& path, const std::string& needle) {
+        std::ifstream in(path);
+        std::string line;
+        size_t n = 0;
+        while (std::getline(in, line)) {
+            n += line.find(needle) != std::string::npos;
+        }
+        return n;
+    }
+}
+
+static void test_disabled() {
+    trace::disable();
+    trace::clear();
+    trace::span(trace::Stage::Hook, 1, 10, 20);
+    trace::observePeerTime(10, 20);
+    CHECK(trace::collect().empty());
+}
+
+static void test_session_stages() {
+    constexpr size_t kKeys = 100;
+    trace::clear();
+    trace::enable();
+
+    boost::asio::io_context io;
+    MemoryTransport::Pair ends = MemoryTransport::connect(io, io);
+    auto client = std::make_shared<Session>(std::move(ends.first));
+    auto server = std::make_shared<Session>(std::move(ends.second));
+    SessionGroup group;
+    group.add(client);
+    size_t received = 0;
+    server->start([&](const EventPacket& pkt) {
+        uint64_t start = trace::nowUs();
+        ++received;
+        trace::span(trace::Stage::Inject, trace::eventId(pkt), start, trace::nowUs());
+    }, [](const boost::system::error_code&) {});
+    client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+
+    std::vector<uint64_t> ids;
+    for (size_t i = 0; i < kKeys; ++i) {
+        EventPacket pkt = makeKeyPacket(SamenessEventType::KeyPress, trace::nowUs() * 4 + i, static_cast<uint32_t>(i));
+        ids.push_back(trace::eventId(pkt));
+        group.send(pkt);
+        if (i % 7 == 0) {
+            while (io.poll() > 0) {
+            }
+        }
+    }
+    while (io.poll() > 0) {
+    }
+    CHECK(received == kKeys);
+    trace::disable();
+
+    std::map<uint64_t, Stages> events = byEvent(trace::collect());
+    CHECK(events.size() == kKeys);
+    for (uint64_t id : ids) {
+        Stages& s = events[id];
+        CHECK(s.size() == 6);   // all but the hook; inject comes from the handler above
+        CHECK(s[trace::Stage::Encode].endUs <= s[trace::Stage::Queue].beginUs);
+        CHECK(s[trace::Stage::Queue].endUs == s[trace::Stage::Write].beginUs);
+        CHECK(s[trace::Stage::Read].endUs == s[trace::Stage::Decode].beginUs);
+        CHECK(s[trace::Stage::Decode].endUs <= s[trace::Stage::Inject].beginUs);
+    }
+
+    // Off again: the same traffic adds nothing
+    size_t before = trace::collect().size();
+    group.send(makeKeyPacket(SamenessEventType::KeyRelease, 1, 1));
+    while (io.poll() > 0) {
+    }
+    CHECK(trace::collect().size() == before);
+    client->close();
+    server->close();
+    io.poll();
+}
+
+static void test_peer_clock() {
+    trace::clear();
+    trace::Config config;
+    config.alignToPeer = true;
+    trace::enable(config);
+    // The peer's clock runs 5 s behind; the quickest packet took 300 us
+    trace::observePeerTime(1000000, 6000400);
+    trace::observePeerTime(1002000, 6002300);
+    trace::observePeerTime(1004000, 6004900);
+    trace::span(trace::Stage::Inject, 7, 6002300, 6002350);
+    trace::disable();
+    std::vector<trace::Span> spans = trace::collect();
+    CHECK(spans.size() == 1);
+    CHECK(spans[0].beginUs == 1002000 && spans[0].endUs == 1002050);
+    trace::clear();
+}
+
+static void test_json() {
+    std::string client = tempPath("trace_client.json");
+    std::string server = tempPath("trace_server.json");
+    std::string merged = tempPath("trace_merged.json");
+
+    trace::clear();
+    trace::enable();
+    trace::span(trace::Stage::Hook, 0x31, 100, 110);
+    trace::span(trace::Stage::Encode, 0x31, 110, 112);
+    trace::disable();
+    CHECK(trace::writeJson(client, "client"));
+    trace::clear();
+    trace::enable();
+    trace::span(trace::Stage::Inject, 0x31, 300, 320);
+    trace::disable();
+    CHECK(trace::writeJson(server, "server"));
+    CHECK(trace::mergeJson({client, server}, merged));
+
+    CHECK(countLines(client, "\"ph\":\"b\"") == 2);
+    CHECK(countLines(merged, "\"ph\":\"b\"") == 3);
+    CHECK(countLines(merged, "\"ph\":\"e\"") == 3);
+    CHECK(countLines(merged, "process_name") == 2);
+    CHECK(countLines(merged, "\"global\":\"0x31\"") == 6);
+    CHECK(countLines(merged, "\"name\":\"inject\",\"cat\":\"input\",\"ph\":\"e\"") == 1);
+
+    // Well formed: every event line but the last ends in a comma
+    std::ifstream in(merged);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);) {
+        lines.push_back(line);
+    }
+    CHECK(lines.front() == "{\"traceEvents\":[" && lines.back() == "]}");
+    for (size_t i = 1; i + 1 < lines.size(); ++i) {
+        CHECK((lines[i].back() == ',') == (i + 2 < lines.size()));
+    }
+    trace::clear();
+    std::remove(client.c_str());
+    std::remove(server.c_str());
+    std::remove(merged.c_str());
+}
+
+int main() {
+    test_disabled();
+    test_session_stages();
+    test_peer_clock();
+    test_json();
+    std::cout << "trace_test passed" << std::endl;
+    return 0;
+}
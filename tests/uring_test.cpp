@@ -0,0 +1,377 @@
+// io_uring server backend: packets become the uinput records they should,
+// a taken-over TLS connection keeps working in both directions, and under a
+// steady input load the ring serves each event with fewer syscalls than the
+// Asio session path. Syscalls are counted by tracing a forked server with
+// ptrace, which slows it down, so latency is measured in a separate untraced
+// run. Skipped where the kernel has no io_uring.
+
+#include "EvdevKeys.h"
+#include "IoUring.h"
+#include "TestSupport.h"
+#include "UinputDevice.h"
+#include "UringServer.h"
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <future>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <uiohook.h>
+#include <unistd.h>
+
+namespace {
+    using boost::asio::ip::tcp;
+    namespace ssl = boost::asio::ssl;
+
+    struct IoThread {
+        boost::asio::io_context io;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work{io.get_executor()};
+        std::thread thread{[this]() { io.run(); }};
+
+        ~IoThread() {
+            io.stop();
+            thread.join();
+        }
+    };
+
+    bool sameRecord(const input_event& ev, uint16_t type, uint16_t code, int32_t value) {
+        return ev.type == type && ev.code == code && ev.value == value;
+    }
+
+    std::vector<input_event> readRecords(int fd) {
+        std::vector<input_event> records(4096);
+        ssize_t n = ::read(fd, records.data(), records.size() * sizeof(input_event));
+        records.resize(n > 0 ? static_cast<size_t>(n) / sizeof(input_event) : 0);
+        return records;
+    }
+
+    enum class Backend { Asio, Uring };
+
+    struct LoadResult {
+        uint64_t packets = 0;
+        std::vector<uint64_t> latencyUs;    // arrival to injection, per packet
+        uint64_t syscalls = 0;              // while serving; traced runs only
+        bool traced = false;
+    };
+
+    // The server half, in a forked child: accepts one client, serves it until
+    // it leaves, and writes the packet count and latencies to `results`.
+    // getppid() marks where serving begins and ends for the tracer.
+    [[noreturn]] void serveChild(Backend backend, int portOut, int results) {
+        boost::asio::io_context io;
+        ssl::context ctx(ssl::context::tlsv12_server);
+        ctx.use_certificate_chain_file(SAMENESS_SOURCE_DIR "/server.crt");
+        ctx.use_private_key_file(SAMENESS_SOURCE_DIR "/server.key", ssl::context::pem);
+        tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        uint16_t port = acceptor.local_endpoint().port();
+        CHECK(::write(portOut, &port, sizeof(port)) == sizeof(port));
+
+        auto stream = std::make_unique<UringServer::Stream>(io, ctx);
+        acceptor.accept(stream->next_layer());
+        stream->next_layer().set_option(tcp::no_delay(true));
+        stream->handshake(ssl::stream_base::server);
+        std::vector<uint8_t> leftover;
+        uint16_t version = negotiateServer(*stream, leftover);
+
+        int sink = ::open("/dev/null", O_WRONLY | O_CLOEXEC);
+        std::vector<uint64_t> latency;
+        latency.reserve(1 << 16);
+        auto record = [&latency](const EventPacket& pkt) { latency.push_back(test::nowMicroseconds() - pkt.timestamp); };
+
+        if (backend == Backend::Asio) {
+            // What the server does per packet today, with a uinput write standing in for the injector
+            auto session = std::make_shared<Session>(std::move(stream), version, std::move(leftover));
+            std::vector<input_event> records;
+            syscall(SYS_getppid);
+            session->start([&](const EventPacket& pkt) {
+                records.clear();
+                if (UinputDevice::encode(pkt, records)) {
+                    ssize_t ignored = ::write(sink, records.data(), records.size() * sizeof(input_event));
+                    (void)ignored;
+                    record(pkt);
+                }
+            }, [](const boost::system::error_code&) {});
+            io.run();
+            syscall(SYS_getppid);
+        } else {
+            UringServer server(std::move(stream), version, std::move(leftover));
+            server.setInjectFd(sink);
+            syscall(SYS_getppid);
+            server.run(record);
+            syscall(SYS_getppid);
+        }
+
+        uint64_t count = latency.size();
+        CHECK(::write(results, &count, sizeof(count)) == sizeof(count));
+        CHECK(::write(results, latency.data(), count * sizeof(uint64_t)) == static_cast<ssize_t>(count * sizeof(uint64_t)));
+        _exit(0);
+    }
+
+    // Follows `child` from its first getppid() to its second and counts the
+    // syscalls in between. Must run on the thread that will wait for it.
+    bool countSyscalls(pid_t child, std::promise<bool>& attached, uint64_t& count) {
+        if (ptrace(PTRACE_SEIZE, child, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL) != 0) {
+            attached.set_value(false);
+            return false;
+        }
+        ptrace(PTRACE_INTERRUPT, child, nullptr, nullptr);
+        attached.set_value(true);
+        int markers = 0;
+        int status = 0;
+        while (waitpid(child, &status, __WALL) == child && !WIFEXITED(status) && !WIFSIGNALED(status)) {
+            int deliver = 0;
+            if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+                __ptrace_syscall_info info{};
+                ptrace(PTRACE_GET_SYSCALL_INFO, child, sizeof(info), &info);
+                if (info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                    if (info.entry.nr == SYS_getppid) {
+                        ++markers;
+                    } else if (markers == 1) {
+                        ++count;
+                    }
+                }
+            } else if (status >> 16 == 0) {
+                deliver = WSTOPSIG(status);     // a real signal, not one of ours
+            }
+            ptrace(PTRACE_SYSCALL, child, nullptr, deliver);
+        }
+        return markers == 2;
+    }
+
+    // Half a second of 4 kHz pointer motion with a key tapped every 10 ms.
+    LoadResult runLoad(Backend backend, bool traced) {
+        int portPipe[2];
+        int resultPipe[2];
+        CHECK(pipe(portPipe) == 0 && pipe(resultPipe) == 0);
+        pid_t child = fork();
+        CHECK(child >= 0);
+        if (child == 0) {
+            ::close(portPipe[0]);
+            ::close(resultPipe[0]);
+            serveChild(backend, portPipe[1], resultPipe[1]);
+        }
+        ::close(portPipe[1]);
+        ::close(resultPipe[1]);
+        uint16_t port = 0;
+        CHECK(::read(portPipe[0], &port, sizeof(port)) == sizeof(port));
+
+        LoadResult result;
+        std::promise<bool> attached;
+        std::thread tracer;
+        if (traced) {
+            tracer = std::thread([&]() {
+                result.traced = countSyscalls(child, attached, result.syscalls);
+                if (!result.traced) {
+                    waitpid(child, nullptr, 0);
+                }
+            });
+            attached.get_future().wait();
+        }
+
+        {
+            IoThread clientIo;
+            ssl::context ctx(ssl::context::tlsv12_client);
+            auto stream = std::make_unique<Session::Stream>(clientIo.io, ctx);
+            stream->lowest_layer().connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+            stream->lowest_layer().set_option(tcp::no_delay(true));
+            stream->handshake(ssl::stream_base::client);
+            uint16_t version = negotiateClient(*stream);
+            auto client = std::make_shared<Session>(std::move(stream), version);
+            client->start([](const EventPacket&) {}, [](const boost::system::error_code&) {});
+
+            uint64_t start = test::nowMicroseconds();
+            for (uint32_t ms = 0; ms < 500; ++ms) {
+                while (test::nowMicroseconds() < start + ms * 1000) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+                for (int32_t i = 0; i < 4; ++i) {
+                    client->send(makeMouseMovePacket(test::nowMicroseconds(), static_cast<int32_t>(ms), i));
+                }
+                if (ms % 10 == 0) {
+                    client->send(makeKeyPacket(SamenessEventType::KeyPress, test::nowMicroseconds(), VC_A));
+                    client->send(makeKeyPacket(SamenessEventType::KeyRelease, test::nowMicroseconds(), VC_A));
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            client->close();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+
+        uint64_t count = 0;
+        CHECK(::read(resultPipe[0], &count, sizeof(count)) == sizeof(count));
+        result.latencyUs.resize(count);
+        size_t want = count * sizeof(uint64_t);
+        size_t got = 0;
+        while (got < want) {
+            ssize_t n = ::read(resultPipe[0], reinterpret_cast<uint8_t*>(result.latencyUs.data()) + got, want - got);
+            CHECK(n > 0);
+            got += static_cast<size_t>(n);
+        }
+        result.packets = count;
+        ::close(portPipe[0]);
+        ::close(resultPipe[0]);
+        if (traced) {
+            tracer.join();
+        } else {
+            waitpid(child, nullptr, 0);
+        }
+        return result;
+    }
+}
+
+static void test_encode() {
+    std::vector<input_event> records;
+    CHECK(UinputDevice::encode(makeKeyPacket(SamenessEventType::KeyPress, 1, VC_A), records));
+    CHECK(records.size() == 2);
+    CHECK(sameRecord(records[0], EV_KEY, KEY_A, 1));
+    CHECK(sameRecord(records[1], EV_SYN, SYN_REPORT, 0));
+
+    records.clear();
+    CHECK(UinputDevice::encode(makeMouseMovePacket(1, 640, 480), records));
+    CHECK(records.size() == 3);
+    CHECK(sameRecord(records[0], EV_ABS, ABS_X, 640));
+    CHECK(sameRecord(records[1], EV_ABS, ABS_Y, 480));
+
+    records.clear();
+    CHECK(UinputDevice::encode(makeMouseButtonPacket(SamenessEventType::MouseButtonRelease, 1, MOUSE_BUTTON2, 5, 6), records));
+    CHECK(records.size() == 4);
+    CHECK(sameRecord(records[2], EV_KEY, BTN_RIGHT, 0));
+
+    // Not input, or nothing to press
+    EventPacket heartbeat;
+    heartbeat.type = SamenessEventType::Heartbeat;
+    heartbeat.timestamp = 1;
+    heartbeat.payloadSize = 0;
+    records.clear();
+    CHECK(!UinputDevice::encode(heartbeat, records));
+    CHECK(!UinputDevice::encode(makeKeyPacket(SamenessEventType::KeyPress, 1, VC_UNDEFINED), records));
+    CHECK(records.empty());
+
+    // Keys survive capture on one machine and injection on another
+    for (uint16_t code : {KEY_A, KEY_HOME, KEY_RIGHTCTRL, KEY_F13, KEY_F24, KEY_VOLUMEUP}) {
+        CHECK(virtualKeyToEvdev(evdevToVirtualKey(code)) == code);
+    }
+}
+
+static void test_takeover() {
+    IoThread clientIo;
+    boost::asio::io_context serverIo;
+    test::LoopbackTls tls(serverIo, clientIo.io);
+    std::vector<uint8_t> leftover;
+    uint16_t version = 0;
+    std::thread negotiation([&]() { version = negotiateServer(*tls.server, leftover); });
+    uint16_t clientVersion = negotiateClient(*tls.client);
+    negotiation.join();
+    CHECK(version == kProtocolV2 && clientVersion == version);
+
+    int records[2];
+    CHECK(pipe(records) == 0);
+    UringServer server(std::move(tls.server), version, std::move(leftover));
+    server.setInjectFd(records[1]);
+    server.setHeartbeat(std::chrono::milliseconds(400));
+    std::atomic<int> seen{0};
+    boost::system::error_code result;
+    std::thread serving([&]() {
+        result = server.run([&seen, &server](const EventPacket& pkt) {
+            ++seen;
+            // Answers go out on the ring too
+            if (pkt.type == SamenessEventType::MouseButtonPress) {
+                server.send(makeSwitchBackPacket(pkt.timestamp, 0, 20, 1920, 1080));
+            }
+        });
+    });
+
+    auto client = std::make_shared<Session>(std::move(tls.client), clientVersion);
+    client->setHeartbeat(std::chrono::milliseconds(400));
+    std::atomic<bool> clientClosed{false};
+    std::atomic<uint64_t> switchedBack{0};
+    client->start([&switchedBack](const EventPacket& pkt) {
+        if (pkt.type == SamenessEventType::SwitchBack) {
+            switchedBack = pkt.timestamp;
+        }
+    }, [&clientClosed](const boost::system::error_code&) { clientClosed = true; });
+
+    client->send(makeKeyPacket(SamenessEventType::KeyPress, 1, VC_A));
+    client->send(makeKeyPacket(SamenessEventType::KeyRelease, 2, VC_A));
+    uint64_t deadline = test::nowMicroseconds() + 2000000;
+    while (seen < 2 && test::nowMicroseconds() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // Quiet for longer than either deadline: only heartbeats keep both ends up
+    std::this_thread::sleep_for(std::chrono::milliseconds(700));
+    CHECK(!clientClosed);
+    client->send(makeMouseButtonPacket(SamenessEventType::MouseButtonPress, 3, MOUSE_BUTTON1, 10, 20));
+    while (seen < 3 && test::nowMicroseconds() < deadline + 1000000) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(seen == 3);
+    while (switchedBack == 0 && test::nowMicroseconds() < deadline + 1000000) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(switchedBack == 3);
+
+    client->close();
+    serving.join();
+    CHECK(result == boost::asio::error::eof || result == boost::asio::error::connection_reset);
+    ::close(records[1]);
+    std::vector<input_event> written = readRecords(records[0]);
+    ::close(records[0]);
+    CHECK(written.size() == 2 + 2 + 4);
+    CHECK(sameRecord(written[0], EV_KEY, KEY_A, 1));
+    CHECK(sameRecord(written[2], EV_KEY, KEY_A, 0));
+    CHECK(sameRecord(written[4], EV_ABS, ABS_X, 10));
+    CHECK(sameRecord(written[6], EV_KEY, BTN_LEFT, 1));
+
+    const UringServer::Counters& counters = server.counters();
+    CHECK(counters.packets == 3);
+    CHECK(counters.receives >= 2);
+    CHECK(counters.injectWrites >= 2 && counters.injectWrites <= 3);
+}
+
+static void test_stop() {
+    IoThread clientIo;
+    boost::asio::io_context serverIo;
+    test::LoopbackTls tls(serverIo, clientIo.io);
+    UringServer server(std::move(tls.server), kProtocolV1);
+    boost::system::error_code result;
+    std::thread serving([&]() { result = server.run(nullptr); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    server.stop();
+    serving.join();
+    CHECK(result == boost::asio::error::operation_aborted);
+}
+
+static void test_against_asio() {
+    LoadResult asio = runLoad(Backend::Asio, false);
+    LoadResult uring = runLoad(Backend::Uring, false);
+    test::printLatency("asio session, injection latency", asio.latencyUs);
+    test::printLatency("io_uring server, injection latency", uring.latencyUs);
+    CHECK(asio.packets > 0 && uring.packets > 0);
+
+    LoadResult asioTraced = runLoad(Backend::Asio, true);
+    LoadResult uringTraced = runLoad(Backend::Uring, true);
+    if (!asioTraced.traced || !uringTraced.traced) {
+        std::cout << "uring_test: ptrace unavailable, skipping syscall count" << std::endl;
+        return;
+    }
+    double asioPerEvent = static_cast<double>(asioTraced.syscalls) / asioTraced.packets;
+    double uringPerEvent = static_cast<double>(uringTraced.syscalls) / uringTraced.packets;
+    std::cout << "syscalls per event: asio " << asioPerEvent << " (" << asioTraced.packets << " events), io_uring "
+              << uringPerEvent << " (" << uringTraced.packets << " events)" << std::endl;
+    CHECK(uringPerEvent < asioPerEvent);
+}
+
+int main() {
+    test_encode();
+    if (!IoUring::available()) {
+        std::cout << "uring_test: io_uring unavailable, skipping" << std::endl;
+        return 0;
+    }
+    test_takeover();
+    test_stop();
+    test_against_asio();
+    std::cout << "uring_test passed" << std::endl;
+    return 0;
+}